@@ -1547,13 +1547,18 @@ void AllImages::runInitialzersBottomUp(const mach_header* imageLoadAddress)
                     (*_objcNotifyInit)(imagePath(imageToInit.binaryData()), foundEntry->loadedAddress());
                 }
                 // run all initializers in image
+                uint64_t initStartTime = mach_absolute_time();
+                __block bool hasInitializers = false;
                 imageToInit.forEachInitializer(foundEntry->loadedAddress(), ^(const void* func) {
                     Initializer initFunc = (Initializer)func;
                     dyld3::kdebug_trace_dyld_duration(DBG_DYLD_TIMING_STATIC_INITIALIZER, (uint64_t)func, 0, ^{
                         initFunc(NXArgc, NXArgv, environ, appleParams, _programVars);
                     });
                     log_initializers("dyld: called initialzer %p in %s\n", initFunc, imageToInit.path());
+                    hasInitializers = true;
                 });
+                if ( hasInitializers )
+                    dyld3::launch_profile_add_duration("initializer", imagePath(imageToInit.binaryData()), initStartTime, mach_absolute_time());
                 // reaquire initializer lock to switch state to inited
                 pthread_mutex_lock(&_initializerLock);
                 foundEntry->setState(LoadedImage::State::inited);
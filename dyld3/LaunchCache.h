@@ -252,6 +252,8 @@ struct VIS_HIDDEN Image
     void                                forEachCacheSegment(void (^handler)(uint32_t segIndex, uint64_t vmOffset, uint64_t vmSize, uint8_t permissions, bool& stop)) const;
     void                                forEachFixup(uint32_t segIndex, MemoryRange segContent,
                                                      void (^handler)(uint64_t segOffset, FixupKind kind, TargetSymbolValue value, bool& stop)) const;
+    static void                         forEachFixup(const uint8_t* pageFixups, const void* segContent, uint32_t& offset, uint32_t& ordinal,
+                                                     void (^handler)(uint32_t pageOffset, FixupKind kind, uint32_t targetOrdinal, bool& stop));
 
 #if !DYLD_IN_PROCESS
     void                                 printAsJSON(const ImageGroupList& groupList, bool printFixups=false, bool printDependentsDetails=false, FILE* out=stdout) const;
@@ -267,8 +269,6 @@ private:
                                                                           void (^handler)(const dyld3::launch_cache::binary_format::Image* aBinImage, bool& stop)) const;
     uint32_t                                    pageSize() const;
     const binary_format::SegmentFixupsByPage*   segmentFixups(uint32_t segIndex) const;
-    static void                                 forEachFixup(const uint8_t* pageFixups, const void* segContent, uint32_t& offset, uint32_t& ordinal,
-                                                             void (^handler)(uint32_t pageOffset, FixupKind kind, uint32_t targetOrdinal, bool& stop));
     static Image                                resolveImageRef(const ImageGroupList& groups, binary_format::ImageRef ref, bool applyOverrides=true);
 
 
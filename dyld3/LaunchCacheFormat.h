@@ -41,7 +41,7 @@ namespace binary_format {
 
 
 // bump this number each time binary format changes
-enum  { kFormatVersion = 8 };
+enum  { kFormatVersion = 10 };
 
 union VIS_HIDDEN ImageRef {
     ImageRef() : val(0xFFFFFFFF) { }
@@ -193,8 +193,9 @@ struct SegmentFixupsByPage
     uint32_t    size;                // of this struct, including fixup opcodes
     uint32_t    pageSize;            // 0x1000 or 0x4000
     uint32_t    pageCount;
-    uint32_t    pageInfoOffsets[1];  // array size is pageCount
-    // each page info is a FixUpOpcode[]
+    int32_t     pageInfoOffsets[1];  // array size is pageCount, signed offset from start of this struct
+    // each page info is a FixUpOpcode[].  Identical page infos are stored once per ImageGroup,
+    // so an offset may point into the SegmentFixupsByPage of an earlier segment or image
 };
 
 enum class FixUpOpcode : uint8_t {
@@ -208,7 +209,9 @@ enum class FixUpOpcode : uint8_t {
       bindText32      = 0x15,    // set 32-bit ordinal value at current text pageOffset, increment pageOffset by 4
       bindTextRel32   = 0x16,    // set delta to 32-bit ordinal value at current text pageOffset, increment pageOffset by 4 (i386 CALL to dylib)
       bindImportJmp32 = 0x17,    // set delta to 32-bit ordinal value at current text pageOffset, increment pageOffset by 4 (i386 JMP to dylib)
-//    fixupChain64    = 0x18,    // current page offset is start of a chain of locations to fix up
+      fixupChain64    = 0x18,    // current page offset is start of a chain of 64-bit locations to fix up.  Each following byte is one location:
+                                 //   high bit set is bind64 to current ordinal, clear is rebase64.  Low 7-bits *4 is delta to next location.
+                                 //   A zero delta ends the chain and increments pageOffset by 8
 //    adjPageOffset   = 0x20,
       setPageOffset   = 0x20,    // low 4-bits is amount to increment (1 to 15).  If zero, then add next ULEB (note: can set offset for unaligned pointer)
       incPageOffset   = 0x30,    // low 4-bits *4 is amount to increment (4 to 60).  If zero, then add next ULEB * 4
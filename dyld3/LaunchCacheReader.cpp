@@ -1382,9 +1382,24 @@ void Image::forEachFixup(const uint8_t* pageFixups, const void* segContent, uint
                         offset += 5;
                         ++p;
                         break;
-                    //case binary_format::FixUpOpcode::fixupChain64:
-                    //    assert(0 && "rebase/bind chain support not implemented yet");
-                    //    break;
+                    case binary_format::FixUpOpcode::fixupChain64:
+                        ++p;
+                        while ( true ) {
+                            uint8_t link = *p++;
+                            if ( link & 0x80 )
+                                handler(offset, FixupKind::bind64, ordinal, stop);
+                            else
+                                handler(offset, FixupKind::rebase64, 0, stop);
+                            uint32_t delta4 = (link & 0x7F);
+                            if ( delta4 == 0 ) {
+                                offset += 8;
+                                break;
+                            }
+                            offset += (delta4*4);
+                            if ( stop )
+                                break;
+                        }
+                        break;
                     default:
                         assert(0 && "bad opcode");
                         break;
@@ -44,6 +44,7 @@
 #include <list>
 #include <unordered_set>
 #include <unordered_map>
+#include <atomic>
 
 #include "LaunchCacheFormat.h"
 #include "LaunchCacheWriter.h"
@@ -74,6 +75,8 @@ static uintptr_t align(uintptr_t value, uintptr_t align)
 
 ////////////////////////////  ImageGroupWriter ////////////////////////////////////////
 
+std::atomic<uint64_t> ImageGroupWriter::sTotalSharedFixupBytes(0);
+
 ImageGroupWriter::ImageGroupWriter(uint32_t groupNum, bool pages16KB, bool is64, bool dylibsExpectedOnDisk, bool mtimeAndInodeAreValid)
     : _isDiskImage(groupNum != 0), _is64(is64), _groupNum(groupNum), _pageSize(pages16KB ? 0x4000 : 0x1000),
       _dylibsExpectedOnDisk(dylibsExpectedOnDisk), _imageFileInfoIsCdHash(!mtimeAndInodeAreValid)
@@ -596,13 +599,14 @@ void ImageGroupWriter::addImageIsOverride(binary_format::ImageRef standardDylibR
 class SegmentFixUpBuilder
 {
 public:
-                            SegmentFixUpBuilder(uint32_t segIndex, uint32_t dataSegPageCount, uint32_t pageSize, bool is64,
+                            SegmentFixUpBuilder(uint32_t segIndex, uint32_t dataSegPageCount, uint32_t pageSize, bool is64, bool allowChains,
                                                     const std::vector<ImageGroupWriter::FixUp>& fixups,
                                                     std::vector<TargetSymbolValue>& targetsForImage, bool log);
 
     bool                    hasFixups() { return _hasFixups; }
     uint32_t                segIndex() { return _segIndex; }
-    void                    appendSegmentFixUpMap(ContentBuffer&);
+    void                    appendSegmentFixUpMap(ContentBuffer&, std::unordered_map<std::string, uint32_t>* existingPageStreams=nullptr,
+                                                  uint64_t* sharedBytes=nullptr);
 
 private:
     struct TmpOpcode {
@@ -618,6 +622,9 @@ private:
 
     ContentBuffer           makeFixupOpcodesForPage(uint32_t pageStartSegmentOffset, const ImageGroupWriter::FixUp* start,
                                                     const ImageGroupWriter::FixUp* end);
+    ContentBuffer           makeChainedFixupsForPage(uint32_t pageStartSegmentOffset, const ImageGroupWriter::FixUp* start,
+                                                     const ImageGroupWriter::FixUp* end);
+    static void             appendAdjustOpcode(ContentBuffer& opcodes, binary_format::FixUpOpcode op, uint32_t count);
     uint32_t                getOrdinalForTarget(TargetSymbolValue);
     void                    expandOpcodes(const std::vector<TmpOpcode>& opcodes, uint8_t page[0x4000],  uint32_t& offset, uint32_t& ordinal);
     void                    expandOpcodes(const std::vector<TmpOpcode>& opcodes, uint8_t page[0x4000]);
@@ -627,6 +634,7 @@ private:
     uint32_t                opcodeEncodingSize(const std::vector<TmpOpcode>& opcodes);
 
     const bool                              _is64;
+    const bool                              _allowChains;
     const bool                              _log;
     bool                                    _hasFixups;
     const uint32_t                          _segIndex;
@@ -639,10 +647,10 @@ private:
 
 
 
-SegmentFixUpBuilder::SegmentFixUpBuilder(uint32_t segIndex, uint32_t segPageCount, uint32_t pageSize, bool is64,
+SegmentFixUpBuilder::SegmentFixUpBuilder(uint32_t segIndex, uint32_t segPageCount, uint32_t pageSize, bool is64, bool allowChains,
                                          const std::vector<ImageGroupWriter::FixUp>& fixups,
                                          std::vector<TargetSymbolValue>& targetsForImage, bool log)
-    : _is64(is64), _log(log), _hasFixups(false), _segIndex(segIndex), _dataSegPageCount(segPageCount), _pageSize(pageSize), _targets(targetsForImage)
+    : _is64(is64), _allowChains(allowChains), _log(log), _hasFixups(false), _segIndex(segIndex), _dataSegPageCount(segPageCount), _pageSize(pageSize), _targets(targetsForImage)
 {
     //fprintf(stderr, "SegmentFixUpBuilder(segIndex=%d, segPageCount=%d)\n", segIndex, segPageCount);
     _targets.push_back(TargetSymbolValue::makeInvalid()); // ordinal zero reserved to mean "add slide"
@@ -658,8 +666,14 @@ SegmentFixUpBuilder::SegmentFixUpBuilder(uint32_t segIndex, uint32_t segPageCoun
         size_t endFixupIndex = startFixupIndex;
         while ( (endFixupIndex < fixups.size()) && (fixups[endFixupIndex].segIndex == segIndex) && (fixups[endFixupIndex].segOffset < pageEndOffset) )
             ++endFixupIndex;
-        // create opcodes for fixups on this pageb
+        // create opcodes for fixups on this page
         _opcodesByPage[pageIndex] = makeFixupOpcodesForPage(pageStartOffset, &fixups[startFixupIndex], &fixups[endFixupIndex]);
+        // scattered 64-bit pointers are usually smaller as chains, but dense runs compress better with repeat opcodes
+        if ( _is64 && _allowChains ) {
+            ContentBuffer chained = makeChainedFixupsForPage(pageStartOffset, &fixups[startFixupIndex], &fixups[endFixupIndex]);
+            if ( (chained.size() != 0) && (chained.size() < _opcodesByPage[pageIndex].size()) )
+                _opcodesByPage[pageIndex] = chained;
+        }
         startFixupIndex = endFixupIndex;
     }
 }
@@ -677,15 +691,33 @@ uint32_t SegmentFixUpBuilder::getOrdinalForTarget(TargetSymbolValue target)
     return ordinal;
 }
 
-void SegmentFixUpBuilder::appendSegmentFixUpMap(ContentBuffer& buffer)
+void SegmentFixUpBuilder::appendSegmentFixUpMap(ContentBuffer& buffer, std::unordered_map<std::string, uint32_t>* existingPageStreams, uint64_t* sharedBytes)
 {
-    std::vector<uint32_t> offsets;
+    // if page opcode stream is already in buffer (from this segment or an earlier one), point to that copy
+    const uint32_t headerOffsetInBuffer = (uint32_t)buffer.size();
+    std::vector<int32_t>  offsets;
+    std::vector<bool>     pageIsNew;
     uint32_t curOffset = sizeof(binary_format::SegmentFixupsByPage)-4 + _dataSegPageCount*4;
     for (auto& opcodes : _opcodesByPage) {
-        if ( opcodes.size() == 0 )
+        if ( opcodes.size() == 0 ) {
             offsets.push_back(0);
-        else
-            offsets.push_back(curOffset);
+            pageIsNew.push_back(false);
+            continue;
+        }
+        if ( existingPageStreams != nullptr ) {
+            std::string key((char*)opcodes.start(), opcodes.size());
+            auto pos = existingPageStreams->find(key);
+            if ( pos != existingPageStreams->end() ) {
+                offsets.push_back((int32_t)(pos->second - headerOffsetInBuffer));
+                pageIsNew.push_back(false);
+                if ( sharedBytes != nullptr )
+                    *sharedBytes += opcodes.size();
+                continue;
+            }
+            (*existingPageStreams)[key] = headerOffsetInBuffer + curOffset;
+        }
+        offsets.push_back(curOffset);
+        pageIsNew.push_back(true);
         curOffset += opcodes.size();
     }
     uint32_t totalSize = curOffset;
@@ -695,11 +727,12 @@ void SegmentFixUpBuilder::appendSegmentFixUpMap(ContentBuffer& buffer)
     buffer.append_uint32(_pageSize);                    // SegmentFixupsByPage.pageSize
     buffer.append_uint32(_dataSegPageCount);            // SegmentFixupsByPage.pageCount
     for (uint32_t i=0; i < _dataSegPageCount; ++i) {
-        buffer.append_uint32(offsets[i]);               // SegmentFixupsByPage.pageInfoOffsets[i]
+        buffer.append_uint32((uint32_t)offsets[i]);     // SegmentFixupsByPage.pageInfoOffsets[i]
     }
-    // write each page's opcode stream
+    // write each page's opcode stream that is not shared
     for (uint32_t i=0; i < offsets.size(); ++i) {
-        buffer.append_buffer(_opcodesByPage[i]);
+        if ( pageIsNew[i] )
+            buffer.append_buffer(_opcodesByPage[i]);
     }
 }
 
@@ -749,6 +782,9 @@ void SegmentFixUpBuilder::expandOpcodes(const std::vector<TmpOpcode>& opcodes, u
                 *(uint32_t*)(&page[offset]) = 0x44556677;
                 offset += 4;
                 break;
+            case binary_format::FixUpOpcode::fixupChain64:
+                assert(0 && "chains are never temp opcodes");
+                break;
             case binary_format::FixUpOpcode::done:
                 break;
             case binary_format::FixUpOpcode::setPageOffset:
@@ -793,6 +829,7 @@ uint32_t SegmentFixUpBuilder::opcodeEncodingSize(const std::vector<TmpOpcode>& o
             case binary_format::FixUpOpcode::bindText32:
             case binary_format::FixUpOpcode::bindTextRel32:
             case binary_format::FixUpOpcode::bindImportJmp32:
+            case binary_format::FixUpOpcode::fixupChain64:
             case binary_format::FixUpOpcode::done:
                 ++size;
                 break;
@@ -895,6 +932,9 @@ void SegmentFixUpBuilder::printOpcodes(const char* prefix, bool printOffset, con
                 fprintf(stderr, "bindJmpRel32\n");
                 offset += 4;
                 break;
+            case binary_format::FixUpOpcode::fixupChain64:
+                fprintf(stderr, "fixupChain64\n");
+                break;
             case binary_format::FixUpOpcode::done:
                 fprintf(stderr, "done\n");
                 break;
@@ -1102,6 +1142,7 @@ ContentBuffer SegmentFixUpBuilder::makeFixupOpcodesForPage(uint32_t pageStartSeg
             case binary_format::FixUpOpcode::bindText32:
             case binary_format::FixUpOpcode::bindTextRel32:
             case binary_format::FixUpOpcode::bindImportJmp32:
+            case binary_format::FixUpOpcode::fixupChain64:
                 opcodes.append_byte((uint8_t)tmp.op);
                 break;
             case binary_format::FixUpOpcode::done:
@@ -1112,13 +1153,7 @@ ContentBuffer SegmentFixUpBuilder::makeFixupOpcodesForPage(uint32_t pageStartSeg
             case binary_format::FixUpOpcode::incPageOffset:
             case binary_format::FixUpOpcode::setOrdinal:
             case binary_format::FixUpOpcode::incOrdinal:
-                if ( (tmp.count > 0) && (tmp.count < 16) ) {
-                    opcodes.append_byte((uint8_t)tmp.op | tmp.count);
-                }
-                else {
-                    opcodes.append_byte((uint8_t)tmp.op);
-                    opcodes.append_uleb128(tmp.count);
-                }
+                appendAdjustOpcode(opcodes, tmp.op, tmp.count);
                 break;
             case binary_format::FixUpOpcode::repeat: {
                     const TmpOpcode* nextOpcodes = &tmp;
@@ -1148,6 +1183,88 @@ ContentBuffer SegmentFixUpBuilder::makeFixupOpcodesForPage(uint32_t pageStartSeg
 }
 
 
+void SegmentFixUpBuilder::appendAdjustOpcode(ContentBuffer& opcodes, binary_format::FixUpOpcode op, uint32_t count)
+{
+    if ( (count > 0) && (count < 16) ) {
+        opcodes.append_byte((uint8_t)op | count);
+    }
+    else {
+        opcodes.append_byte((uint8_t)op);
+        opcodes.append_uleb128(count);
+    }
+}
+
+ContentBuffer SegmentFixUpBuilder::makeChainedFixupsForPage(uint32_t pageStartSegmentOffset, const ImageGroupWriter::FixUp* start, const ImageGroupWriter::FixUp* end)
+{
+    ContentBuffer chained;
+    uint32_t offset = pageStartSegmentOffset;
+    uint32_t ordinal = 0;
+    size_t   linkIndex = 0;         // index of link byte for last location in current chain, zero if no chain open
+    uint32_t linkOffset = 0;
+    const ImageGroupWriter::FixUp* lastFixup = nullptr;
+    for (const ImageGroupWriter::FixUp* f=start; f < end; ++f) {
+        // ignore double bind at same address (ld64 bug)
+        if ( lastFixup && (lastFixup->segOffset == f->segOffset) )
+            continue;
+        lastFixup = f;
+        bool isBind = false;
+        switch ( f->type ) {
+            case ImageGroupWriter::FixupType::rebase:
+                break;
+            case ImageGroupWriter::FixupType::pointerLazyBind:
+            case ImageGroupWriter::FixupType::pointerBind:
+                isBind = true;
+                break;
+            default:
+                // text fixups only exist in 32-bit images, so cannot be chained
+                return ContentBuffer();
+        }
+        uint32_t nextOrd = (isBind ? getOrdinalForTarget(f->target) : ordinal);
+        if ( linkIndex != 0 ) {
+            // extend current chain if next location is reachable and uses same ordinal
+            uint32_t delta = (uint32_t)f->segOffset - linkOffset;
+            if ( ((delta % 4) == 0) && (delta/4 <= 0x7F) && (nextOrd == ordinal) ) {
+                chained.bytes()[linkIndex] |= (delta/4);
+                linkIndex  = chained.size();
+                linkOffset = (uint32_t)f->segOffset;
+                chained.append_byte(isBind ? 0x80 : 0x00);
+                continue;
+            }
+            // last link has zero delta, so chain ends there
+            offset = linkOffset + 8;
+            linkIndex = 0;
+        }
+        if ( f->segOffset != offset ) {
+            if ( ((f->segOffset % 4) != 0) || ((offset % 4) != 0) ) {
+                appendAdjustOpcode(chained, binary_format::FixUpOpcode::setPageOffset, (uint32_t)(f->segOffset-pageStartSegmentOffset));
+            }
+            else {
+                uint32_t delta4 = (uint32_t)(f->segOffset - offset)/4;
+                assert(delta4*4 < _pageSize);
+                appendAdjustOpcode(chained, binary_format::FixUpOpcode::incPageOffset, delta4);
+            }
+            offset = (uint32_t)f->segOffset;
+        }
+        if ( nextOrd != ordinal ) {
+            if ( (nextOrd > ordinal) && (nextOrd < (ordinal+31)) )
+                appendAdjustOpcode(chained, binary_format::FixUpOpcode::incOrdinal, nextOrd-ordinal);
+            else
+                appendAdjustOpcode(chained, binary_format::FixUpOpcode::setOrdinal, nextOrd);
+            ordinal = nextOrd;
+        }
+        chained.append_byte((uint8_t)binary_format::FixUpOpcode::fixupChain64);
+        linkIndex  = chained.size();
+        linkOffset = (uint32_t)f->segOffset;
+        chained.append_byte(isBind ? 0x80 : 0x00);
+    }
+    chained.append_byte((uint8_t)binary_format::FixUpOpcode::done);
+
+    // make opcodes streams 4-byte aligned
+    chained.pad_to_size(4);
+
+    return chained;
+}
+
 
 
 void ImageGroupWriter::setImageFixups(Diagnostics& diag, uint32_t imageIndex, std::vector<FixUp>& fixups, bool hasTextRelocs)
@@ -1234,10 +1351,10 @@ void ImageGroupWriter::setImageFixups(Diagnostics& diag, uint32_t imageIndex, st
             continue;
         }
         if ( diskSeg->permissions & VM_PROT_WRITE ) {
-            builder = new SegmentFixUpBuilder(onDiskSegIndex, diskSeg->filePageCount, _pageSize, _is64, fixups, targetsForImage, opcodeLogging);
+            builder = new SegmentFixUpBuilder(onDiskSegIndex, diskSeg->filePageCount, _pageSize, _is64, true, fixups, targetsForImage, opcodeLogging);
         }
         else if ( hasTextRelocs && (diskSeg->permissions == (VM_PROT_READ|VM_PROT_EXECUTE)) ) {
-            builder = new SegmentFixUpBuilder(onDiskSegIndex, diskSeg->filePageCount, _pageSize, _is64, fixups, targetsForImage, opcodeLogging);
+            builder = new SegmentFixUpBuilder(onDiskSegIndex, diskSeg->filePageCount, _pageSize, _is64, true, fixups, targetsForImage, opcodeLogging);
         }
         if ( builder != nullptr ) {
             if ( builder->hasFixups() )
@@ -1261,7 +1378,10 @@ void ImageGroupWriter::setImageFixups(Diagnostics& diag, uint32_t imageIndex, st
         binary_format::AllFixupsBySegment* entries = (binary_format::AllFixupsBySegment*)(_fixupsPool.start()+offsetOfSegmentHeaderInBuffer);
         entries[entryIndex].segIndex = builder->segIndex();
         entries[entryIndex].offset   = (uint32_t)_fixupsPool.size() - startOfFixupsOffset;
-        builder->appendSegmentFixUpMap(_fixupsPool);
+        uint64_t sharedBytes = 0;
+        builder->appendSegmentFixUpMap(_fixupsPool, &_fixupPageStreamsExisting, &sharedBytes);
+        _sharedFixupBytes      += sharedBytes;
+        sTotalSharedFixupBytes += sharedBytes;
         delete builder;
         ++entryIndex;
     }
@@ -1279,7 +1399,13 @@ void ImageGroupWriter::setImageFixups(Diagnostics& diag, uint32_t imageIndex, st
 }
 
 
-}
+void ImageGroupWriter::encodeSegmentFixups(uint32_t segIndex, uint32_t segPageCount, uint32_t pageSize, bool is64, bool allowChains,
+                                           const std::vector<FixUp>& fixups, std::vector<TargetSymbolValue>& targets, ContentBuffer& buffer)
+{
+    SegmentFixUpBuilder builder(segIndex, segPageCount, pageSize, is64, allowChains, fixups, targets, false);
+    builder.appendSegmentFixUpMap(buffer);
 }
 
 
+}
+}
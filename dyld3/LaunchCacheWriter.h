@@ -32,6 +32,7 @@
 #include <list>
 #include <unordered_map>
 #include <map>
+#include <atomic>
 
 #include "LaunchCacheFormat.h"
 #include "LaunchCache.h"
@@ -158,9 +159,17 @@ public:
     uint32_t        addString(const char* str);
     void            alignStringPool();
 
+    // bytes of fixup opcodes shared between pages, by this writer and by all writers in the process
+    uint64_t                 sharedFixupBytes() const { return _sharedFixupBytes; }
+    static uint64_t          totalSharedFixupBytes() { return sTotalSharedFixupBytes; }
+
     uint32_t                 imageDependentsCount(uint32_t imageIndex) const;
     binary_format::ImageRef  imageDependent(uint32_t imageIndex, uint32_t depIndex) const;
 
+    // builds the SegmentFixupsByPage for one segment, optionally without fixupChain64 runs (for comparing encodings)
+    static void              encodeSegmentFixups(uint32_t segIndex, uint32_t segPageCount, uint32_t pageSize, bool is64, bool allowChains,
+                                                 const std::vector<FixUp>& fixups, std::vector<TargetSymbolValue>& targets, ContentBuffer& buffer);
+
 private:
     struct InitializerInfo {
         std::vector<uint32_t>                   offsetsInImage;
@@ -200,6 +209,9 @@ private:
     std::unordered_map<uint32_t, uint32_t>       _indirectGroupNumPoolExisting;
     std::vector<char>                            _stringPool;
     std::unordered_map<std::string, uint32_t>    _stringPoolExisting;
+    std::unordered_map<std::string, uint32_t>    _fixupPageStreamsExisting;
+    uint64_t                                     _sharedFixupBytes = 0;
+    static std::atomic<uint64_t>                 sTotalSharedFixupBytes;
 };
 
 
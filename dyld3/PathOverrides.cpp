@@ -303,37 +303,28 @@ void PathOverrides::forEachPathVariant(const char* initialPath,
 #endif
     __block bool stop = false;
 
-    // check for overrides
+    // the part of initialPath appended to each search directory is the same for every
+    // directory, so compute it and its length once
     const char* frameworkPartialPath = getFrameworkPartialPath(initialPath);
-    if ( frameworkPartialPath != nullptr ) {
-        const size_t frameworkPartialPathLen = strlen(frameworkPartialPath);
-        // look at each DYLD_FRAMEWORK_PATH directory
-        if ( _frameworkPathOverrides != nullptr ) {
-            for (const char** fp=_frameworkPathOverrides; *fp != nullptr; ++fp) {
-                char npath[strlen(*fp)+frameworkPartialPathLen+8];
-                strcpy(npath, *fp);
-                strcat(npath, "/");
-                strcat(npath, frameworkPartialPath);
-                handler(npath, stop);
-                if ( stop )
-                    return;
-            }
-        }
-    }
-    else {
-        const char* libraryLeafName = getLibraryLeafName(initialPath);
-        const size_t libraryLeafNameLen = strlen(libraryLeafName);
-        // look at each DYLD_LIBRARY_PATH directory
-        if ( _dylibPathOverrides != nullptr ) {
-            for (const char** lp=_dylibPathOverrides; *lp != nullptr; ++lp) {
-                char libpath[strlen(*lp)+libraryLeafNameLen+8];
-                strcpy(libpath, *lp);
-                strcat(libpath, "/");
-                strcat(libpath, libraryLeafName);
-                handler(libpath, stop);
-                if ( stop )
-                    return;
-            }
+    const char* const leafPath = (frameworkPartialPath != nullptr) ? frameworkPartialPath : getLibraryLeafName(initialPath);
+    const size_t leafPathLen = strlen(leafPath);
+    void (^tryInDir)(const char* dir, bool& innerStop) = ^(const char* dir, bool& innerStop) {
+        const size_t dirLen = strlen(dir);
+        char npath[dirLen+leafPathLen+2];
+        memcpy(npath, dir, dirLen);
+        npath[dirLen] = '/';
+        memcpy(&npath[dirLen+1], leafPath, leafPathLen+1);
+        handler(npath, innerStop);
+    };
+
+    // check for overrides
+    // look at each DYLD_FRAMEWORK_PATH or DYLD_LIBRARY_PATH directory
+    const char** overrides = (frameworkPartialPath != nullptr) ? _frameworkPathOverrides : _dylibPathOverrides;
+    if ( overrides != nullptr ) {
+        for (const char** op=overrides; *op != nullptr; ++op) {
+            tryInDir(*op, stop);
+            if ( stop )
+                return;
         }
     }
 
@@ -344,32 +335,12 @@ void PathOverrides::forEachPathVariant(const char* initialPath,
 
     // check fallback paths
     if ( frameworkPartialPath != nullptr ) {
-        const size_t frameworkPartialPathLen = strlen(frameworkPartialPath);
         // look at each DYLD_FALLBACK_FRAMEWORK_PATH directory
-        forEachFrameworkFallback(platform, ^(const char* dir, bool& innerStop) {
-            char npath[strlen(dir)+frameworkPartialPathLen+8];
-            strcpy(npath, dir);
-            strcat(npath, "/");
-            strcat(npath, frameworkPartialPath);
-            handler(npath, innerStop);
-            if ( innerStop )
-                stop = innerStop;
-        });
-
+        forEachFrameworkFallback(platform, tryInDir);
     }
-   else {
-        const char* libraryLeafName = getLibraryLeafName(initialPath);
-        const size_t libraryLeafNameLen = strlen(libraryLeafName);
+    else {
         // look at each DYLD_FALLBACK_LIBRARY_PATH directory
-        forEachDylibFallback(platform, ^(const char* dir, bool& innerStop) {
-            char libpath[strlen(dir)+libraryLeafNameLen+8];
-            strcpy(libpath, dir);
-            strcat(libpath, "/");
-            strcat(libpath, libraryLeafName);
-            handler(libpath, innerStop);
-            if ( innerStop )
-                stop = innerStop;
-        });
+        forEachDylibFallback(platform, tryInDir);
     }
 }
 
@@ -35,6 +35,7 @@
 #include <sys/sysctl.h>
 #include <sys/mman.h>
 #include <mach/mach.h>
+#include <mach/mach_time.h>
 #include <mach-o/fat.h>
 #include <mach-o/loader.h>
 #include <mach-o/ldsyms.h>
@@ -50,6 +51,7 @@
 #include "Loading.h"
 
 #define ENABLE_DYLIBS_TO_OVERRIDE_CACHE_SIZE 1024
+#define PRIVATE_SLIDE_CHUNK_SIZE             0x200000
 
 // should be in mach/shared_region.h
 extern "C" int __shared_region_check_np(uint64_t* startaddress);
@@ -72,6 +74,7 @@ struct CacheInfo
     shared_file_mapping_np  mappings[3];
     uint64_t                slideInfoAddressUnslid;
     size_t                  slideInfoSize;
+    uint32_t                slideInfoVersion;
     uint64_t                cachedDylibsGroupUnslid;
     uint64_t                sharedRegionStart;
     uint64_t                sharedRegionSize;
@@ -132,6 +135,62 @@ static void rebaseChain(uint8_t* pageContent, uint16_t startOffset, uintptr_t sl
     }
 }
 
+static void rebasePageV3(uint8_t* pageContent, uint16_t startOffset, uintptr_t slideAmount, const dyld_cache_slide_info3* slideInfo)
+{
+    // every location is 8-byte aligned and non-zero, so no filler entries to skip
+    const uint64_t valueAdd = slideInfo->value_add + slideAmount;
+    uint64_t* loc = (uint64_t*)(pageContent + startOffset);
+    uint64_t delta;
+    do {
+        uint64_t rawValue = *loc;
+        delta = (rawValue >> DYLD_CACHE_SLIDE_V3_DELTA_SHIFT) & DYLD_CACHE_SLIDE_V3_DELTA_MASK;
+        *loc = (rawValue & DYLD_CACHE_SLIDE_V3_VALUE_MASK) + valueAdd;
+        loc += delta;
+    } while ( delta != 0 );
+}
+
+// slides DATA pages [startPage, endPage) using v2 or v3 slide info
+static void slideDataPages(uintptr_t dataPagesStart, const dyld_cache_slide_info2* slideInfo, uint32_t startPage, uint32_t endPage, uintptr_t slideAmount)
+{
+    const uint32_t  page_size   = slideInfo->page_size;
+    const uint16_t* page_starts = (uint16_t*)((long)(slideInfo) + slideInfo->page_starts_offset);
+    if ( slideInfo->version == 3 ) {
+        const dyld_cache_slide_info3* slideHeader = (dyld_cache_slide_info3*)slideInfo;
+        for (uint32_t i=startPage; i < endPage; ++i) {
+            uint16_t pageEntry = page_starts[i];
+            if ( pageEntry == DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE )
+                continue;
+            rebasePageV3((uint8_t*)(long)(dataPagesStart + (page_size*i)), pageEntry, slideAmount, slideHeader);
+        }
+        return;
+    }
+    const uint16_t* page_extras = (uint16_t*)((long)(slideInfo) + slideInfo->page_extras_offset);
+    for (uint32_t i=startPage; i < endPage; ++i) {
+        uint8_t* page = (uint8_t*)(long)(dataPagesStart + (page_size*i));
+        uint16_t pageEntry = page_starts[i];
+        //dyld::log("page[%d]: page_starts[i]=0x%04X\n", i, pageEntry);
+        if ( pageEntry == DYLD_CACHE_SLIDE_PAGE_ATTR_NO_REBASE )
+            continue;
+        if ( pageEntry & DYLD_CACHE_SLIDE_PAGE_ATTR_EXTRA ) {
+            uint16_t chainIndex = (pageEntry & 0x3FFF);
+            bool done = false;
+            while ( !done ) {
+                uint16_t pInfo = page_extras[chainIndex];
+                uint16_t pageStartOffset = (pInfo & 0x3FFF)*4;
+                //dyld::log("     chain[%d] pageOffset=0x%03X\n", chainIndex, pageStartOffset);
+                rebaseChain(page, pageStartOffset, slideAmount, slideInfo);
+                done = (pInfo & DYLD_CACHE_SLIDE_PAGE_ATTR_END);
+                ++chainIndex;
+            }
+        }
+        else {
+            uint32_t pageOffset = pageEntry * 4;
+            //dyld::log("     start pageOffset=0x%03X\n", pageOffset);
+            rebaseChain(page, pageOffset, slideAmount, slideInfo);
+        }
+    }
+}
+
 
 static void getCachePath(const SharedCacheOptions& options, size_t pathBufferSize, char pathBuffer[])
 {
@@ -346,6 +405,12 @@ static bool preflightCacheFile(const SharedCacheOptions& options, SharedCacheLoa
     info->mappings[1].sfm_init_prot |= VM_PROT_SLIDE;
     info->slideInfoAddressUnslid  = fileMappings[2].address + cache->header.slideInfoOffset - fileMappings[2].fileOffset;
     info->slideInfoSize           = (long)cache->header.slideInfoSize;
+    info->slideInfoVersion        = 0;
+    if ( cache->header.slideInfoSize != 0 ) {
+        uint32_t version;
+        if ( ::pread(fd, &version, sizeof(version), cache->header.slideInfoOffset) == sizeof(version) )
+            info->slideInfoVersion = version;
+    }
     if ( cache->header.mappingOffset > 0xD0 )
         info->cachedDylibsGroupUnslid = cache->header.dylibsImageGroupAddr;
     else
@@ -424,12 +489,24 @@ static long pickCacheASLR(CacheInfo& info)
     return slide;
 }
 
+static bool mapCachePrivate(const SharedCacheOptions& options, SharedCacheLoadInfo* results);
+
 static bool mapCacheSystemWide(const SharedCacheOptions& options, SharedCacheLoadInfo* results)
 {
     CacheInfo info;
     if ( !preflightCacheFile(options, results, &info) )
         return false;
 
+    // kernel only knows how to apply v1 and v2 slide info, dyld slides newer formats itself in a private
+    // mapping.  update_dyld_shared_cache refuses to build such caches for the boot volume, so this is
+    // only reached when a cache built with -slide_info_v3 -root is installed by hand.
+    if ( info.slideInfoVersion > 2 ) {
+        ::close(info.fd);
+        if ( options.verbose )
+            dyld::log("dyld cache has slide info v%u which the kernel cannot apply, mapping privately: %s\n", info.slideInfoVersion, results->path);
+        return mapCachePrivate(options, results);
+    }
+
     const dyld_cache_slide_info2* slideInfo = nullptr;
     if ( info.slideInfoSize != 0 ) {
         results->slide = pickCacheASLR(info);
@@ -514,45 +591,44 @@ static bool mapCachePrivate(const SharedCacheOptions& options, SharedCacheLoadIn
 
     // update all __DATA pages with slide info
     const dyld_cache_slide_info* slideInfoHeader = (dyld_cache_slide_info*)slideInfo;
+    uint64_t slideTime = 0;
     if ( slideInfoHeader != nullptr ) {
-        if ( slideInfoHeader->version != 2 ) {
+        if ( (slideInfoHeader->version != 2) && (slideInfoHeader->version != 3) ) {
             results->errorMessage = "invalide slide info in cache file";
             return false;
         }
-        const dyld_cache_slide_info2* slideHeader = (dyld_cache_slide_info2*)slideInfo;
-        const uint32_t  page_size = slideHeader->page_size;
-        const uint16_t* page_starts = (uint16_t*)((long)(slideInfo) + slideHeader->page_starts_offset);
-        const uint16_t* page_extras = (uint16_t*)((long)(slideInfo) + slideHeader->page_extras_offset);
+        // v2 and v3 headers both start with version, page_size, page_starts_offset, page_starts_count
+        const uint32_t  pageSize       = slideInfo->page_size;
+        const uint32_t  pageCount      = slideInfo->page_starts_count;
         const uintptr_t dataPagesStart = (uintptr_t)info.mappings[1].sfm_address;
-        for (int i=0; i < slideHeader->page_starts_count; ++i) {
-            uint8_t* page = (uint8_t*)(long)(dataPagesStart + (page_size*i));
-            uint16_t pageEntry = page_starts[i];
-            //dyld::log("page[%d]: page_starts[i]=0x%04X\n", i, pageEntry);
-            if ( pageEntry == DYLD_CACHE_SLIDE_PAGE_ATTR_NO_REBASE )
-                continue;
-            if ( pageEntry & DYLD_CACHE_SLIDE_PAGE_ATTR_EXTRA ) {
-                uint16_t chainIndex = (pageEntry & 0x3FFF);
-                bool done = false;
-                while ( !done ) {
-                    uint16_t pInfo = page_extras[chainIndex];
-                    uint16_t pageStartOffset = (pInfo & 0x3FFF)*4;
-                    //dyld::log("     chain[%d] pageOffset=0x%03X\n", chainIndex, pageStartOffset);
-                    rebaseChain(page, pageStartOffset, results->slide, slideInfo);
-                    done = (pInfo & DYLD_CACHE_SLIDE_PAGE_ATTR_END);
-                    ++chainIndex;
-                }
-            }
-            else {
-                uint32_t pageOffset = pageEntry * 4;
-                //dyld::log("     start pageOffset=0x%03X\n", pageOffset);
-                rebaseChain(page, pageOffset, results->slide, slideInfo);
+        uint64_t t0 = mach_absolute_time();
+        if ( options.serialSlide ) {
+            slideDataPages(dataPagesStart, slideInfo, 0, pageCount, results->slide);
+        }
+        else {
+            // slide a chunk at a time, asking the kernel to start reading in the next chunk
+            // so disk I/O overlaps with rebasing instead of every page faulting synchronously
+            const uint32_t chunkPages = PRIVATE_SLIDE_CHUNK_SIZE / pageSize;
+            ::madvise((void*)dataPagesStart, (size_t)MIN(chunkPages, pageCount)*pageSize, MADV_WILLNEED);
+            for (uint32_t startPage=0; startPage < pageCount; startPage += chunkPages) {
+                uint32_t endPage = MIN(startPage + chunkPages, pageCount);
+                if ( endPage < pageCount )
+                    ::madvise((void*)(dataPagesStart + (uintptr_t)endPage*pageSize), (size_t)MIN(chunkPages, pageCount - endPage)*pageSize, MADV_WILLNEED);
+                slideDataPages(dataPagesStart, slideInfo, startPage, endPage, results->slide);
             }
         }
+        slideTime = mach_absolute_time() - t0;
     }
 
     if ( options.verbose ) {
         dyld::log("mapped dyld cache file private to process (%s):\n", results->path);
         verboseSharedCacheMappings(info.mappings);
+        if ( slideInfo != nullptr ) {
+            mach_timebase_info_data_t timebase;
+            mach_timebase_info(&timebase);
+            dyld::log("        slid %u DATA pages (slide info v%u) in %lluus, %s\n", slideInfo->page_starts_count, slideInfo->version,
+                      slideTime * timebase.numer / timebase.denom / 1000, (options.serialSlide ? "serially" : "in chunks with read-ahead"));
+        }
     }
     return true;
 }
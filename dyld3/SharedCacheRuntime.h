@@ -38,6 +38,7 @@ struct SharedCacheOptions {
     bool            forcePrivate;
     bool            useHaswell;
     bool            verbose;
+    bool            serialSlide;        // slide privately mapped DATA without read-ahead
 };
 
 struct SharedCacheLoadInfo {
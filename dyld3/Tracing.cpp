@@ -25,7 +25,14 @@
 #include <atomic>
 
 #include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <_simple.h>
 #include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <libkern/OSAtomic.h>
 
 #include "Tracing.h"
 
@@ -93,6 +100,11 @@ void kdebug_trace_dyld_duration(const uint32_t code, uint64_t data1, uint64_t da
         kdebug_trace(KDBG_CODE(DBG_DYLD, DBG_DYLD_TIMING, code) | DBG_FUNC_START, current_trace_id, 0, data1, data2);
         block();
         kdebug_trace(KDBG_CODE(DBG_DYLD, DBG_DYLD_TIMING, code) | DBG_FUNC_END, current_trace_id, 0, data1, data2);
+    } else if (launch_profile_enabled()) {
+        uint64_t startTime = mach_absolute_time();
+        block();
+        const char* phase = (code == DBG_DYLD_TIMING_STATIC_INITIALIZER) ? "initializer function" : "dyld timing";
+        launch_profile_add_duration(phase, nullptr, startTime, mach_absolute_time(), "data", data1);
     } else {
         block();
     }
@@ -103,4 +115,197 @@ void kdebug_trace_print(const uint32_t code, const char *string) {
         kdebug_trace_string(KDBG_CODE(DBG_DYLD, DBG_DYLD_PRINT, code), 0, string);
     }
 }
+
+
+struct LaunchProfileEvent {
+    const char* phase;
+    char*       imagePath;      // copied, images can be unloaded before the profile is written
+    uint64_t    startTime;
+    uint64_t    endTime;
+    const char* countName;
+    uint64_t    count;
+};
+
+struct LaunchProfileCounter {
+    const char* name;
+    uint64_t    value;
+};
+
+static const char*              sProfilePath        = nullptr;
+static uint64_t                 sProfileStartTime   = 0;
+static OSSpinLock               sProfileLock        = OS_SPINLOCK_INIT;
+// Events are kept in fixed size chunks, allocated as needed once malloc() is ready.  Chunks stay
+// small enough for dyld's pre-libSystem malloc() pool.
+struct LaunchProfileChunk {
+    LaunchProfileChunk*         next;
+    uint32_t                    count;
+    LaunchProfileEvent          events[128];
+};
+
+static LaunchProfileChunk*      sProfileFirstChunk  = nullptr;
+static LaunchProfileChunk*      sProfileLastChunk   = nullptr;
+static uint32_t                 sProfileEventsDropped = 0;
+static LaunchProfileCounter     sProfileCounters[32];
+static uint32_t                 sProfileCounterCount = 0;
+
+VIS_HIDDEN
+void launch_profile_enable(const char* outputPath) {
+    sProfilePath      = outputPath;
+    sProfileStartTime = mach_absolute_time();
+}
+
+VIS_HIDDEN
+bool launch_profile_enabled() {
+    return (sProfilePath != nullptr);
+}
+
+VIS_HIDDEN
+void launch_profile_add_duration(const char* phase, const char* imagePath, uint64_t startTime, uint64_t endTime,
+                                 const char* countName, uint64_t count) {
+    if (!launch_profile_enabled())
+        return;
+    char* pathCopy = nullptr;
+    if (imagePath != nullptr) {
+        pathCopy = (char*)malloc(strlen(imagePath)+1);
+        if (pathCopy != nullptr)
+            strcpy(pathCopy, imagePath);
+    }
+    OSSpinLockLock(&sProfileLock);
+    // the profile may have been written while this event was being timed
+    if (launch_profile_enabled()) {
+        const uint32_t chunkSpace = sizeof(LaunchProfileChunk::events)/sizeof(LaunchProfileEvent);
+        if ((sProfileLastChunk == nullptr) || (sProfileLastChunk->count == chunkSpace)) {
+            LaunchProfileChunk* chunk = (LaunchProfileChunk*)malloc(sizeof(LaunchProfileChunk));
+            if (chunk != nullptr) {
+                chunk->next  = nullptr;
+                chunk->count = 0;
+                if (sProfileLastChunk != nullptr)
+                    sProfileLastChunk->next = chunk;
+                else
+                    sProfileFirstChunk = chunk;
+                sProfileLastChunk = chunk;
+            }
+        }
+        if ((sProfileLastChunk != nullptr) && (sProfileLastChunk->count < chunkSpace)) {
+            sProfileLastChunk->events[sProfileLastChunk->count++] = { phase, pathCopy, startTime, endTime, countName, count };
+            pathCopy = nullptr;
+        } else {
+            ++sProfileEventsDropped;
+        }
+    }
+    OSSpinLockUnlock(&sProfileLock);
+    if (pathCopy != nullptr)
+        free(pathCopy);
+}
+
+VIS_HIDDEN
+void launch_profile_add_counter(const char* name, uint64_t value) {
+    if (!launch_profile_enabled())
+        return;
+    OSSpinLockLock(&sProfileLock);
+    if (sProfileCounterCount < sizeof(sProfileCounters)/sizeof(sProfileCounters[0]))
+        sProfileCounters[sProfileCounterCount++] = { name, value };
+    OSSpinLockUnlock(&sProfileLock);
+}
+
+// trace-event times are in microseconds, printed with nanosecond precision
+static void printMicroseconds(int fd, uint64_t machTime) {
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    uint64_t nanos = machTime * timebase.numer / timebase.denom;
+    _simple_dprintf(fd, "%llu.%03llu", nanos/1000, nanos%1000);
+}
+
+static void printJSONString(int fd, const char* str) {
+    char buffer[256];
+    size_t used = 0;
+    buffer[used++] = '"';
+    for (const char* s = str; *s != '\0'; ++s) {
+        if (used > sizeof(buffer) - 8) {
+            buffer[used] = '\0';
+            _simple_dprintf(fd, "%s", buffer);
+            used = 0;
+        }
+        unsigned char c = *s;
+        if ((c == '"') || (c == '\\')) {
+            buffer[used++] = '\\';
+            buffer[used++] = c;
+        } else if (c < 0x20) {
+            static const char hexDigits[] = "0123456789abcdef";
+            memcpy(&buffer[used], "\\u00", 4);
+            used += 4;
+            buffer[used++] = hexDigits[c >> 4];
+            buffer[used++] = hexDigits[c & 0xF];
+        } else {
+            buffer[used++] = c;
+        }
+    }
+    buffer[used++] = '"';
+    buffer[used] = '\0';
+    _simple_dprintf(fd, "%s", buffer);
+}
+
+VIS_HIDDEN
+void launch_profile_write() {
+    if (!launch_profile_enabled())
+        return;
+    OSSpinLockLock(&sProfileLock);
+    const char* path = sProfilePath;
+    sProfilePath = nullptr;
+    OSSpinLockUnlock(&sProfileLock);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd != -1) {
+        int pid = getpid();
+        _simple_dprintf(fd, "{\"traceEvents\":[");
+        const char* eventSeparator = "";
+        for (const LaunchProfileChunk* chunk = sProfileFirstChunk; chunk != nullptr; chunk = chunk->next) {
+            for (uint32_t i = 0; i < chunk->count; ++i) {
+                const LaunchProfileEvent& event = chunk->events[i];
+                _simple_dprintf(fd, "%s\n{\"name\":", eventSeparator);
+                eventSeparator = ",";
+                printJSONString(fd, event.phase);
+                _simple_dprintf(fd, ",\"cat\":\"dyld\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,\"ts\":", pid);
+                printMicroseconds(fd, event.startTime - sProfileStartTime);
+                _simple_dprintf(fd, ",\"dur\":");
+                printMicroseconds(fd, event.endTime - event.startTime);
+                _simple_dprintf(fd, ",\"args\":{");
+                const char* separator = "";
+                if (event.imagePath != nullptr) {
+                    _simple_dprintf(fd, "\"image\":");
+                    printJSONString(fd, event.imagePath);
+                    separator = ",";
+                }
+                if (event.countName != nullptr) {
+                    _simple_dprintf(fd, "%s", separator);
+                    printJSONString(fd, event.countName);
+                    _simple_dprintf(fd, ":%llu", event.count);
+                }
+                _simple_dprintf(fd, "}}");
+            }
+        }
+        _simple_dprintf(fd, "\n],\n\"displayTimeUnit\":\"ns\",\n\"otherData\":{\"eventsDropped\":%u", sProfileEventsDropped);
+        for (uint32_t i = 0; i < sProfileCounterCount; ++i) {
+            _simple_dprintf(fd, ",\n");
+            printJSONString(fd, sProfileCounters[i].name);
+            _simple_dprintf(fd, ":%llu", sProfileCounters[i].value);
+        }
+        _simple_dprintf(fd, "}}\n");
+        close(fd);
+    }
+
+    LaunchProfileChunk* chunk = sProfileFirstChunk;
+    while (chunk != nullptr) {
+        for (uint32_t i = 0; i < chunk->count; ++i) {
+            if (chunk->events[i].imagePath != nullptr)
+                free(chunk->events[i].imagePath);
+        }
+        LaunchProfileChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    sProfileFirstChunk = nullptr;
+    sProfileLastChunk  = nullptr;
+}
 };
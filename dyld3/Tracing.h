@@ -86,6 +86,27 @@ void kdebug_trace_dyld_duration(const uint32_t code, uint64_t data1, uint64_t da
 
 VIS_HIDDEN
 void kdebug_trace_print(const uint32_t code, const char *string);
+
+//
+// Launch profile, enabled with DYLD_LAUNCH_PROFILE=<path>.  Timed phases (per image when imagePath is
+// not NULL) and launch wide counters are collected in memory, then written once to <path> in Chrome
+// trace-event JSON format by launch_profile_write(), after which recording stops.
+//
+VIS_HIDDEN
+void launch_profile_enable(const char* outputPath);
+
+VIS_HIDDEN
+bool launch_profile_enabled();
+
+VIS_HIDDEN
+void launch_profile_add_duration(const char* phase, const char* imagePath, uint64_t startTime, uint64_t endTime,
+                                 const char* countName=nullptr, uint64_t count=0);
+
+VIS_HIDDEN
+void launch_profile_add_counter(const char* name, uint64_t value);
+
+VIS_HIDDEN
+void launch_profile_write();
 }
 
 #endif /* Tracing_h */
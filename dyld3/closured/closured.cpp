@@ -44,6 +44,7 @@
 #include "ImageProxy.h"
 #include "DyldSharedCache.h"
 #include "FileUtils.h"
+#include "ClosureStore.h"
 
 extern "C" {
     #include "closuredProtocolServer.h"
@@ -54,6 +55,51 @@ static os_log_t sLog = os_log_create("com.apple.dyld.closured", "closured");
 
 static char sCrashMessageBuffer[1024];
 
+static const char* const sClosureStoreDir = "/private/var/db/dyld/closures/";
+
+
+static dyld3::ClosureStore& closureStore()
+{
+    static dyld3::ClosureStore store(sClosureStoreDir);
+    return store;
+}
+
+// the closure store is only used when the client has the same dyld cache as closured,
+// because validating a stored closure requires the cache it was built against
+static const DyldSharedCache* currentDyldCacheWithUUID(const uint8_t cacheUUID[16])
+{
+    size_t currentCacheSize;
+    const DyldSharedCache* currentCache = (const DyldSharedCache*)_dyld_get_shared_cache_range(&currentCacheSize);
+    if ( currentCache == nullptr )
+        return nullptr;
+    uuid_t currentCacheUUID;
+    currentCache->getUUID(currentCacheUUID);
+    if ( memcmp(currentCacheUUID, cacheUUID, 16) != 0 )
+        return nullptr;
+    return currentCache;
+}
+
+static bool closureStoreKey(const DyldSharedCache* cache, const char* mainPath, const std::vector<std::string>& envVars, dyld3::ClosureStore::Key& key)
+{
+    uint8_t cdHash[20];
+    if ( !dyld3::ImageProxyGroup::mainExecutableCdHash(mainPath, cache->archName(), cdHash) )
+        return false;
+    uuid_t cacheUUID;
+    cache->getUUID(cacheUUID);
+    key = dyld3::ClosureStore::makeKey(cdHash, cacheUUID, mainPath, envVars);
+    return true;
+}
+
+static const dyld3::launch_cache::BinaryClosureData* findStoredClosure(const DyldSharedCache* cache, const dyld3::ClosureStore::Key& key)
+{
+    dyld3::DyldCacheParser cacheParser(cache, false);
+    size_t closureSize;
+    const void* closure = closureStore().find(key, closureSize, [&](const void* content, size_t size) {
+        return dyld3::ImageProxyGroup::closureStillValid(cacheParser, (const dyld3::launch_cache::BinaryClosureData*)content);
+    });
+    return (const dyld3::launch_cache::BinaryClosureData*)closure;
+}
+
 
 kern_return_t
 do_CreateClosure(
@@ -73,6 +119,27 @@ do_CreateClosure(
     strlcat(sCrashMessageBuffer, imagePath, sizeof(sCrashMessageBuffer));
     CRSetCrashLogMessage(sCrashMessageBuffer);
 
+    // look for a closure built by an earlier request
+    std::vector<std::string> envVars;
+    uint32_t envCount = clsBuff.envVarCount();
+    const char* envVarCStrings[envCount];
+    clsBuff.copyImageGroups(envVarCStrings);
+    for (uint32_t i=0; i < envCount; ++i)
+        envVars.push_back(envVarCStrings[i]);
+    dyld3::ClosureStore::Key storeKey;
+    const DyldSharedCache* cache = currentDyldCacheWithUUID(clsBuff.cacheIndent().cacheUUID);
+    bool useStore = (cache != nullptr) && closureStoreKey(cache, imagePath, envVars, storeKey);
+    if ( useStore ) {
+        if ( const dyld3::launch_cache::BinaryClosureData* stored = findStoredClosure(cache, storeKey) ) {
+            os_log_info(sLog, "returning stored closure for %s\n", imagePath);
+            dyld3::ClosureBuffer result(stored);
+            *returnData    = result.vmBuffer();
+            *returnDataCnt = result.vmBufferSize();
+            CRSetCrashLogMessage(nullptr);
+            return KERN_SUCCESS;
+        }
+    }
+
     Diagnostics diag;
     const dyld3::launch_cache::binary_format::Closure* cls = dyld3::ImageProxyGroup::makeClosure(diag, clsBuff, requestor);
 
@@ -81,6 +148,8 @@ do_CreateClosure(
         os_log(sLog, "Image generated warning: %s\n", message.c_str());
 
     if ( diag.noError() ) {
+        if ( useStore && !closureStore().save(storeKey, cls, dyld3::launch_cache::Closure(cls).size()) )
+            os_log_error(sLog, "could not save closure for %s, errno=%d\n", imagePath, errno);
         // on success return the closure binary in the "returnData" buffer
         dyld3::ClosureBuffer result(cls);
         *returnData    = result.vmBuffer();
@@ -283,11 +352,29 @@ int runAsTool(int argc, const char* argv[])
     }
     dyld3::DyldCacheParser cacheParser(currentCache, false);
 
+    // look for a closure built by an earlier request
+    dyld3::ClosureStore::Key storeKey;
+    bool useStore = closureStoreKey(currentCache, progPath, dyldEnvVars, storeKey);
+    if ( useStore ) {
+        if ( const dyld3::launch_cache::BinaryClosureData* stored = findStoredClosure(currentCache, storeKey) ) {
+            dyld3::launch_cache::Closure closure(stored);
+            os_log(sLog, "returning stored closure, size=%lu\n", closure.size());
+            header.success = 1;
+            header.length  = (uint32_t)closure.size();
+            write(pipeNum, &header, sizeof(SocketBasedClousureHeader));
+            write(pipeNum, stored, closure.size());
+            close(pipeNum);
+            return 0;
+        }
+    }
+
     Diagnostics diag;
     os_log_info(sLog, "starting closure build\n");
     const dyld3::launch_cache::BinaryClosureData* cls = dyld3::ImageProxyGroup::makeClosure(diag, cacheParser, progPath, false, {""}, dyldEnvVars);
     os_log_info(sLog, "finished closure build, cls=%p\n", cls);
     if ( diag.noError() ) {
+        if ( useStore && !closureStore().save(storeKey, cls, dyld3::launch_cache::Closure(cls).size()) )
+            os_log_error(sLog, "could not save closure for %s, errno=%d\n", progPath, errno);
         // on success write the closure binary after the header to the socket
         dyld3::launch_cache::Closure closure(cls);
         os_log(sLog, "returning closure, size=%lu\n", closure.size());
@@ -29,6 +29,7 @@
 #include "Logging.h"
 #include "PathOverrides.h"
 #include "LaunchCacheFormat.h"
+#include "Tracing.h"
 #include "start_glue.h"
 
 extern "C" void start();
@@ -73,6 +74,10 @@ static void entry_setVars(const mach_header* mainMH, int argc, const char* argv[
     gUseDyld3 = true;
 
     setLoggingFromEnvs(envp);
+
+    // dyld has already dropped DYLD_* variables if this process is restricted
+    if ( const char* profilePath = _simple_getenv(envp, "DYLD_LAUNCH_PROFILE") )
+        launch_profile_enable(profilePath);
 }
 
 static void entry_setHaltFunction(void (*func)(const char* message) __attribute__((noreturn)) )
@@ -117,6 +122,17 @@ static void entry_runInitialzersBottomUp(const mach_header* mainExecutableImageL
 {
     gAllImages.runInitialzersBottomUp(mainExecutableImageLoadAddress);
     gAllImages.notifyMonitorMain();
+
+    if ( launch_profile_enabled() ) {
+        struct dyld_global_lock_statistics lockStats;
+        _dyld_get_global_lock_statistics(&lockStats);
+        launch_profile_add_counter("images", gAllImages.count());
+        launch_profile_add_counter("lockAcquisitions", lockStats.acquisitions);
+        launch_profile_add_counter("lockContendedAcquisitions", lockStats.contendedAcquisitions);
+        launch_profile_add_counter("lockWaitTime", lockStats.totalWaitTime);
+        launch_profile_add_counter("lockHoldTime", lockStats.totalHoldTime);
+        launch_profile_write();
+    }
 }
 
 static void entry_setChildForkFunction(void (*func)() )
@@ -28,6 +28,8 @@
 #include <sys/errno.h>
 #include <sys/fcntl.h>
 #include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <mach/mach.h>
 #include <mach/mach_time.h>
 #include <mach-o/loader.h>
@@ -53,6 +55,7 @@
 #include "Trie.hpp"
 #include "Diagnostics.h"
 #include "ImageProxy.h"
+#include "StringUtils.h"
 
 #if __has_include("dyld_cache_config.h")
     #include "dyld_cache_config.h"
@@ -94,6 +97,7 @@ CacheBuilder::CacheBuilder(const DyldSharedCache::CreateOptions& options)
     , _currentFileSize(0)
     , _vmSize(0)
     , _branchPoolsLinkEditStartAddr(0)
+    , _streamFd(-1)
 {
 
     std::string targetArch = options.archName;
@@ -129,6 +133,11 @@ void CacheBuilder::deleteBuffer()
     vm_deallocate(mach_task_self(), (vm_address_t)_buffer, _allocatedBufferSize);
     _buffer = nullptr;
     _allocatedBufferSize = 0;
+    if ( _streamFd != -1 ) {
+        ::close(_streamFd);
+        ::unlink(_streamTempPath.c_str());
+        _streamFd = -1;
+    }
 }
 
 std::vector<DyldSharedCache::MappedMachO>
@@ -276,6 +285,8 @@ void CacheBuilder::build(const std::vector<DyldSharedCache::MappedMachO>& dylibs
         return;
     }
     _currentFileSize = _allocatedBufferSize;
+    if ( !_options.outputFilePath.empty() && !startStreaming() )
+        return;
 
     // write unoptimized cache
     writeCacheHeader(regions, sortedDylibs, segmentMapping);
@@ -319,7 +330,19 @@ void CacheBuilder::build(const std::vector<DyldSharedCache::MappedMachO>& dylibs
     if ( dylibs.size() == 0 )
         _currentFileSize = 0x1000;
     else
-        _currentFileSize = optimizeLinkedit(_buffer, _archLayout->is64, _options.excludeLocalSymbols, _options.optimizeStubs, branchPoolOffsets, _diagnostics, &localsInfo);
+        _currentFileSize = optimizeLinkedit(_buffer, _archLayout->is64, _options.excludeLocalSymbols, _options.optimizeStubs, branchPoolOffsets,
+                                            findSymlinkAliases(sortedDylibs), _diagnostics, &localsInfo);
+
+    // TEXT is final once LINKEDIT optimization has updated load commands, so stream it out
+    // before building ImageGroups and closures.  Header pages keep changing until the end.
+    if ( _streamFd != -1 ) {
+        const dyld_cache_mapping_info* mappings = (dyld_cache_mapping_info*)((char*)_buffer + _buffer->header.mappingOffset);
+        const dyld_cache_image_info*   images   = (dyld_cache_image_info*)((char*)_buffer + _buffer->header.imagesOffset);
+        uint64_t headerEnd = mappings[0].size;
+        for (uint32_t i=0; i < _buffer->header.imagesCount; ++i)
+            headerEnd = std::min(headerEnd, images[i].address - mappings[0].address);
+        streamRange(headerEnd, mappings[0].size - headerEnd);
+    }
 
     uint64_t t3 = mach_absolute_time();
 
@@ -378,6 +401,8 @@ void CacheBuilder::build(const std::vector<DyldSharedCache::MappedMachO>& dylibs
         return;
 
     uint64_t t5 = mach_absolute_time();
+    uint64_t otherGroupSharedFixupBytes = otherGroup->sharedFixupBytes();
+    uint64_t initOrderTime = dylibGroup->initOrderTime() + otherGroup->initOrderTime();
 
     // compute and add launch closures
     std::map<std::string, const dyld3::launch_cache::binary_format::Closure*> closures;
@@ -406,16 +431,21 @@ void CacheBuilder::build(const std::vector<DyldSharedCache::MappedMachO>& dylibs
     // fill in slide info at start of region[2]
     // do this last because it modifies pointers in DATA segments
     if ( _options.cacheSupportsASLR ) {
-        if ( _archLayout->is64 )
-            writeSlideInfoV2<Pointer64<LittleEndian>>();
+        if ( _archLayout->is64 ) {
+            if ( !_options.slideInfoV3 || !writeSlideInfoV3<Pointer64<LittleEndian>>() )
+                writeSlideInfoV2<Pointer64<LittleEndian>>();
+        }
         else
             writeSlideInfoV2<Pointer32<LittleEndian>>();
     }
 
+    // DATA is final once slid pointers are encoded
+    dyld_cache_mapping_info* mappings = (dyld_cache_mapping_info*)((char*)_buffer + _buffer->header.mappingOffset);
+    streamRange(mappings[1].fileOffset, mappings[1].size);
+
     uint64_t t7 = mach_absolute_time();
 
     // update last region size
-    dyld_cache_mapping_info* mappings = (dyld_cache_mapping_info*)((char*)_buffer + _buffer->header.mappingOffset);
     _currentFileSize = align(_currentFileSize, _archLayout->sharedRegionAlignP2);
     mappings[2].size = _currentFileSize - mappings[2].fileOffset;
 
@@ -476,9 +506,23 @@ void CacheBuilder::build(const std::vector<DyldSharedCache::MappedMachO>& dylibs
         fprintf(stderr, "time to optimize LINKEDITs: %ums\n", absolutetime_to_milliseconds(t3-t2));
         fprintf(stderr, "time to build ImageGroup of %lu cached dylibs: %ums\n", sortedDylibs.size(), absolutetime_to_milliseconds(t4-t3));
         fprintf(stderr, "time to build ImageGroup of %lu other dylibs: %ums\n", otherOsDylibs.size(), absolutetime_to_milliseconds(t5-t4));
+        fprintf(stderr, "fixup opcode bytes shared in ImageGroup of other dylibs: %llu\n", otherGroupSharedFixupBytes);
         fprintf(stderr, "time to build %lu closures: %ums\n", osExecutables.size(), absolutetime_to_milliseconds(t6-t5));
+        fprintf(stderr, "time to compute initializer order (cached and other dylibs): %ums\n", absolutetime_to_milliseconds(initOrderTime));
         fprintf(stderr, "time to compute slide info: %ums\n", absolutetime_to_milliseconds(t7-t6));
         fprintf(stderr, "time to compute UUID and codesign cache file: %ums\n", absolutetime_to_milliseconds(t8-t7));
+        if ( _streamFd != -1 ) {
+            uint64_t streamedSize = 0;
+            for (const auto& range : _streamedRanges)
+                streamedSize += range.second;
+            fprintf(stderr, "streamed %lluMB of finished TEXT and DATA to %s\n", streamedSize/1024/1024, _streamTempPath.c_str());
+        }
+    }
+
+    // write out rest of cache file and swap buffer for mapping of it
+    if ( _streamFd != -1 ) {
+        finishStreaming();
+        return;
     }
 
     // trim over allocated buffer
@@ -1104,6 +1148,89 @@ uint64_t CacheBuilder::pathHash(const char* path)
 }
 
 
+// Record symlinks next to cached dylibs (e.g. Foo.framework/Foo, libz.dylib -> libz.1.dylib) so that
+// dyld can find dylibs through them with one hash table lookup instead of calling realpath() at runtime.
+// The symlinks are read from the root each dylib was loaded from, never from the build host's own file system.
+std::unordered_map<std::string, std::string> CacheBuilder::findSymlinkAliases(const std::vector<DyldSharedCache::MappedMachO>& dylibs)
+{
+    std::unordered_map<std::string, std::string>               aliases;
+    std::unordered_map<std::string, std::string>               runtimePathToInstallName;
+    std::unordered_map<std::string, std::vector<std::string>>  dirToLeafNames;
+    std::map<std::string, std::set<std::string>>              rootToDirsToScan;
+    for (const DyldSharedCache::MappedMachO& dylib : dylibs) {
+        dyld3::MachOParser parser(dylib.mh);
+        const char* installName = parser.installName();
+        runtimePathToInstallName[dylib.runtimePath] = installName;
+        if ( dylib.runtimePath != installName )
+            aliases[dylib.runtimePath] = installName;
+        size_t lastSlash = dylib.runtimePath.rfind('/');
+        if ( lastSlash == std::string::npos )
+            continue;
+        std::string dir = dylib.runtimePath.substr(0, lastSlash);
+        dirToLeafNames[dir].push_back(dylib.runtimePath.substr(lastSlash+1));
+        // dylibs from a manifest know where they were built, others were read from one of the path prefixes
+        std::vector<std::string> roots;
+        if ( dylib.buildPath.empty() )
+            roots = _options.pathPrefixes;
+        else if ( endsWith(dylib.buildPath, dylib.runtimePath) )
+            roots.push_back(dylib.buildPath.substr(0, dylib.buildPath.size() - dylib.runtimePath.size()));
+        for (const std::string& root : roots) {
+            std::set<std::string>& dirsToScan = rootToDirsToScan[root];
+            dirsToScan.insert(dir);
+            // frameworks have their unversioned symlinks at the top of the bundle and in Versions/
+            size_t versionsPos = dir.find(".framework/Versions/");
+            if ( versionsPos != std::string::npos ) {
+                dirsToScan.insert(dir.substr(0, versionsPos + strlen(".framework")));
+                dirsToScan.insert(dir.substr(0, versionsPos + strlen(".framework/Versions")));
+            }
+        }
+    }
+
+    for (const auto& rootAndDirs : rootToDirsToScan) {
+        const std::string& prefix = rootAndDirs.first;
+        for (const std::string& dir : rootAndDirs.second) {
+            std::string fullDir = prefix + dir;
+            DIR* dirp = ::opendir(fullDir.c_str());
+            if ( dirp == nullptr )
+                continue;
+            while ( dirent* entry = ::readdir(dirp) ) {
+                if ( entry->d_type != DT_LNK )
+                    continue;
+                std::string symlinkPath = dir + "/" + entry->d_name;
+                char resolvedPath[PATH_MAX];
+                if ( realpath((prefix + symlinkPath).c_str(), resolvedPath) == nullptr )
+                    continue;
+                if ( strncmp(resolvedPath, prefix.c_str(), prefix.size()) != 0 )
+                    continue;
+                std::string resolvedUnPrefixed = &resolvedPath[prefix.size()];
+                // symlink to a dylib
+                auto pos = runtimePathToInstallName.find(resolvedUnPrefixed);
+                if ( pos != runtimePathToInstallName.end() ) {
+                    if ( symlinkPath != pos->second )
+                        aliases[symlinkPath] = pos->second;
+                    continue;
+                }
+                // symlink to a directory of dylibs (e.g. Versions/Current)
+                auto dirPos = dirToLeafNames.find(resolvedUnPrefixed);
+                if ( dirPos != dirToLeafNames.end() ) {
+                    for (const std::string& leafName : dirPos->second) {
+                        const std::string& installName = runtimePathToInstallName[resolvedUnPrefixed + "/" + leafName];
+                        std::string aliasPath = symlinkPath + "/" + leafName;
+                        if ( aliasPath != installName )
+                            aliases[aliasPath] = installName;
+                    }
+                }
+            }
+            ::closedir(dirp);
+        }
+    }
+    if ( _options.verbose )
+        fprintf(stderr, "%s found %lu symlink aliases of cached dylibs\n", _options.archName.c_str(), aliases.size());
+
+    return aliases;
+}
+
+
 void CacheBuilder::findDylibAndSegment(const void* contentPtr, std::string& foundDylibName, std::string& foundSegName)
 {
     foundDylibName = "???";
@@ -1346,6 +1473,91 @@ void CacheBuilder::writeSlideInfoV2()
     //warning("pageCount=%u, page_starts_count=%lu, page_extras_count=%lu", pageCount, pageStarts.size(), pageExtras.size());
 }
 
+// Slide info v3 is 64-bit only and needs every rebase location 8-byte aligned.
+// Returns false without touching DATA if the cache cannot be encoded that way.
+template <typename P>
+bool CacheBuilder::writeSlideInfoV3()
+{
+    typedef typename P::uint_t    pint_t;
+    static_assert(sizeof(pint_t) == 8, "slide info v3 is for 64-bit caches only");
+    const uint32_t pageSize       = 4096;
+    const uint32_t slotsPerPage   = pageSize/8;
+    const uint64_t valueAdd       = _archLayout->sharedMemoryStart;
+
+    // check every pointer can be encoded before modifying DATA
+    const dyld_cache_mapping_info* mappings = (dyld_cache_mapping_info*)((char*)_buffer + _buffer->header.mappingOffset);
+    uint8_t* const dataStart = (uint8_t*)_buffer + mappings[1].fileOffset;
+    uint8_t* const dataEnd   = dataStart + mappings[1].size;
+    unsigned pageCount = (unsigned)(mappings[1].size+pageSize-1)/pageSize;
+    for (void* p : _pointersForASLR) {
+        // out of range pointers are reported by writeSlideInfoV2()
+        if ( (p < dataStart) || ( p > dataEnd) )
+            return false;
+        long byteOffset = (long)((uint8_t*)p - dataStart);
+        if ( (byteOffset % 8) != 0 ) {
+            _diagnostics.warning("pointer not 8-byte aligned in DATA offset 0x%08lX, using slide info v2", byteOffset);
+            return false;
+        }
+        uint64_t value = P::getP(*((pint_t*)p));
+        if ( (value != 0) && ((value < valueAdd) || ((value - valueAdd) > DYLD_CACHE_SLIDE_V3_VALUE_MASK)) ) {
+            _diagnostics.warning("pointer value 0x%llX at DATA offset 0x%08lX not encodable, using slide info v2", value, byteOffset);
+            return false;
+        }
+    }
+
+    // build one 512 bool bitmap per page (4KB) of DATA, one bool per 8-byte slot
+    std::vector<bool> bitmap(pageCount*slotsPerPage, false);
+    for (void* p : _pointersForASLR) {
+        long byteOffset = (long)((uint8_t*)p - dataStart);
+        // work around <rdar://24941083> by ignoring pointers to be slid that are NULL on disk
+        if ( P::getP(*((pint_t*)p)) == 0 ) {
+            std::string dylibName;
+            std::string segName;
+            findDylibAndSegment(p, dylibName, segName);
+            _diagnostics.warning("NULL pointer asked to be slid in %s at DATA region offset 0x%04lX of %s", segName.c_str(), byteOffset, dylibName.c_str());
+            continue;
+        }
+        bitmap[byteOffset/8] = true;
+    }
+
+    // fill in fixed info
+    assert(_slideInfoFileOffset != 0);
+    dyld_cache_slide_info3* info = (dyld_cache_slide_info3*)((uint8_t*)_buffer + _slideInfoFileOffset);
+    info->version            = 3;
+    info->page_size          = pageSize;
+    info->page_starts_offset = sizeof(dyld_cache_slide_info3);
+    info->page_starts_count  = pageCount;
+    info->value_add          = valueAdd;
+    uint16_t* pageStarts = (uint16_t*)((char*)info + info->page_starts_offset);
+
+    // one chain per page, each location holds its target offset plus delta to next location
+    for (unsigned i=0; i < pageCount; ++i) {
+        uint8_t* pageContent = dataStart + i*pageSize;
+        pint_t*  lastLoc     = nullptr;
+        uint32_t lastSlot    = 0;
+        pageStarts[i] = DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE;
+        for (uint32_t slot=0; slot < slotsPerPage; ++slot) {
+            if ( !bitmap[i*slotsPerPage + slot] )
+                continue;
+            pint_t* loc = (pint_t*)(pageContent + slot*8);
+            P::setP(*loc, P::getP(*loc) - valueAdd);
+            if ( lastLoc == nullptr )
+                pageStarts[i] = slot*8;
+            else
+                P::setP(*lastLoc, P::getP(*lastLoc) | ((uint64_t)(slot - lastSlot) << DYLD_CACHE_SLIDE_V3_DELTA_SHIFT));
+            lastLoc  = loc;
+            lastSlot = slot;
+        }
+    }
+
+    // update header with final size
+    _buffer->header.slideInfoSize = align(info->page_starts_offset + pageCount*sizeof(uint16_t), _archLayout->sharedRegionAlignP2);
+    if ( _buffer->header.slideInfoSize > _slideInfoBufferSizeAllocated ) {
+        _diagnostics.error("kernel slide info overflow buffer");
+    }
+    return true;
+}
+
 
 /*
 void CacheBuilder::writeSlideInfoV1()
@@ -1451,12 +1663,9 @@ void CacheBuilder::fipsSign() {
     }
 }
 
-void CacheBuilder::codeSign()
+bool CacheBuilder::codeSigningDigest(uint8_t& hashType, uint8_t& hashSize, uint32_t& digestFormat, bool& agile)
 {
-    uint8_t  dscHashType;
-    uint8_t  dscHashSize;
-    uint32_t dscDigestFormat;
-    bool agile = false;
+    agile = false;
 
     // select which codesigning hash
     switch (_options.codeSigningDigestMode) {
@@ -1464,20 +1673,31 @@ void CacheBuilder::codeSign()
             agile = true;
             // Fall through to SHA1, because the main code directory remains SHA1 for compatibility.
         case DyldSharedCache::SHA1only:
-            dscHashType     = CS_HASHTYPE_SHA1;
-            dscHashSize     = CS_HASH_SIZE_SHA1;
-            dscDigestFormat = kCCDigestSHA1;
+            hashType     = CS_HASHTYPE_SHA1;
+            hashSize     = CS_HASH_SIZE_SHA1;
+            digestFormat = kCCDigestSHA1;
             break;
         case DyldSharedCache::SHA256only:
-            dscHashType     = CS_HASHTYPE_SHA256;
-            dscHashSize     = CS_HASH_SIZE_SHA256;
-            dscDigestFormat = kCCDigestSHA256;
+            hashType     = CS_HASHTYPE_SHA256;
+            hashSize     = CS_HASH_SIZE_SHA256;
+            digestFormat = kCCDigestSHA256;
             break;
         default:
             _diagnostics.error("codeSigningDigestMode has unknown, unexpected value %d, bailing out.",
                                _options.codeSigningDigestMode);
-            return;
+            return false;
     }
+    return true;
+}
+
+void CacheBuilder::codeSign()
+{
+    uint8_t  dscHashType;
+    uint8_t  dscHashSize;
+    uint32_t dscDigestFormat;
+    bool     agile;
+    if ( !codeSigningDigest(dscHashType, dscHashSize, dscDigestFormat, agile) )
+        return;
 
     std::string cacheIdentifier = "com.apple.dyld.cache." + _options.archName;
     if ( _options.dylibsRemovedDuringMastering ) {
@@ -1629,14 +1849,21 @@ void CacheBuilder::codeSign()
     _buffer->header.codeSignatureOffset = inBbufferSize;
     _buffer->header.codeSignatureSize   = sigSize;
 
-    // compute hashes
+    // compute hashes, reusing those of pages hashed as they were streamed out
     const uint8_t* code = inBuffer;
     for (uint32_t i=0; i < slotCount; ++i) {
-        CCDigest(dscDigestFormat, code, CS_PAGE_SIZE, hashSlot);
+        bool streamed = (i < _streamedPageHashed.size()) && _streamedPageHashed[i];
+        if ( streamed )
+            memcpy(hashSlot, &_streamedPageHashes[i*dscHashSize], dscHashSize);
+        else
+            CCDigest(dscDigestFormat, code, CS_PAGE_SIZE, hashSlot);
         hashSlot += dscHashSize;
 
         if ( agile ) {
-            CCDigest(kCCDigestSHA256, code, CS_PAGE_SIZE, hash256Slot);
+            if ( streamed )
+                memcpy(hash256Slot, &_streamedPageHashes256[i*CS_HASH_SIZE_SHA256], CS_HASH_SIZE_SHA256);
+            else
+                CCDigest(kCCDigestSHA256, code, CS_PAGE_SIZE, hash256Slot);
             hash256Slot += CS_HASH_SIZE_SHA256;
         }
         code += CS_PAGE_SIZE;
@@ -1661,6 +1888,105 @@ void CacheBuilder::codeSign()
     _currentFileSize += sigSize;
 }
 
+bool CacheBuilder::startStreaming()
+{
+    std::string pathTemplate = _options.outputFilePath + "-XXXXXX";
+    size_t templateLen = strlen(pathTemplate.c_str())+2;
+    char pathTemplateSpace[templateLen];
+    strlcpy(pathTemplateSpace, pathTemplate.c_str(), templateLen);
+    _streamFd = ::mkstemp(pathTemplateSpace);
+    if ( _streamFd == -1 ) {
+        _diagnostics.error("could not create temp file for %s, errno=%d", _options.outputFilePath.c_str(), errno);
+        return false;
+    }
+    _streamTempPath = pathTemplateSpace;
+    return true;
+}
+
+// Writes a finished range of the cache to the output file, hashes its pages for the code
+// signature, then replaces the anonymous memory with a read-only mapping of what was written,
+// so it no longer counts against the builder's dirty memory.
+void CacheBuilder::streamRange(uint64_t fileOffset, uint64_t size)
+{
+    if ( (_streamFd == -1) || _diagnostics.hasError() )
+        return;
+    uint64_t start = align(fileOffset, __builtin_ctz(vm_page_size));
+    uint64_t end   = (fileOffset + size) & ~((uint64_t)vm_page_size - 1);
+    if ( end <= start )
+        return;
+    uint8_t* content = (uint8_t*)_buffer + start;
+    size_t   len     = (size_t)(end - start);
+    if ( ::pwrite(_streamFd, content, len, start) != (ssize_t)len ) {
+        _diagnostics.error("could not write cache content to %s, errno=%d", _streamTempPath.c_str(), errno);
+        return;
+    }
+
+    // content cannot change after being streamed, so its page hashes are final
+    uint8_t  hashType;
+    uint8_t  hashSize;
+    uint32_t digestFormat;
+    bool     agile;
+    if ( !codeSigningDigest(hashType, hashSize, digestFormat, agile) )
+        return;
+    size_t firstPage = (size_t)(start / CS_PAGE_SIZE);
+    size_t pageCount = len / CS_PAGE_SIZE;
+    if ( _streamedPageHashed.size() < firstPage + pageCount ) {
+        _streamedPageHashed.resize(firstPage + pageCount, false);
+        _streamedPageHashes.resize((firstPage + pageCount) * hashSize);
+        if ( agile )
+            _streamedPageHashes256.resize((firstPage + pageCount) * CS_HASH_SIZE_SHA256);
+    }
+    for (size_t i=firstPage; i < firstPage + pageCount; ++i) {
+        const uint8_t* page = (uint8_t*)_buffer + i*CS_PAGE_SIZE;
+        CCDigest(digestFormat, page, CS_PAGE_SIZE, &_streamedPageHashes[i*hashSize]);
+        if ( agile )
+            CCDigest(kCCDigestSHA256, page, CS_PAGE_SIZE, &_streamedPageHashes256[i*CS_HASH_SIZE_SHA256]);
+        _streamedPageHashed[i] = true;
+    }
+
+    if ( ::mmap(content, len, PROT_READ, MAP_FIXED | MAP_SHARED, _streamFd, start) != content ) {
+        _diagnostics.error("could not map streamed cache content from %s, errno=%d", _streamTempPath.c_str(), errno);
+        return;
+    }
+    _streamedRanges.push_back({start, len});
+}
+
+void CacheBuilder::finishStreaming()
+{
+    // write out everything not already streamed: header pages, LINKEDIT, local symbols, code signature
+    std::sort(_streamedRanges.begin(), _streamedRanges.end());
+    _streamedRanges.push_back({_currentFileSize, 0});
+    uint64_t offset = 0;
+    for (const auto& range : _streamedRanges) {
+        if ( range.first > offset ) {
+            size_t len = (size_t)(range.first - offset);
+            if ( ::pwrite(_streamFd, (uint8_t*)_buffer + offset, len, offset) != (ssize_t)len ) {
+                _diagnostics.error("could not write cache content to %s, errno=%d", _streamTempPath.c_str(), errno);
+                return;
+            }
+        }
+        offset = range.first + range.second;
+    }
+
+    // swap build buffer for a read-only mapping of the finished file
+    void* content = ::mmap(nullptr, (size_t)_currentFileSize, PROT_READ, MAP_SHARED, _streamFd, 0);
+    if ( content == MAP_FAILED ) {
+        _diagnostics.error("could not map %s, errno=%d", _streamTempPath.c_str(), errno);
+        return;
+    }
+    vm_deallocate(mach_task_self(), (vm_address_t)_buffer, _allocatedBufferSize);
+    _buffer              = (DyldSharedCache*)content;
+    _allocatedBufferSize = _currentFileSize;
+
+    ::fchmod(_streamFd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH); // mkstemp() makes file "rw-------", switch it to "rw-r--r--"
+    ::close(_streamFd);
+    _streamFd = -1;
+    if ( ::rename(_streamTempPath.c_str(), _options.outputFilePath.c_str()) != 0 ) {
+        _diagnostics.error("could not rename %s to %s, errno=%d", _streamTempPath.c_str(), _options.outputFilePath.c_str(), errno);
+        ::unlink(_streamTempPath.c_str());
+    }
+}
+
 const bool CacheBuilder::agileSignature()
 {
     return _options.codeSigningDigestMode == DyldSharedCache::Agile;
@@ -104,8 +104,13 @@ private:
                                                  const std::vector<uint64_t>& segCacheSizes, std::vector<void*>& pointersForASLR);
 
     void        fipsSign();
+    bool        codeSigningDigest(uint8_t& hashType, uint8_t& hashSize, uint32_t& digestFormat, bool& agile);
     void        codeSign();
+    bool        startStreaming();
+    void        streamRange(uint64_t fileOffset, uint64_t size);
+    void        finishStreaming();
     uint64_t    pathHash(const char* path);
+    std::unordered_map<std::string, std::string> findSymlinkAliases(const std::vector<DyldSharedCache::MappedMachO>& dylibs);
     void        writeCacheHeader(const struct dyld_cache_mapping_info regions[3], const std::vector<DyldSharedCache::MappedMachO>& dylibs, const SegmentMapping&);
     void        copyRawSegments(const std::vector<DyldSharedCache::MappedMachO>& dylibs, const SegmentMapping& mapping);
     void        adjustAllImagesForNewSegmentLocations(const std::vector<DyldSharedCache::MappedMachO>& dylibs, const SegmentMapping& mapping);
@@ -119,6 +124,7 @@ private:
     void        addClosures(const std::map<std::string, const dyld3::launch_cache::binary_format::Closure*>& closures);
 
     template <typename P> void writeSlideInfoV2();
+    template <typename P> bool writeSlideInfoV3();
     template <typename P> bool makeRebaseChain(uint8_t* pageContent, uint16_t lastLocationOffset, uint16_t newOffset, const struct dyld_cache_slide_info2* info);
     template <typename P> void addPageStarts(uint8_t* pageContent, const bool bitmap[], const struct dyld_cache_slide_info2* info,
                                              std::vector<uint16_t>& pageStarts, std::vector<uint16_t>& pageExtras);
@@ -142,6 +148,12 @@ private:
     uint64_t                                    _branchPoolsLinkEditStartAddr;
     uint8_t                                     _cdHashFirst[20];
     uint8_t                                     _cdHashSecond[20];
+    int                                         _streamFd;
+    std::string                                 _streamTempPath;
+    std::vector<std::pair<uint64_t, uint64_t>>  _streamedRanges;        // (fileOffset, size) already written and re-mapped from file
+    std::vector<bool>                           _streamedPageHashed;    // per CS_PAGE_SIZE page of file
+    std::vector<uint8_t>                        _streamedPageHashes;
+    std::vector<uint8_t>                        _streamedPageHashes256; // only for agile signatures
 };
 
 
@@ -149,7 +161,8 @@ private:
 void        adjustDylibSegments(DyldSharedCache* cache, bool is64, mach_header* mhInCache, const std::vector<CacheBuilder::SegmentMappingInfo>& mappingInfo, std::vector<void*>& pointersForASLR, Diagnostics& diag);
 
 // implemented in OptimizerLinkedit.cpp
-uint64_t    optimizeLinkedit(DyldSharedCache* cache, bool is64, bool dontMapLocalSymbols, bool addAcceleratorTables, const std::vector<uint64_t>& branchPoolOffsets, Diagnostics& diag, dyld_cache_local_symbols_info** localsInfo);
+uint64_t    optimizeLinkedit(DyldSharedCache* cache, bool is64, bool dontMapLocalSymbols, bool addAcceleratorTables, const std::vector<uint64_t>& branchPoolOffsets,
+                             const std::unordered_map<std::string, std::string>& dylibAliases, Diagnostics& diag, dyld_cache_local_symbols_info** localsInfo);
 
 // implemented in OptimizerBranches.cpp
 void        bypassStubs(DyldSharedCache* cache, const std::vector<uint64_t>& branchPoolStartAddrs, const char* const alwaysUsesStubsTo[], Diagnostics& diag);
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2017 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <string>
+#include <vector>
+
+#include "ClosureStore.h"
+
+
+namespace dyld3 {
+
+static const char sMagic[8] = { 'd', 'y', 'l', 'd', 'c', 'l', 'o', '2' };
+
+
+bool ClosureStore::Key::operator==(const Key& other) const
+{
+    return (envHash == other.envHash) && (pathHash == other.pathHash)
+        && (memcmp(cdHash, other.cdHash, sizeof(cdHash)) == 0)
+        && (memcmp(cacheUUID, other.cacheUUID, sizeof(cacheUUID)) == 0);
+}
+
+std::string ClosureStore::Key::fileName() const
+{
+    // file name is the hex form of the whole key, so it is content addressed
+    static const char hexDigits[] = "0123456789abcdef";
+    std::string result;
+    result.reserve(2*(sizeof(cdHash)+sizeof(cacheUUID)+sizeof(pathHash)+sizeof(envHash)) + 11);
+    for (uint8_t byte : cdHash) {
+        result.push_back(hexDigits[byte >> 4]);
+        result.push_back(hexDigits[byte & 0xF]);
+    }
+    result.push_back('-');
+    for (uint8_t byte : cacheUUID) {
+        result.push_back(hexDigits[byte >> 4]);
+        result.push_back(hexDigits[byte & 0xF]);
+    }
+    result.push_back('-');
+    for (int shift=60; shift >= 0; shift -= 4)
+        result.push_back(hexDigits[(pathHash >> shift) & 0xF]);
+    result.push_back('-');
+    for (int shift=60; shift >= 0; shift -= 4)
+        result.push_back(hexDigits[(envHash >> shift) & 0xF]);
+    result.append(".closure");
+    return result;
+}
+
+
+ClosureStore::ClosureStore(const std::string& storeDir, size_t maxMappedClosures)
+    : _storeDir(storeDir), _maxMapped(maxMappedClosures)
+{
+    if ( !_storeDir.empty() && (_storeDir.back() != '/') )
+        _storeDir.push_back('/');
+    if ( _maxMapped == 0 )
+        _maxMapped = 1;
+    // create store directory on first use
+    ::mkdir(_storeDir.c_str(), S_IRWXU|S_IRGRP|S_IXGRP|S_IROTH|S_IXOTH);
+}
+
+ClosureStore::~ClosureStore()
+{
+    for (const Mapping& mapping : _lru)
+        unmap(mapping);
+}
+
+ClosureStore::Key ClosureStore::makeKey(const uint8_t cdHash[20], const uint8_t cacheUUID[16], const std::string& mainExecutablePath,
+                                       const std::vector<std::string>& envVars)
+{
+    Key key;
+    memset(&key, 0, sizeof(key));
+    memcpy(key.cdHash, cdHash, sizeof(key.cdHash));
+    memcpy(key.cacheUUID, cacheUUID, sizeof(key.cacheUUID));
+    // FNV-1a over the path
+    uint64_t pathHash = 0xcbf29ce484222325ULL;
+    for (char c : mainExecutablePath) {
+        pathHash ^= (uint8_t)c;
+        pathHash *= 0x100000001b3ULL;
+    }
+    key.pathHash = pathHash;
+    // FNV-1a over env vars, each terminated by its NUL so "A=1","B" differs from "A=1B"
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const std::string& var : envVars) {
+        for (size_t i=0; i <= var.size(); ++i) {
+            hash ^= (uint8_t)var.c_str()[i];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    key.envHash = hash;
+    return key;
+}
+
+const void* ClosureStore::find(const Key& key, size_t& closureSize, const Validator& stillValid)
+{
+    const std::string fileName = key.fileName();
+
+    // check in-memory LRU first
+    auto pos = _index.find(fileName);
+    if ( pos != _index.end() ) {
+        MappingList::iterator entry = pos->second;
+        if ( stillValid && !stillValid(entry->closure(), entry->closureSize()) ) {
+            ++_stats.invalidated;
+            evict(entry, true);
+            ++_stats.misses;
+            return nullptr;
+        }
+        _lru.splice(_lru.begin(), _lru, entry);
+        ++_stats.memoryHits;
+        closureSize = entry->closureSize();
+        return entry->closure();
+    }
+
+    // then look on disk
+    Mapping mapping;
+    if ( !mapFile(key, mapping) ) {
+        ++_stats.misses;
+        return nullptr;
+    }
+    if ( stillValid && !stillValid(mapping.closure(), mapping.closureSize()) ) {
+        ++_stats.invalidated;
+        ++_stats.misses;
+        unmap(mapping);
+        ::unlink((_storeDir + fileName).c_str());
+        return nullptr;
+    }
+    _lru.push_front(mapping);
+    _index[fileName] = _lru.begin();
+    if ( _lru.size() > _maxMapped )
+        evict(std::prev(_lru.end()), false);
+    ++_stats.diskHits;
+    closureSize = mapping.closureSize();
+    return mapping.closure();
+}
+
+bool ClosureStore::save(const Key& key, const void* closure, size_t closureSize)
+{
+    const std::string fileName = key.fileName();
+
+    // drop any stale mapping of this key
+    auto pos = _index.find(fileName);
+    if ( pos != _index.end() )
+        evict(pos->second, false);
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, sMagic, sizeof(sMagic));
+    header.key         = key;
+    header.closureSize = closureSize;
+
+    // write to temp file, then rename so readers never see a partial closure
+    std::string finalPath = _storeDir + fileName;
+    std::string tempPath  = finalPath + "-XXXXXX";
+    std::vector<char> tempPathSpace(tempPath.begin(), tempPath.end());
+    tempPathSpace.push_back('\0');
+    int fd = ::mkstemp(&tempPathSpace[0]);
+    if ( fd == -1 )
+        return false;
+    bool success = false;
+    if ( (::pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header))
+      && (::pwrite(fd, closure, closureSize, sizeof(header)) == (ssize_t)closureSize) ) {
+        ::fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+        success = ( ::rename(&tempPathSpace[0], finalPath.c_str()) == 0 );
+    }
+    ::close(fd);
+    if ( !success )
+        ::unlink(&tempPathSpace[0]);
+    else
+        ++_stats.saves;
+    return success;
+}
+
+void ClosureStore::remove(const Key& key)
+{
+    const std::string fileName = key.fileName();
+    auto pos = _index.find(fileName);
+    if ( pos != _index.end() )
+        evict(pos->second, true);
+    else
+        ::unlink((_storeDir + fileName).c_str());
+}
+
+bool ClosureStore::mapFile(const Key& key, Mapping& mapping)
+{
+    mapping.fileName = key.fileName();
+    int fd = ::open((_storeDir + mapping.fileName).c_str(), O_RDONLY);
+    if ( fd == -1 )
+        return false;
+    struct stat statBuf;
+    if ( (::fstat(fd, &statBuf) != 0) || (statBuf.st_size < (off_t)sizeof(FileHeader)) ) {
+        ::close(fd);
+        return false;
+    }
+    mapping.mappedSize  = (size_t)statBuf.st_size;
+    mapping.mappedStart = ::mmap(nullptr, mapping.mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if ( mapping.mappedStart == MAP_FAILED )
+        return false;
+
+    // reject truncated files and files whose name does not match their content
+    const FileHeader* header = (FileHeader*)mapping.mappedStart;
+    if ( (memcmp(header->magic, sMagic, sizeof(sMagic)) != 0) || !(header->key == key)
+      || (header->closureSize != mapping.mappedSize - sizeof(FileHeader)) ) {
+        unmap(mapping);
+        return false;
+    }
+    return true;
+}
+
+void ClosureStore::unmap(const Mapping& mapping)
+{
+    ::munmap((void*)mapping.mappedStart, mapping.mappedSize);
+}
+
+void ClosureStore::evict(MappingList::iterator pos, bool deleteFile)
+{
+    if ( deleteFile )
+        ::unlink((_storeDir + pos->fileName).c_str());
+    unmap(*pos);
+    _index.erase(pos->fileName);
+    _lru.erase(pos);
+}
+
+
+} // namespace dyld3
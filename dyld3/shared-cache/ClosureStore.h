@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2017 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef ClosureStore_h
+#define ClosureStore_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <iterator>
+
+#ifndef VIS_HIDDEN
+  #define VIS_HIDDEN __attribute__((visibility("hidden")))
+#endif
+
+namespace dyld3 {
+
+//
+// Persistent store of launch closures.  Each closure is saved in its own file whose name
+// is derived from the key (main executable cdHash and runtime path, dyld cache UUID, and DYLD_* env vars).
+// The path is part of the key because copies of one binary in different directories resolve
+// @executable_path, @loader_path and @rpath differently.
+// Files are mmap()ed back in on lookup and the most recently used mappings are kept in an
+// in-memory LRU in front of the disk store.
+//
+// The store only depends on POSIX file APIs so it can be built and tested outside of closured.
+// It is not thread safe.
+//
+class VIS_HIDDEN ClosureStore
+{
+public:
+    struct Key
+    {
+        uint8_t     cdHash[20];
+        uint8_t     cacheUUID[16];
+        uint64_t    pathHash;
+        uint64_t    envHash;
+
+        bool        operator==(const Key& other) const;
+        std::string fileName() const;
+    };
+
+    struct Stats
+    {
+        uint64_t    memoryHits  = 0;
+        uint64_t    diskHits    = 0;
+        uint64_t    misses      = 0;
+        uint64_t    invalidated = 0;
+        uint64_t    saves       = 0;
+    };
+
+    // called on each lookup hit, returns false if closure is out of date and should be discarded
+    typedef std::function<bool(const void* closure, size_t closureSize)> Validator;
+
+                        ClosureStore(const std::string& storeDir, size_t maxMappedClosures=32);
+                        ~ClosureStore();
+
+    static Key          makeKey(const uint8_t cdHash[20], const uint8_t cacheUUID[16], const std::string& mainExecutablePath,
+                                const std::vector<std::string>& envVars);
+
+    // returns closure content (valid until the next call that modifies the store) or nullptr
+    const void*         find(const Key& key, size_t& closureSize, const Validator& stillValid);
+    bool                save(const Key& key, const void* closure, size_t closureSize);
+    void                remove(const Key& key);
+    const Stats&        stats() const { return _stats; }
+
+private:
+    struct FileHeader
+    {
+        char        magic[8];       // "dyldclo2"
+        Key         key;
+        uint64_t    closureSize;
+        uint64_t    reserved;
+    };
+
+    struct Mapping
+    {
+        std::string fileName;
+        const void* mappedStart;
+        size_t      mappedSize;
+
+        const void* closure() const     { return (uint8_t*)mappedStart + sizeof(FileHeader); }
+        size_t      closureSize() const { return mappedSize - sizeof(FileHeader); }
+    };
+
+    typedef std::list<Mapping> MappingList;
+
+    bool                mapFile(const Key& key, Mapping& mapping);
+    void                unmap(const Mapping& mapping);
+    void                evict(MappingList::iterator pos, bool deleteFile);
+
+    std::string                                         _storeDir;
+    size_t                                              _maxMapped;
+    MappingList                                         _lru;        // most recently used at front
+    std::unordered_map<std::string, MappingList::iterator> _index;
+    Stats                                               _stats;
+};
+
+
+} // namespace dyld3
+
+#endif // ClosureStore_h
@@ -75,6 +75,7 @@ DyldSharedCache::CreateResults DyldSharedCache::create(const CreateOptions&
     if ( cache.errorMessage().empty() ) {
         results.cacheContent = cache.buffer();
         results.cacheLength  = cache.bufferSize();
+        results.savedToFile  = !options.outputFilePath.empty();
     }
     else {
         cache.deleteBuffer();
@@ -69,6 +69,7 @@ public:
         bool                                        dylibsRemovedDuringMastering;
         bool                                        inodesAreSameAsRuntime;
         bool                                        cacheSupportsASLR;
+        bool                                        slideInfoV3;
         bool                                        forSimulator;
         bool                                        verbose;
         bool                                        evictLeafDylibsOnOverflow;
@@ -76,6 +77,7 @@ public:
         std::unordered_map<std::string, unsigned>   dirtyDataSegmentOrdering;
         std::vector<std::string>                    pathPrefixes;
         std::string                                 loggingPrefix;
+        std::string                                 outputFilePath;     // if set, cache is streamed to this file as it is built
     };
 
     struct MappedMachO
@@ -93,6 +95,7 @@ public:
                                     sliceFileOffset : 62;
         uint64_t                    modTime;                // only recorded if inodesAreSameAsRuntime
         uint64_t                    inode;                  // only recorded if inodesAreSameAsRuntime
+        std::string                 buildPath;              // only recorded if loaded from somewhere other than a path prefix
     };
 
     struct CreateResults
@@ -105,6 +108,7 @@ public:
         bool                            agileSignature = false;
         std::string                     cdHashFirst;
         std::string                     cdHashSecond;
+        bool                            savedToFile = false;      // cache already written to options.outputFilePath
     };
 
 
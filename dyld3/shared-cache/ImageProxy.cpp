@@ -34,11 +34,14 @@
 #include <sys/types.h>
 #include <sys/param.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <mach/mach_vm.h>
+#include <mach/mach_time.h>
 #include <mach-o/dyld.h>
 #include <mach-o/dyld_priv.h>
 #include <uuid/uuid.h>
 #include <os/log.h>
+#include <Block.h>
 
 #include <string>
 #include <vector>
@@ -59,20 +62,70 @@ typedef launch_cache::TargetSymbolValue   TargetSymbolValue;
 
 
 
+///////////////////////////  ImageProxyArena  ///////////////////////////
+
+ImageProxyArena::~ImageProxyArena()
+{
+    for (Chunk* chunk=_chunks; chunk != nullptr; ) {
+        Chunk* next = chunk->next;
+        ::free(chunk);
+        chunk = next;
+    }
+}
+
+void* ImageProxyArena::allocate(size_t size, size_t alignment)
+{
+    uint8_t* result = (uint8_t*)(((uintptr_t)_cur + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    if ( (_cur == nullptr) || (result + size > _end) ) {
+        // big requests get their own chunk so they do not waste the rest of the current one
+        const bool ownChunk = (size > kChunkSize/4);
+        size_t chunkSize = ownChunk ? (sizeof(Chunk) + alignment + size) : kChunkSize;
+        Chunk* chunk = (Chunk*)::malloc(chunkSize);
+        if ( chunk == nullptr )
+            throw std::bad_alloc();
+        chunk->next = _chunks;
+        chunk->size = chunkSize;
+        _chunks = chunk;
+        _bytesReserved += chunkSize;
+        uint8_t* start = (uint8_t*)chunk + sizeof(Chunk);
+        result = (uint8_t*)(((uintptr_t)start + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        _bytesUsed += size;
+        if ( ownChunk )
+            return result;
+        _end = (uint8_t*)chunk + chunkSize;
+    }
+    else {
+        _bytesUsed += size;
+    }
+    _cur = result + size;
+    return result;
+}
+
+const char* ImageProxyArena::intern(const char* str)
+{
+    size_t len = strlen(str) + 1;
+    char* copy = (char*)allocate(len, 1);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+
 ///////////////////////////  ImageProxy  ///////////////////////////
 
-ImageProxy::ImageProxy(const mach_header* mh, const BinaryImageData* imageData, uint32_t indexInGroup, bool dyldCacheIsRaw)
+ImageProxy::ImageProxy(const mach_header* mh, const BinaryImageData* imageData, uint32_t indexInGroup, bool dyldCacheIsRaw, ImageProxyArena& arena)
  : _mh(mh), _sliceFileOffset(0), _modTime(0), _inode(0), _imageBinaryData(imageData), _runtimePath(launch_cache::Image(imageData).path()),
-   _groupNum(0), _indexInGroup(indexInGroup), _isSetUID(false), _dyldCacheIsRaw(dyldCacheIsRaw), _platformBinary(false), _overrideOf(ImageRef::weakImportMissing()),
-   _directDependentsSet(false), _deepDependentsSet(false), _initBeforesArraySet(false), _initBeforesComputed(false),
+   _groupNum(0), _indexInGroup(indexInGroup), _isSetUID(false), _dyldCacheIsRaw(dyldCacheIsRaw), _platformBinary(false),
+   _arena(arena), _dependents(arena), _dependentsKind(arena), _rpaths(arena), _overrideOf(ImageRef::weakImportMissing()),
+   _prebuiltImageData(nullptr), _directDependentsSet(false), _deepDependentsSet(false), _initBeforesArraySet(false), _initBeforesComputed(false),
    _invalid(launch_cache::Image(imageData).isInvalid()), _staticallyReferenced(false), _cwdMustBeThisDir(false)
 {
 }
 
-ImageProxy::ImageProxy(const DyldSharedCache::MappedMachO& mapping, uint32_t groupNum, uint32_t indexInGroup, bool dyldCacheIsRaw)
+ImageProxy::ImageProxy(const DyldSharedCache::MappedMachO& mapping, uint32_t groupNum, uint32_t indexInGroup, bool dyldCacheIsRaw, ImageProxyArena& arena)
  : _mh(mapping.mh), _sliceFileOffset(mapping.sliceFileOffset), _modTime(mapping.modTime), _inode(mapping.inode), _imageBinaryData(nullptr), _runtimePath(mapping.runtimePath),
    _groupNum(groupNum), _indexInGroup(indexInGroup), _isSetUID(mapping.isSetUID), _dyldCacheIsRaw(dyldCacheIsRaw), _platformBinary(mapping.protectedBySIP),
-   _overrideOf(ImageRef::weakImportMissing()), _directDependentsSet(false), _deepDependentsSet(false), _initBeforesArraySet(false), _initBeforesComputed(false),
+   _arena(arena), _dependents(arena), _dependentsKind(arena), _rpaths(arena), _overrideOf(ImageRef::weakImportMissing()),
+   _prebuiltImageData(nullptr), _directDependentsSet(false), _deepDependentsSet(false), _initBeforesArraySet(false), _initBeforesComputed(false),
    _invalid(false), _staticallyReferenced(false), _cwdMustBeThisDir(false)
 {
 }
@@ -99,7 +152,7 @@ void ImageProxy::processRPaths(ImageProxyGroup& owningGroup)
                 std::string newPath = mainPath.substr(0, mainPath.rfind('/')+1) + thisRPath.substr(17);
                 std::string normalizedPath = owningGroup.normalizedPath(newPath);
                 if ( fileExists(normalizedPath) )
-                    _rpaths.push_back(normalizedPath);
+                    _rpaths.push_back(_arena.intern(normalizedPath));
                 else
                     _diag.warning("LC_RPATH to nowhere (%s) in %s", rpath, _runtimePath.c_str());
                 char resolvedMainPath[PATH_MAX];
@@ -111,7 +164,7 @@ void ImageProxy::processRPaths(ImageProxyGroup& owningGroup)
                         for (const std::string& pre : owningGroup._buildTimePrefixes) {
                             std::string aPath = owningGroup.normalizedPath(pre + newRealPath);
                             if ( fileExists(aPath) ) {
-                                _rpaths.push_back(owningGroup.normalizedPath(newRealPath));
+                                _rpaths.push_back(_arena.intern(owningGroup.normalizedPath(newRealPath)));
                             }
                         }
                     }
@@ -129,7 +182,7 @@ void ImageProxy::processRPaths(ImageProxyGroup& owningGroup)
             if ( !mainPath.empty() ) {
                 std::string newPath = mainPath.substr(0, mainPath.rfind('/')+1);
                 std::string normalizedPath = owningGroup.normalizedPath(newPath);
-                _rpaths.push_back(normalizedPath);
+                _rpaths.push_back(_arena.intern(normalizedPath));
             }
             else {
                 _diag.warning("LC_RPATH uses @executable_path in %s", _runtimePath.c_str());
@@ -142,7 +195,7 @@ void ImageProxy::processRPaths(ImageProxyGroup& owningGroup)
             for (const std::string& pre : owningGroup._buildTimePrefixes) {
                 std::string aPath = owningGroup.normalizedPath(pre + newPath);
                 if ( fileExists(aPath) ) {
-                    _rpaths.push_back(owningGroup.normalizedPath(newPath));
+                    _rpaths.push_back(_arena.intern(owningGroup.normalizedPath(newPath)));
                     found = true;
                     break;
                 }
@@ -156,7 +209,7 @@ void ImageProxy::processRPaths(ImageProxyGroup& owningGroup)
                     for (const std::string& pre : owningGroup._buildTimePrefixes) {
                         std::string aPath = owningGroup.normalizedPath(pre + newRealPath);
                         if ( fileExists(aPath) ) {
-                            _rpaths.push_back(owningGroup.normalizedPath(newRealPath));
+                            _rpaths.push_back(_arena.intern(owningGroup.normalizedPath(newRealPath)));
                             found = true;
                             break;
                         }
@@ -166,7 +219,7 @@ void ImageProxy::processRPaths(ImageProxyGroup& owningGroup)
             if ( !found ) {
                 // even though this path does not exist, we need to add it to must-be-missing paths
                 // in case it shows up at launch time
-                _rpaths.push_back(owningGroup.normalizedPath(newPath));
+                _rpaths.push_back(_arena.intern(owningGroup.normalizedPath(newPath)));
                 _diag.warning("LC_RPATH to nowhere (%s) in %s", rpath, _runtimePath.c_str());
             }
         }
@@ -174,7 +227,7 @@ void ImageProxy::processRPaths(ImageProxyGroup& owningGroup)
             size_t lastSlashPos = _runtimePath.rfind('/');
             std::string newPath = _runtimePath.substr(0, lastSlashPos+1);
             std::string normalizedPath = owningGroup.normalizedPath(newPath);
-            _rpaths.push_back(normalizedPath);
+            _rpaths.push_back(_arena.intern(normalizedPath));
         }
         else if ( rpath[0] == '@' ) {
             _diag.warning("LC_RPATH with unknown @ variable (%s) in %s", rpath, _runtimePath.c_str());
@@ -182,13 +235,13 @@ void ImageProxy::processRPaths(ImageProxyGroup& owningGroup)
         else {
             if ( rpath[0] == '/' )
                 _diag.warning("LC_RPATH is absolute path (%s) in %s", rpath, _runtimePath.c_str());
-            _rpaths.push_back(rpath);
+            _rpaths.push_back(_arena.intern(rpath));
         }
     });
     //if ( !_rpaths.empty() ) {
     //    fprintf(stderr, "for %s\n", _runtimePath.c_str());
-    //    for (const std::string& p : _rpaths)
-    //        fprintf(stderr, "   %s\n", p.c_str());
+    //    for (const char* p : _rpaths)
+    //        fprintf(stderr, "   %s\n", p);
     //}
 }
 
@@ -385,22 +438,28 @@ void ImageProxy::recursiveBuildInitBeforeInfo(ImageProxyGroup& owningGroup)
         return;
     _initBeforesComputed = true; // break cycles
 
-    if ( _imageBinaryData != nullptr ) {
-        assert(_groupNum == 0);
-        // if this is proxy for something in dyld cache, get its list from cache
-        // and parse list into befores and upwards
-        launch_cache::Image image(_imageBinaryData);
+    const BinaryImageData* builtImageData = (_imageBinaryData != nullptr) ? _imageBinaryData : _prebuiltImageData;
+    if ( builtImageData != nullptr ) {
+        // if this is proxy for something in dyld cache (or in the prebuilt group of other OS dylibs),
+        // get its list from that ImageGroup and parse list into befores and upwards
+        launch_cache::Image image(builtImageData);
         image.forEachInitBefore(^(launch_cache::binary_format::ImageRef ref) {
             if ( (LinkKind)ref.kind() == LinkKind::upward ) {
                 ImageProxyGroup* groupP = &owningGroup;
-                while (groupP->_groupNum != 0)
+                while ( (groupP != nullptr) && (groupP->_groupNum != ref.groupNum()) )
                     groupP = groupP->_nextSearchGroup;
-                launch_cache::ImageGroup dyldCacheGroup(groupP->_basedOn);
-                launch_cache::Image      dyldCacheImage = dyldCacheGroup.image(ref.indexInGroup());
+                if ( (groupP == nullptr) || (groupP->_basedOn == nullptr) ) {
+                    _diag.error("initializer list of %s refers to unknown group %u", _runtimePath.c_str(), ref.groupNum());
+                    return;
+                }
+                launch_cache::ImageGroup builtGroup(groupP->_basedOn);
+                launch_cache::Image      builtImage = builtGroup.image(ref.indexInGroup());
                 Diagnostics diag;
-                ImageProxy* p = groupP->findAbsoluteImage(diag, dyldCacheImage.path(), false, false);
-                if ( diag.noError() )
+                ImageProxy* p = groupP->findAbsoluteImage(diag, builtImage.path(), false, false);
+                if ( diag.noError() && (p != nullptr) )
                     _initBeforesInfo.danglingUpward.push_back(p);
+                else
+                    _diag.warning("upward linked '%s' in initializer list of %s not found", builtImage.path(), _runtimePath.c_str());
             }
             else {
                 _initBeforesInfo.initBefore.push_back(ref);
@@ -509,7 +568,9 @@ const std::vector<ImageRef>& ImageProxy::getInitBeforeList(ImageProxyGroup& owni
 {
     if ( !_initBeforesArraySet ) {
         _initBeforesArraySet = true; // break cycles
+        uint64_t startTime = mach_absolute_time();
         recursiveBuildInitBeforeInfo(owningGroup);
+        owningGroup._initOrderTime += (mach_absolute_time() - startTime);
         convertInitBeforeInfoToArray(owningGroup);
     }
     return _initBeforesArray;
@@ -766,21 +827,59 @@ ImageProxyGroup::ImageProxyGroup(uint32_t groupNum, const DyldCacheParser& dyldC
                                  bool stubsEliminated, bool dylibsExpectedOnDisk, bool inodesAreSameAsRuntime)
     : _pathOverrides(envVars), _patchTable(nullptr), _basedOn(basedOn), _dyldCache(dyldCache), _nextSearchGroup(next), _groupNum(groupNum),
       _stubEliminated(stubsEliminated), _dylibsExpectedOnDisk(dylibsExpectedOnDisk), _inodesAreSameAsRuntime(inodesAreSameAsRuntime),
-      _knownGroups(knownGroups), _buildTimePrefixes(buildTimePrefixes), _mainProgRuntimePath(mainProgRuntimePath), _platform(Platform::unknown)
+      _knownGroups(knownGroups), _pathToProxy(64, CStringHash(), CStringEquals(), _arena),
+      _buildTimePrefixes(buildTimePrefixes), _mainProgRuntimePath(mainProgRuntimePath), _platform(Platform::unknown)
 {
     _archName = dyldCache.cacheHeader()->archName();
     _platform = (Platform)(dyldCache.cacheHeader()->platform());
 }
 
 
+std::atomic<uint64_t> ImageProxyGroup::sTotalFileChecksAvoided(0);
+std::atomic<uint64_t> ImageProxyGroup::sTotalInitOrderTime(0);
+ImageProxyGroup::MemoryStatsHandler ImageProxyGroup::sMemoryStatsHandler = nullptr;
+
 ImageProxyGroup::~ImageProxyGroup()
 {
+    sTotalFileChecksAvoided += _fileChecksAvoided;
     for (DyldSharedCache::MappedMachO& mapping : _ownedMappings ) {
         vm_deallocate(mach_task_self(), (vm_address_t)mapping.mh, mapping.length);
     }
+    // proxies live in _arena, so only run their destructors; the memory goes when _arena does
     for (ImageProxy* proxy : _images) {
-        delete proxy;
+        proxy->~ImageProxy();
     }
+    if ( sMemoryStatsHandler != nullptr ) {
+        struct rusage usage;
+        uint64_t peakResident = 0;
+        if ( getrusage(RUSAGE_SELF, &usage) == 0 )
+            peakResident = usage.ru_maxrss;    // bytes on Darwin
+        sMemoryStatsHandler(_groupNum, _arena.bytesUsed(), peakResident);
+    }
+}
+
+void ImageProxyGroup::setMemoryStatsHandler(MemoryStatsHandler handler)
+{
+    MemoryStatsHandler old = sMemoryStatsHandler;
+    sMemoryStatsHandler = (handler != nullptr) ? Block_copy(handler) : nullptr;
+    if ( old != nullptr )
+        Block_release(old);
+}
+
+template <typename... Args>
+ImageProxy* ImageProxyGroup::makeProxy(Args&&... args)
+{
+    void* storage = _arena.allocate(sizeof(ImageProxy), alignof(ImageProxy));
+    return new (storage) ImageProxy(std::forward<Args>(args)..., _arena);
+}
+
+void ImageProxyGroup::addPathToProxy(const std::string& path, ImageProxy* proxy)
+{
+    auto pos = _pathToProxy.find(path.c_str());
+    if ( pos != _pathToProxy.end() )
+        pos->second = proxy;
+    else
+        _pathToProxy[_arena.intern(path)] = proxy;
 }
 
 
@@ -810,11 +909,11 @@ ImageProxy* ImageProxyGroup::findImage(Diagnostics& diag, const std::string& run
         if ( startsWith(possiblePath, "@rpath/") ) {
             std::string trailing = &possiblePath[6];
             for (const ImageProxy::RPathChain* cur=rChain; cur != nullptr; cur = cur->prev) {
-                for (const std::string& rpath : cur->rpaths) {
+                for (const char* rpath : cur->rpaths) {
                     std::string aPath = rpath + trailing;
                     result = findAbsoluteImage(diag, aPath, true, false);
                     if ( result != nullptr ) {
-                        _pathToProxy[runtimeLoadPath] = result;
+                        addPathToProxy(runtimeLoadPath, result);
                         stop = true;
                         return;
                     }
@@ -836,7 +935,7 @@ ImageProxy* ImageProxyGroup::findImage(Diagnostics& diag, const std::string& run
                 std::string newPath = loaderDir + &possiblePath[12];
                 result = findAbsoluteImage(diag, newPath, canBeMissing, false);
                 if ( result != nullptr ) {
-                    _pathToProxy[runtimeLoadPath] = result;
+                    addPathToProxy(runtimeLoadPath, result);
                     stop = true;
                     return;
                 }
@@ -852,7 +951,7 @@ ImageProxy* ImageProxyGroup::findImage(Diagnostics& diag, const std::string& run
                         std::string newPath = mainDir + &possiblePath[16];
                         result = findAbsoluteImage(diag, newPath, canBeMissing, false);
                         if ( result != nullptr ) {
-                            _pathToProxy[runtimeLoadPath] = result;
+                            addPathToProxy(runtimeLoadPath, result);
                             stop = true;
                             return;
                         }
@@ -898,6 +997,48 @@ bool ImageProxyGroup::builtImageStillValid(const launch_cache::Image& image)
     if ( _platform != MachOParser::currentPlatform() )
         return true;
 
+    return imageFileStillValid(image);
+}
+
+bool ImageProxyGroup::builtImageClosureStillValid(const launch_cache::Image& image, uint32_t imageIndex)
+{
+    // an initializer order computed at build time covers every image reachable from this one,
+    // so it is only reusable if all of them are unchanged
+    auto pos = _builtClosureValid.find(imageIndex);
+    if ( pos != _builtClosureValid.end() )
+        return pos->second;
+    bool valid = false;
+    if ( builtImageStillValidCached(image) ) {
+        const BinaryImageGroupData* groups[2] = { _dyldCache.cachedDylibsGroup(), _dyldCache.otherDylibsGroup() };
+        launch_cache::ImageGroupList groupList(2, groups);
+        std::unordered_set<const BinaryImageData*> allImages;
+        if ( image.recurseAllDependentImages(groupList, allImages) ) {
+            valid = true;
+            for (const BinaryImageData* imageData : allImages) {
+                if ( !builtImageStillValidCached(launch_cache::Image(imageData)) ) {
+                    valid = false;
+                    break;
+                }
+            }
+        }
+    }
+    _builtClosureValid[imageIndex] = valid;
+    return valid;
+}
+
+bool ImageProxyGroup::builtImageStillValidCached(const launch_cache::Image& image)
+{
+    // closures of different images mostly overlap, so only stat each dependent once per group
+    auto pos = _builtImageValid.find(image.binaryData());
+    if ( pos != _builtImageValid.end() )
+        return pos->second;
+    bool valid = builtImageStillValid(image);
+    _builtImageValid[image.binaryData()] = valid;
+    return valid;
+}
+
+bool ImageProxyGroup::imageFileStillValid(const launch_cache::Image& image)
+{
     struct stat statBuf;
     bool expectedOnDisk   = image.group().dylibsExpectedOnDisk();
     bool overridableDylib = image.overridableDylib();
@@ -952,7 +1093,7 @@ bool ImageProxyGroup::builtImageStillValid(const launch_cache::Image& image)
 
 ImageProxy* ImageProxyGroup::findAbsoluteImage(Diagnostics& diag, const std::string& runtimeLoadPath, bool canBeMissing, bool makeErrorMessage, bool pathIsAlreadyReal)
 {
-    auto pos = _pathToProxy.find(runtimeLoadPath);
+    auto pos = _pathToProxy.find(runtimeLoadPath.c_str());
     if ( pos != _pathToProxy.end() )
         return pos->second;
 
@@ -966,20 +1107,24 @@ ImageProxy* ImageProxyGroup::findAbsoluteImage(Diagnostics& diag, const std::str
                 ImageProxy* proxy = nullptr;
                 if ( _groupNum == 0 ) {
                     const mach_header* mh = (mach_header*)((uint8_t*)(_dyldCache.cacheHeader()) + image.cacheOffset());
-                    proxy = new ImageProxy(mh, image.binaryData(), foundIndex, _dyldCache.cacheIsMappedRaw());
+                    proxy = makeProxy(mh, image.binaryData(), foundIndex, _dyldCache.cacheIsMappedRaw());
                 }
                 else {
                     DyldSharedCache::MappedMachO* mapping = addMappingIfValidMachO(diag, runtimeLoadPath);
                     if ( mapping != nullptr ) {
-                        proxy = new ImageProxy(*mapping, _groupNum, foundIndex, false);
+                        proxy = makeProxy(*mapping, _groupNum, foundIndex, false);
+                        // without DYLD_* overrides, dependents resolve the same as when the group was built,
+                        // so the initializer order computed then can be reused instead of walking the graph again
+                        if ( (_pathOverrides.envVarCount() == 0) && builtImageClosureStillValid(image, foundIndex) )
+                            proxy->setPrebuiltImageData(image.binaryData());
                     }
                 }
                 if ( proxy != nullptr ) {
-                    _pathToProxy[runtimeLoadPath] = proxy;
+                    addPathToProxy(runtimeLoadPath, proxy);
                     _images.push_back(proxy);
                     if ( runtimeLoadPath != image.path() ) {
                         // lookup path is an alias, add real path too
-                        _pathToProxy[image.path()] = proxy;
+                        addPathToProxy(image.path(), proxy);
                     }
                     return proxy;
                 }
@@ -993,21 +1138,33 @@ ImageProxy* ImageProxyGroup::findAbsoluteImage(Diagnostics& diag, const std::str
             return result;
     }
 
+    // search path variants of each dependent probe the same missing files over and over
+    bool knownMissing = (_pathsNotFound.count(runtimeLoadPath) != 0);
+
     // see if this is a symlink to a dylib
     if ( !pathIsAlreadyReal ) {
-        for (const std::string& prefix : _buildTimePrefixes) {
-            std::string fullPath = prefix + runtimeLoadPath;
-            if ( endsWith(prefix, "/") )
-                fullPath = prefix.substr(0, prefix.size()-1) + runtimeLoadPath;
-            if ( fileExists(fullPath) ) {
-                std::string resolvedPath = realFilePath(fullPath);
-                if ( !resolvedPath.empty() && (resolvedPath!= fullPath) ) {
-                    std::string resolvedRuntimePath = resolvedPath.substr(prefix.size());
-                    ImageProxy* proxy = findAbsoluteImage(diag, resolvedRuntimePath, true, false, true);
-                    if ( proxy != nullptr )
-                        return proxy;
+        if ( knownMissing ) {
+            _fileChecksAvoided += _buildTimePrefixes.size();
+        }
+        else {
+            bool foundInAnyPrefix = false;
+            for (const std::string& prefix : _buildTimePrefixes) {
+                std::string fullPath = prefix + runtimeLoadPath;
+                if ( endsWith(prefix, "/") )
+                    fullPath = prefix.substr(0, prefix.size()-1) + runtimeLoadPath;
+                if ( fileExists(fullPath) ) {
+                    foundInAnyPrefix = true;
+                    std::string resolvedPath = realFilePath(fullPath);
+                    if ( !resolvedPath.empty() && (resolvedPath!= fullPath) ) {
+                        std::string resolvedRuntimePath = resolvedPath.substr(prefix.size());
+                        ImageProxy* proxy = findAbsoluteImage(diag, resolvedRuntimePath, true, false, true);
+                        if ( proxy != nullptr )
+                            return proxy;
+                    }
                 }
             }
+            if ( !foundInAnyPrefix && (runtimeLoadPath[0] == '/') )
+                _pathsNotFound.insert(runtimeLoadPath);
         }
     }
 
@@ -1023,8 +1180,8 @@ ImageProxy* ImageProxyGroup::findAbsoluteImage(Diagnostics& diag, const std::str
 
         DyldSharedCache::MappedMachO* mapping = addMappingIfValidMachO(diag, runtimeLoadPath);
         if ( mapping != nullptr ) {
-            ImageProxy* proxy = new ImageProxy(*mapping, _groupNum, (uint32_t)_images.size(), false);
-            _pathToProxy[runtimeLoadPath] = proxy;
+            ImageProxy* proxy = makeProxy(*mapping, _groupNum, (uint32_t)_images.size(), false);
+            addPathToProxy(runtimeLoadPath, proxy);
             _images.push_back(proxy);
             return proxy;
         }
@@ -1063,6 +1220,11 @@ ImageProxy* ImageProxyGroup::findAbsoluteImage(Diagnostics& diag, const std::str
 DyldSharedCache::MappedMachO* ImageProxyGroup::addMappingIfValidMachO(Diagnostics& diag, const std::string& runtimePath, bool ignoreMainExecutables)
 {
     bool fileFound = false;
+    if ( _pathsNotFound.count(runtimePath) != 0 ) {
+        _fileChecksAvoided += _buildTimePrefixes.size();
+        diag.warning("file not found '%s'", runtimePath.c_str());
+        return nullptr;
+    }
     for (const std::string& prefix : _buildTimePrefixes) {
         std::string fullPath = prefix + runtimePath;
         struct stat statBuf;
@@ -1109,8 +1271,11 @@ DyldSharedCache::MappedMachO* ImageProxyGroup::addMappingIfValidMachO(Diagnostic
         }
         ::close(fd);
     }
-    if ( !fileFound )
+    if ( !fileFound ) {
         diag.warning("file not found '%s'", runtimePath.c_str());
+        if ( runtimePath[0] == '/' )
+            _pathsNotFound.insert(runtimePath);
+    }
 
     return nullptr;
 }
@@ -1133,13 +1298,13 @@ void ImageProxyGroup::addExtraMachOsInBundle(const std::string& appDir)
             return;
 
         // if the file is mach-o, add to list
-        if ( _pathToProxy.find(path) == _pathToProxy.end() ) {
+        if ( _pathToProxy.find(path.c_str()) == _pathToProxy.end() ) {
             Diagnostics  machoDiag;
             DyldSharedCache::MappedMachO* mapping = addMappingIfValidMachO(machoDiag, path, true);
             if ( mapping != nullptr ) {
-                ImageProxy* proxy = new ImageProxy(*mapping, _groupNum, (uint32_t)_images.size(), false);
+                ImageProxy* proxy = makeProxy(*mapping, _groupNum, (uint32_t)_images.size(), false);
                 if ( proxy != nullptr ) {
-                    _pathToProxy[path] = proxy;
+                    addPathToProxy(path, proxy);
                     _images.push_back(proxy);
                 }
             }
@@ -1161,9 +1326,9 @@ ImageProxyGroup* ImageProxyGroup::makeDyldCacheDylibsGroup(Diagnostics& diag, co
     // add every dylib in shared cache to _images
     uint32_t indexInGroup = 0;
     for (const DyldSharedCache::MappedMachO& mapping : cachedDylibs) {
-        ImageProxy* proxy = new ImageProxy(mapping, 0, indexInGroup++, true);
+        ImageProxy* proxy = groupProxy->makeProxy(mapping, 0, indexInGroup++, true);
         groupProxy->_images.push_back(proxy);
-        groupProxy->_pathToProxy[mapping.runtimePath] = proxy;
+        groupProxy->addPathToProxy(mapping.runtimePath, proxy);
     }
 
     // verify libdyld is compatible
@@ -1212,9 +1377,9 @@ ImageProxyGroup* ImageProxyGroup::makeOtherOsGroup(Diagnostics& diag, const Dyld
     // add every dylib/bundle in "other: list to _images
     uint32_t indexInGroup = 0;
     for (const DyldSharedCache::MappedMachO& mapping : otherDylibsAndBundles) {
-        ImageProxy* proxy = new ImageProxy(mapping, 1, indexInGroup++, true);
+        ImageProxy* proxy = groupProxy->makeProxy(mapping, 1, indexInGroup++, true);
         groupProxy->_images.push_back(proxy);
-        groupProxy->_pathToProxy[mapping.runtimePath] = proxy;
+        groupProxy->addPathToProxy(mapping.runtimePath, proxy);
     }
 
     // wire up dependents
@@ -1267,13 +1432,13 @@ const BinaryImageGroupData* ImageProxyGroup::makeDlopenGroup(Diagnostics& diag,
         return nullptr;
     }
 
-    ImageProxy* topImageProxy = new ImageProxy(*topMapping, groupNum, 0, false);
+    ImageProxy* topImageProxy = dlopenGroupProxy.makeProxy(*topMapping, groupNum, 0, false);
     if ( topImageProxy == nullptr ) {
         diag.error("can't find slice matching dyld cache in %s", imagePath.c_str());
         return nullptr;
     }
     dlopenGroupProxy._images.push_back(topImageProxy);
-    dlopenGroupProxy._pathToProxy[imagePath] = topImageProxy;
+    dlopenGroupProxy.addPathToProxy(imagePath, topImageProxy);
 
     // add all dylibs needed by dylib and are not in dyld cache
     topImageProxy->addDependentsDeep(dlopenGroupProxy, nullptr, false);
@@ -1304,13 +1469,13 @@ BinaryClosureData* ImageProxyGroup::makeClosure(Diagnostics& diag, const DyldCac
     ImageProxyGroup mainClosureGroupProxy(2, dyldCache, nullptr, otherOsDylibs, mainProgMapping.runtimePath, existingGroups, buildTimePrefixes,
                                           emptyEnvVars, false, true, inodesAreSameAsRuntime);
 
-    ImageProxy* mainProxy = new ImageProxy(mainProgMapping, 2, 0, true);
+    ImageProxy* mainProxy = mainClosureGroupProxy.makeProxy(mainProgMapping, 2, 0, true);
     if ( mainProxy == nullptr ) {
         diag.error("can't find slice matching dyld cache in %s", mainProgMapping.runtimePath.c_str());
         return nullptr;
     }
     mainClosureGroupProxy._images.push_back(mainProxy);
-    mainClosureGroupProxy._pathToProxy[mainProgMapping.runtimePath] = mainProxy;
+    mainClosureGroupProxy.addPathToProxy(mainProgMapping.runtimePath, mainProxy);
 
     return mainClosureGroupProxy.makeClosureBinary(diag, mainProxy, false);
 }
@@ -1514,7 +1679,7 @@ const BinaryImageGroupData* ImageProxyGroup::makeDlopenGroup(Diagnostics& diag,
     }
 
     // make ImageProxy for top level dylib
-    ImageProxy* topImageProxy = new ImageProxy(*topMapping, groupCount, 0, false);
+    ImageProxy* topImageProxy = dlopenGroupProxy.makeProxy(*topMapping, groupCount, 0, false);
     if ( topImageProxy == nullptr ) {
         diag.error("can't find slice matching dyld cache in %s", targetDylib);
         if ( deallocCacheCopy )
@@ -1522,7 +1687,7 @@ const BinaryImageGroupData* ImageProxyGroup::makeDlopenGroup(Diagnostics& diag,
         return nullptr;
     }
     dlopenGroupProxy._images.push_back(topImageProxy);
-    dlopenGroupProxy._pathToProxy[targetDylib] = topImageProxy;
+    dlopenGroupProxy.addPathToProxy(targetDylib, topImageProxy);
 
     // add all dylibs needed by dylib and are not in dyld cache
     topImageProxy->addDependentsDeep(dlopenGroupProxy, nullptr, false);
@@ -1582,6 +1747,79 @@ const char* sSkipPrograms_macOS[] = {
     "/Applications/iBooks.app/Contents/MacOS/iBooks",
 };
 
+bool ImageProxyGroup::closureStillValid(const DyldCacheParser& dyldCache, const BinaryClosureData* closureData)
+{
+    launch_cache::Closure closure(closureData);
+
+    // closure must have been built against this dyld cache
+    uuid_t currentCacheUUID;
+    dyldCache.cacheHeader()->getUUID(currentCacheUUID);
+    if ( memcmp(currentCacheUUID, *closure.dyldCacheUUID(), sizeof(uuid_t)) != 0 )
+        return false;
+
+    // any file that was missing when the closure was built must still be missing
+    __block bool valid = true;
+    closure.forEachMustBeMissingFile(^(const char* path, bool& stop) {
+        if ( fileExists(path) ) {
+            valid = false;
+            stop = true;
+        }
+    });
+    if ( !valid )
+        return false;
+
+    // every image in the closure, and every cached image they depend on, must be unchanged
+    const BinaryImageGroupData* groups[3] = { dyldCache.cachedDylibsGroup(), dyldCache.otherDylibsGroup(), closure.group().binaryData() };
+    launch_cache::ImageGroupList groupList(3, groups);
+    std::unordered_set<const BinaryImageData*> allImages;
+    launch_cache::ImageGroup closureGroup = closure.group();
+    for (uint32_t i=0; i < closureGroup.imageCount(); ++i) {
+        launch_cache::Image image = closureGroup.image(i);
+        allImages.insert(image.binaryData());
+        if ( !image.recurseAllDependentImages(groupList, allImages) )
+            return false;
+    }
+    for (const BinaryImageData* imageData : allImages) {
+        if ( !imageFileStillValid(launch_cache::Image(imageData)) )
+            return false;
+    }
+    return true;
+}
+
+bool ImageProxyGroup::mainExecutableCdHash(const std::string& path, const std::string& archName, uint8_t cdHash[20])
+{
+    size_t mappedSize;
+    const void* mapped = mapFileReadOnly(path, mappedSize);
+    if ( mapped == nullptr )
+        return false;
+
+    const void* slice    = mapped;
+    size_t      sliceLen = mappedSize;
+    size_t      sliceOffset;
+    bool        missingSlice;
+    Diagnostics fatDiag;
+    if ( FatUtil::isFatFileWithSlice(fatDiag, mapped, mappedSize, archName, sliceOffset, sliceLen, missingSlice) )
+        slice = (uint8_t*)mapped + sliceOffset;
+    else if ( fatDiag.hasError() || missingSlice )
+        slice = nullptr;
+
+    bool result = false;
+    Diagnostics machoDiag;
+    if ( (slice != nullptr) && MachOParser::isValidMachO(machoDiag, archName, MachOParser::currentPlatform(), slice, sliceLen, path, false) ) {
+        MachOParser parser((mach_header*)slice);
+        if ( parser.getCDHash(cdHash) ) {
+            result = true;
+        }
+        else {
+            // if no code signature, fill in 16-bytes with UUID then 4 bytes of zero
+            bzero(cdHash, 20);
+            result = parser.getUuid(cdHash);
+        }
+    }
+    ::munmap((void*)mapped, mappedSize);
+    return result;
+}
+
 const char* sSkipPrograms_embeddedOSes[] = {
     "/sbin/launchd",
     "/usr/local/sbin/launchd.debug",
@@ -1808,6 +2046,7 @@ const BinaryImageGroupData* ImageProxyGroup::makeImageGroupBinary(Diagnostics& d
     // malloc a buffer and fill in ImageGroup part
     BinaryImageGroupData* groupData = (BinaryImageGroupData*)malloc(groupWriter.size());
     groupWriter.finalizeTo(diag, _knownGroups, groupData);
+    _sharedFixupBytes = groupWriter.sharedFixupBytes();
 
     if ( !continueIfErrors && groupWriter.isInvalid(0) ) {
         free((void*)groupData);
@@ -2321,6 +2560,7 @@ void ImageProxyGroup::populateGroupWriter(Diagnostics& diag, launch_cache::Image
         }
         groupWriter.setImageInitBefore(imageIndex, inits);
     }
+    sTotalInitOrderTime += _initOrderTime;
 
     // pass 7: compute DOFs
     for (uint32_t imageIndex=0; imageIndex < imageCount; ++imageIndex) {
@@ -27,11 +27,14 @@
 #define ImageProxy_h
 
 #include <stdint.h>
+#include <string.h>
 
 #include <string>
 #include <vector>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
+#include <atomic>
 
 #include "DyldSharedCache.h"
 #include "Diagnostics.h"
@@ -58,16 +61,86 @@ typedef launch_cache::ImageGroupList                    ImageGroupList;
 
 class ImageProxyGroup;
 
+//
+// Bump-pointer allocator owned by an ImageProxyGroup.  Proxies, their dependent
+// and rpath lists, and interned paths all come from the arena and are released
+// together when the group is destroyed.  Nothing is freed individually, so a
+// growing vector leaves its old storage behind until then.
+//
+class ImageProxyArena
+{
+public:
+                    ImageProxyArena() = default;
+                    ~ImageProxyArena();
+                    ImageProxyArena(const ImageProxyArena&) = delete;
+    ImageProxyArena& operator=(const ImageProxyArena&) = delete;
+
+    void*           allocate(size_t size, size_t alignment);
+    const char*     intern(const char* str);
+    const char*     intern(const std::string& str) { return intern(str.c_str()); }
+    uint64_t        bytesUsed() const       { return _bytesUsed; }
+    uint64_t        bytesReserved() const   { return _bytesReserved; }
+
+private:
+    struct Chunk {
+        Chunk*      next;
+        size_t      size;
+    };
+    enum { kChunkSize = 256*1024 };
+
+    Chunk*          _chunks         = nullptr;
+    uint8_t*        _cur            = nullptr;
+    uint8_t*        _end            = nullptr;
+    uint64_t        _bytesUsed      = 0;
+    uint64_t        _bytesReserved  = 0;
+};
+
+template <typename T>
+struct ImageProxyArenaAllocator
+{
+    typedef T value_type;
+
+                    ImageProxyArenaAllocator(ImageProxyArena& arena) : _arena(&arena) { }
+    template <typename U>
+                    ImageProxyArenaAllocator(const ImageProxyArenaAllocator<U>& other) : _arena(other._arena) { }
+
+    T*              allocate(size_t count)          { return (T*)_arena->allocate(count*sizeof(T), alignof(T)); }
+    void            deallocate(T*, size_t)          { }
+
+    template <typename U>
+    bool            operator==(const ImageProxyArenaAllocator<U>& other) const { return (_arena == other._arena); }
+    template <typename U>
+    bool            operator!=(const ImageProxyArenaAllocator<U>& other) const { return (_arena != other._arena); }
+
+    ImageProxyArena* _arena;
+};
+
+struct CStringHash {
+    size_t operator()(const char* str) const {
+        size_t hash = 0;
+        for (const char* s=str; *s != '\0'; ++s)
+            hash = (hash * 33) + *s;
+        return hash;
+    }
+};
+
+struct CStringEquals {
+    bool operator()(const char* left, const char* right) const { return (strcmp(left, right) == 0); }
+};
+
+
 class ImageProxy
 {
 public:
-                            ImageProxy(const mach_header* mh, const BinaryImageData* image, uint32_t indexInGroup, bool dyldCacheIsRaw);
-                            ImageProxy(const DyldSharedCache::MappedMachO& mapping, uint32_t groupNum, uint32_t indexInGroup, bool dyldCacheIsRaw);
+    typedef std::vector<const char*, ImageProxyArenaAllocator<const char*>> PathList;
+
+                            ImageProxy(const mach_header* mh, const BinaryImageData* image, uint32_t indexInGroup, bool dyldCacheIsRaw, ImageProxyArena& arena);
+                            ImageProxy(const DyldSharedCache::MappedMachO& mapping, uint32_t groupNum, uint32_t indexInGroup, bool dyldCacheIsRaw, ImageProxyArena& arena);
 
     struct RPathChain {
         ImageProxy*                         inProxy;
         const RPathChain*                   prev;
-        const std::vector<std::string>&     rpaths;
+        const PathList&                     rpaths;
     };
 
     struct InitOrderInfo {
@@ -105,6 +178,7 @@ public:
     ImageRef                overrideOf() const              { return _overrideOf; }
     bool                    inLibSystem() const;
     void                    setCwdMustBeThisDir()           { _cwdMustBeThisDir = true; }
+    void                    setPrebuiltImageData(const BinaryImageData* image) { _prebuiltImageData = image; }
     void                    setPlatformBinary()             { _platformBinary = true; }
     void                    setOverrideOf(uint32_t groupNum, uint32_t indexInGroup);
     void                    checkIfImageOverride(const std::string& runtimeLoadPath);
@@ -114,7 +188,7 @@ public:
     void                    convertInitBeforeInfoToArray(ImageProxyGroup& owningGroup);
     void                    addToFlatLookup(std::vector<ImageProxy*>& imageList);
     const std::vector<ImageRef>&    getInitBeforeList(ImageProxyGroup& owningGroup);
-    const std::vector<std::string>& rpaths() { return _rpaths; }
+    const PathList&         rpaths() { return _rpaths; }
 
 private:
     void                    processRPaths(ImageProxyGroup& owningGroup);
@@ -130,13 +204,15 @@ private:
     uint32_t               const _groupNum;
     uint32_t               const _indexInGroup;
     bool                         _platformBinary;
+    ImageProxyArena&             _arena;
     Diagnostics                  _diag;
-    std::vector<ImageProxy*>     _dependents;
-    std::vector<LinkKind>        _dependentsKind;
-    std::vector<std::string>     _rpaths;
+    std::vector<ImageProxy*, ImageProxyArenaAllocator<ImageProxy*>> _dependents;
+    std::vector<LinkKind, ImageProxyArenaAllocator<LinkKind>>       _dependentsKind;
+    PathList                     _rpaths;
     InitOrderInfo                _initBeforesInfo;
     std::vector<ImageRef>        _initBeforesArray;
     ImageRef                     _overrideOf;
+    const BinaryImageData*       _prebuiltImageData;  // set if proxy is for image in an already built group 1
     bool                         _directDependentsSet;
     bool                         _deepDependentsSet;
     bool                         _initBeforesArraySet;
@@ -168,6 +244,9 @@ public:
 
      const BinaryImageGroupData*    makeImageGroupBinary(Diagnostics& diag, const char* const neverEliminateStubs[]=nullptr);
 
+    // Bytes of fixup opcodes shared between pages by the last makeImageGroupBinary() of this group.
+    uint64_t                        sharedFixupBytes() const { return _sharedFixupBytes; }
+
     // used when building dyld shared cache
     static BinaryClosureData*       makeClosure(Diagnostics& diag, const DyldCacheParser& dyldCache, ImageProxyGroup* cachedDylibsGroup,
                                                 ImageProxyGroup* otherOsDylibs, const DyldSharedCache::MappedMachO& mainProg,
@@ -200,6 +279,37 @@ public:
                                                const std::vector<std::string>& buildTimePrefixes={},
                                                const std::vector<std::string>& envVars={});
 
+    //
+    // Used by closured and dyld_closure_util to decide if a previously built closure can be reused.
+    // Returns false if any file the closure depends on has changed, or a file that
+    // the closure expects to be missing now exists.
+    //
+    static bool                     closureStillValid(const DyldCacheParser& dyldCache, const BinaryClosureData* closure);
+
+    //
+    // Computes the cdHash of the slice of the main executable that a closure would be built
+    // for.  If the slice is not code signed, the UUID is used (same as in the closure).
+    //
+    static bool                     mainExecutableCdHash(const std::string& path, const std::string& archName, uint8_t cdHash[20]);
+
+    // Number of stat()s skipped because a search path variant was already known to be missing,
+    // summed over all ImageProxyGroups destroyed so far.
+    static uint64_t                 totalFileChecksAvoided() { return sTotalFileChecksAvoided; }
+
+    // Time (in mach_absolute_time() units) spent in recursiveBuildInitBeforeInfo(), summed over all groups built so far.
+    static uint64_t                 totalInitOrderTime() { return sTotalInitOrderTime; }
+
+    // Time (in mach_absolute_time() units) this group spent in recursiveBuildInitBeforeInfo().
+    uint64_t                        initOrderTime() const { return _initOrderTime; }
+
+    //
+    // Installs a handler called as each ImageProxyGroup is destroyed, with the bytes
+    // its arena handed out and the peak resident size of the process so far.
+    // Used by cache and closure builders to track memory use.
+    //
+    typedef void                    (^MemoryStatsHandler)(uint32_t groupNum, uint64_t arenaBytes, uint64_t peakResidentBytes);
+    static void                     setMemoryStatsHandler(MemoryStatsHandler handler);
+
 
 private:
     friend class ImageProxy;
@@ -214,6 +324,9 @@ private:
     ImageProxy*                     findImage(Diagnostics& diag, const std::string& runtimePath, bool canBeMissing, ImageProxy::RPathChain*);
     ImageProxy*                     findAbsoluteImage(Diagnostics& diag, const std::string& runtimePath, bool canBeMissing, bool makeErrorMessage, bool pathIsReal=false);
     bool                            builtImageStillValid(const launch_cache::Image& image);
+    bool                            builtImageClosureStillValid(const launch_cache::Image& image, uint32_t imageIndex);
+    bool                            builtImageStillValidCached(const launch_cache::Image& image);
+    static bool                     imageFileStillValid(const launch_cache::Image& image);
     const std::string&              mainProgRuntimePath() { return _mainProgRuntimePath; }
     DyldSharedCache::MappedMachO*   addMappingIfValidMachO(Diagnostics& diag, const std::string& runtimePath, bool ignoreMainExecutables=false);
     BinaryClosureData*              makeClosureBinary(Diagnostics& diag, ImageProxy* mainProg, bool includeDylibsInDir);
@@ -224,7 +337,14 @@ private:
     void                            addExtraMachOsInBundle(const std::string& appDir);
     bool                            addInsertedDylibs(Diagnostics& diag);
     std::vector<ImageProxy*>        flatLookupOrder();
+    template <typename... Args>
+    ImageProxy*                     makeProxy(Args&&... args);
+    void                            addPathToProxy(const std::string& path, ImageProxy* proxy);
+
+    typedef std::unordered_map<const char*, ImageProxy*, CStringHash, CStringEquals,
+                               ImageProxyArenaAllocator<std::pair<const char* const, ImageProxy*>>> PathToProxyMap;
 
+    ImageProxyArena                                 _arena;     // must outlive everything allocated from it
     PathOverrides                                   _pathOverrides;
     const BinaryImageGroupData*                     _basedOn;   // if not null, then lazily populate _images
     const PatchTable*                               _patchTable;
@@ -237,7 +357,7 @@ private:
     uint32_t                                        _mainExecutableIndex;
     std::vector<const BinaryImageGroupData*>        _knownGroups;
     std::vector<ImageProxy*>                        _images;
-    std::unordered_map<std::string, ImageProxy*>    _pathToProxy;
+    PathToProxyMap                                  _pathToProxy;
     std::vector<DyldSharedCache::MappedMachO>       _ownedMappings;
     std::vector<std::string>                        _buildTimePrefixes;
     std::vector<DyldCacheOverride>                  _cacheOverrides;
@@ -245,6 +365,16 @@ private:
     std::string                                     _archName;
     Platform                                        _platform;
     std::set<std::string>                           _mustBeMissingFiles;
+    std::unordered_set<std::string>                 _pathsNotFound;
+    uint64_t                                        _fileChecksAvoided = 0;
+    uint64_t                                        _sharedFixupBytes = 0;
+    uint64_t                                        _initOrderTime = 0;
+    std::unordered_map<uint32_t, bool>              _builtClosureValid;     // image index -> whole closure unchanged since build
+    std::unordered_map<const BinaryImageData*, bool> _builtImageValid;      // built image -> file unchanged since build
+
+    static std::atomic<uint64_t>                    sTotalFileChecksAvoided;
+    static MemoryStatsHandler                       sMemoryStatsHandler;
+    static std::atomic<uint64_t>                    sTotalInitOrderTime;
 };
 
 
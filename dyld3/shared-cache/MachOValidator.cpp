@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2017 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <dispatch/dispatch.h>
+
+#include <string>
+#include <vector>
+
+#include "MachOValidator.h"
+
+
+namespace dyld3 {
+
+static const char sMagic[8] = { 'd', 'y', 'l', 'd', 'v', 'a', 'l', '2' };
+
+
+bool MachOValidator::Key::operator==(const Key& other) const
+{
+    return (device == other.device) && (inode == other.inode) && (changeTime == other.changeTime) && (fileSize == other.fileSize)
+        && (sliceOffset == other.sliceOffset) && (cpuType == other.cpuType) && (cpuSubtype == other.cpuSubtype);
+}
+
+size_t MachOValidator::KeyHash::operator()(const Key& key) const
+{
+    size_t result = std::hash<uint64_t>()(key.inode);
+    result = result * 31 + std::hash<uint64_t>()(key.device);
+    result = result * 31 + std::hash<uint64_t>()(key.changeTime);
+    result = result * 31 + std::hash<uint64_t>()(key.fileSize);
+    result = result * 31 + std::hash<uint64_t>()(key.sliceOffset);
+    result = result * 31 + key.cpuType;
+    result = result * 31 + key.cpuSubtype;
+    return result;
+}
+
+
+MachOValidator::MachOValidator(Platform platform, bool ignoreMainExecutables)
+    : _platform(platform), _ignoreMainExecutables(ignoreMainExecutables)
+{
+}
+
+uint64_t MachOValidator::changeTime(const struct stat& statBuf)
+{
+    return (uint64_t)statBuf.st_ctimespec.tv_sec * 1000000000ULL + (uint64_t)statBuf.st_ctimespec.tv_nsec;
+}
+
+MachOValidator::Key MachOValidator::makeKey(const File& file)
+{
+    Key key;
+    key.device      = file.device;
+    key.inode       = file.inode;
+    key.changeTime  = file.changeTime;
+    key.fileSize    = file.fileSize;
+    key.sliceOffset = file.sliceOffset;
+    key.cpuType     = MachOParser::cpuTypeFromArchName(file.archName);
+    key.cpuSubtype  = MachOParser::cpuSubtypeFromArchName(file.archName);
+    return key;
+}
+
+// the UUID of the binary this code is linked into, so a newer validator never trusts an older one's results
+void MachOValidator::getToolUUID(uuid_t uuid)
+{
+    uuid_clear(uuid);
+    Dl_info info;
+    if ( (dladdr((void*)&MachOValidator::getToolUUID, &info) != 0) && (info.dli_fbase != nullptr) )
+        MachOParser((const mach_header*)info.dli_fbase).getUuid(uuid);
+}
+
+bool MachOValidator::load(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if ( fd == -1 )
+        return false;
+    bool success = false;
+    FileHeader header;
+    struct stat statBuf;
+    uuid_t toolUUID;
+    getToolUUID(toolUUID);
+    if ( (::fstat(fd, &statBuf) == 0) && (::pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)) ) {
+        // results from another build of the tool, another platform or mode, or a truncated file, are not used
+        if ( (memcmp(header.magic, sMagic, sizeof(sMagic)) == 0) && (uuid_compare(header.toolUUID, toolUUID) == 0)
+          && (header.platform == (uint32_t)_platform) && (header.ignoreMainExecutables == _ignoreMainExecutables)
+          && ((uint64_t)statBuf.st_size == sizeof(header) + header.count*sizeof(Key)) ) {
+            std::vector<Key> keys(header.count);
+            size_t keysSize = header.count*sizeof(Key);
+            if ( (keysSize == 0) || (::pread(fd, &keys[0], keysSize, sizeof(header)) == (ssize_t)keysSize) ) {
+                _previouslyValid.insert(keys.begin(), keys.end());
+                _stats.loaded = keys.size();
+                success = true;
+            }
+        }
+    }
+    ::close(fd);
+    return success;
+}
+
+bool MachOValidator::save(const std::string& path) const
+{
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, sMagic, sizeof(sMagic));
+    getToolUUID(header.toolUUID);
+    header.platform              = (uint32_t)_platform;
+    header.ignoreMainExecutables = _ignoreMainExecutables;
+    header.count                 = _valid.size();
+    std::vector<Key> keys(_valid.begin(), _valid.end());
+    size_t keysSize = keys.size()*sizeof(Key);
+
+    // write to temp file, then rename so the next run never sees a partial file
+    std::string tempPath = path + "-XXXXXX";
+    std::vector<char> tempPathSpace(tempPath.begin(), tempPath.end());
+    tempPathSpace.push_back('\0');
+    int fd = ::mkstemp(&tempPathSpace[0]);
+    if ( fd == -1 )
+        return false;
+    bool success = false;
+    if ( (::pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header))
+      && ((keysSize == 0) || (::pwrite(fd, &keys[0], keysSize, sizeof(header)) == (ssize_t)keysSize)) ) {
+        ::fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+        success = ( ::rename(&tempPathSpace[0], path.c_str()) == 0 );
+    }
+    ::close(fd);
+    if ( !success )
+        ::unlink(&tempPathSpace[0]);
+    return success;
+}
+
+void MachOValidator::validate(const std::vector<File>& files, std::vector<Result>& results)
+{
+    results.clear();
+    results.resize(files.size());
+
+    // look up all files first, so the concurrent part only touches its own Result
+    std::vector<Key>    keys;
+    std::vector<size_t> toValidate;
+    keys.reserve(files.size());
+    for (size_t i=0; i < files.size(); ++i) {
+        keys.push_back(makeKey(files[i]));
+        if ( (_previouslyValid.count(keys.back()) != 0) || (_valid.count(keys.back()) != 0) ) {
+            results[i].valid     = true;
+            results[i].fromCache = true;
+            _valid.insert(keys.back());
+            ++_stats.cacheHits;
+        }
+        else {
+            toValidate.push_back(i);
+        }
+    }
+
+    const File*   filesArray    = files.data();
+    Result*       resultsArray  = results.data();
+    const size_t* indexArray    = toValidate.data();
+    Platform      platform      = _platform;
+    bool          ignoreMainExe = _ignoreMainExecutables;
+    dispatch_apply(toValidate.size(), dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t n) {
+        const File& file   = filesArray[indexArray[n]];
+        Result&     result = resultsArray[indexArray[n]];
+        result.valid = MachOParser::isValidMachO(result.diag, file.archName, platform, file.content, file.length, file.path, ignoreMainExe);
+    });
+    _stats.validated += toValidate.size();
+
+    // only remember files that had nothing to report, so a cached result never hides a warning
+    for (size_t i : toValidate) {
+        if ( results[i].valid && results[i].diag.noError() && results[i].diag.warnings().empty() )
+            _valid.insert(keys[i]);
+    }
+}
+
+
+} // namespace dyld3
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2017 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+#ifndef MachOValidator_h
+#define MachOValidator_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <uuid/uuid.h>
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <functional>
+
+#include "MachOParser.h"
+#include "Diagnostics.h"
+
+namespace dyld3 {
+
+//
+// Validates a batch of mapped mach-o files with MachOParser::isValidMachO().  The files are
+// checked concurrently, each with its own Diagnostics.  Files that pass with no warnings are
+// remembered by device, inode, change time (to the nanosecond), file size, slice offset and arch.
+// That set can be saved to disk and loaded by the next run of the same build of the tool, so
+// unchanged files are not checked again.
+//
+// validate() must not be called on the same validator from more than one thread at a time.
+//
+class VIS_HIDDEN MachOValidator
+{
+public:
+    struct File
+    {
+        const void*     content;
+        size_t          length;
+        std::string     path;
+        std::string     archName;
+        uint64_t        device;
+        uint64_t        inode;
+        uint64_t        changeTime;     // from changeTime()
+        uint64_t        fileSize;
+        uint64_t        sliceOffset;
+    };
+
+    // st_ctimespec in nanoseconds, which changes on any write to the file, even within one second
+    static uint64_t     changeTime(const struct stat& statBuf);
+
+    struct Result
+    {
+        bool            valid     = false;
+        bool            fromCache = false;
+        Diagnostics     diag;
+    };
+
+    struct Stats
+    {
+        uint64_t        cacheHits = 0;
+        uint64_t        validated = 0;
+        uint64_t        loaded    = 0;
+    };
+
+                        MachOValidator(Platform platform, bool ignoreMainExecutables);
+
+    // loads results saved by a previous run, returns false if there is no usable file
+    bool                load(const std::string& path);
+    // saves the files that passed in this run, so files no longer present are dropped
+    bool                save(const std::string& path) const;
+
+    // results is resized to match files
+    void                validate(const std::vector<File>& files, std::vector<Result>& results);
+    const Stats&        stats() const { return _stats; }
+
+private:
+    struct Key
+    {
+        uint64_t        device;
+        uint64_t        inode;
+        uint64_t        changeTime;
+        uint64_t        fileSize;
+        uint64_t        sliceOffset;
+        uint32_t        cpuType;
+        uint32_t        cpuSubtype;
+
+        bool            operator==(const Key& other) const;
+    };
+
+    struct KeyHash
+    {
+        size_t          operator()(const Key& key) const;
+    };
+
+    struct FileHeader
+    {
+        char            magic[8];       // "dyldval2"
+        uuid_t          toolUUID;       // results from another build of the validator are not used
+        uint32_t        platform;
+        uint32_t        ignoreMainExecutables;
+        uint64_t        count;
+    };
+
+    typedef std::unordered_set<Key, KeyHash> KeySet;
+
+    static Key          makeKey(const File& file);
+    static void         getToolUUID(uuid_t uuid);
+
+    Platform            _platform;
+    bool                _ignoreMainExecutables;
+    KeySet              _previouslyValid;   // from load()
+    KeySet              _valid;             // passed in this run
+    Stats               _stats;
+};
+
+
+} // namespace dyld3
+
+#endif // MachOValidator_h
@@ -277,6 +277,7 @@ BuildQueueEntry Manifest::makeQueueEntry(const std::string& outputPath, const st
     options.dylibsRemovedDuringMastering = true;
     options.inodesAreSameAsRuntime = false;
     options.cacheSupportsASLR = true;
+    options.slideInfoV3 = false;
     options.forSimulator = false;
     options.verbose = verbose;
     options.evictLeafDylibsOnOverflow = true;
@@ -611,6 +612,7 @@ void Manifest::insert(std::vector<DyldSharedCache::MappedMachO>& mappedMachOs, c
     auto info = infoForUUID(imageInfo.uuid);
     auto runtimePath = info.runtimePath;
     mappedMachOs.emplace_back(runtimePath, info.mh, info.size, false, false, info.sliceFileOffset, 0, 0);
+    mappedMachOs.back().buildPath = info.buildPath;
 }
 
 std::vector<DyldSharedCache::MappedMachO> Manifest::dylibsForCache(const std::string& configuration, const std::string& architecture)
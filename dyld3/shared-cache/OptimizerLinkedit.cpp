@@ -35,6 +35,7 @@
 #include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
+#include <functional>
 
 #include "MachOFileAbstraction.hpp"
 #include "Trie.hpp"
@@ -192,10 +193,12 @@ private:
 template <typename P>
 class AcceleratorTables {
 public:
-                AcceleratorTables(DyldSharedCache* cache, uint64_t linkeditStartAddr, Diagnostics& diag, const std::vector<LinkeditOptimizer<P>*>& optimizers);
+                AcceleratorTables(DyldSharedCache* cache, uint64_t linkeditStartAddr, Diagnostics& diag, const std::vector<LinkeditOptimizer<P>*>& optimizers,
+                                  const std::unordered_map<std::string, std::string>& dylibAliases);
 
     uint32_t    totalSize() const;
     void        copyTo(uint8_t* buffer);
+    void        dropExportIndexes();
 
 private:
     typedef typename P::E  E;
@@ -217,6 +220,9 @@ private:
         DepNode*     node;
     };
 
+    bool        buildDylibPathHash(const std::vector<std::pair<std::string, uint32_t>>& paths);
+    void        buildExportIndexes(const uint8_t* linkeditContent, uint64_t linkeditStartAddr);
+
     std::unordered_map<macho_header<P>*, DepNode>                   _depDAG;
     std::vector<dyld_cache_image_info_extra>                        _extraInfo;
     std::vector<uint8_t>                                            _trieBytes;
@@ -226,6 +232,12 @@ private:
     std::vector<dyld_cache_accelerator_initializer>                 _initializers;
     std::vector<dyld_cache_accelerator_dof>                         _dofSections;
     std::vector<dyld_cache_range_entry>                             _rangeTable;
+    std::vector<uint32_t>                                           _dylibHashDisplacements;
+    std::vector<dyld_cache_accelerator_dylib_slot>                  _dylibHashSlots;
+    std::vector<char>                                               _dylibHashStrings;
+    uint32_t                                                        _dylibHashSeed = 0;
+    std::vector<dyld_cache_accelerator_export_index>                _exportIndexes;
+    std::vector<dyld_cache_accelerator_export_entry>                _exportEntries;
     std::unordered_map<macho_header<P>*, uint32_t>                  _machHeaderToImageIndex;
     std::unordered_map<std::string, macho_header<P>*>               _dylibPathToMachHeader;
     std::unordered_map<macho_header<P>*, LinkeditOptimizer<P>*>     _machHeaderToOptimizer;
@@ -268,7 +280,8 @@ void AcceleratorTables<P>::AcceleratorTables::DepNode::verifyUnreachable(Acceler
 const uint16_t kBranchIslandDylibIndex = 0x7FFF;
 
 template <typename P>
-AcceleratorTables<P>::AcceleratorTables(DyldSharedCache* cache, uint64_t linkeditStartAddr, Diagnostics& diag, const std::vector<LinkeditOptimizer<P>*>& optimizers)
+AcceleratorTables<P>::AcceleratorTables(DyldSharedCache* cache, uint64_t linkeditStartAddr, Diagnostics& diag, const std::vector<LinkeditOptimizer<P>*>& optimizers,
+                                        const std::unordered_map<std::string, std::string>& dylibAliases)
 {
     // build table mapping tables to map between mach_header, index, and optimizer
     for ( LinkeditOptimizer<P>* op : optimizers ) {
@@ -431,6 +444,10 @@ AcceleratorTables<P>::AcceleratorTables(DyldSharedCache* cache, uint64_t linkedi
         _extraInfo[index].weakBindingsSize = op->weakBindingLinkEditSize();
     }
 
+    // build flattened export index for each image that re-exports other images
+    const dyld_cache_mapping_info& linkeditMapping = mappings[cache->header.mappingCount-1];
+    buildExportIndexes((uint8_t*)cache + linkeditMapping.fileOffset + (linkeditStartAddr - linkeditMapping.address), linkeditStartAddr);
+
     // record location of __DATA/__dyld section in libdyld.dylib
     macho_header<P>* libdyldMH = _dylibPathToMachHeader["/usr/lib/system/libdyld.dylib"];
     LinkeditOptimizer<P>* libdyldOp = _machHeaderToOptimizer[libdyldMH];
@@ -467,8 +484,24 @@ AcceleratorTables<P>::AcceleratorTables(DyldSharedCache* cache, uint64_t linkedi
     while ( (_trieBytes.size() % 4) != 0 )
         _trieBytes.push_back(0);
 
+    // build perfect hash that maps install names and symlink aliases to image index
+    std::vector<std::pair<std::string, uint32_t>> hashedPaths;
+    for (auto &x : _dylibPathToMachHeader) {
+        hashedPaths.push_back(std::make_pair(x.first, _machHeaderToImageIndex[x.second]));
+    }
+    for (auto &x : dylibAliases) {
+        if ( _dylibPathToMachHeader.count(x.first) != 0 )
+            continue;
+        auto pos = _dylibPathToMachHeader.find(x.second);
+        if ( pos == _dylibPathToMachHeader.end() )
+            continue;
+        hashedPaths.push_back(std::make_pair(x.first, _machHeaderToImageIndex[pos->second]));
+    }
+    if ( !buildDylibPathHash(hashedPaths) )
+        diag.warning("could not build perfect hash of %lu dylib paths", hashedPaths.size());
+
     // fill out header
-    _acceleratorInfoHeader.version              = 1;
+    _acceleratorInfoHeader.version              = 3;
     _acceleratorInfoHeader.imageExtrasCount     = (uint32_t)_extraInfo.size();
     _acceleratorInfoHeader.imagesExtrasOffset   = ALIGN_AS_TYPE(sizeof(dyld_cache_accelerator_info), dyld_cache_image_info_extra);
     _acceleratorInfoHeader.bottomUpListOffset   = _acceleratorInfoHeader.imagesExtrasOffset + _acceleratorInfoHeader.imageExtrasCount*sizeof(dyld_cache_image_info_extra);
@@ -485,6 +518,178 @@ AcceleratorTables<P>::AcceleratorTables(DyldSharedCache* cache, uint64_t linkedi
     _acceleratorInfoHeader.rangeTableOffset     = ALIGN_AS_TYPE(_acceleratorInfoHeader.depListOffset + _acceleratorInfoHeader.depListCount*sizeof(uint16_t), dyld_cache_range_entry);
     _acceleratorInfoHeader.rangeTableCount      = (uint32_t)_rangeTable.size();
     _acceleratorInfoHeader.dyldSectionAddr      = dyldSectionAddr;
+    _acceleratorInfoHeader.dylibHashSeed                = _dylibHashSeed;
+    _acceleratorInfoHeader.dylibHashBucketCount         = (uint32_t)_dylibHashDisplacements.size();
+    _acceleratorInfoHeader.dylibHashDisplacementsOffset = ALIGN_AS_TYPE(_acceleratorInfoHeader.rangeTableOffset + _acceleratorInfoHeader.rangeTableCount*sizeof(dyld_cache_range_entry), uint32_t);
+    _acceleratorInfoHeader.dylibHashSlotsOffset         = ALIGN_AS_TYPE(_acceleratorInfoHeader.dylibHashDisplacementsOffset + _acceleratorInfoHeader.dylibHashBucketCount*sizeof(uint32_t), dyld_cache_accelerator_dylib_slot);
+    _acceleratorInfoHeader.dylibHashSlotCount           = (uint32_t)_dylibHashSlots.size();
+    _acceleratorInfoHeader.dylibHashStringsOffset       = _acceleratorInfoHeader.dylibHashSlotsOffset + _acceleratorInfoHeader.dylibHashSlotCount*sizeof(dyld_cache_accelerator_dylib_slot);
+    _acceleratorInfoHeader.dylibHashStringsSize         = (uint32_t)_dylibHashStrings.size();
+    _acceleratorInfoHeader.dylibHashPad                 = 0;
+    _acceleratorInfoHeader.exportIndexesOffset          = ALIGN_AS_TYPE(_acceleratorInfoHeader.dylibHashStringsOffset + _acceleratorInfoHeader.dylibHashStringsSize, dyld_cache_accelerator_export_index);
+    _acceleratorInfoHeader.exportEntriesOffset          = _acceleratorInfoHeader.exportIndexesOffset + (uint32_t)(_exportIndexes.size()*sizeof(dyld_cache_accelerator_export_index));
+    _acceleratorInfoHeader.exportEntriesCount           = (uint32_t)_exportEntries.size();
+    _acceleratorInfoHeader.exportIndexPad               = 0;
+    if ( _exportEntries.empty() )
+        dropExportIndexes();
+    else
+        diag.verbose("  flattened export indexes: %u buckets, %luKB\n", _acceleratorInfoHeader.exportEntriesCount, _exportEntries.size()*sizeof(dyld_cache_accelerator_export_entry)/1024);
+
+    // slots were built with offsets into string pool, make them relative to start of chunk
+    for (dyld_cache_accelerator_dylib_slot& slot : _dylibHashSlots)
+        slot.pathOffset += _acceleratorInfoHeader.dylibHashStringsOffset;
+}
+
+
+template <typename P>
+void AcceleratorTables<P>::buildExportIndexes(const uint8_t* linkeditContent, uint64_t linkeditStartAddr)
+{
+    struct FoundExport { uint32_t nameHash; uint32_t imageIndex; uint32_t nodeOffset; };
+
+    // many umbrellas re-export the same dylibs, so parse each exports trie once
+    std::unordered_map<uint32_t, std::vector<ExportInfoTrie::EntryWithOffset>> parsedTries;
+    auto exportsOf = [&](uint32_t imageIndex) -> const std::vector<ExportInfoTrie::EntryWithOffset>& {
+        auto pos = parsedTries.find(imageIndex);
+        if ( pos != parsedTries.end() )
+            return pos->second;
+        std::vector<ExportInfoTrie::EntryWithOffset>& entries = parsedTries[imageIndex];
+        const dyld_cache_image_info_extra& extra = _extraInfo[imageIndex];
+        if ( extra.exportsTrieSize != 0 ) {
+            const uint8_t* start = linkeditContent + (extra.exportsTrieAddr - linkeditStartAddr);
+            ExportInfoTrie::parseTrie(start, start+extra.exportsTrieSize, entries);
+        }
+        return entries;
+    };
+
+    dyld_cache_accelerator_export_index noIndex = { 0, 0 };
+    _exportIndexes.assign(_extraInfo.size(), noIndex);
+    for (uint32_t umbrellaIndex=0; umbrellaIndex < _extraInfo.size(); ++umbrellaIndex) {
+        if ( _extraInfo[umbrellaIndex].reExportsStartArrayIndex == 0 )
+            continue;
+        // walk re-export tree in the same order as ImageLoaderMegaDylib::exportTrieHasNodeRecursive(), so first definition wins
+        std::vector<FoundExport>        found;
+        std::unordered_set<std::string> seenNames;
+        std::unordered_set<uint32_t>    visitedImages;
+        std::function<void(uint32_t)>   addExports = [&](uint32_t imageIndex) {
+            if ( !visitedImages.insert(imageIndex).second )
+                return;
+            for (const ExportInfoTrie::EntryWithOffset& entry : exportsOf(imageIndex)) {
+                if ( seenNames.insert(entry.entry.name).second )
+                    found.push_back({ dyld_cache_export_name_hash(entry.entry.name.c_str()), imageIndex, (uint32_t)entry.nodeOffset });
+            }
+            for (uint32_t i=_extraInfo[imageIndex].reExportsStartArrayIndex; _reExportArray[i] != 0xFFFF; ++i)
+                addExports(_reExportArray[i]);
+        };
+        addExports(umbrellaIndex);
+        if ( found.empty() )
+            continue;
+
+        // open addressed table, at most 75% full so probes always reach an empty bucket
+        uint32_t bucketCount = 1;
+        while ( bucketCount*3 < found.size()*4 )
+            bucketCount <<= 1;
+        uint32_t entriesStartIndex = (uint32_t)_exportEntries.size();
+        dyld_cache_accelerator_export_entry emptyEntry = { 0, 0, 0 };
+        _exportEntries.insert(_exportEntries.end(), bucketCount, emptyEntry);
+        for (const FoundExport& exp : found) {
+            uint32_t bucket = exp.nameHash & (bucketCount-1);
+            while ( _exportEntries[entriesStartIndex+bucket].nameHash != 0 )
+                bucket = (bucket + 1) & (bucketCount-1);
+            dyld_cache_accelerator_export_entry& entry = _exportEntries[entriesStartIndex+bucket];
+            entry.nameHash   = exp.nameHash;
+            entry.imageIndex = exp.imageIndex;
+            entry.nodeOffset = exp.nodeOffset;
+        }
+        _exportIndexes[umbrellaIndex].entriesStartIndex = entriesStartIndex;
+        _exportIndexes[umbrellaIndex].bucketCount       = bucketCount;
+    }
+}
+
+template <typename P>
+void AcceleratorTables<P>::dropExportIndexes()
+{
+    _exportIndexes.clear();
+    _exportEntries.clear();
+    _acceleratorInfoHeader.exportIndexesOffset = 0;
+    _acceleratorInfoHeader.exportEntriesOffset = 0;
+    _acceleratorInfoHeader.exportEntriesCount  = 0;
+}
+
+template <typename P>
+bool AcceleratorTables<P>::buildDylibPathHash(const std::vector<std::pair<std::string, uint32_t>>& paths)
+{
+    // hash-and-displace: each bucket of ~4 paths searches for a displacement that lands all its
+    // paths in unused slots.  Largest buckets are placed first while the table is mostly empty.
+    const uint32_t slotCount       = (uint32_t)paths.size();
+    const uint32_t bucketCount     = (slotCount + 3) / 4;
+    const uint32_t maxDisplacement = 64 * slotCount + 1024;
+    if ( slotCount == 0 )
+        return false;
+    for (uint32_t seed=0; seed < 16; ++seed) {
+        std::vector<uint64_t>               hashes(slotCount);
+        std::vector<std::vector<uint32_t>>  buckets(bucketCount);
+        for (uint32_t i=0; i < slotCount; ++i) {
+            hashes[i] = dyld_cache_dylib_path_hash(paths[i].first.c_str(), seed);
+            buckets[dyld_cache_dylib_hash_bucket(hashes[i], bucketCount)].push_back(i);
+        }
+        std::vector<uint32_t> bucketOrder(bucketCount);
+        for (uint32_t b=0; b < bucketCount; ++b)
+            bucketOrder[b] = b;
+        std::stable_sort(bucketOrder.begin(), bucketOrder.end(), [&](uint32_t l, uint32_t r) -> bool {
+            return (buckets[l].size() > buckets[r].size());
+        });
+
+        std::vector<uint32_t>   displacements(bucketCount, 0);
+        std::vector<uint32_t>   slotToPath(slotCount, UINT32_MAX);
+        std::vector<uint32_t>   candidateSlots;
+        bool                    placedAll = true;
+        for (uint32_t b : bucketOrder) {
+            const std::vector<uint32_t>& bucket = buckets[b];
+            if ( bucket.empty() )
+                break;
+            bool placed = false;
+            for (uint32_t d=0; (d < maxDisplacement) && !placed; ++d) {
+                candidateSlots.clear();
+                placed = true;
+                for (uint32_t pathIndex : bucket) {
+                    uint32_t slot = dyld_cache_dylib_hash_slot(hashes[pathIndex], d, slotCount);
+                    if ( (slotToPath[slot] != UINT32_MAX) || (std::find(candidateSlots.begin(), candidateSlots.end(), slot) != candidateSlots.end()) ) {
+                        placed = false;
+                        break;
+                    }
+                    candidateSlots.push_back(slot);
+                }
+                if ( placed ) {
+                    displacements[b] = d;
+                    for (size_t i=0; i < bucket.size(); ++i)
+                        slotToPath[candidateSlots[i]] = bucket[i];
+                }
+            }
+            if ( !placed ) {
+                placedAll = false;
+                break;
+            }
+        }
+        if ( !placedAll )
+            continue;
+
+        // lay out slots and path strings in slot order
+        _dylibHashSeed          = seed;
+        _dylibHashDisplacements = displacements;
+        _dylibHashSlots.resize(slotCount);
+        _dylibHashStrings.clear();
+        for (uint32_t slot=0; slot < slotCount; ++slot) {
+            const std::pair<std::string, uint32_t>& entry = paths[slotToPath[slot]];
+            _dylibHashSlots[slot].pathOffset = (uint32_t)_dylibHashStrings.size();
+            _dylibHashSlots[slot].imageIndex = entry.second;
+            _dylibHashStrings.insert(_dylibHashStrings.end(), entry.first.begin(), entry.first.end());
+            _dylibHashStrings.push_back('\0');
+        }
+        while ( (_dylibHashStrings.size() % 4) != 0 )
+            _dylibHashStrings.push_back('\0');
+        return true;
+    }
+    return false;
 }
 
 
@@ -504,7 +709,9 @@ void AcceleratorTables<P>::DepNode::computeDepth()
 template <typename P>
 uint32_t AcceleratorTables<P>::totalSize() const
 {
-    return (uint32_t)align(_acceleratorInfoHeader.rangeTableOffset + _acceleratorInfoHeader.rangeTableCount*sizeof(dyld_cache_range_entry), 14);
+    if ( _acceleratorInfoHeader.exportEntriesCount != 0 )
+        return (uint32_t)align(_acceleratorInfoHeader.exportEntriesOffset + _acceleratorInfoHeader.exportEntriesCount*sizeof(dyld_cache_accelerator_export_entry), 14);
+    return (uint32_t)align(_acceleratorInfoHeader.dylibHashStringsOffset + _acceleratorInfoHeader.dylibHashStringsSize, 14);
 }
 
 template <typename P>
@@ -519,6 +726,13 @@ void AcceleratorTables<P>::copyTo(uint8_t* buffer)
     memcpy(&buffer[_acceleratorInfoHeader.depListOffset],      &_dependencyArray[0], _dependencyArray.size()*sizeof(uint16_t));
     memcpy(&buffer[_acceleratorInfoHeader.rangeTableOffset],   &_rangeTable[0],      _rangeTable.size()*sizeof(dyld_cache_range_entry));
     memcpy(&buffer[_acceleratorInfoHeader.dylibTrieOffset],    &_trieBytes[0],       _trieBytes.size());
+    memcpy(&buffer[_acceleratorInfoHeader.dylibHashDisplacementsOffset], _dylibHashDisplacements.data(), _dylibHashDisplacements.size()*sizeof(uint32_t));
+    memcpy(&buffer[_acceleratorInfoHeader.dylibHashSlotsOffset],         _dylibHashSlots.data(),         _dylibHashSlots.size()*sizeof(dyld_cache_accelerator_dylib_slot));
+    memcpy(&buffer[_acceleratorInfoHeader.dylibHashStringsOffset],       _dylibHashStrings.data(),       _dylibHashStrings.size());
+    if ( _acceleratorInfoHeader.exportEntriesCount != 0 ) {
+        memcpy(&buffer[_acceleratorInfoHeader.exportIndexesOffset], _exportIndexes.data(), _exportIndexes.size()*sizeof(dyld_cache_accelerator_export_index));
+        memcpy(&buffer[_acceleratorInfoHeader.exportEntriesOffset], _exportEntries.data(), _exportEntries.size()*sizeof(dyld_cache_accelerator_export_entry));
+    }
 }
 
 
@@ -958,7 +1172,8 @@ void LinkeditOptimizer<P>::copyIndirectSymbolTable(uint8_t* newLinkEditContent,
 }
 
 template <typename P>
-uint64_t mergeLinkedits(DyldSharedCache* cache, bool dontMapLocalSymbols, bool addAcceleratorTables, std::vector<LinkeditOptimizer<P>*>& optimizers, Diagnostics& diagnostics, dyld_cache_local_symbols_info** localsInfo)
+uint64_t mergeLinkedits(DyldSharedCache* cache, bool dontMapLocalSymbols, bool addAcceleratorTables, const std::unordered_map<std::string, std::string>& dylibAliases,
+                        std::vector<LinkeditOptimizer<P>*>& optimizers, Diagnostics& diagnostics, dyld_cache_local_symbols_info** localsInfo)
 {
     // allocate space for new linkedit data
     uint32_t linkeditStartOffset = 0xFFFFFFFF;
@@ -1075,8 +1290,14 @@ uint64_t mergeLinkedits(DyldSharedCache* cache, bool dontMapLocalSymbols, bool a
 
     // If making cache for customers, add extra accelerator tables for dyld
     if ( addAcceleratorTables ) {
-        AcceleratorTables<P> tables(cache, linkeditStartAddr, diagnostics, optimizers);
+        AcceleratorTables<P> tables(cache, linkeditStartAddr, diagnostics, optimizers, dylibAliases);
         uint32_t tablesSize = tables.totalSize();
+        if ( tablesSize >= (totalUnoptLinkeditsSize-newLinkeditUnalignedSize) ) {
+            // flattened export indexes are optional, drop them before giving up on all accelerator tables
+            tables.dropExportIndexes();
+            tablesSize = tables.totalSize();
+            diagnostics.verbose("not enough room for flattened export indexes\n");
+        }
         if ( tablesSize < (totalUnoptLinkeditsSize-newLinkeditUnalignedSize) ) {
             tables.copyTo((uint8_t*)cache+newLinkeditEnd);
             newLinkeditEnd += tablesSize;
@@ -1143,7 +1364,8 @@ uint64_t mergeLinkedits(DyldSharedCache* cache, bool dontMapLocalSymbols, bool a
 } // anonymous namespace
 
 template <typename P>
-uint64_t optimizeLinkedit(DyldSharedCache* cache, bool dontMapLocalSymbols, bool addAcceleratorTables, const std::vector<uint64_t>& branchPoolOffsets, Diagnostics& diag, dyld_cache_local_symbols_info** localsInfo)
+uint64_t optimizeLinkedit(DyldSharedCache* cache, bool dontMapLocalSymbols, bool addAcceleratorTables, const std::vector<uint64_t>& branchPoolOffsets,
+                          const std::unordered_map<std::string, std::string>& dylibAliases, Diagnostics& diag, dyld_cache_local_symbols_info** localsInfo)
 {
     // construct a LinkeditOptimizer for each image
     __block std::vector<LinkeditOptimizer<P>*> optimizers;
@@ -1158,7 +1380,7 @@ uint64_t optimizeLinkedit(DyldSharedCache* cache, bool dontMapLocalSymbols, bool
     }
 #endif
     // merge linkedit info
-    uint64_t newFileSize = mergeLinkedits(cache, dontMapLocalSymbols, addAcceleratorTables, optimizers, diag, localsInfo);
+    uint64_t newFileSize = mergeLinkedits(cache, dontMapLocalSymbols, addAcceleratorTables, dylibAliases, optimizers, diag, localsInfo);
 
     // delete optimizers
     for (LinkeditOptimizer<P>* op : optimizers)
@@ -1167,13 +1389,14 @@ uint64_t optimizeLinkedit(DyldSharedCache* cache, bool dontMapLocalSymbols, bool
     return newFileSize;
 }
 
-uint64_t optimizeLinkedit(DyldSharedCache* cache, bool is64, bool dontMapLocalSymbols, bool addAcceleratorTables, const std::vector<uint64_t>& branchPoolOffsets, Diagnostics& diag, dyld_cache_local_symbols_info** localsInfo)
+uint64_t optimizeLinkedit(DyldSharedCache* cache, bool is64, bool dontMapLocalSymbols, bool addAcceleratorTables, const std::vector<uint64_t>& branchPoolOffsets,
+                          const std::unordered_map<std::string, std::string>& dylibAliases, Diagnostics& diag, dyld_cache_local_symbols_info** localsInfo)
 {
     if ( is64) {
-        return optimizeLinkedit<Pointer64<LittleEndian>>(cache, dontMapLocalSymbols, addAcceleratorTables, branchPoolOffsets, diag, localsInfo);
+        return optimizeLinkedit<Pointer64<LittleEndian>>(cache, dontMapLocalSymbols, addAcceleratorTables, branchPoolOffsets, dylibAliases, diag, localsInfo);
     }
     else {
-        return optimizeLinkedit<Pointer32<LittleEndian>>(cache, dontMapLocalSymbols, addAcceleratorTables, branchPoolOffsets, diag, localsInfo);
+        return optimizeLinkedit<Pointer32<LittleEndian>>(cache, dontMapLocalSymbols, addAcceleratorTables, branchPoolOffsets, dylibAliases, diag, localsInfo);
     }
 }
 
@@ -138,6 +138,14 @@ struct Trie {
 		Entry(const std::string& N, V I) : name(N), info(I) {}
 	};
 
+	struct EntryWithOffset
+	{
+		uintptr_t		nodeOffset;		// offset of terminal info, same as returned by dyld's trieWalk()
+		Entry			entry;
+
+		bool operator<(const EntryWithOffset& other) const { return ( nodeOffset < other.nodeOffset ); }
+	};
+
 	Trie(const std::vector<Entry>& entries) : count(0), nodeCount(1) {
 		// make nodes for all exported symbols
 		for (auto& entry : entries) {
@@ -189,6 +197,19 @@ struct Trie {
 		return true;
 	}
 
+	static
+	inline bool parseTrie(const uint8_t* start, const uint8_t* end, std::vector<EntryWithOffset>& output)
+	{
+		// empty trie has no entries
+		if ( start == end )
+			return false;
+		char cummulativeString[32768];
+		if ( !processExportNode(start, start, end, cummulativeString, 0, output) )
+			return false;
+		std::sort(output.begin(), output.end());
+		return true;
+	}
+
 private:
 	struct Node
 	{
@@ -248,14 +269,6 @@ private:
 
 	Node root;
 
-	struct EntryWithOffset
-	{
-		uintptr_t		nodeOffset;
-		Entry			entry;
-
-		bool operator<(const EntryWithOffset& other) const { return ( nodeOffset < other.nodeOffset ); }
-	};
-
 	void addEntry(const std::string& fullStr, std::string::const_iterator start, V v) {
 		Node *currentNode = &root;
 		bool done = false;
@@ -38,8 +38,10 @@
 #include <bootstrap.h>
 #include <mach/mach.h>
 #include <dispatch/dispatch.h>
+#include <mach/mach_time.h>
 
 #include <map>
+#include <memory>
 #include <vector>
 
 #include "LaunchCache.h"
@@ -49,6 +51,7 @@
 #include "ImageProxy.h"
 #include "StringUtils.h"
 #include "ClosureBuffer.h"
+#include "ClosureStore.h"
 
 extern "C" {
     #include "closuredProtocol.h"
@@ -99,6 +102,107 @@ static const CachedSections& find(uint32_t mappedOffset, const std::vector<Cache
     assert(0 && "invalid offset");
 }
 
+struct FixupEncodingStats
+{
+    uint64_t    fixupCount      = 0;
+    uint64_t    opcodeBytes     = 0;
+    uint64_t    chainedBytes    = 0;
+    uint64_t    opcodeTime      = 0;
+    uint64_t    chainedTime     = 0;
+};
+
+static dyld3::launch_cache::ImageGroupWriter::FixupType fixupTypeForKind(dyld3::launch_cache::Image::FixupKind kind)
+{
+    switch ( kind ) {
+        case dyld3::launch_cache::Image::FixupKind::rebase32:
+        case dyld3::launch_cache::Image::FixupKind::rebase64:
+            return dyld3::launch_cache::ImageGroupWriter::FixupType::rebase;
+        case dyld3::launch_cache::Image::FixupKind::bind32:
+        case dyld3::launch_cache::Image::FixupKind::bind64:
+            return dyld3::launch_cache::ImageGroupWriter::FixupType::pointerBind;
+        case dyld3::launch_cache::Image::FixupKind::rebaseText32:
+            return dyld3::launch_cache::ImageGroupWriter::FixupType::rebaseText;
+        case dyld3::launch_cache::Image::FixupKind::bindText32:
+            return dyld3::launch_cache::ImageGroupWriter::FixupType::bindText;
+        case dyld3::launch_cache::Image::FixupKind::bindTextRel32:
+            return dyld3::launch_cache::ImageGroupWriter::FixupType::bindTextRel;
+        case dyld3::launch_cache::Image::FixupKind::bindImportJmp32:
+            return dyld3::launch_cache::ImageGroupWriter::FixupType::bindImportJmpRel;
+    }
+    return dyld3::launch_cache::ImageGroupWriter::FixupType::ignore;
+}
+
+// walks an encoded SegmentFixupsByPage and applies it to a scratch copy of the segment, returns mach_absolute_time() units
+static uint64_t timeApplyFixups(const dyld3::launch_cache::ContentBuffer& encoded, std::vector<uint8_t>& scratch)
+{
+    const dyld3::launch_cache::binary_format::SegmentFixupsByPage* segFixups = (dyld3::launch_cache::binary_format::SegmentFixupsByPage*)encoded.start();
+    uint8_t* segContent = &scratch[0];
+    uint64_t start = mach_absolute_time();
+    for (uint32_t pageIndex=0; pageIndex < segFixups->pageCount; ++pageIndex) {
+        const uint8_t* opcodes = (uint8_t*)(segFixups) + segFixups->pageInfoOffsets[pageIndex];
+        uint8_t* pageContent = segContent + pageIndex*segFixups->pageSize;
+        uint32_t curOffset = 0;
+        uint32_t curOrdinal = 0;
+        dyld3::launch_cache::Image::forEachFixup(opcodes, segContent, curOffset, curOrdinal, ^(uint32_t pageOffset, dyld3::launch_cache::Image::FixupKind kind, uint32_t targetOrdinal, bool& stop) {
+            switch ( kind ) {
+                case dyld3::launch_cache::Image::FixupKind::rebase64:
+                    *(uint64_t*)(pageContent + pageOffset) += 0x1000;
+                    break;
+                case dyld3::launch_cache::Image::FixupKind::bind64:
+                    *(uint64_t*)(pageContent + pageOffset) = targetOrdinal;
+                    break;
+                case dyld3::launch_cache::Image::FixupKind::rebase32:
+                case dyld3::launch_cache::Image::FixupKind::rebaseText32:
+                    *(uint32_t*)(pageContent + pageOffset) += 0x1000;
+                    break;
+                default:
+                    *(uint32_t*)(pageContent + pageOffset) = targetOrdinal;
+                    break;
+            }
+        });
+    }
+    return mach_absolute_time() - start;
+}
+
+// re-encodes the fixups of every disk image in a closure with and without fixupChain64 runs
+static void compareFixupEncodings(const dyld3::launch_cache::Closure& closure, FixupEncodingStats& stats)
+{
+    dyld3::launch_cache::ImageGroup group = closure.group();
+    for (uint32_t imageIndex=0; imageIndex < group.imageCount(); ++imageIndex) {
+        dyld3::launch_cache::Image image = group.image(imageIndex);
+        if ( !image.isDiskImage() )
+            continue;
+        const uint32_t pageSize = (image.binaryData()->has16KBpages ? 0x4000 : 0x1000);
+        image.forEachDiskSegment(^(uint32_t segIndex, uint32_t fileOffset, uint32_t fileSize, int64_t vmOffset, uint64_t vmSize, uint8_t permissions, bool& stop) {
+            if ( !image.segmentHasFixups(segIndex) )
+                return;
+            __block std::vector<dyld3::launch_cache::ImageGroupWriter::FixUp> fixups;
+            __block bool is64 = false;
+            const dyld3::launch_cache::MemoryRange segContent = { nullptr, vmSize };
+            image.forEachFixup(segIndex, segContent, ^(uint64_t segOffset, dyld3::launch_cache::Image::FixupKind kind, dyld3::launch_cache::TargetSymbolValue value, bool& fixupStop) {
+                if ( (kind == dyld3::launch_cache::Image::FixupKind::rebase64) || (kind == dyld3::launch_cache::Image::FixupKind::bind64) )
+                    is64 = true;
+                fixups.push_back({segIndex, segOffset, fixupTypeForKind(kind), value});
+            });
+            uint32_t segPageCount = (uint32_t)((fileSize + pageSize - 1)/pageSize);
+            std::vector<dyld3::launch_cache::TargetSymbolValue> opcodeTargets;
+            std::vector<dyld3::launch_cache::TargetSymbolValue> chainedTargets;
+            dyld3::launch_cache::ContentBuffer opcodeEncoding;
+            dyld3::launch_cache::ContentBuffer chainedEncoding;
+            dyld3::launch_cache::ImageGroupWriter::encodeSegmentFixups(segIndex, segPageCount, pageSize, is64, false, fixups, opcodeTargets, opcodeEncoding);
+            dyld3::launch_cache::ImageGroupWriter::encodeSegmentFixups(segIndex, segPageCount, pageSize, is64, true, fixups, chainedTargets, chainedEncoding);
+            std::vector<uint8_t> scratch(segPageCount*pageSize + 8);
+            for (int i=0; i < 10; ++i) {
+                stats.opcodeTime  += timeApplyFixups(opcodeEncoding, scratch);
+                stats.chainedTime += timeApplyFixups(chainedEncoding, scratch);
+            }
+            stats.fixupCount   += fixups.size();
+            stats.opcodeBytes  += opcodeEncoding.size();
+            stats.chainedBytes += chainedEncoding.size();
+        });
+    }
+}
+
 /*
 static const dyld3::launch_cache::BinaryClosureData*
 callClosureDaemon(const std::string& mainPath, const std::string& cachePath, const std::vector<std::string>& envArgs)
@@ -157,6 +261,7 @@ static void usage()
     printf("    -print_dyld_cache_other_dylibs         # print group-1 (non-cached dylibs/bundles) as JSON\n");
     printf("    -print_dyld_cache_other <path>         # print just one group-1 (non-cached dylib/bundle) as JSON\n");
     printf("    -print_dyld_cache_patch_table          # print locations in shared cache that may need patching\n");
+    printf("    -compare_fixup_encodings               # compare size and apply time of fixups with and without chains for all closures in dyld cache\n");
     printf("  options:\n");
     printf("    -cache_file <cache-path>               # path to cache file to use (default is current cache)\n");
     printf("    -build_root <path-prefix>              # when building a closure, the path prefix when runtime volume is not current boot volume\n");
@@ -164,7 +269,9 @@ static void usage()
     printf("    -include_all_dylibs_in_dir             # when building a closure, add other mach-o files found in directory\n");
     printf("    -env <var=value>                       # when building a closure, DYLD_* env vars to assume\n");
     printf("    -dlopen <path>                         # for use with -create_closure to append ImageGroup if target had called dlopen\n");
+    printf("    -closure_store <dir>                   # for use with -create_closure to reuse closures saved in <dir> and save new ones there\n");
     printf("    -verbose_fixups                        # for use with -print* options to force printing fixups\n");
+    printf("    -print_stats                           # for use with -create_closure to print closure building statistics and memory use to stderr\n");
 }
 
 int main(int argc, const char* argv[])
@@ -178,6 +285,8 @@ int main(int argc, const char* argv[])
     const char*               printCacheClosure = nullptr;
     const char*               printCachedDylib = nullptr;
     const char*               printOtherDylib = nullptr;
+    const char*               closureStoreDir = nullptr;
+    bool                      printStats = false;
     bool                      listCacheClosures = false;
     bool                      listOtherDylibs = false;
     bool                      includeAllDylibs = false;
@@ -185,6 +294,7 @@ int main(int argc, const char* argv[])
     bool                      printCachedDylibs = false;
     bool                      printOtherDylibs = false;
     bool                      printPatchTable = false;
+    bool                      compareEncodings = false;
     bool                      useClosured = false;
     bool                      verboseFixups = false;
     std::vector<std::string>  buildtimePrefixes;
@@ -227,6 +337,16 @@ int main(int argc, const char* argv[])
             }
             dlopens.push_back(path);
         }
+       else if ( strcmp(arg, "-closure_store") == 0 ) {
+            closureStoreDir = argv[++i];
+            if ( closureStoreDir == nullptr ) {
+                fprintf(stderr, "-closure_store option requires a path to a directory\n");
+                return 1;
+            }
+        }
+       else if ( strcmp(arg, "-print_stats") == 0 ) {
+            printStats = true;
+        }
        else if ( strcmp(arg, "-verbose_fixups") == 0 ) {
            verboseFixups = true;
         }
@@ -298,6 +418,9 @@ int main(int argc, const char* argv[])
         else if ( strcmp(arg, "-print_dyld_cache_patch_table") == 0 ) {
             printPatchTable = true;
         }
+        else if ( strcmp(arg, "-compare_fixup_encodings") == 0 ) {
+            compareEncodings = true;
+        }
         else if ( strcmp(arg, "-include_all_dylibs_in_dir") == 0 ) {
             includeAllDylibs = true;
         }
@@ -318,6 +441,12 @@ int main(int argc, const char* argv[])
         }
     }
 
+    if ( printStats ) {
+        dyld3::ImageProxyGroup::setMemoryStatsHandler(^(uint32_t groupNum, uint64_t arenaBytes, uint64_t peakResidentBytes) {
+            fprintf(stderr, "dyld_closure_util: ImageProxyGroup %u used %llu bytes, peak RSS %llu bytes\n", groupNum, arenaBytes, peakResidentBytes);
+        });
+    }
+
     if ( (inputMainExecutablePath || inputTopImagePath) && printPath ) {
         fprintf(stderr, "-create_closure and -print_closure_file are mutually exclusive");
         return 1;
@@ -365,17 +494,43 @@ int main(int argc, const char* argv[])
             }
         }
         
-        Diagnostics closureDiag;
-        //if ( useClosured )
-        //    mainClosure = closured_makeClosure(closureDiag, clsBuffer);
-       // else
-            mainClosure = dyld3::ImageProxyGroup::makeClosure(closureDiag, clsBuffer, mach_task_self(), buildtimePrefixes);
-        if ( closureDiag.hasError() ) {
-            fprintf(stderr, "dyld_closure_util: %s\n", closureDiag.errorMessage().c_str());
-            return 1;
+        // stored closures can only be validated against the boot volume
+        std::unique_ptr<dyld3::ClosureStore> closureStore;
+        dyld3::ClosureStore::Key storeKey;
+        if ( (closureStoreDir != nullptr) && (buildtimePrefixes.size() == 1) && buildtimePrefixes.front().empty() ) {
+            uint8_t cdHash[20];
+            if ( dyld3::ImageProxyGroup::mainExecutableCdHash(mainPath, dyldCache->archName(), cdHash) ) {
+                closureStore.reset(new dyld3::ClosureStore(closureStoreDir));
+                storeKey = dyld3::ClosureStore::makeKey(cdHash, cacheIdent.cacheUUID, mainPath, envArgs);
+                size_t closureSize;
+                mainClosure = (const dyld3::launch_cache::BinaryClosureData*)closureStore->find(storeKey, closureSize, [&](const void* content, size_t size) {
+                    return dyld3::ImageProxyGroup::closureStillValid(cacheParser, (const dyld3::launch_cache::BinaryClosureData*)content);
+                });
+            }
+        }
+
+        if ( mainClosure == nullptr ) {
+            Diagnostics closureDiag;
+            //if ( useClosured )
+            //    mainClosure = closured_makeClosure(closureDiag, clsBuffer);
+           // else
+                mainClosure = dyld3::ImageProxyGroup::makeClosure(closureDiag, clsBuffer, mach_task_self(), buildtimePrefixes);
+            if ( closureDiag.hasError() ) {
+                fprintf(stderr, "dyld_closure_util: %s\n", closureDiag.errorMessage().c_str());
+                return 1;
+            }
+            for (const std::string& warn : closureDiag.warnings() )
+                fprintf(stderr, "dyld_closure_util: warning: %s\n", warn.c_str());
+            if ( printStats ) {
+                fprintf(stderr, "dyld_closure_util: %llu file checks avoided for known missing search paths\n", dyld3::ImageProxyGroup::totalFileChecksAvoided());
+                fprintf(stderr, "dyld_closure_util: %llu bytes of fixup opcodes shared between pages\n", dyld3::launch_cache::ImageGroupWriter::totalSharedFixupBytes());
+                mach_timebase_info_data_t timebase;
+                mach_timebase_info(&timebase);
+                fprintf(stderr, "dyld_closure_util: %llu us computing initializer order\n", dyld3::ImageProxyGroup::totalInitOrderTime() * timebase.numer / timebase.denom / 1000);
+            }
+            if ( closureStore && !closureStore->save(storeKey, mainClosure, dyld3::launch_cache::Closure(mainClosure).size()) )
+                fprintf(stderr, "dyld_closure_util: warning: could not save closure in %s\n", closureStoreDir);
         }
-        for (const std::string& warn : closureDiag.warnings() )
-            fprintf(stderr, "dyld_closure_util: warning: %s\n", warn.c_str());
 
         dyld3::launch_cache::Closure closure(mainClosure);
         if ( outPath != nullptr ) {
@@ -491,6 +646,24 @@ int main(int argc, const char* argv[])
             printf("%6lu  %s\n", closure.size(), runtimePath);
         });
     }
+    else if ( compareEncodings ) {
+        __block FixupEncodingStats stats;
+        __block uint32_t closureCount = 0;
+        cacheParser.forEachClosure(^(const char* runtimePath, const dyld3::launch_cache::binary_format::Closure* closureBinary) {
+            compareFixupEncodings(dyld3::launch_cache::Closure(closureBinary), stats);
+            ++closureCount;
+        });
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        uint64_t opcodeNanos  = stats.opcodeTime  * timebase.numer / timebase.denom / 10;
+        uint64_t chainedNanos = stats.chainedTime * timebase.numer / timebase.denom / 10;
+        printf("closures:          %u\n", closureCount);
+        printf("fixups:            %llu\n", stats.fixupCount);
+        printf("opcodes:           %10llu bytes, %8llu us to apply\n", stats.opcodeBytes, opcodeNanos/1000);
+        printf("with chains:       %10llu bytes, %8llu us to apply\n", stats.chainedBytes, chainedNanos/1000);
+        if ( stats.opcodeBytes != 0 )
+            printf("size change:       %.1f%%\n", ((double)stats.chainedBytes - (double)stats.opcodeBytes) * 100.0 / (double)stats.opcodeBytes);
+    }
     else if ( listOtherDylibs ) {
         dyld3::launch_cache::ImageGroup dylibGroup(cacheParser.otherDylibsGroup());
         for (uint32_t i=0; i < dylibGroup.imageCount(); ++i) {
@@ -319,6 +319,7 @@ int main(int argc, const char* argv[])
         options.dylibsRemovedDuringMastering = true;
         options.inodesAreSameAsRuntime       = false;
         options.cacheSupportsASLR            = true;
+        options.slideInfoV3                  = false;
         options.forSimulator                 = false;
         options.verbose                      = verbose;
         options.evictLeafDylibsOnOverflow    = false;
@@ -52,9 +52,11 @@
 #include <CoreFoundation/CoreFoundation.h>
 
 #include <algorithm>
+#include <atomic>
 #include <vector>
 #include <unordered_set>
 #include <unordered_set>
+#include <unordered_map>
 #include <iostream>
 #include <fstream>
 
@@ -62,6 +64,8 @@
 #include "FileUtils.h"
 #include "StringUtils.h"
 #include "DyldSharedCache.h"
+#include "ImageProxy.h"
+#include "MachOValidator.h"
 
 struct MappedMachOsByCategory
 {
@@ -71,6 +75,21 @@ struct MappedMachOsByCategory
     std::vector<DyldSharedCache::MappedMachO>   mainExecutables;
 };
 
+//
+// Every file looked at while scanning, keyed by full path, with what it has for each architecture.
+// The scan opens, maps and validates each file once for all architectures.  The index is not changed
+// after the scan, so the per-arch cache builds, which run in parallel, use it without locking.
+//
+struct ParsedInputFile
+{
+    std::vector<DyldSharedCache::MappedMachO>   dylibForCache;  // indexed like the MappedMachOsByCategory list, mh is nullptr if none
+};
+typedef std::unordered_map<std::string, ParsedInputFile> ParsedInputIndex;
+
+// input file syscalls, reported with -verbose
+static std::atomic<uint32_t> sInputFilesOpened(0);
+static std::atomic<uint32_t> sInputFilesMapped(0);
+
 static const char* sAllowedPrefixes[] = {
     "/bin/",
     "/sbin/",
@@ -143,106 +162,204 @@ static bool verbose = false;
 
 
 
-static bool addIfMachO(const std::string& pathPrefix, const std::string& runtimePath, const struct stat& statBuf, bool requireSIP, std::vector<MappedMachOsByCategory>& files)
+//
+// A file found by the scan, mapped once, with where each arch's slice is.  The slices of all
+// files found under a path prefix are validated as one batch, then sorted by addMappedMachOs().
+//
+struct InputFile
+{
+    struct Slice
+    {
+        bool                        present     = false;
+        size_t                      offset      = 0;
+        size_t                      length      = 0;
+        size_t                      batchIndex  = 0;
+        std::vector<std::string>    fatWarnings;
+    };
+
+    std::string         pathPrefix;
+    std::string         runtimePath;
+    struct stat         statBuf;
+    const void*         wholeFile;
+    bool                sipProtected;
+    std::vector<Slice>  slices;         // indexed like the MappedMachOsByCategory list
+};
+
+static bool mapIfMachO(const std::string& pathPrefix, const std::string& runtimePath, const struct stat& statBuf,
+                       const std::vector<MappedMachOsByCategory>& files, std::vector<InputFile>& inputs)
 {
     // don't precompute closure info for any debug or profile dylibs
     if ( endsWith(runtimePath, "_profile.dylib") || endsWith(runtimePath, "_debug.dylib") || endsWith(runtimePath, "_profile") || endsWith(runtimePath, "_debug") )
         return false;
 
-    // read start of file to determine if it is mach-o or a fat file
+    // map whole file once, fat slices for each arch are used in place
     std::string fullPath = pathPrefix + runtimePath;
     int fd = ::open(fullPath.c_str(), O_RDONLY);
     if ( fd < 0 )
         return false;
-    bool result = false;
-    const void* wholeFile = ::mmap(NULL, statBuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if ( wholeFile != MAP_FAILED ) {
+    ++sInputFilesOpened;
+    const void* wholeFile = ::mmap(NULL, statBuf.st_size, PROT_READ, MAP_PRIVATE | MAP_RESILIENT_CODESIGN, fd, 0);
+    if ( wholeFile == MAP_FAILED ) {
+        ::close(fd);
+        return false;
+    }
+    ++sInputFilesMapped;
+
+    InputFile input;
+    input.pathPrefix    = pathPrefix;
+    input.runtimePath   = runtimePath;
+    input.statBuf       = statBuf;
+    input.wholeFile     = wholeFile;
+    input.slices.resize(files.size());
+    for (size_t fileIndex=0; fileIndex < files.size(); ++fileIndex) {
+        InputFile::Slice& slice = input.slices[fileIndex];
         Diagnostics diag;
+        size_t sliceOffset;
+        size_t sliceLength;
+        bool fatButMissingSlice;
+        if ( dyld3::FatUtil::isFatFileWithSlice(diag, wholeFile, statBuf.st_size, files[fileIndex].archName, sliceOffset, sliceLength, fatButMissingSlice) ) {
+            slice.present   = true;
+            slice.offset    = sliceOffset;
+            slice.length    = sliceLength;
+        }
+        else if ( !fatButMissingSlice ) {
+            slice.present   = true;
+            slice.offset    = 0;
+            slice.length    = statBuf.st_size;
+        }
+        for (const std::string& warning : diag.warnings())
+            slice.fatWarnings.push_back(warning);
+    }
+
+    // SIP status is per file, so only look it up once for all archs
+    const mach_header* mh = (mach_header*)wholeFile;
+    if ( dyld3::FatUtil::isFatFile(wholeFile) || (mh->magic == MH_MAGIC) || (mh->magic == MH_MAGIC_64) )
+        input.sipProtected = isProtectedBySIP(fd);
+    else
+        input.sipProtected = false;
+    ::close(fd);
+
+    inputs.push_back(std::move(input));
+    return true;
+}
+
+//
+// Validates all slices of the mapped files as one batch, then adds the valid ones to the lists
+// for each arch.  If alreadyUsed is not null, runtime paths in it are skipped and the paths used
+// are added to it, so only the first file found for a runtime path is used.
+// Files with nothing usable are unmapped.
+//
+static void addMappedMachOs(std::vector<InputFile>& inputs, bool requireSIP, std::unordered_set<std::string>* alreadyUsed, dyld3::MachOValidator& validator,
+                            std::vector<MappedMachOsByCategory>& files, ParsedInputIndex* index)
+{
+    std::vector<dyld3::MachOValidator::File> batch;
+    for (InputFile& input : inputs) {
+        for (size_t fileIndex=0; fileIndex < files.size(); ++fileIndex) {
+            InputFile::Slice& slice = input.slices[fileIndex];
+            if ( !slice.present )
+                continue;
+            slice.batchIndex = batch.size();
+            batch.push_back({ (uint8_t*)input.wholeFile + slice.offset, slice.length, input.pathPrefix + input.runtimePath, files[fileIndex].archName,
+                              (uint64_t)input.statBuf.st_dev, (uint64_t)input.statBuf.st_ino, dyld3::MachOValidator::changeTime(input.statBuf),
+                              (uint64_t)input.statBuf.st_size, slice.offset });
+        }
+    }
+    std::vector<dyld3::MachOValidator::Result> results;
+    validator.validate(batch, results);
+
+    for (InputFile& input : inputs) {
+        const std::string& runtimePath = input.runtimePath;
+        const struct stat& statBuf     = input.statBuf;
         bool usedWholeFile = false;
-        for (MappedMachOsByCategory& file : files) {
-            size_t sliceOffset;
-            size_t sliceLength;
-            bool fatButMissingSlice;
-            const void* slice = MAP_FAILED;
-            if ( dyld3::FatUtil::isFatFileWithSlice(diag, wholeFile, statBuf.st_size, file.archName, sliceOffset, sliceLength, fatButMissingSlice) ) {
-                slice = ::mmap(NULL, sliceLength, PROT_READ, MAP_PRIVATE | MAP_RESILIENT_CODESIGN, fd, sliceOffset);
-                if ( slice != MAP_FAILED ) {
-                    //fprintf(stderr, "mapped slice at %p size=0x%0lX, offset=0x%0lX for %s\n", p, len, offset, fullPath.c_str());
-                    if ( !dyld3::MachOParser::isValidMachO(diag, file.archName, dyld3::Platform::macOS, slice, sliceLength, fullPath.c_str(), false) ) {
-                        ::munmap((void*)slice, sliceLength);
-                        slice = MAP_FAILED;
-                    }
-                }
-            }
-            else if ( !fatButMissingSlice && dyld3::MachOParser::isValidMachO(diag, file.archName, dyld3::Platform::macOS, wholeFile, statBuf.st_size, fullPath.c_str(), false) ) {
-                slice           = wholeFile;
-                sliceLength     = statBuf.st_size;
-                sliceOffset     = 0;
-                usedWholeFile   = true;
-                //fprintf(stderr, "mapped whole file at %p size=0x%0lX for %s\n", p, len, inputPath.c_str());
-            }
-            std::vector<std::string> nonArchWarnings;
-            for (const std::string& warning : diag.warnings()) {
-                if ( !contains(warning, "required architecture") && !contains(warning, "not a dylib") )
-                    nonArchWarnings.push_back(warning);
+
+        // don't add paths already found using previous prefix
+        if ( (alreadyUsed == nullptr) || (alreadyUsed->count(runtimePath) == 0) ) {
+            // record that this file was looked at, even if it has nothing usable
+            ParsedInputFile* parsed = nullptr;
+            if ( index != nullptr ) {
+                parsed = &(*index)[input.pathPrefix + runtimePath];
+                parsed->dylibForCache.resize(files.size());
             }
-            diag.clearWarnings();
-            if ( !nonArchWarnings.empty() ) {
-                fprintf(stderr, "update_dyld_shared_cache: warning: %s for %s: ", file.archName.c_str(), runtimePath.c_str());
-                for (const std::string& warning : nonArchWarnings) {
-                    fprintf(stderr, "%s ", warning.c_str());
+            for (size_t fileIndex=0; fileIndex < files.size(); ++fileIndex) {
+                MappedMachOsByCategory& file = files[fileIndex];
+                const InputFile::Slice& slice = input.slices[fileIndex];
+                std::vector<std::string> nonArchWarnings;
+                for (const std::string& warning : slice.fatWarnings) {
+                    if ( !contains(warning, "required architecture") && !contains(warning, "not a dylib") )
+                        nonArchWarnings.push_back(warning);
                 }
-                fprintf(stderr, "\n");
-            }
-            if ( slice != MAP_FAILED ) {
-                const mach_header* mh = (mach_header*)slice;
-                dyld3::MachOParser parser((mach_header*)slice);
-                bool sipProtected = isProtectedBySIP(fd);
-                bool issetuid = false;
-                if ( parser.isDynamicExecutable() ) {
-                    // When SIP enabled, only build closures for SIP protected programs
-                    if ( !requireSIP || sipProtected ) {
-                        //fprintf(stderr, "requireSIP=%d, sipProtected=%d, path=%s\n", requireSIP, sipProtected, fullPath.c_str());
-                        issetuid = (statBuf.st_mode & (S_ISUID|S_ISGID));
-                        file.mainExecutables.emplace_back(runtimePath, mh, sliceLength, issetuid, sipProtected, sliceOffset, statBuf.st_mtime, statBuf.st_ino);
+                if ( slice.present ) {
+                    for (const std::string& warning : results[slice.batchIndex].diag.warnings()) {
+                        if ( !contains(warning, "required architecture") && !contains(warning, "not a dylib") )
+                            nonArchWarnings.push_back(warning);
                     }
                 }
-                else if ( parser.canBePlacedInDyldCache(runtimePath) ) {
-                    // when SIP is enabled, only dylib protected by SIP can go in cache
-                    if ( !requireSIP || sipProtected )
-                        file.dylibsForCache.emplace_back(runtimePath, mh, sliceLength, issetuid, sipProtected, sliceOffset, statBuf.st_mtime, statBuf.st_ino);
-                    else
-                        file.otherDylibsAndBundles.emplace_back(runtimePath, mh, sliceLength, issetuid, sipProtected, sliceOffset, statBuf.st_mtime, statBuf.st_ino);
+                if ( !nonArchWarnings.empty() ) {
+                    fprintf(stderr, "update_dyld_shared_cache: warning: %s for %s: ", file.archName.c_str(), runtimePath.c_str());
+                    for (const std::string& warning : nonArchWarnings) {
+                        fprintf(stderr, "%s ", warning.c_str());
+                    }
+                    fprintf(stderr, "\n");
                 }
-                else {
-                    if ( parser.fileType() == MH_DYLIB ) {
-                        std::string installName = parser.installName();
-                        if ( startsWith(installName, "@") && !contains(runtimePath, ".app/") ) {
-                            if (  startsWith(runtimePath, "/usr/lib/") || startsWith(runtimePath, "/System/Library/") )
-                                fprintf(stderr, "update_dyld_shared_cache: warning @rpath install name for system framework: %s\n", runtimePath.c_str());
+                if ( slice.present && results[slice.batchIndex].valid ) {
+                    const mach_header* mh = (mach_header*)((uint8_t*)input.wholeFile + slice.offset);
+                    size_t sliceLength = slice.length;
+                    size_t sliceOffset = slice.offset;
+                    bool sipProtected  = input.sipProtected;
+                    dyld3::MachOParser parser(mh);
+                    usedWholeFile = true;
+                    bool issetuid = false;
+                    if ( parser.isDynamicExecutable() ) {
+                        // When SIP enabled, only build closures for SIP protected programs
+                        if ( !requireSIP || sipProtected ) {
+                            //fprintf(stderr, "requireSIP=%d, sipProtected=%d, path=%s\n", requireSIP, sipProtected, fullPath.c_str());
+                            issetuid = (statBuf.st_mode & (S_ISUID|S_ISGID));
+                            file.mainExecutables.emplace_back(runtimePath, mh, sliceLength, issetuid, sipProtected, sliceOffset, statBuf.st_mtime, statBuf.st_ino);
                         }
                     }
-                    file.otherDylibsAndBundles.emplace_back(runtimePath, mh, sliceLength, issetuid, sipProtected, sliceOffset, statBuf.st_mtime, statBuf.st_ino);
+                    else if ( parser.canBePlacedInDyldCache(runtimePath) ) {
+                        // when SIP is enabled, only dylib protected by SIP can go in cache
+                        if ( !requireSIP || sipProtected ) {
+                            file.dylibsForCache.emplace_back(runtimePath, mh, sliceLength, issetuid, sipProtected, sliceOffset, statBuf.st_mtime, statBuf.st_ino);
+                            if ( parsed != nullptr )
+                                parsed->dylibForCache[fileIndex] = file.dylibsForCache.back();
+                        }
+                        else
+                            file.otherDylibsAndBundles.emplace_back(runtimePath, mh, sliceLength, issetuid, sipProtected, sliceOffset, statBuf.st_mtime, statBuf.st_ino);
+                    }
+                    else {
+                        if ( parser.fileType() == MH_DYLIB ) {
+                            std::string installName = parser.installName();
+                            if ( startsWith(installName, "@") && !contains(runtimePath, ".app/") ) {
+                                if (  startsWith(runtimePath, "/usr/lib/") || startsWith(runtimePath, "/System/Library/") )
+                                    fprintf(stderr, "update_dyld_shared_cache: warning @rpath install name for system framework: %s\n", runtimePath.c_str());
+                            }
+                        }
+                        file.otherDylibsAndBundles.emplace_back(runtimePath, mh, sliceLength, issetuid, sipProtected, sliceOffset, statBuf.st_mtime, statBuf.st_ino);
+                    }
                 }
-                result = true;
             }
+            if ( (alreadyUsed != nullptr) && usedWholeFile )
+                alreadyUsed->insert(runtimePath);
         }
         if ( !usedWholeFile )
-            ::munmap((void*)wholeFile, statBuf.st_size);
+            ::munmap((void*)input.wholeFile, statBuf.st_size);
     }
-    ::close(fd);
-    return result;
 }
 
-static void findAllFiles(const std::vector<std::string>& pathPrefixes, bool requireSIP, std::vector<MappedMachOsByCategory>& files)
+static void findAllFiles(const std::vector<std::string>& pathPrefixes, bool requireSIP, dyld3::MachOValidator& validator,
+                         std::vector<MappedMachOsByCategory>& files, ParsedInputIndex& index)
 {
     std::unordered_set<std::string> skipDirs;
     for (const char* s : sDontUsePrefixes)
         skipDirs.insert(s);
 
+    // with an overlay, each prefix is one batch, so a path already used from the overlay is not even mapped
+    // from the boot volume (if the overlay's file has nothing usable, the boot volume's is used instead)
     __block std::unordered_set<std::string> alreadyUsed;
-    bool multiplePrefixes = (pathPrefixes.size() > 1);
+    const bool firstPrefixWins = (pathPrefixes.size() > 1);
     for (const std::string& prefix : pathPrefixes) {
+        __block std::vector<InputFile> inputs;
         // get all files from overlay for this search dir
         for (const char* searchDir : sAllowedPrefixes ) {
             iterateDirectoryTree(prefix, searchDir, ^(const std::string& dirPath) { return (skipDirs.count(dirPath) != 0); }, ^(const std::string& path, const struct stat& statBuf) {
@@ -255,24 +372,24 @@ static void findAllFiles(const std::vector<std::string>& pathPrefixes, bool requ
                 if ( statBuf.st_size < 0x3000 )
                     return;
 
-                // don't add paths already found using previous prefix
-                if ( multiplePrefixes && (alreadyUsed.count(path) != 0) )
+                // a path in the overlay hides the same path on the boot volume
+                if ( alreadyUsed.count(path) != 0 )
                     return;
 
-                // if the file is mach-o, add to list
-                if ( addIfMachO(prefix, path, statBuf, requireSIP, files) ) {
-                    if ( multiplePrefixes )
-                        alreadyUsed.insert(path);
-                }
+                // map it, checking if it is mach-o is done with all other files from this prefix
+                mapIfMachO(prefix, path, statBuf, files, inputs);
             });
         }
+        addMappedMachOs(inputs, requireSIP, firstPrefixWins ? &alreadyUsed : nullptr, validator, files, &index);
     }
 }
 
 
-static void findOSFilesViaBOMS(const std::vector<std::string>& pathPrefixes, bool requireSIP, std::vector<MappedMachOsByCategory>& files)
+static void findOSFilesViaBOMS(const std::vector<std::string>& pathPrefixes, bool requireSIP, dyld3::MachOValidator& validator,
+                               std::vector<MappedMachOsByCategory>& files, ParsedInputIndex& index)
 {
     __block std::unordered_set<std::string> runtimePathsFound;
+    __block std::vector<InputFile> inputs;
     for (const std::string& prefix : pathPrefixes) {
         iterateDirectoryTree(prefix, "/System/Library/Receipts", ^(const std::string&) { return false; }, ^(const std::string& path, const struct stat& statBuf) {
             if ( !contains(path, "com.apple.pkg.") )
@@ -322,7 +439,7 @@ static void findOSFilesViaBOMS(const std::vector<std::string>& pathPrefixes, boo
                                     struct stat statBuf2;
                                     std::string fullPath2 = prefix2 + runPath;
                                     if ( stat(fullPath2.c_str(), &statBuf2) == 0 ) {
-                                        addIfMachO(prefix2, runPath, statBuf2, requireSIP, files);
+                                        mapIfMachO(prefix2, runPath, statBuf2, files, inputs);
                                         runtimePathsFound.insert(runPath);
                                         break;
                                     }
@@ -338,6 +455,9 @@ static void findOSFilesViaBOMS(const std::vector<std::string>& pathPrefixes, boo
             BOMBomFree(bom);
         });
     }
+
+    // each runtime path was only mapped from the first prefix it was found in
+    addMappedMachOs(inputs, requireSIP, nullptr, validator, files, &index);
 }
 
 
@@ -548,6 +668,8 @@ int main(int argc, const char* argv[])
     bool                            force = false;
     bool                            searchDisk = false;
     bool                            dylibsRemoved = false;
+    bool                            slideInfoV3 = false;
+    bool                            streamOutput = false;
     std::string                     cacheDir;
     std::unordered_set<std::string> archStrs;
     std::unordered_set<std::string> skipDylibs;
@@ -593,6 +715,12 @@ int main(int argc, const char* argv[])
         else if (strcmp(arg, "-force") == 0) {
             force = true;
         }
+        else if (strcmp(arg, "-slide_info_v3") == 0) {
+            slideInfoV3 = true;
+        }
+        else if (strcmp(arg, "-stream_output") == 0) {
+            streamOutput = true;
+        }
         else if (strcmp(arg, "-sort_by_name") == 0) {
             //No-op, we always do this now
         }
@@ -625,6 +753,11 @@ int main(int argc, const char* argv[])
             rootPath = "";
         }
     }
+    // the kernel only applies v1/v2 slide info, so dyld maps a v3 cache privately into every process
+    if ( slideInfoV3 && rootPath.empty() ) {
+        fprintf(stderr, "-slide_info_v3 can only be used with -root, caches for the boot volume must be shareable system wide\n");
+        return 1;
+    }
     // canonicalize overlayPath
     if ( !overlayPath.empty() ) {
         char resolvedPath[PATH_MAX];
@@ -679,6 +812,11 @@ int main(int argc, const char* argv[])
     // find all mach-o files for requested architectures
     bool requireDylibsBeRootlessProtected = isProtectedBySIP(cacheDir);
     __block std::vector<MappedMachOsByCategory> allFileSets;
+    __block ParsedInputIndex parsedInputs;
+    // files that validated cleanly on a previous run and have not changed are not validated again
+    dyld3::MachOValidator validator(dyld3::Platform::macOS, false);
+    const std::string validationCachePath = cacheDir + "/update_dyld_shared_cache.validated";
+    validator.load(validationCachePath);
     if ( archStrs.count("x86_64") )
         allFileSets.push_back({"x86_64"});
     if ( archStrs.count("x86_64h") )
@@ -686,11 +824,12 @@ int main(int argc, const char* argv[])
     if ( archStrs.count("i386") )
         allFileSets.push_back({"i386"});
     if ( searchDisk )
-        findAllFiles(pathPrefixes, requireDylibsBeRootlessProtected, allFileSets);
+        findAllFiles(pathPrefixes, requireDylibsBeRootlessProtected, validator, allFileSets, parsedInputs);
     else {
         std::unordered_set<std::string> runtimePathsFound;
-        findOSFilesViaBOMS(pathPrefixes, requireDylibsBeRootlessProtected, allFileSets);
+        findOSFilesViaBOMS(pathPrefixes, requireDylibsBeRootlessProtected, validator, allFileSets, parsedInputs);
     }
+    validator.save(validationCachePath);
 
     // nothing in OS uses i386 dylibs, so only dylibs used by third party apps need to be in cache
     for (MappedMachOsByCategory& fileSet : allFileSets) {
@@ -705,6 +844,8 @@ int main(int argc, const char* argv[])
             fprintf(stderr, "time to scan file system and construct lists of mach-o files: %ums\n", absolutetime_to_milliseconds(t2-t1));
         else
             fprintf(stderr, "time to read BOM and construct lists of mach-o files: %ums\n", absolutetime_to_milliseconds(t2-t1));
+        const dyld3::MachOValidator::Stats& stats = validator.stats();
+        fprintf(stderr, "mach-o slices validated: %llu, unchanged since last run: %llu\n", stats.validated, stats.cacheHits);
     }
 
     // build caches in parallel on machines with at leat 4GB of RAM
@@ -718,12 +859,28 @@ int main(int argc, const char* argv[])
     dispatch_queue_t dqueue = buildInParallel ? dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)
                                               : dispatch_queue_create("serial-queue", DISPATCH_QUEUE_SERIAL);
 
+    // track how much memory closure building uses, to size build hosts
+    static std::atomic<uint64_t> closureGroupsBytes(0);
+    static std::atomic<uint64_t> closureGroupsCount(0);
+    if ( verbose ) {
+        dyld3::ImageProxyGroup::setMemoryStatsHandler(^(uint32_t groupNum, uint64_t arenaBytes, uint64_t peakResidentBytes) {
+            if ( groupNum < 2 ) {
+                fprintf(stderr, "ImageProxyGroup %u used %lluKB, peak RSS %lluMB\n", groupNum, arenaBytes/1024, peakResidentBytes/(1024*1024));
+            }
+            else {
+                closureGroupsBytes += arenaBytes;
+                ++closureGroupsCount;
+            }
+        });
+    }
+
     // build all caches
     __block bool cacheBuildFailure = false;
     __block bool wroteSomeCacheFile = false;
     dispatch_apply(allFileSets.size(), dqueue, ^(size_t index) {
         MappedMachOsByCategory& fileSet = allFileSets[index];
         const std::string outFile = cacheDir + "/dyld_shared_cache_" + fileSet.archName;
+        const size_t fileSetIndex = index;
 
         DyldSharedCache::MappedMachO (^loader)(const std::string&) = ^DyldSharedCache::MappedMachO(const std::string& runtimePath) {
             if ( skipDylibs.count(runtimePath) )
@@ -732,9 +889,20 @@ int main(int argc, const char* argv[])
                 std::string fullPath = prefix + runtimePath;
                 struct stat statBuf;
                 if ( stat(fullPath.c_str(), &statBuf) == 0 ) {
+                    // use what the scan found, if it looked at this file; if nothing usable, try the next prefix
+                    auto pos = parsedInputs.find(fullPath);
+                    if ( pos != parsedInputs.end() ) {
+                        const DyldSharedCache::MappedMachO& found = pos->second.dylibForCache[fileSetIndex];
+                        if ( found.mh != nullptr )
+                            return found;
+                        continue;
+                    }
                     std::vector<MappedMachOsByCategory> mappedFiles;
                     mappedFiles.push_back({fileSet.archName});
-                    if ( addIfMachO(prefix, runtimePath, statBuf, requireDylibsBeRootlessProtected, mappedFiles) ) {
+                    std::vector<InputFile> inputs;
+                    if ( mapIfMachO(prefix, runtimePath, statBuf, mappedFiles, inputs) ) {
+                        dyld3::MachOValidator oneFileValidator(dyld3::Platform::macOS, false);
+                        addMappedMachOs(inputs, requireDylibsBeRootlessProtected, nullptr, oneFileValidator, mappedFiles, nullptr);
                         if ( !mappedFiles.back().dylibsForCache.empty() )
                             return mappedFiles.back().dylibsForCache.back();
                     }
@@ -790,10 +958,13 @@ int main(int argc, const char* argv[])
         options.dylibsRemovedDuringMastering = dylibsRemoved;
         options.inodesAreSameAsRuntime       = true;
         options.cacheSupportsASLR            = (fileSet.archName != "i386");
+        options.slideInfoV3                  = slideInfoV3;
         options.forSimulator                 = false;
         options.verbose                      = verbose;
         options.evictLeafDylibsOnOverflow    = true;
         options.pathPrefixes                 = pathPrefixes;
+        if ( streamOutput )
+            options.outputFilePath           = outFile;
         DyldSharedCache::CreateResults results = DyldSharedCache::create(options, fileSet.dylibsForCache, fileSet.otherDylibsAndBundles, fileSet.mainExecutables);
 
         // print any warnings
@@ -808,7 +979,7 @@ int main(int argc, const char* argv[])
         else {
             // save new cache file to disk and write new .map file
             assert(results.cacheContent != nullptr);
-            if ( !safeSave(results.cacheContent, results.cacheLength, outFile) ) {
+            if ( !results.savedToFile && !safeSave(results.cacheContent, results.cacheLength, outFile) ) {
                 fprintf(stderr, "update_dyld_shared_cache: could not write dyld cache file %s\n", outFile.c_str());
                 cacheBuildFailure = true;
             }
@@ -829,6 +1000,17 @@ int main(int argc, const char* argv[])
     });
 
 
+    if ( verbose ) {
+        uint64_t t3 = mach_absolute_time();
+        fprintf(stderr, "time to build all caches: %ums, total: %ums\n", absolutetime_to_milliseconds(t3-t2), absolutetime_to_milliseconds(t3-t1));
+        fprintf(stderr, "input files: %lu parsed by scan, %u opened, %u mapped\n", parsedInputs.size(), sInputFilesOpened.load(), sInputFilesMapped.load());
+        struct rusage usage;
+        if ( getrusage(RUSAGE_SELF, &usage) == 0 )
+            fprintf(stderr, "peak RSS building caches: %lluMB\n", (uint64_t)usage.ru_maxrss/(1024*1024));
+        if ( closureGroupsCount != 0 )
+            fprintf(stderr, "%llu closure ImageProxyGroups used %lluKB on average\n", closureGroupsCount.load(), closureGroupsBytes.load()/closureGroupsCount.load()/1024);
+    }
+
     // Save off spintrace data
     if ( wroteSomeCacheFile ) {
         void* h = dlopen("/usr/lib/libdscsym.dylib", 0);
@@ -504,6 +504,7 @@ int main(int argc, const char* argv[])
         options.dylibsRemovedDuringMastering = false;
         options.inodesAreSameAsRuntime       = true;
         options.cacheSupportsASLR            = false;
+        options.slideInfoV3                  = false;
         options.forSimulator                 = true;
         options.verbose                      = verbose;
         options.evictLeafDylibsOnOverflow    = true;
@@ -132,6 +132,23 @@ dyld_enumerate_tlv_storage(dyld_tlv_state_change_handler handler);
 extern intptr_t _dyld_get_image_slide(const struct mach_header* mh);
 
 
+//
+// Statistics for the global dyld lock taken by dlopen(), dlsym(), dlclose() and the other dyld APIs.
+// Times are in mach_absolute_time() units.  Only the outermost acquire of a recursive hold counts.
+//
+struct dyld_global_lock_statistics
+{
+	uint64_t		acquisitions;
+	uint64_t		contendedAcquisitions;	// acquisitions that had to wait for another thread
+	uint64_t		totalWaitTime;
+	uint64_t		maxWaitTime;
+	uint64_t		totalHoldTime;
+	uint64_t		maxHoldTime;
+};
+
+extern void _dyld_get_global_lock_statistics(struct dyld_global_lock_statistics* stats);
+
+
 
 struct dyld_unwind_sections
 {
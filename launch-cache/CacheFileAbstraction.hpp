@@ -241,6 +241,36 @@ public:
 	uint64_t		dyldSectionAddr() const						INLINE { return E::get64(fields.dyldSectionAddr); }
 	void			set_dyldSectionAddr(uint64_t value)			INLINE { E::set64(fields.dyldSectionAddr, value); }
 
+	uint32_t		dylibHashSeed() const						INLINE { return E::get32(fields.dylibHashSeed); }
+	void			set_dylibHashSeed(uint32_t value)			INLINE { E::set32(fields.dylibHashSeed, value); }
+
+	uint32_t		dylibHashBucketCount() const				INLINE { return E::get32(fields.dylibHashBucketCount); }
+	void			set_dylibHashBucketCount(uint32_t value)	INLINE { E::set32(fields.dylibHashBucketCount, value); }
+
+	uint32_t		dylibHashDisplacementsOffset() const		INLINE { return E::get32(fields.dylibHashDisplacementsOffset); }
+	void			set_dylibHashDisplacementsOffset(uint32_t value) INLINE { E::set32(fields.dylibHashDisplacementsOffset, value); }
+
+	uint32_t		dylibHashSlotsOffset() const				INLINE { return E::get32(fields.dylibHashSlotsOffset); }
+	void			set_dylibHashSlotsOffset(uint32_t value)	INLINE { E::set32(fields.dylibHashSlotsOffset, value); }
+
+	uint32_t		dylibHashSlotCount() const					INLINE { return E::get32(fields.dylibHashSlotCount); }
+	void			set_dylibHashSlotCount(uint32_t value)		INLINE { E::set32(fields.dylibHashSlotCount, value); }
+
+	uint32_t		dylibHashStringsOffset() const				INLINE { return E::get32(fields.dylibHashStringsOffset); }
+	void			set_dylibHashStringsOffset(uint32_t value)	INLINE { E::set32(fields.dylibHashStringsOffset, value); }
+
+	uint32_t		dylibHashStringsSize() const				INLINE { return E::get32(fields.dylibHashStringsSize); }
+	void			set_dylibHashStringsSize(uint32_t value)	INLINE { E::set32(fields.dylibHashStringsSize, value); }
+
+	uint32_t		exportIndexesOffset() const					INLINE { return E::get32(fields.exportIndexesOffset); }
+	void			set_exportIndexesOffset(uint32_t value)		INLINE { E::set32(fields.exportIndexesOffset, value); }
+
+	uint32_t		exportEntriesOffset() const					INLINE { return E::get32(fields.exportEntriesOffset); }
+	void			set_exportEntriesOffset(uint32_t value)		INLINE { E::set32(fields.exportEntriesOffset, value); }
+
+	uint32_t		exportEntriesCount() const					INLINE { return E::get32(fields.exportEntriesCount); }
+	void			set_exportEntriesCount(uint32_t value)		INLINE { E::set32(fields.exportEntriesCount, value); }
+
 
 private:
 	dyld_cache_accelerator_info			fields;
@@ -367,6 +397,33 @@ private:
 };
 
 
+template <typename E>
+class dyldCacheSlideInfo3 {
+public:		
+	uint32_t		version() const								INLINE { return E::get32(fields.version); }
+	void			set_version(uint32_t value)					INLINE { E::set32(fields.version, value); }
+
+	uint32_t		page_size() const							INLINE { return E::get32(fields.page_size); }
+	void			set_page_size(uint32_t value)				INLINE { E::set32(fields.page_size, value); }
+
+	uint32_t		page_starts_offset() const					INLINE { return E::get32(fields.page_starts_offset); }
+	void			set_page_starts_offset(uint32_t value)		INLINE { E::set32(fields.page_starts_offset, value); }
+
+	uint32_t		page_starts_count() const					INLINE { return E::get32(fields.page_starts_count); }
+	void			set_page_starts_count(uint32_t value)		INLINE { E::set32(fields.page_starts_count, value); }
+
+	uint64_t		value_add() const							INLINE { return E::get64(fields.value_add); }
+	void			set_value_add(uint64_t value)				INLINE { E::set64(fields.value_add, value); }
+
+	uint16_t		page_starts(unsigned index) const				INLINE { return E::get16(((uint16_t*)(((uint8_t*)this)+E::get32(fields.page_starts_offset)))[index]); }
+	void			set_page_starts(unsigned index, uint16_t value) INLINE { return E::set16(((uint16_t*)(((uint8_t*)this)+E::get32(fields.page_starts_offset)))[index], value); }
+
+
+private:
+	dyld_cache_slide_info3			fields;
+};
+
+
 
 template <typename E>
 class dyldCacheLocalSymbolsInfo {
@@ -30,6 +30,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fnmatch.h>
 #include <sys/mman.h>
 #include <sys/syslimits.h>
 #include <libkern/OSByteOrder.h>
@@ -52,6 +53,7 @@
 #include <map>
 #include <unordered_map>
 #include <algorithm>
+#include <atomic>
 #include <dispatch/dispatch.h>
 
 struct seg_info
@@ -236,6 +238,8 @@ int optimize_linkedit(macho_header<typename A::P>* mh, uint64_t textOffsetInCach
 		memcpy((char*)mh + newFunctionStartsOffset, (char*)mapped_cache + functionStarts->dataoff(), functionStartsSize);
 	}
 	const uint64_t newDataInCodeOffset = (newFunctionStartsOffset + functionStartsSize + sizeof(pint_t) - 1) & (-sizeof(pint_t)); // pointer align
+	// LINKEDIT is rebuilt in a reused buffer, so explicitly zero any alignment padding
+	::bzero((char*)mh + newFunctionStartsOffset + functionStartsSize, (size_t)(newDataInCodeOffset - newFunctionStartsOffset - functionStartsSize));
 	uint32_t dataInCodeSize = 0;
 	if ( dataInCode != NULL ) {
 		// copy data-in-code info from original cache file to new mapped dylib file
@@ -292,6 +296,7 @@ int optimize_linkedit(macho_header<typename A::P>* mh, uint64_t textOffsetInCach
 
 	// copy symbol entries and strings from original cache file to new mapped dylib file
 	const uint64_t newSymTabOffset = (newDataInCodeOffset + dataInCodeSize + sizeof(pint_t) - 1) & (-sizeof(pint_t)); // pointer align
+	::bzero((char*)mh + newDataInCodeOffset + dataInCodeSize, (size_t)(newSymTabOffset - newDataInCodeOffset - dataInCodeSize));
 	const uint64_t newIndSymTabOffset = newSymTabOffset + newSymCount*sizeof(macho_nlist<P>);
 	const uint64_t newStringPoolOffset = newIndSymTabOffset + dynamicSymTab->nindirectsyms()*sizeof(uint32_t);
 	macho_nlist<P>* const newSymTabStart = (macho_nlist<P>*)(((uint8_t*)mh) + newSymTabOffset);
@@ -359,7 +364,7 @@ int optimize_linkedit(macho_header<typename A::P>* mh, uint64_t textOffsetInCach
 	
 	// pointer align string pool size
 	while ( (poolOffset % sizeof(pint_t)) != 0 )
-		++poolOffset; 
+		newStringPoolStart[poolOffset++] = '\0';
 	// copy indirect symbol table
 	uint32_t* newIndSymTab = (uint32_t*)((char*)mh + newIndSymTabOffset);
 	memcpy(newIndSymTab, mergedIndSymTab, dynamicSymTab->nindirectsyms()*sizeof(uint32_t));
@@ -387,6 +392,7 @@ int optimize_linkedit(macho_header<typename A::P>* mh, uint64_t textOffsetInCach
 	
 	// return new size
 	*newSize = (symtab->stroff()+symtab->strsize()+4095) & (-4096);
+	::bzero((char*)mh + symtab->stroff() + symtab->strsize(), (size_t)(*newSize - symtab->stroff() - symtab->strsize()));
 	
 	// <rdar://problem/17671438> Xcode 6 leaks in dyld_shared_cache_extract_dylibs
 	for (std::vector<mach_o::trie::Entry>::iterator it = exports.begin(); it != exports.end(); ++it) {
@@ -424,91 +430,184 @@ static void make_dirs(const char* file_path)
 
 
 
+//
+// Per-worker scratch space for the parts of a dylib that are rewritten: the mach_header,
+// load commands, and LINKEDIT.  Everything else is written straight from the mapped cache.
+// The arena is reused for every dylib a worker extracts and only ever grows.  It is
+// anonymous memory, so pages that are never written (most of the span covered by the
+// cache's shared LINKEDIT) are never touched.
+//
+class OutputArena
+{
+public:
+				OutputArena() : _buffer(NULL), _size(0) { }
+				~OutputArena() { if ( _buffer != NULL ) ::munmap(_buffer, _size); }
+
+	uint8_t*	reserve(size_t size);
+
+private:
+	uint8_t*	_buffer;
+	size_t		_size;
+};
+
+uint8_t* OutputArena::reserve(size_t size)
+{
+	if ( size <= _size )
+		return _buffer;
+	if ( _buffer != NULL )
+		::munmap(_buffer, _size);
+	_size = (size + 4095) & (-4096);
+	void* p = ::mmap(NULL, _size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
+	if ( p == MAP_FAILED ) {
+		_buffer = NULL;
+		_size   = 0;
+		return NULL;
+	}
+	_buffer = (uint8_t*)p;
+	return _buffer;
+}
+
+
+static bool write_all(int fd, const void* buffer, uint64_t size, uint64_t offset)
+{
+	const uint8_t* p = (uint8_t*)buffer;
+	while ( size != 0 ) {
+		ssize_t amount = ::pwrite(fd, p, (size_t)size, (off_t)offset);
+		if ( amount == -1 ) {
+			if ( errno == EINTR )
+				continue;
+			return false;
+		}
+		p      += amount;
+		size   -= amount;
+		offset += amount;
+	}
+	return true;
+}
+
+
+//
+// Appends a slice for one dylib to the (possibly fat) file open at fd.  Only the mach_header,
+// load commands and rebuilt LINKEDIT go through the arena, all other segment content is
+// pwrite()n directly from the mapped cache.
+// Returns 0 on success or if the file already has a slice of this arch.
+//
 template <typename A>
-size_t dylib_maker(const void* mapped_cache, std::vector<uint8_t> &dylib_data, const std::vector<seg_info>& segments) {		
+int dylib_maker(const void* mapped_cache, int fd, OutputArena& arena, const std::vector<seg_info>& segments)
+{
 	typedef typename A::P P;
-    
-    size_t  additionalSize  = 0;
-	for(std::vector<seg_info>::const_iterator it=segments.begin(); it != segments.end(); ++it) {
-		additionalSize                          += it->sizem;
-	}
-    
-    dylib_data.reserve(dylib_data.size() + additionalSize);
-    
-    uint32_t                nfat_archs          = 0;
+
+	// find existing fat header, so new slice can be appended to end
+	uint8_t                 fatPage[4096];
+	uint32_t                nfat_archs          = 0;
 	uint32_t                offsetInFatFile     = 4096;
-    uint8_t                 *base_ptr           = &dylib_data.front();
-	    
-#define FH reinterpret_cast<fat_header*>(base_ptr)
-#define FA reinterpret_cast<fat_arch*>(base_ptr + (8 + (nfat_archs - 1) * sizeof(fat_arch)))
-    
-    if(dylib_data.size() >= 4096 && OSSwapBigToHostInt32(FH->magic) == FAT_MAGIC) {
+	bzero(fatPage, sizeof(fatPage));
+	struct stat statbuf;
+	if ( ::fstat(fd, &statbuf) != 0 )
+		return -1;
+	if ( statbuf.st_size >= 4096 ) {
+		if ( ::pread(fd, fatPage, 4096, 0) != 4096 )
+			return -1;
+	}
+
+#define FH reinterpret_cast<fat_header*>(fatPage)
+#define FA reinterpret_cast<fat_arch*>(fatPage + (8 + (nfat_archs - 1) * sizeof(fat_arch)))
+
+	if ( OSSwapBigToHostInt32(FH->magic) == FAT_MAGIC ) {
 		// have fat header, append new arch to end
-        nfat_archs                              = OSSwapBigToHostInt32(FH->nfat_arch);
+		nfat_archs                              = OSSwapBigToHostInt32(FH->nfat_arch);
 		offsetInFatFile                         = OSSwapBigToHostInt32(FA->offset) + OSSwapBigToHostInt32(FA->size);
-    }
-    
-    dylib_data.resize(offsetInFatFile);
-    base_ptr                                    = &dylib_data.front();
-    
-    FH->magic                                   = OSSwapHostToBigInt32(FAT_MAGIC);
-    FH->nfat_arch                               = OSSwapHostToBigInt32(++nfat_archs);
-    
-    FA->cputype                                 = 0; // filled in later
-    FA->cpusubtype                              = 0; // filled in later
-    FA->offset                                  = OSSwapHostToBigInt32(offsetInFatFile);
-    FA->size                                    = 0; // filled in later
-    FA->align                                   = OSSwapHostToBigInt32(12);
-    
-	// Write regular segments into the buffer
-	uint64_t                totalSize           = 0;
-    uint64_t				textOffsetInCache	= 0;
-	for( std::vector<seg_info>::const_iterator it=segments.begin(); it != segments.end(); ++it) {
-        
-        if(strcmp(it->segName, "__TEXT") == 0 ) {
-			textOffsetInCache					= it->offset;
-            const macho_header<P>   *textMH     = reinterpret_cast<macho_header<P>*>((uint8_t*)mapped_cache+textOffsetInCache);
-            FA->cputype                         = OSSwapHostToBigInt32(textMH->cputype()); 
-            FA->cpusubtype                      = OSSwapHostToBigInt32(textMH->cpusubtype());
-            
-            // if this cputype/subtype already exist in fat header, then return immediately
-            for(uint32_t i=0; i < nfat_archs-1; ++i) {
-                fat_arch            *afa        = reinterpret_cast<fat_arch*>(base_ptr+8)+i;
-                
-                if(   afa->cputype == FA->cputype
-                   && afa->cpusubtype == FA->cpusubtype) {
-                    //fprintf(stderr, "arch already exists in fat dylib\n");
-                    dylib_data.resize(offsetInFatFile);
-                    return offsetInFatFile;
-                }
-            }
+	}
+	else {
+		bzero(fatPage, sizeof(fatPage));
+	}
+
+	const seg_info*         textSeg             = NULL;
+	uint64_t                sliceSize           = 0;
+	for (std::vector<seg_info>::const_iterator it=segments.begin(); it != segments.end(); ++it) {
+		if ( strcmp(it->segName, "__TEXT") == 0 )
+			textSeg = &*it;
+		sliceSize += it->sizem;
+	}
+	if ( textSeg == NULL ) {
+		fprintf(stderr, "__TEXT not found\n");
+		return -1;
+	}
+	const uint64_t          textOffsetInCache   = textSeg->offset;
+	const macho_header<P>*  textMH              = reinterpret_cast<macho_header<P>*>((uint8_t*)mapped_cache+textOffsetInCache);
+
+	// if this cputype/subtype already exist in fat header, then there is nothing to do
+	for (uint32_t i=0; i < nfat_archs; ++i) {
+		const fat_arch*     afa                 = reinterpret_cast<fat_arch*>(fatPage+8)+i;
+		if (   (OSSwapBigToHostInt32(afa->cputype) == textMH->cputype())
+			&& (OSSwapBigToHostInt32(afa->cpusubtype) == textMH->cpusubtype()) ) {
+			//fprintf(stderr, "arch already exists in fat dylib\n");
+			return 0;
 		}
-        
-		//printf("segName=%s, offset=0x%llX, size=0x%0llX\n", it->segName, it->offset, it->sizem);
-        std::copy(((uint8_t*)mapped_cache)+it->offset, ((uint8_t*)mapped_cache)+it->offset+it->sizem, std::back_inserter(dylib_data));
-        base_ptr                                = &dylib_data.front();
-        totalSize                               += it->sizem;
 	}
-    
-	FA->size                                    = OSSwapHostToBigInt32(totalSize); 
-    
-	// optimize linkedit
-	uint64_t                newSize             = dylib_data.size();
-	optimize_linkedit<A>(((macho_header<P>*)(base_ptr+offsetInFatFile)), textOffsetInCache, mapped_cache, &newSize);
-	
-	// update fat header with new file size
-    dylib_data.resize((size_t)(offsetInFatFile+newSize));
-    base_ptr                                    = &dylib_data.front();
+
+	FH->magic                                   = OSSwapHostToBigInt32(FAT_MAGIC);
+	FH->nfat_arch                               = OSSwapHostToBigInt32(++nfat_archs);
+	FA->cputype                                 = OSSwapHostToBigInt32(textMH->cputype());
+	FA->cpusubtype                              = OSSwapHostToBigInt32(textMH->cpusubtype());
+	FA->offset                                  = OSSwapHostToBigInt32(offsetInFatFile);
+	FA->size                                    = 0; // filled in later
+	FA->align                                   = OSSwapHostToBigInt32(12);
+
+	// copy mach_header and load commands into arena, and rebuild LINKEDIT there
+	uint8_t*                slice               = arena.reserve((size_t)sliceSize + 4096);
+	if ( slice == NULL ) {
+		fprintf(stderr, "could not allocate 0x%llX bytes\n", sliceSize);
+		return -1;
+	}
+	const size_t            headerSize          = sizeof(macho_header<P>) + textMH->sizeofcmds();
+	memcpy(slice, textMH, headerSize);
+	uint64_t                newSize             = 0;
+	if ( optimize_linkedit<A>((macho_header<P>*)slice, textOffsetInCache, mapped_cache, &newSize) != 0 )
+		return -1;
 	FA->size                                    = OSSwapHostToBigInt32(newSize);
 #undef FH
 #undef FA
-	return offsetInFatFile;
-} 
 
+	// write fat header, then the slice
+	if ( !write_all(fd, fatPage, sizeof(fatPage), 0) )
+		return -1;
+	uint64_t                fileOffset          = 0;
+	for (std::vector<seg_info>::const_iterator it=segments.begin(); it != segments.end(); ++it) {
+		//printf("segName=%s, offset=0x%llX, size=0x%0llX\n", it->segName, it->offset, it->sizem);
+		const uint8_t*      segInCache          = ((uint8_t*)mapped_cache)+it->offset;
+		bool                ok;
+		if ( strcmp(it->segName, "__LINKEDIT") == 0 ) {
+			// LINKEDIT is always last, and rebuilt LINKEDIT ends at newSize
+			ok = write_all(fd, &slice[fileOffset], newSize - fileOffset, offsetInFatFile + fileOffset);
+			if ( !ok )
+				return -1;
+			break;
+		}
+		else if ( &*it == textSeg ) {
+			ok =   write_all(fd, slice, headerSize, offsetInFatFile + fileOffset)
+				&& write_all(fd, segInCache + headerSize, it->sizem - headerSize, offsetInFatFile + fileOffset + headerSize);
+		}
+		else {
+			ok = write_all(fd, segInCache, it->sizem, offsetInFatFile + fileOffset);
+		}
+		if ( !ok )
+			return -1;
+		fileOffset += it->sizem;
+	}
+	return 0;
+}
 
-int dyld_shared_cache_extract_dylibs_progress(const char* shared_cache_file_path, const char* extraction_root_path,
-													void (^progress)(unsigned current, unsigned total))
+
+int dyld_shared_cache_extract_dylibs_with_options(const char* shared_cache_file_path, const char* extraction_root_path,
+												  const struct dyld_shared_cache_extract_options* options,
+												  void (^progress)(unsigned current, unsigned total))
 {
+	if ( (options != NULL) && (options->version != 0) ) {
+		fprintf(stderr, "Error: unsupported dyld_shared_cache_extract_options version %u\n", options->version);
+		return -1;
+	}
+
 	struct stat statbuf;
 	if (stat(shared_cache_file_path, &statbuf)) {
 		fprintf(stderr, "Error: stat failed for dyld shared cache at %s\n", shared_cache_file_path);
@@ -530,7 +629,7 @@ int dyld_shared_cache_extract_dylibs_progress(const char* shared_cache_file_path
     close(cache_fd);
 
 	// instantiate arch specific dylib maker
-    size_t (*dylib_create_func)(const void*, std::vector<uint8_t>&, const std::vector<seg_info>&) = NULL;
+    int (*dylib_create_func)(const void*, int, OutputArena&, const std::vector<seg_info>&) = NULL;
 	     if ( strcmp((char*)mapped_cache, "dyld_v1    i386") == 0 ) 
 		dylib_create_func = dylib_maker<x86>;
 	else if ( strcmp((char*)mapped_cache, "dyld_v1  x86_64") == 0 ) 
@@ -567,81 +666,82 @@ int dyld_shared_cache_extract_dylibs_progress(const char* shared_cache_file_path
 		return result;
     }
 
-	// for each dylib instantiate a dylib file
-    dispatch_group_t        group               = dispatch_group_create();
-    dispatch_semaphore_t    sema                = dispatch_semaphore_create(2);
-    dispatch_queue_t        process_queue       = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);
-    dispatch_queue_t        writer_queue        = dispatch_queue_create("dyld writer queue", 0);
-    
+	// select which dylibs to extract
+	const char*             installNameGlob     = (options != NULL) ? options->installNameGlob : NULL;
+	__block std::vector<NameToSegments::const_iterator> work;
+	for (NameToSegments::const_iterator it = map.begin(); it != map.end(); ++it) {
+		if ( (installNameGlob == NULL) || (fnmatch(installNameGlob, it->first, 0) == 0) )
+			work.push_back(it);
+	}
+
+	unsigned                workerCount         = (options != NULL) ? options->workerCount : 0;
+	if ( workerCount == 0 ) {
+		long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+		workerCount = (cpuCount > 0) ? (unsigned)cpuCount : 1;
+	}
+	if ( workerCount > work.size() )
+		workerCount = (unsigned)work.size();
+
+	// each worker pulls the next dylib to extract until none are left
+	std::atomic<size_t>     nextIndex(0);
+	std::atomic<size_t>*    nextIndexPtr        = &nextIndex;
+	dispatch_group_t        group               = dispatch_group_create();
+	dispatch_queue_t        process_queue       = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);
+	dispatch_queue_t        progress_queue      = dispatch_queue_create("dyld extractor progress queue", 0);
 	__block unsigned        count               = 0;
-    
-	for ( NameToSegments::iterator it = map.begin(); it != map.end(); ++it) {
-		dispatch_semaphore_wait(sema, DISPATCH_TIME_FOREVER);
-        dispatch_group_async(group, process_queue, ^{
-            
-            char    dylib_path[PATH_MAX];
-            strcpy(dylib_path, extraction_root_path);
-            strcat(dylib_path, "/");
-            strcat(dylib_path, it->first);
-            
-            //printf("%s with %lu segments\n", dylib_path, it->second.size());
-            // make sure all directories in this path exist
-            make_dirs(dylib_path);
-            
-            // open file, create if does not already exist
-            int fd = ::open(dylib_path, O_CREAT | O_EXLOCK | O_RDWR, 0644);
-            if ( fd == -1 ) {
-                fprintf(stderr, "can't open or create dylib file %s, errnor=%d\n", dylib_path, errno);
-                result    = -1;
-                return;
-            }
-            
-            struct stat statbuf;
-            if (fstat(fd, &statbuf)) {
-                fprintf(stderr, "Error: stat failed for dyld file %s, errnor=%d\n", dylib_path, errno);
-                close(fd);
-                result    = -1;
-                return;
-            }
-            
-            std::vector<uint8_t> *vec   = new std::vector<uint8_t>((size_t)statbuf.st_size);
-            if(pread(fd, &vec->front(), vec->size(), 0) != (long)vec->size()) {
-                fprintf(stderr, "can't read dylib file %s, errnor=%d\n", dylib_path, errno);
-                close(fd);
-                result    = -1;
-                return;
-            }
-            
-            const size_t    offset  = dylib_create_func(mapped_cache, *vec, it->second);
-            
-            dispatch_group_async(group, writer_queue, ^{
-                progress(count++, (unsigned)map.size());
-                
-                if(offset != vec->size()) {
-                    //Write out the first page, and everything after offset
-                    if(   pwrite(fd, &vec->front(), 4096, 0) == -1 
-                       || pwrite(fd, &vec->front() + offset, vec->size() - offset, offset) == -1) {
-                        fprintf(stderr, "error writing, errnor=%d\n", errno);
-                        result    = -1;
-                    }
-                }
-                
-                delete vec;
-                close(fd);
-                dispatch_semaphore_signal(sema);
-            });
-        });
+
+	for (unsigned worker=0; worker < workerCount; ++worker) {
+		dispatch_group_async(group, process_queue, ^{
+			OutputArena arena;
+			for (size_t i = nextIndexPtr->fetch_add(1); i < work.size(); i = nextIndexPtr->fetch_add(1)) {
+				NameToSegments::const_iterator it = work[i];
+
+				char    dylib_path[PATH_MAX];
+				strcpy(dylib_path, extraction_root_path);
+				strcat(dylib_path, "/");
+				strcat(dylib_path, it->first);
+
+				//printf("%s with %lu segments\n", dylib_path, it->second.size());
+				// make sure all directories in this path exist
+				make_dirs(dylib_path);
+
+				// open file, create if does not already exist
+				int fd = ::open(dylib_path, O_CREAT | O_EXLOCK | O_RDWR, 0644);
+				if ( fd == -1 ) {
+					fprintf(stderr, "can't open or create dylib file %s, errnor=%d\n", dylib_path, errno);
+					result    = -1;
+				}
+				else {
+					if ( dylib_create_func(mapped_cache, fd, arena, it->second) != 0 ) {
+						fprintf(stderr, "error writing %s, errnor=%d\n", dylib_path, errno);
+						result    = -1;
+					}
+					close(fd);
+				}
+
+				dispatch_sync(progress_queue, ^{
+					progress(count++, (unsigned)work.size());
+				});
+			}
+		});
 	}
-    
-    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
-    dispatch_release(group);
-    dispatch_release(writer_queue);
-    
-    munmap(mapped_cache, (size_t)statbuf.st_size);
+
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+	dispatch_release(group);
+	dispatch_release(progress_queue);
+
+	munmap(mapped_cache, (size_t)statbuf.st_size);
 	return result;
 }
 
 
+int dyld_shared_cache_extract_dylibs_progress(const char* shared_cache_file_path, const char* extraction_root_path,
+													void (^progress)(unsigned current, unsigned total))
+{
+	return dyld_shared_cache_extract_dylibs_with_options(shared_cache_file_path, extraction_root_path, NULL, progress);
+}
+
+
 
 int dyld_shared_cache_extract_dylibs(const char* shared_cache_file_path, const char* extraction_root_path)
 {
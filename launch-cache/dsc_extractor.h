@@ -35,6 +35,16 @@ extern int dyld_shared_cache_extract_dylibs(const char* shared_cache_file_path,
 extern int dyld_shared_cache_extract_dylibs_progress(const char* shared_cache_file_path, const char* extraction_root_path,
 													void (^progress)(unsigned current, unsigned total));
 
+struct dyld_shared_cache_extract_options {
+	uint32_t		version;			// must be 0
+	uint32_t		workerCount;		// dylibs extracted concurrently, 0 means one per active cpu
+	const char*		installNameGlob;	// if not NULL, only extract dylibs whose install name matches this fnmatch(3) pattern
+};
+
+extern int dyld_shared_cache_extract_dylibs_with_options(const char* shared_cache_file_path, const char* extraction_root_path,
+													const struct dyld_shared_cache_extract_options* options,
+													void (^progress)(unsigned current, unsigned total));
+
 #ifdef __cplusplus
 }
 #endif 
@@ -24,6 +24,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdarg.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -53,57 +54,12 @@ int update_dyld_shared_cache_load_address(const char* path, void (*logProc)(cons
 		close(fd);
 		return -1;
 	}
-	bool has64BitPointers = false;
-	bool isBigEndian = false;
-	uint64_t startReadOnlySharedRegion = 0;
-	uint64_t endReadOnlySharedRegion = 0;
-	uint64_t startReadWriteSharedRegion = 0;
-	uint64_t endReadWriteSharedRegion = 0;
-	if ( strcmp((char*)buffer, "dyld_v1    i386") == 0 ) {
-		has64BitPointers = false;
-		isBigEndian = false;
-	}
-	else if ( strcmp((char*)buffer, "dyld_v1  x86_64") == 0 ) {
-		has64BitPointers = true;
-		isBigEndian = false;
-		startReadOnlySharedRegion  = 0x7FFF80000000LL;
-		endReadOnlySharedRegion    = 0x7FFFC0000000LL;
-		startReadWriteSharedRegion = 0x7FFF70000000LL;
-		endReadWriteSharedRegion   = 0x7FFF80000000LL;
-	}
-	else if ( strcmp((char*)buffer, "dyld_v1     ppc") == 0 ) {
-		has64BitPointers = false;
-		isBigEndian = true;
-	}
-	else if ( strcmp((char*)buffer, "dyld_v1   armv5") == 0 ) {
-		has64BitPointers = false;
-		isBigEndian = false;
-		startReadOnlySharedRegion  = 0x30000000LL;
-		endReadOnlySharedRegion    = 0x3E000000LL;
-		startReadWriteSharedRegion = 0x3E000000LL;
-		endReadWriteSharedRegion   = 0x40000000LL;
-	}
-	else if ( strcmp((char*)buffer, "dyld_v1   armv6") == 0 ) {
-		has64BitPointers = false;
-		isBigEndian = false;
-		startReadOnlySharedRegion  = 0x30000000LL;
-		endReadOnlySharedRegion    = 0x3E000000LL;
-		startReadWriteSharedRegion = 0x3E000000LL;
-		endReadWriteSharedRegion   = 0x40000000LL;
-	}
-	else if ( strcmp((char*)buffer, "dyld_v1   armv7") == 0 ) {
-		has64BitPointers = false;
-		isBigEndian = false;
-		startReadOnlySharedRegion  = 0x30000000LL;
-		endReadOnlySharedRegion    = 0x3E000000LL;
-		startReadWriteSharedRegion = 0x3E000000LL;
-		endReadWriteSharedRegion   = 0x40000000LL;
-	}
-	else {
+	if ( strncmp((char*)buffer, "dyld_v1 ", 8) != 0 ) {
 		(*logProc)("file %s is not a known dyld shared cache file\n", path);
 		close(fd);
 		return -1;
 	}
+	bool isBigEndian = (strcmp((char*)buffer, "dyld_v1     ppc") == 0);
 #if __BIG_ENDIAN__ 
 	bool swap = !isBigEndian;
 #else
@@ -125,167 +81,149 @@ int update_dyld_shared_cache_load_address(const char* path, void (*logProc)(cons
 		return -1;
 	}
 
-	uint64_t slidePointersOffset = swap ? OSSwapInt64(header->slidePointersOffset) : header->slidePointersOffset;
-	uint64_t slidePointersSize = swap ? OSSwapInt64(header->slidePointersSize) : header->slidePointersSize;
-	if ( (slidePointersOffset == 0) || (slidePointersSize == 0) ) {
+	uint64_t slideInfoOffset = swap ? OSSwapInt64(header->slideInfoOffset) : header->slideInfoOffset;
+	uint64_t slideInfoSize = swap ? OSSwapInt64(header->slideInfoSize) : header->slideInfoSize;
+	if ( (slideInfoOffset == 0) || (slideInfoSize < sizeof(uint32_t)) ) {
 		(*logProc)("dyld shared cache file %s is missing slide information\n", path);
 		close(fd);
 		return -1;
 	}
-	
-	// read slide info
-	void* slideInfo = malloc(slidePointersSize);
-	if ( slideInfo == NULL ) {
-		(*logProc)("malloc(%llu) failed\n", slidePointersSize);
+	uint32_t slideInfoVersion;
+	if ( pread(fd, &slideInfoVersion, sizeof(slideInfoVersion), slideInfoOffset) != sizeof(slideInfoVersion) ) {
+		(*logProc)("slide info pread(fd, buf, %lu, %llu) failed\n", sizeof(slideInfoVersion), slideInfoOffset);
 		close(fd);
 		return -1;
 	}
-	int64_t amountRead = pread(fd, slideInfo, slidePointersSize, slidePointersOffset);
-	if ( amountRead != (int64_t)slidePointersSize ) {
-		(*logProc)("slide info pread(fd, buf, %llu, %llu) failed\n", slidePointersSize, slidePointersOffset);
-		close(fd);
-		return -1;
+	close(fd);
+	if ( swap )
+		slideInfoVersion = OSSwapInt32(slideInfoVersion);
+
+	// DATA in caches with chained slide info always holds unslid values.  The
+	// slide is picked each boot when the cache is mapped, so there is nothing
+	// to randomize in the file itself.
+	if ( (slideInfoVersion == 2) || (slideInfoVersion == 3) ) {
+		(*logProc)("dyld shared cache file %s uses slide info v%u, which is applied when the cache is mapped\n", path, slideInfoVersion);
+		return 0;
 	}
 
-	// read all DATA 
-	const dyld_cache_mapping_info* mappings = (dyld_cache_mapping_info*)&buffer[mappingOffset];
-	uint64_t dataFileOffset = swap ? OSSwapInt64(mappings[1].fileOffset) : mappings[1].fileOffset;
-	uint64_t dataSize = swap ? OSSwapInt64(mappings[1].size) : mappings[1].size;
-	uint8_t* data = (uint8_t*)malloc(dataSize);
-	amountRead = pread(fd, data, dataSize, dataFileOffset);
-	if ( amountRead != (int64_t)dataSize ) {
-		(*logProc)("data pread(fd, buf, %llu, %llu) failed\n", data, dataSize);
-		close(fd);
+	(*logProc)("dyld shared cache file %s has unsupported slide info version %u\n", path, slideInfoVersion);
+	return -1;
+}
+
+
+static int slideDataV2(const dyld_cache_slide_info2* info, uint64_t slideInfoSize, uint8_t* data, uint64_t dataSize,
+					   uint64_t slide, bool has64BitPointers, void (*logProc)(const char* format, ...))
+{
+	const uint16_t* pageStarts = (uint16_t*)((uint8_t*)info + info->page_starts_offset);
+	const uint16_t* pageExtras = (uint16_t*)((uint8_t*)info + info->page_extras_offset);
+	if ( (info->page_starts_offset + info->page_starts_count*sizeof(uint16_t) > slideInfoSize)
+	  || (info->page_extras_offset + info->page_extras_count*sizeof(uint16_t) > slideInfoSize)
+	  || ((uint64_t)info->page_starts_count*info->page_size > dataSize) ) {
+		(*logProc)("slide info v2 tables out of range\n");
 		return -1;
 	}
-	
-	// close read-only file
-	close(fd);
-	
-	// extract current slide
-	uint64_t headerDataUses;
-	if ( has64BitPointers ) {
-		headerDataUses = *((uint64_t*)data);
-		if ( swap ) 
-			headerDataUses = OSSwapInt64(headerDataUses);
-	}
-	else {
-		uint32_t temp = *((uint32_t*)data);
-		if ( swap ) 
-			temp = OSSwapInt32(temp);
-		headerDataUses = temp;
-	}
-	uint64_t textAddress = swap ? OSSwapInt64(mappings[0].address) : mappings[0].address;
-	uint32_t currentSlide = headerDataUses - textAddress;
-	(*logProc)("currentSlide=0x%08X\n", currentSlide);
-	
-	// find read-only space
-	uint64_t linkeditAddress = swap ? OSSwapInt64(mappings[2].address) : mappings[2].address;
-	uint64_t linkeditSize = swap ? OSSwapInt64(mappings[2].size) : mappings[2].size;
-	uint64_t linkeditEnd = linkeditAddress + linkeditSize;
-	uint64_t roSpace = endReadOnlySharedRegion - linkeditEnd;
-	(*logProc)("ro space=0x%08llX\n", roSpace);
-	
-	// find read-write space
-	uint64_t dataAddress = swap ? OSSwapInt64(mappings[1].address) : mappings[1].address;
-	uint64_t dataEnd = dataAddress + dataSize;
-	uint64_t rwSpace = endReadWriteSharedRegion - dataEnd;
-	(*logProc)("rw space=0x%08llX\n", rwSpace);
-	
-	// choose new random slide
-	uint32_t slideSpace = rwSpace;
-	if ( roSpace < rwSpace )
-		slideSpace = roSpace;
-	uint32_t newSlide = (arc4random() % slideSpace) & (-4096);
-	(*logProc)("newSlide=0x%08X\n", newSlide);
-	int32_t slideAdjustment = newSlide - currentSlide;
-	
-	// update DATA with slide info
-	uint64_t offsetInCacheFile = 0;
-	const uint8_t* infoStart = (uint8_t*)slideInfo;
-	const uint8_t* infoEnd = infoStart + slidePointersSize;
-	for(const uint8_t* p = infoStart; (*p != 0) && (p < infoEnd); ) {
-		uint64_t delta = 0;
-		uint32_t shift = 0;
-		bool more = true;
-		do {
-			uint8_t byte = *p++;
-			delta |= ((byte & 0x7F) << shift);
-			shift += 7;
-			if ( byte < 0x80 ) {
-				offsetInCacheFile += delta;
-				// verify in DATA range
-				if ( (offsetInCacheFile < dataFileOffset) || (offsetInCacheFile > (dataFileOffset+dataSize)) ) {
-					(*logProc)("pointer offset 0x%llX outside DATA range\n", offsetInCacheFile);
+	const uint64_t deltaMask  = info->delta_mask;
+	const uint64_t valueMask  = ~deltaMask;
+	const unsigned deltaShift = __builtin_ctzll(deltaMask) - 2;
+	for (uint32_t i=0; i < info->page_starts_count; ++i) {
+		uint8_t* page = &data[(uint64_t)i*info->page_size];
+		uint16_t pageEntry = pageStarts[i];
+		if ( pageEntry == DYLD_CACHE_SLIDE_PAGE_ATTR_NO_REBASE )
+			continue;
+		uint16_t chainIndex = (pageEntry & 0x3FFF);
+		bool	 done = false;
+		while ( !done ) {
+			uint32_t pageOffset;
+			if ( pageEntry & DYLD_CACHE_SLIDE_PAGE_ATTR_EXTRA ) {
+				if ( chainIndex >= info->page_extras_count ) {
+					(*logProc)("slide info v2 page %u extras out of range\n", i);
 					return -1;
 				}
-				uint32_t offsetInData = offsetInCacheFile - dataFileOffset;
+				uint16_t pInfo = pageExtras[chainIndex++];
+				pageOffset = (pInfo & 0x3FFF)*4;
+				done = (pInfo & DYLD_CACHE_SLIDE_PAGE_ATTR_END);
+			}
+			else {
+				pageOffset = pageEntry*4;
+				done = true;
+			}
+			uint32_t delta = 1;
+			while ( delta != 0 ) {
+				if ( pageOffset + (has64BitPointers ? 8 : 4) > info->page_size ) {
+					(*logProc)("slide info v2 chain runs off page %u\n", i);
+					return -1;
+				}
+				uint8_t* loc = &page[pageOffset];
 				if ( has64BitPointers ) {
-					uint64_t value64 = *((uint64_t*)(&data[offsetInData]));
-					if ( swap ) 
-						value64 = OSSwapInt64(value64);
-					value64 += slideAdjustment;
-					if ( swap ) 
-						value64 = OSSwapInt64(value64);
-					*((uint64_t*)(&data[offsetInData])) = value64;
+					uint64_t rawValue = *((uint64_t*)loc);
+					delta = (uint32_t)((rawValue & deltaMask) >> deltaShift);
+					uint64_t value = (rawValue & valueMask);
+					if ( value != 0 )
+						value += info->value_add + slide;
+					*((uint64_t*)loc) = value;
 				}
 				else {
-					uint64_t value32 = *((uint32_t*)(&data[offsetInData]));
-					if ( swap ) 
-						value32 = OSSwapInt32(value32);
-					value32 += slideAdjustment;
-					if ( swap ) 
-						value32 = OSSwapInt32(value32);
-					*((uint32_t*)(&data[offsetInData])) = value32;
+					uint32_t rawValue = *((uint32_t*)loc);
+					delta = (uint32_t)((rawValue & deltaMask) >> deltaShift);
+					uint32_t value = (rawValue & (uint32_t)valueMask);
+					if ( value != 0 )
+						value += (uint32_t)(info->value_add + slide);
+					*((uint32_t*)loc) = value;
 				}
-				//(*logProc)("update pointer at offset 0x%08X", offsetInData);
-				more = false;
+				pageOffset += delta;
 			}
-		} while (more);
+		}
 	}
-	free(slideInfo);
-	slideInfo = NULL;
-	
-	// re-open cache file and overwrite DATA range
-	fd = open(path, O_RDWR, 0);
-	if ( fd == -1 ) {
-		(*logProc)("open(%s) failed, errno=%d\n", path, errno);
-		return -1;
-	}
-	(void)fcntl(fd, F_NOCACHE, 1); // tell kernel to not cache file content
-	uint64_t amountWrote = pwrite(fd, data, dataSize, dataFileOffset);
-	if ( amountWrote != dataSize ) {
-		(*logProc)("data pwrite(fd, buf, %llu, %llu) failed\n", data, dataSize);
-		close(fd);
-		return -1;
-	}
-	close(fd);
-	
-	// re-open and re-read to verify write
-	fd = open(path, O_RDONLY, 0);
-	if ( fd == -1 ) {
-		(*logProc)("verify open(%s) failed, errno=%d\n", path, errno);
+	return 0;
+}
+
+
+static int slideDataV3(const dyld_cache_slide_info3* info, uint64_t slideInfoSize, uint8_t* data, uint64_t dataSize,
+					   uint64_t slide, void (*logProc)(const char* format, ...))
+{
+	const uint16_t* pageStarts = (uint16_t*)((uint8_t*)info + info->page_starts_offset);
+	if ( (info->page_starts_offset + info->page_starts_count*sizeof(uint16_t) > slideInfoSize)
+	  || ((uint64_t)info->page_starts_count*info->page_size > dataSize) ) {
+		(*logProc)("slide info v3 tables out of range\n");
 		return -1;
 	}
-	(void)fcntl(fd, F_NOCACHE, 1); // tell kernel to not cache file content
-	uint8_t* dataVerify = (uint8_t*)malloc(dataSize);
-	amountRead = pread(fd, dataVerify, dataSize, dataFileOffset);
-	if ( amountRead != (int64_t)dataSize ) {
-		(*logProc)("verify data pread(fd, buf, %llu, %llu) failed\n", data, dataSize);
-		close(fd);
-		return -1;
+	const uint64_t valueAdd = info->value_add + slide;
+	for (uint32_t i=0; i < info->page_starts_count; ++i) {
+		uint16_t pageOffset = pageStarts[i];
+		if ( pageOffset == DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE )
+			continue;
+		uint64_t* loc = (uint64_t*)&data[(uint64_t)i*info->page_size + pageOffset];
+		uint64_t* end = (uint64_t*)&data[(uint64_t)(i+1)*info->page_size];
+		uint64_t  delta;
+		do {
+			if ( loc >= end ) {
+				(*logProc)("slide info v3 chain runs off page %u\n", i);
+				return -1;
+			}
+			uint64_t rawValue = *loc;
+			delta = (rawValue >> DYLD_CACHE_SLIDE_V3_DELTA_SHIFT) & DYLD_CACHE_SLIDE_V3_DELTA_MASK;
+			*loc = (rawValue & DYLD_CACHE_SLIDE_V3_VALUE_MASK) + valueAdd;
+			loc += delta;
+		} while ( delta != 0 );
 	}
-	close(fd);
-	if ( memcmp(data, dataVerify, dataSize) != 0 ) {
-		(*logProc)("data update verification failed\n");
+	return 0;
+}
+
+
+int dyld_shared_cache_slide_data(const void* slideInfo, uint64_t slideInfoSize, void* data, uint64_t dataSize,
+								 uint64_t slide, bool has64BitPointers, void (*logProc)(const char* format, ...))
+{
+	if ( slideInfoSize < sizeof(uint32_t) ) {
+		(*logProc)("slide info too small\n");
 		return -1;
 	}
-	free(data);
-	free(dataVerify);
-
-	
-	// success
-	return 0;
+	uint32_t version = *((uint32_t*)slideInfo);
+	if ( (version == 2) && (slideInfoSize >= sizeof(dyld_cache_slide_info2)) )
+		return slideDataV2((dyld_cache_slide_info2*)slideInfo, slideInfoSize, (uint8_t*)data, dataSize, slide, has64BitPointers, logProc);
+	if ( (version == 3) && (slideInfoSize >= sizeof(dyld_cache_slide_info3)) && has64BitPointers )
+		return slideDataV3((dyld_cache_slide_info3*)slideInfo, slideInfoSize, (uint8_t*)data, dataSize, slide, logProc);
+	(*logProc)("unsupported slide info version %u\n", version);
+	return -1;
 }
 
 
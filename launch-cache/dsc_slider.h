@@ -23,6 +23,7 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +38,16 @@ extern "C" {
 //
 extern int update_dyld_shared_cache_load_address(const char* path, void (*logProc)(const char* format, ...) );
 
+//
+// This function applies slide info (version 2 or 3) to an in-memory copy of the DATA mapping of a dyld shared
+// cache, the same way the kernel or dyld does when the cache is mapped.  The data must be little endian.
+//
+// On success, the return value is zero.
+// On failure the return value is non-zero and an explanation error was written to the logProc callback.
+//
+extern int dyld_shared_cache_slide_data(const void* slideInfo, uint64_t slideInfoSize, void* data, uint64_t dataSize,
+										uint64_t slide, bool has64BitPointers, void (*logProc)(const char* format, ...) );
+
 
 #ifdef __cplusplus
 }
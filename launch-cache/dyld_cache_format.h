@@ -85,7 +85,7 @@ struct dyld_cache_image_info_extra
 
 struct dyld_cache_accelerator_info
 {
-	uint32_t	version;				// currently 1
+	uint32_t	version;				// currently 3
 	uint32_t	imageExtrasCount;		// does not include aliases
 	uint32_t	imagesExtrasOffset;		// offset into this chunk of first dyld_cache_image_info_extra
 	uint32_t	bottomUpListOffset;		// offset into this chunk to start of 16-bit array of sorted image indexes
@@ -102,6 +102,41 @@ struct dyld_cache_accelerator_info
 	uint32_t	rangeTableOffset;		// offset into this chunk to start of ss
 	uint32_t	rangeTableCount;		// size of dependencies
 	uint64_t	dyldSectionAddr;		// address of libdyld's __dyld section in unslid cache
+	// following fields only exist in version >= 2
+	uint32_t	dylibHashSeed;			// seed passed to dyld_cache_dylib_path_hash()
+	uint32_t	dylibHashBucketCount;	// size of displacements array
+	uint32_t	dylibHashDisplacementsOffset; // offset into this chunk to start of 32-bit array of per-bucket displacements
+	uint32_t	dylibHashSlotsOffset;	// offset into this chunk to start of dyld_cache_accelerator_dylib_slot array
+	uint32_t	dylibHashSlotCount;		// number of install names and aliases in hash table (0 if no table)
+	uint32_t	dylibHashStringsOffset;	// offset into this chunk to start of path strings used by slots
+	uint32_t	dylibHashStringsSize;	// size of path strings
+	uint32_t	dylibHashPad;
+	// following fields only exist in version >= 3
+	uint32_t	exportIndexesOffset;	// offset into this chunk to start of dyld_cache_accelerator_export_index array, one per image (0 if no flattened export index)
+	uint32_t	exportEntriesOffset;	// offset into this chunk to start of dyld_cache_accelerator_export_entry array
+	uint32_t	exportEntriesCount;		// total buckets in all flattened export indexes
+	uint32_t	exportIndexPad;
+};
+
+struct dyld_cache_accelerator_dylib_slot
+{
+	uint32_t	pathOffset;				// offset into this chunk of install name or alias
+	uint32_t	imageIndex;
+};
+
+// Flattened export index of an image with re-exports: every symbol reachable through its re-export
+// tree mapped to the image and export trie node where a recursive search would first find it.
+struct dyld_cache_accelerator_export_index
+{
+	uint32_t	entriesStartIndex;		// index into dyld_cache_accelerator_export_entry array of first bucket
+	uint32_t	bucketCount;			// power of two, zero if image has no flattened index
+};
+
+struct dyld_cache_accelerator_export_entry
+{
+	uint32_t	nameHash;				// dyld_cache_export_name_hash() of symbol, 0 marks empty bucket
+	uint32_t	imageIndex;				// image whose exports trie contains symbol
+	uint32_t	nodeOffset;				// offset into that exports trie of terminal info for symbol
 };
 
 struct dyld_cache_accelerator_initializer
@@ -230,6 +265,48 @@ struct dyld_cache_slide_info2
 #define DYLD_CACHE_SLIDE_PAGE_ATTR_END			0x8000  // last chain entry for page
 
 
+// The version 3 of the slide info is for 64-bit caches only.  It keeps the
+// linked list idea of version 2, but requires every rebase location to be
+// 8-byte aligned, which means a single chain always covers a whole page and
+// there is no need for page extras, nor for the zero-filler entries version 2
+// uses to bridge large gaps.  Each rebase location holds:
+//
+//	bits  0..50	target address minus value_add (the unslid start of the cache)
+//	bits 51..61	delta to the next rebase location, in 8-byte units (0 => end)
+//	bits 62..63	zero
+//
+// The 11-bit delta reaches across a full 16KB page, and the value field can
+// address any target in the cache, so the value base is the same for every
+// page.  pageStarts[pageIndex] is the byte offset of the first rebase location
+// in the page, or DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE if the page has none.
+//
+// The code for processing a page is:
+//
+//	uint64_t* loc = (uint64_t*)(pageStart + pageStarts[pageIndex]);
+//	uint64_t delta;
+//	do {
+//		uint64_t rawValue = *loc;
+//		delta = (rawValue >> DYLD_CACHE_SLIDE_V3_DELTA_SHIFT) & DYLD_CACHE_SLIDE_V3_DELTA_MASK;
+//		*loc = (rawValue & DYLD_CACHE_SLIDE_V3_VALUE_MASK) + valueAdd + slideAmount;
+//		loc += delta;
+//	} while ( delta != 0 );
+//
+//
+struct dyld_cache_slide_info3
+{
+	uint32_t	version;		// currently 3
+	uint32_t	page_size;		// currently 4096 (may also be 16384)
+	uint32_t	page_starts_offset;
+	uint32_t	page_starts_count;
+	uint64_t	value_add;		// unslid address of start of cache
+	//uint16_t	page_starts[page_starts_count];
+};
+#define DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE	0xFFFF	// page has no rebasing
+#define DYLD_CACHE_SLIDE_V3_VALUE_MASK			0x0007FFFFFFFFFFFFULL
+#define DYLD_CACHE_SLIDE_V3_DELTA_SHIFT			51
+#define DYLD_CACHE_SLIDE_V3_DELTA_MASK			0x7FF
+
+
 struct dyld_cache_local_symbols_info
 {
 	uint32_t	nlistOffset;		// offset into this chunk of nlist entries
@@ -258,6 +335,48 @@ static const uint64_t kDyldSharedCacheTypeDevelopment = 0;
 static const uint64_t kDyldSharedCacheTypeProduction = 1;
 
 
+// Minimal perfect hash over all install names and aliases in the accelerator tables.
+// A path hashes once, picks a bucket, and the bucket's displacement selects the only slot
+// that path could be in.  The caller must strcmp() the slot's path to reject misses.
+static inline uint64_t dyld_cache_dylib_hash_mix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDULL;
+	x ^= x >> 33;
+	x *= 0xC4CEB9FE1A85EC53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static inline uint64_t dyld_cache_dylib_path_hash(const char* path, uint32_t seed)
+{
+	uint64_t hash = 0xCBF29CE484222325ULL ^ seed;
+	for (const uint8_t* s = (const uint8_t*)path; *s != '\0'; ++s) {
+		hash ^= *s;
+		hash *= 0x100000001B3ULL;
+	}
+	return dyld_cache_dylib_hash_mix(hash);
+}
+
+static inline uint32_t dyld_cache_dylib_hash_bucket(uint64_t hash, uint32_t bucketCount)
+{
+	return (uint32_t)((hash >> 32) % bucketCount);
+}
+
+static inline uint32_t dyld_cache_dylib_hash_slot(uint64_t hash, uint32_t displacement, uint32_t slotCount)
+{
+	return (uint32_t)(dyld_cache_dylib_hash_mix(hash + (displacement+1ULL)*0x9E3779B97F4A7C15ULL) % slotCount);
+}
+
+// Buckets in a flattened export index are probed linearly starting at (hash & (bucketCount-1)).
+// Hashes can collide, so a hit must be confirmed by walking the exports trie of the entry's image.
+static inline uint32_t dyld_cache_export_name_hash(const char* symbolName)
+{
+	uint32_t hash = (uint32_t)dyld_cache_dylib_path_hash(symbolName, 0);
+	return (hash != 0) ? hash : 1;
+}
+
+
 
 
 #endif // __DYLD_CACHE_FORMAT__
@@ -30,18 +30,22 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <stdarg.h>
 #include <sys/mman.h>
 #include <sys/syslimits.h>
 #include <mach-o/arch.h>
 #include <mach-o/loader.h>
 #include <mach-o/dyld.h>
 #include <mach/mach.h>
+#include <mach/mach_time.h>
 
 #include <map>
+#include <algorithm>
 #include <vector>
 
 #include "dsc_iterator.h"
 #include "dsc_extractor.h"
+#include "dsc_slider.h"
 #include "dyld_cache_format.h"
 #include "Architectures.hpp"
 #include "MachOFileAbstraction.hpp"
@@ -54,6 +58,7 @@ enum Mode {
 	modeMap,
 	modeDependencies,
 	modeSlideInfo,
+	modeCompareSlideInfo,
 	modeAcceleratorInfo,
 	modeTextInfo,
 	modeLinkEdit,
@@ -68,6 +73,8 @@ struct Options {
 	const char*	dependentsOfPath;
 	const void*	mappedCache;
 	const char*	extractionDir;
+	const char*	extractInstallNameGlob;
+	uint32_t	extractWorkers;
 	bool		printUUIDs;
 	bool		printVMAddrs;
     bool		printDylibVersions;
@@ -95,7 +102,7 @@ struct Results {
 
 
 void usage() {
-	fprintf(stderr, "Usage: dyld_shared_cache_util -list [ -uuid ] [-vmaddr] | -dependents <dylib-path> [ -versions ] | -linkedit | -map | -slide_info | -info | -extract <dylib-dir>  [ shared-cache-file ] \n");
+	fprintf(stderr, "Usage: dyld_shared_cache_util -list [ -uuid ] [-vmaddr] | -dependents <dylib-path> [ -versions ] | -linkedit | -map | -slide_info | -compare_slide_info | -info | -extract <dylib-dir> [ -workers <n> ] [ -install_name_glob <pattern> ]  [ shared-cache-file ] \n");
 }
 
 #if __x86_64__
@@ -339,9 +346,144 @@ void print_map(const dyld_shared_cache_dylib_info* dylibInfo, const dyld_shared_
 }
 
 
+static void slideLogger(const char* format, ...)
+{
+	va_list	list;
+	va_start(list, format);
+	fprintf(stderr, "Error: ");
+	vfprintf(stderr, format, list);
+	va_end(list);
+}
+
+// Re-encodes the version 2 slide info of a 64-bit cache as version 3, then times
+// sliding every DATA page with each format using dyld_shared_cache_slide_data().
+static int compareSlideInfo(const void* mappedCache)
+{
+	const dyldCacheHeader<LittleEndian>* header = (dyldCacheHeader<LittleEndian>*)mappedCache;
+	if ( header->slideInfoOffset() == 0 ) {
+		fprintf(stderr, "Error: dyld shared cache does not contain slide info\n");
+		return 1;
+	}
+	const dyld_cache_slide_info2* infoV2 = (dyld_cache_slide_info2*)((char*)mappedCache + header->slideInfoOffset());
+	if ( (infoV2->version != 2) || (strstr(header->magic(), "64") == NULL) ) {
+		fprintf(stderr, "Error: -compare_slide_info requires a 64-bit cache with version 2 slide info\n");
+		return 1;
+	}
+	const dyldCacheFileMapping<LittleEndian>* mappings = (dyldCacheFileMapping<LittleEndian>*)((char*)mappedCache + header->mappingOffset());
+	const uint64_t dataSize   = mappings[1].size();
+	const uint8_t* dataOnDisk = (uint8_t*)mappedCache + mappings[1].file_offset();
+	const uint32_t pageSize   = infoV2->page_size;
+	const uint32_t pageCount  = infoV2->page_starts_count;
+	const uint64_t valueAdd   = mappings[0].address();
+
+	// walk v2 chains to find every rebase location, and strip the chain bits to get plain unslid DATA
+	std::vector<uint8_t> plainData(dataOnDisk, dataOnDisk+dataSize);
+	std::vector<std::vector<uint16_t>> rebaseOffsets(pageCount);
+	const uint16_t* pageStarts = (uint16_t*)((uint8_t*)infoV2 + infoV2->page_starts_offset);
+	const uint16_t* pageExtras = (uint16_t*)((uint8_t*)infoV2 + infoV2->page_extras_offset);
+	const uint64_t  deltaMask  = infoV2->delta_mask;
+	const unsigned  deltaShift = __builtin_ctzll(deltaMask) - 2;
+	uint64_t		chainEntriesV2 = 0;
+	for (uint32_t i=0; i < pageCount; ++i) {
+		uint16_t pageEntry = pageStarts[i];
+		if ( pageEntry == DYLD_CACHE_SLIDE_PAGE_ATTR_NO_REBASE )
+			continue;
+		std::vector<uint16_t> chainStarts;
+		if ( pageEntry & DYLD_CACHE_SLIDE_PAGE_ATTR_EXTRA ) {
+			for (uint16_t j=(pageEntry & 0x3FFF); ; ++j) {
+				chainStarts.push_back((pageExtras[j] & 0x3FFF)*4);
+				if ( pageExtras[j] & DYLD_CACHE_SLIDE_PAGE_ATTR_END )
+					break;
+			}
+		}
+		else {
+			chainStarts.push_back(pageEntry*4);
+		}
+		for (uint16_t pageOffset : chainStarts) {
+			uint32_t delta = 1;
+			while ( delta != 0 ) {
+				uint64_t* loc = (uint64_t*)&plainData[(uint64_t)i*pageSize + pageOffset];
+				delta = (uint32_t)((*loc & deltaMask) >> deltaShift);
+				*loc &= ~deltaMask;
+				++chainEntriesV2;
+				if ( *loc != 0 ) {
+					if ( ((pageOffset % 8) != 0) || ((*loc + infoV2->value_add - valueAdd) > DYLD_CACHE_SLIDE_V3_VALUE_MASK) ) {
+						fprintf(stderr, "Error: rebase location at DATA offset 0x%llX cannot be encoded in slide info v3\n", (uint64_t)i*pageSize + pageOffset);
+						return 1;
+					}
+					*loc += infoV2->value_add;
+					rebaseOffsets[i].push_back(pageOffset);
+				}
+				pageOffset += delta;
+			}
+		}
+	}
+
+	// build v3 slide info and DATA
+	std::vector<uint8_t> dataV3 = plainData;
+	std::vector<uint8_t> slideInfoV3(sizeof(dyld_cache_slide_info3) + pageCount*sizeof(uint16_t));
+	dyld_cache_slide_info3* infoV3 = (dyld_cache_slide_info3*)&slideInfoV3[0];
+	infoV3->version            = 3;
+	infoV3->page_size          = pageSize;
+	infoV3->page_starts_offset = sizeof(dyld_cache_slide_info3);
+	infoV3->page_starts_count  = pageCount;
+	infoV3->value_add          = valueAdd;
+	uint16_t* pageStartsV3 = (uint16_t*)&slideInfoV3[infoV3->page_starts_offset];
+	uint64_t  rebaseCount = 0;
+	for (uint32_t i=0; i < pageCount; ++i) {
+		std::vector<uint16_t>& offsets = rebaseOffsets[i];
+		std::sort(offsets.begin(), offsets.end());
+		pageStartsV3[i] = offsets.empty() ? DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE : offsets[0];
+		for (size_t j=0; j < offsets.size(); ++j) {
+			uint64_t* loc = (uint64_t*)&dataV3[(uint64_t)i*pageSize + offsets[j]];
+			uint64_t delta = (j+1 < offsets.size()) ? (offsets[j+1] - offsets[j])/8 : 0;
+			*loc = (*loc - valueAdd) | (delta << DYLD_CACHE_SLIDE_V3_DELTA_SHIFT);
+		}
+		rebaseCount += offsets.size();
+	}
+
+	// slide both encodings repeatedly from a fresh copy of DATA
+	const unsigned kIterations = 20;
+	const uint64_t slide = 0x12340000;
+	mach_timebase_info_data_t timebase;
+	mach_timebase_info(&timebase);
+	std::vector<uint8_t> workV2(dataSize);
+	std::vector<uint8_t> workV3(dataSize);
+	const uint64_t sizeV2 = infoV2->page_extras_offset + infoV2->page_extras_count*sizeof(uint16_t);
+	uint64_t bestV2 = UINT64_MAX, bestV3 = UINT64_MAX, totalV2 = 0, totalV3 = 0;
+	for (unsigned iter=0; iter < kIterations; ++iter) {
+		memcpy(&workV2[0], dataOnDisk, dataSize);
+		uint64_t t0 = mach_absolute_time();
+		if ( dyld_shared_cache_slide_data(infoV2, sizeV2, &workV2[0], dataSize, slide, true, &slideLogger) != 0 )
+			return 1;
+		uint64_t t1 = mach_absolute_time();
+		memcpy(&workV3[0], &dataV3[0], dataSize);
+		uint64_t t2 = mach_absolute_time();
+		if ( dyld_shared_cache_slide_data(infoV3, slideInfoV3.size(), &workV3[0], dataSize, slide, true, &slideLogger) != 0 )
+			return 1;
+		uint64_t t3 = mach_absolute_time();
+		bestV2 = std::min(bestV2, t1-t0);
+		bestV3 = std::min(bestV3, t3-t2);
+		totalV2 += (t1-t0);
+		totalV3 += (t3-t2);
+	}
+	bool match = (memcmp(&workV2[0], &workV3[0], dataSize) == 0);
+
+	printf("DATA pages:            %u (%u bytes each)\n", pageCount, pageSize);
+	printf("rebase locations:      %llu\n", rebaseCount);
+	printf("v2 chain entries:      %llu (%llu non-rebase fillers), %u page extras\n", chainEntriesV2, chainEntriesV2-rebaseCount, infoV2->page_extras_count);
+	printf("slide info size:       v2=%llu bytes, v3=%lu bytes\n", sizeV2, slideInfoV3.size());
+	printf("slide all pages (us):  v2 best=%llu avg=%llu, v3 best=%llu avg=%llu (%u iterations)\n",
+			bestV2*timebase.numer/timebase.denom/1000, totalV2*timebase.numer/timebase.denom/1000/kIterations,
+			bestV3*timebase.numer/timebase.denom/1000, totalV3*timebase.numer/timebase.denom/1000/kIterations, kIterations);
+	printf("slid DATA identical:   %s\n", match ? "yes" : "NO");
+	return match ? 0 : 1;
+}
+
+
 static void checkMode(Mode mode) {
 	if ( mode != modeNone ) {
-		fprintf(stderr, "Error: select one of: -list, -dependents, -info, -slide_info, -linkedit, -map, -extract, or -size\n");
+		fprintf(stderr, "Error: select one of: -list, -dependents, -info, -slide_info, -compare_slide_info, -linkedit, -map, -extract, or -size\n");
 		usage();
 		exit(1);
 	}
@@ -359,6 +501,8 @@ int main (int argc, const char* argv[]) {
 	options.printInodes = false;
     options.dependentsOfPath = NULL;
     options.extractionDir = NULL;
+    options.extractInstallNameGlob = NULL;
+    options.extractWorkers = 0;
 
     for (uint32_t i = 1; i < argc; i++) {
         const char* opt = argv[i];
@@ -389,6 +533,10 @@ int main (int argc, const char* argv[]) {
 				checkMode(options.mode);
 				options.mode = modeSlideInfo;
 			}
+			else if (strcmp(opt, "-compare_slide_info") == 0) {
+				checkMode(options.mode);
+				options.mode = modeCompareSlideInfo;
+			}
 			else if (strcmp(opt, "-accelerator_info") == 0) {
 				checkMode(options.mode);
 				options.mode = modeAcceleratorInfo;
@@ -419,6 +567,22 @@ int main (int argc, const char* argv[]) {
                     exit(1);
                 }
            }
+			else if (strcmp(opt, "-workers") == 0) {
+				if ( ++i >= argc ) {
+					fprintf(stderr, "Error: option -workers requires a count argument\n");
+					usage();
+					exit(1);
+				}
+				options.extractWorkers = (uint32_t)atoi(argv[i]);
+			}
+			else if (strcmp(opt, "-install_name_glob") == 0) {
+				if ( ++i >= argc ) {
+					fprintf(stderr, "Error: option -install_name_glob requires a pattern argument\n");
+					usage();
+					exit(1);
+				}
+				options.extractInstallNameGlob = argv[i];
+			}
 			else if (strcmp(opt, "-uuid") == 0) {
                 options.printUUIDs = true;
             } 
@@ -535,6 +699,22 @@ int main (int argc, const char* argv[]) {
 				}
 			}
 		}
+		else if ( slideInfoHeader->version() == 3 ) {
+			const dyldCacheSlideInfo3<LittleEndian>* slideInfo = (dyldCacheSlideInfo3<LittleEndian>*)(slideInfoHeader);
+			printf("page_size=%d\n", slideInfo->page_size());
+			printf("value_add=0x%016llX\n", slideInfo->value_add());
+			printf("page_starts_count=%d\n", slideInfo->page_starts_count());
+			for (int i=0; i < slideInfo->page_starts_count(); ++i) {
+				const uint16_t start = slideInfo->page_starts(i);
+				if ( start == DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE )
+					printf("page[% 5d]: no rebasing\n", i);
+				else
+					printf("page[% 5d]: start=0x%04X\n", i, start);
+			}
+		}
+	}
+	else if ( options.mode == modeCompareSlideInfo ) {
+		return compareSlideInfo(options.mappedCache);
 	}
 	else if ( options.mode == modeInfo ) {
 		const dyldCacheHeader<LittleEndian>* header = (dyldCacheHeader<LittleEndian>*)options.mappedCache;
@@ -698,6 +878,28 @@ int main (int argc, const char* argv[]) {
 				for (const DylibIndexTrie::Entry& x : dylibEntries) {
 					printf("  image[%3u] %s\n", x.info.index, x.name.c_str());
 				}
+				if ( (accelInfo->version() >= 2) && (accelInfo->dylibHashSlotCount() != 0) ) {
+					printf("dylib hash (slots=%u, buckets=%u, seed=%u):\n", accelInfo->dylibHashSlotCount(), accelInfo->dylibHashBucketCount(), accelInfo->dylibHashSeed());
+					const dyld_cache_accelerator_dylib_slot* slots = (dyld_cache_accelerator_dylib_slot*)((uint8_t*)accelInfo + accelInfo->dylibHashSlotsOffset());
+					for (uint32_t i=0; i < accelInfo->dylibHashSlotCount(); ++i) {
+						printf("  image[%3u] %s\n", slots[i].imageIndex, (char*)accelInfo + slots[i].pathOffset);
+					}
+				}
+				if ( (accelInfo->version() >= 3) && (accelInfo->exportEntriesCount() != 0) ) {
+					printf("flattened export indexes (buckets=%u):\n", accelInfo->exportEntriesCount());
+					const dyld_cache_accelerator_export_index* exportIndexes = (dyld_cache_accelerator_export_index*)((uint8_t*)accelInfo + accelInfo->exportIndexesOffset());
+					const dyld_cache_accelerator_export_entry* exportEntries = (dyld_cache_accelerator_export_entry*)((uint8_t*)accelInfo + accelInfo->exportEntriesOffset());
+					for (uint32_t i=0; i < accelInfo->imageExtrasCount(); ++i) {
+						if ( exportIndexes[i].bucketCount == 0 )
+							continue;
+						uint32_t symbolCount = 0;
+						for (uint32_t b=0; b < exportIndexes[i].bucketCount; ++b) {
+							if ( exportEntries[exportIndexes[i].entriesStartIndex + b].nameHash != 0 )
+								++symbolCount;
+						}
+						printf("  image[%3u] %5u symbols in %5u buckets %s\n", i, symbolCount, exportIndexes[i].bucketCount, (char*)options.mappedCache + images[i].pathFileOffset());
+					}
+				}
 			}
 		}
 	}
@@ -777,6 +979,23 @@ int main (int argc, const char* argv[]) {
 			return 1;
 		}
 
+		typedef int (*extractor_options_proc)(const char* shared_cache_file_path, const char* extraction_root_path,
+											  const dyld_shared_cache_extract_options* options,
+											  void (^progress)(unsigned current, unsigned total));
+
+		extractor_options_proc optionsProc = (extractor_options_proc)dlsym(handle, "dyld_shared_cache_extract_dylibs_with_options");
+		if ( optionsProc != NULL ) {
+			dyld_shared_cache_extract_options extractOptions;
+			extractOptions.version          = 0;
+			extractOptions.workerCount      = options.extractWorkers;
+			extractOptions.installNameGlob  = options.extractInstallNameGlob;
+			return (*optionsProc)(sharedCachePath, options.extractionDir, &extractOptions, ^(unsigned c, unsigned total) { } );
+		}
+		if ( (options.extractWorkers != 0) || (options.extractInstallNameGlob != NULL) ) {
+			fprintf(stderr, "Error: dsc_extractor.bundle does not support -workers or -install_name_glob\n");
+			return 1;
+		}
+
 		typedef int (*extractor_proc)(const char* shared_cache_file_path, const char* extraction_root_path,
 									  void (^progress)(unsigned current, unsigned total));
 
@@ -811,6 +1030,7 @@ int main (int argc, const char* argv[]) {
 				case modeNone:
 				case modeInfo:
 				case modeSlideInfo:
+				case modeCompareSlideInfo:
 				case modeAcceleratorInfo:
 				case modeTextInfo:
 				case modeLocalSymbols:
@@ -839,6 +1059,7 @@ int main (int argc, const char* argv[]) {
 				case modeNone:
 				case modeInfo:
 				case modeSlideInfo:
+				case modeCompareSlideInfo:
 				case modeAcceleratorInfo:
 				case modeTextInfo:
 				case modeLocalSymbols:
@@ -867,6 +1088,7 @@ int main (int argc, const char* argv[]) {
 				case modeNone:
 				case modeInfo:
 				case modeSlideInfo:
+				case modeCompareSlideInfo:
 				case modeAcceleratorInfo:
 				case modeTextInfo:
 				case modeLocalSymbols:
@@ -895,6 +1117,7 @@ int main (int argc, const char* argv[]) {
 				case modeNone:
 				case modeInfo:
 				case modeSlideInfo:
+				case modeCompareSlideInfo:
 				case modeAcceleratorInfo:
 				case modeTextInfo:
 				case modeLocalSymbols:
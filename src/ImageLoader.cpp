@@ -36,7 +36,10 @@
 #include <sys/mount.h>
 #include <libkern/OSAtomic.h>
 
+#include <algorithm>
+
 #include "ImageLoader.h"
+#include "Tracing.h"
 
 
 uint32_t								ImageLoader::fgImagesUsedFromSharedCache = 0;
@@ -47,6 +50,7 @@ uint32_t								ImageLoader::fgTotalRebaseFixups = 0;
 uint32_t								ImageLoader::fgTotalBindFixups = 0;
 uint32_t								ImageLoader::fgTotalBindSymbolsResolved = 0;
 uint32_t								ImageLoader::fgTotalBindImageSearches = 0;
+uint32_t								ImageLoader::fgTotalSearchPathStatsAvoided = 0;
 uint32_t								ImageLoader::fgTotalLazyBindFixups = 0;
 uint32_t								ImageLoader::fgTotalPossibleLazyBindFixups = 0;
 uint32_t								ImageLoader::fgTotalSegmentsMapped = 0;
@@ -63,6 +67,8 @@ uint64_t								ImageLoader::fgTotalDOF;
 uint64_t								ImageLoader::fgTotalInitTime;
 uint16_t								ImageLoader::fgLoadOrdinal = 0;
 uint32_t								ImageLoader::fgSymbolTrieSearchs = 0;
+ImageLoader::SymbolLookupTraceEntry*	ImageLoader::fgSymbolLookupTrace = NULL;
+unsigned								ImageLoader::fgSymbolLookupTraceTop = 0;
 std::vector<ImageLoader::InterposeTuple>ImageLoader::fgInterposingTuples;
 uintptr_t								ImageLoader::fgNextPIEDylibAddress = 0;
 
@@ -133,6 +139,8 @@ int ImageLoader::compare(const ImageLoader* right) const
 
 void ImageLoader::setPath(const char* path)
 {
+	bool hadPath = (fPath != NULL);
+	uint32_t oldPathHash = fPathHash;
 	if ( fPathOwnedByImage && (fPath != NULL) ) 
 		delete [] fPath;
 	fPath = new char[strlen(path)+1];
@@ -140,16 +148,23 @@ void ImageLoader::setPath(const char* path)
 	fPathOwnedByImage = true;  // delete fPath when this image is destructed
 	fPathHash = hash(fPath);
 	fRealPath = NULL;
+	// images already loaded are indexed by path
+	if ( hadPath )
+		dyld::imagePathChanged(this, oldPathHash);
 }
 
 void ImageLoader::setPathUnowned(const char* path)
 {
+	bool hadPath = (fPath != NULL);
+	uint32_t oldPathHash = fPathHash;
 	if ( fPathOwnedByImage && (fPath != NULL) ) {
 		delete [] fPath;
 	}
 	fPath = path;
 	fPathOwnedByImage = false;  
 	fPathHash = hash(fPath);
+	if ( hadPath )
+		dyld::imagePathChanged(this, oldPathHash);
 }
 
 void ImageLoader::setPaths(const char* path, const char* realPath)
@@ -745,7 +760,10 @@ void ImageLoader::recursiveRebase(const LinkContext& context)
 			}
 				
 			// rebase this image
+			uint64_t t1 = mach_absolute_time();
+			uint32_t fixupsBefore = fgTotalRebaseFixups;
 			doRebase(context);
+			dyld3::launch_profile_add_duration("rebase", this->getPath(), t1, mach_absolute_time(), "fixups", fgTotalRebaseFixups - fixupsBefore);
 			
 			// notify
 			context.notifySingle(dyld_image_state_rebased, this, NULL);
@@ -804,7 +822,10 @@ void ImageLoader::recursiveBind(const LinkContext& context, bool forceLazysBound
 					dependentImage->recursiveBind(context, forceLazysBound, neverUnload);
 			}
 			// bind this image
+			uint64_t t1 = mach_absolute_time();
+			uint32_t lookupsBefore = fgTotalBindSymbolsResolved;
 			this->doBind(context, forceLazysBound);	
+			dyld3::launch_profile_add_duration("bind", this->getPath(), t1, mach_absolute_time(), "symbolLookups", fgTotalBindSymbolsResolved - lookupsBefore);
 			// mark if lazys are also bound
 			if ( forceLazysBound || this->usablePrebinding(context) )
 				fAllLazyPointersBound = true;
@@ -882,6 +903,7 @@ void ImageLoader::weakBind(const LinkContext& context)
 			// process all matching symbols just before incrementing the lowest one that matches
 			if ( sortedIts[0]->symbolMatches && !sortedIts[0]->done ) {
 				const char* nameToCoalesce = sortedIts[0]->symbolName;
+				uint64_t lookupStart = symbolLookupTracingEnabled() ? mach_absolute_time() : 0;
 				// pick first symbol in load order (and non-weak overrides weak)
 				uintptr_t targetAddr = 0;
 				ImageLoader* targetImage = NULL;
@@ -929,6 +951,9 @@ void ImageLoader::weakBind(const LinkContext& context)
 						}
 					}
 				}
+				// requester is every image using the symbol, so none is recorded
+				if ( lookupStart != 0 )
+					traceSymbolLookup(kSymbolLookupWeak, NULL, nameToCoalesce, targetImage, lookupStart);
 				
 			}
 		}
@@ -940,6 +965,7 @@ void ImageLoader::weakBind(const LinkContext& context)
 	}
 	uint64_t t2 = mach_absolute_time();
 	fgTotalWeakBindTime += t2  - t1;
+	dyld3::launch_profile_add_duration("weak bind", NULL, t1, t2);
 	
 	if ( context.verboseWeakBind )
 		dyld::log("dyld: weak bind end\n");
@@ -1056,6 +1082,7 @@ void ImageLoader::recursiveInitialization(const LinkContext& context, mach_port_
 			if ( hasInitializers ) {
 				uint64_t t2 = mach_absolute_time();
 				timingInfo.addTime(this->getShortName(), t2-t1);
+				dyld3::launch_profile_add_duration("initializer", this->getPath(), t1, t2);
 			}
 		}
 		catch (const char* msg) {
@@ -1122,6 +1149,140 @@ static char* commatize(uint64_t in, char* out)
 }
 
 
+//
+// Symbol lookup tracing.  Lookups are counted and timed per (kind, requester, symbol, provider) in an
+// open addressed table that threads update without a lock: a slot is claimed by compare-and-swap of
+// its hash, the claimer fills in the key then sets 'ready', and counts are updated atomically.
+// Names are copied when a slot is claimed, so the table can be printed after images are unloaded.
+//
+struct ImageLoader::SymbolLookupTraceEntry
+{
+	volatile int32_t			hash;			// zero means slot unused
+	volatile int32_t			ready;
+	SymbolLookupKind			kind;
+	const ImageLoader*			requester;
+	const ImageLoader*			provider;
+	const char*					names;			// symbol, requester and provider names, each zero terminated
+	volatile int64_t			count;
+	volatile int64_t			time;
+};
+
+static const unsigned	kSymbolLookupTraceSize = 16384;		// must be power of 2
+static const unsigned	kSymbolLookupTraceMaxProbes = 64;
+static volatile int32_t	sSymbolLookupsDropped = 0;
+
+void ImageLoader::enableSymbolLookupTracing(unsigned topCount)
+{
+	// the variable can be processed more than once (e.g. again from LC_DYLD_ENVIRONMENT), keep the table
+	fgSymbolLookupTraceTop = topCount;
+	if ( fgSymbolLookupTrace != NULL )
+		return;
+	vm_address_t addr = 0;
+	if ( vm_alloc(&addr, kSymbolLookupTraceSize*sizeof(SymbolLookupTraceEntry), VM_FLAGS_ANYWHERE) != KERN_SUCCESS )
+		return;
+	fgSymbolLookupTrace = (SymbolLookupTraceEntry*)addr;
+}
+
+void ImageLoader::traceSymbolLookup(SymbolLookupKind kind, const ImageLoader* requester, const char* symbolName,
+									const ImageLoader* provider, uint64_t startTime)
+{
+	const uint64_t elapsed = mach_absolute_time() - startTime;
+	SymbolLookupTraceEntry* table = fgSymbolLookupTrace;
+	if ( table == NULL )
+		return;
+	uint32_t h = hash(symbolName) ^ (uint32_t)(((uintptr_t)requester >> 4) * 2654435761U) ^ (uint32_t)((uintptr_t)provider >> 4) ^ kind;
+	if ( h == 0 )
+		h = 1;
+	for (unsigned i=0; i < kSymbolLookupTraceMaxProbes; ++i) {
+		SymbolLookupTraceEntry& entry = table[(h + i) & (kSymbolLookupTraceSize-1)];
+		if ( entry.hash == 0 ) {
+			if ( OSAtomicCompareAndSwap32Barrier(0, (int32_t)h, &entry.hash) ) {
+				const char* requesterName = (requester != NULL) ? requester->getShortName() : "-";
+				const char* providerName  = (provider != NULL)  ? provider->getShortName()  : "-";
+				size_t symbolLen    = strlen(symbolName) + 1;
+				size_t requesterLen = strlen(requesterName) + 1;
+				char* names = (char*)malloc(symbolLen + requesterLen + strlen(providerName) + 1);
+				strcpy(names, symbolName);
+				strcpy(&names[symbolLen], requesterName);
+				strcpy(&names[symbolLen+requesterLen], providerName);
+				entry.kind		= kind;
+				entry.requester	= requester;
+				entry.provider	= provider;
+				entry.names		= names;
+				entry.count		= 1;
+				entry.time		= elapsed;
+				OSMemoryBarrier();
+				entry.ready		= 1;
+				return;
+			}
+		}
+		if ( entry.hash != (int32_t)h )
+			continue;
+		// slot just claimed by another thread, its key is about to be filled in
+		while ( entry.ready == 0 )
+			OSMemoryBarrier();
+		if ( (entry.kind == kind) && (entry.requester == requester) && (entry.provider == provider) && (strcmp(entry.names, symbolName) == 0) ) {
+			OSAtomicIncrement64(&entry.count);
+			OSAtomicAdd64(elapsed, &entry.time);
+			return;
+		}
+	}
+	OSAtomicIncrement32(&sSymbolLookupsDropped);
+}
+
+void ImageLoader::printSymbolLookupTrace()
+{
+	if ( fgSymbolLookupTrace == NULL )
+		return;
+	// stop tracing, lookups from other threads from now on are not recorded
+	SymbolLookupTraceEntry* table = fgSymbolLookupTrace;
+	fgSymbolLookupTrace = NULL;
+
+	std::vector<const SymbolLookupTraceEntry*> used;
+	for (unsigned i=0; i < kSymbolLookupTraceSize; ++i) {
+		if ( table[i].ready )
+			used.push_back(&table[i]);
+	}
+	std::sort(used.begin(), used.end(), [](const SymbolLookupTraceEntry* a, const SymbolLookupTraceEntry* b) {
+		return (a->time > b->time);
+	});
+
+	mach_timebase_info_data_t timebase;
+	mach_timebase_info(&timebase);
+	static const char* const kindNames[] = { "two-level", "flat", "weak", "dlsym" };
+	const size_t printCount = std::min<size_t>(used.size(), fgSymbolLookupTraceTop);
+	dyld::log("dyld: top %lu of %lu symbol lookups by time (%d not recorded):\n", (unsigned long)printCount, (unsigned long)used.size(), sSymbolLookupsDropped);
+	dyld::log("     count    total(us)   avg(ns)  kind       requester -> symbol -> provider\n");
+	for (size_t i=0; i < printCount; ++i) {
+		const SymbolLookupTraceEntry* entry = used[i];
+		const char* symbolName    = entry->names;
+		const char* requesterName = &symbolName[strlen(symbolName)+1];
+		const char* providerName  = &requesterName[strlen(requesterName)+1];
+		uint64_t nanos = entry->time * timebase.numer / timebase.denom;
+		dyld::log("  %8lld  %11llu  %8llu  %-9s  %s -> %s -> %s\n", entry->count, nanos/1000, nanos/entry->count,
+				  kindNames[entry->kind], requesterName, symbolName, providerName);
+	}
+}
+
+void ImageLoader::addLaunchProfileCounters(unsigned int imageCount)
+{
+	dyld3::launch_profile_add_counter("images", imageCount);
+	dyld3::launch_profile_add_counter("imagesFromSharedCache", fgImagesUsedFromSharedCache);
+	dyld3::launch_profile_add_counter("segmentsMapped", fgTotalSegmentsMapped);
+	dyld3::launch_profile_add_counter("bytesMapped", fgTotalBytesMapped);
+	dyld3::launch_profile_add_counter("bytesPreFetched", fgTotalBytesPreFetched);
+	dyld3::launch_profile_add_counter("rebaseFixups", fgTotalRebaseFixups);
+	dyld3::launch_profile_add_counter("bindFixups", fgTotalBindFixups);
+	dyld3::launch_profile_add_counter("symbolLookups", fgTotalBindSymbolsResolved);
+	dyld3::launch_profile_add_counter("symbolLookupImageSearches", fgTotalBindImageSearches);
+	dyld3::launch_profile_add_counter("lazyBindFixups", fgTotalLazyBindFixups);
+	dyld3::launch_profile_add_counter("loadLibrariesTime", fgTotalLoadLibrariesTime);
+	dyld3::launch_profile_add_counter("rebaseTime", fgTotalRebaseTime);
+	dyld3::launch_profile_add_counter("bindTime", fgTotalBindTime);
+	dyld3::launch_profile_add_counter("weakBindTime", fgTotalWeakBindTime);
+	dyld3::launch_profile_add_counter("initializerTime", fgTotalInitTime);
+}
+
 void ImageLoader::printStatistics(unsigned int imageCount, const InitializerTimingList& timingInfo)
 {
 	uint64_t totalTime = fgTotalLoadLibrariesTime  + fgTotalRebaseTime + fgTotalBindTime + fgTotalWeakBindTime + fgTotalDOF + fgTotalInitTime;
@@ -1155,6 +1316,8 @@ void ImageLoader::printStatisticsDetails(unsigned int imageCount, const Initiali
 	dyld::log("  total images loaded:  %d (%u from dyld shared cache)\n", imageCount, fgImagesUsedFromSharedCache);
 	dyld::log("  total segments mapped: %u, into %llu pages with %llu pages pre-fetched\n", fgTotalSegmentsMapped, fgTotalBytesMapped/4096, fgTotalBytesPreFetched/4096);
 	printTime("  total images loading time", fgTotalLoadLibrariesTime, totalTime);
+	if ( fgTotalSearchPathStatsAvoided != 0 )
+		dyld::log("  total search path stat() calls avoided: %s\n", commatize(fgTotalSearchPathStatsAvoided, commaNum1));
 	printTime("  total load time in ObjC", fgTotalObjCSetupTime, totalTime);
 	printTime("  total debugger pause time", fgTotalDebuggerPausedTime, totalTime);
 	printTime("  total dtrace DOF registration time", fgTotalDOF, totalTime);
@@ -147,7 +147,10 @@
        }
 
 // utilities
+class ImageLoader;
+
 namespace dyld {
+	extern void imagePathChanged(ImageLoader* image, uint32_t oldPathHash);
 	extern __attribute__((noreturn)) void throwf(const char* format, ...)  __attribute__((format(printf, 1, 2)));
 	extern void log(const char* format, ...)  __attribute__((format(printf, 1, 2)));
 	extern void warn(const char* format, ...)  __attribute__((format(printf, 1, 2)));
@@ -311,6 +314,7 @@ public:
 		bool			preFetchDisabled;
 		bool			prebinding;
 		bool			bindFlat;
+		bool			preResolveBinds;
 		bool			linkingMainExecutable;
 		bool			startedInitializingMainExecutable;
 #if __MAC_OS_X_VERSION_MIN_REQUIRED
@@ -633,6 +637,17 @@ public:
 										// triggered by DYLD_PRINT_STATISTICS to write info on work done and how fast
 	static void							printStatistics(unsigned int imageCount, const InitializerTimingList& timingInfo);
 	static void							printStatisticsDetails(unsigned int imageCount, const InitializerTimingList& timingInfo);
+										// triggered by DYLD_LAUNCH_PROFILE to record launch wide totals in the profile
+	static void							addLaunchProfileCounters(unsigned int imageCount);
+
+	enum SymbolLookupKind { kSymbolLookupTwoLevel, kSymbolLookupFlat, kSymbolLookupWeak, kSymbolLookupDlsym };
+
+										// triggered by DYLD_PRINT_SYMBOL_LOOKUPS to count and time lookups per (requester, symbol, provider)
+	static void							enableSymbolLookupTracing(unsigned topCount);
+	static bool							symbolLookupTracingEnabled() { return (fgSymbolLookupTrace != NULL); }
+	static void							traceSymbolLookup(SymbolLookupKind kind, const ImageLoader* requester, const char* symbolName,
+															const ImageLoader* provider, uint64_t startTime);
+	static void							printSymbolLookupTrace();
 
 										// used with DYLD_IMAGE_SUFFIX
 	static void							addSuffix(const char* path, const char* suffix, char* result);
@@ -806,6 +821,7 @@ public:
 	static uint64_t				fgTotalObjCSetupTime;
 	static uint64_t				fgTotalDebuggerPausedTime;
 	static uint64_t				fgTotalRebindCacheTime;
+	static uint32_t				fgTotalSearchPathStatsAvoided;
 protected:
 	static uint64_t				fgTotalRebaseTime;
 	static uint64_t				fgTotalBindTime;
@@ -813,6 +829,9 @@ protected:
 	static uint64_t				fgTotalDOF;
 	static uint64_t				fgTotalInitTime;
 	static std::vector<InterposeTuple>	fgInterposingTuples;
+	struct SymbolLookupTraceEntry;
+	static SymbolLookupTraceEntry*		fgSymbolLookupTrace;
+	static unsigned						fgSymbolLookupTraceTop;
 	
 	const char*					fPath;
 	const char*					fRealPath;
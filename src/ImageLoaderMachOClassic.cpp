@@ -1046,6 +1046,7 @@ uintptr_t ImageLoaderMachOClassic::resolveUndefined(const LinkContext& context,
 {
 	++fgTotalBindSymbolsResolved;
 	const char* symbolName = &fStrings[undefinedSymbol->n_un.n_strx];
+	uint64_t lookupStart = symbolLookupTracingEnabled() ? mach_absolute_time() : 0;
 
 #if LINKEDIT_USAGE_DEBUG
 	noteAccessedLinkEditAddress(undefinedSymbol);
@@ -1063,6 +1064,8 @@ uintptr_t ImageLoaderMachOClassic::resolveUndefined(const LinkContext& context,
 		if ( context.flatExportFinder(symbolName, &sym, foundIn) ) {
 			if ( *foundIn != this )
 				context.addDynamicReference(this, const_cast<ImageLoader*>(*foundIn));
+			if ( lookupStart != 0 )
+				traceSymbolLookup(kSymbolLookupFlat, this, symbolName, *foundIn, lookupStart);
 			return (*foundIn)->getExportedSymbolAddress(sym, context, this);
 		}
 		// if a bundle is loaded privately the above will not find its exports
@@ -1086,6 +1089,8 @@ uintptr_t ImageLoaderMachOClassic::resolveUndefined(const LinkContext& context,
 			if ( context.coalescedExportFinder(symbolName, &sym, foundIn) ) {
 				if ( *foundIn != this )
 					context.addDynamicReference(this, const_cast<ImageLoader*>(*foundIn));
+				if ( lookupStart != 0 )
+					traceSymbolLookup(kSymbolLookupWeak, this, symbolName, *foundIn, lookupStart);
 				return (*foundIn)->getExportedSymbolAddress(sym, context, this);
 			}
 			//throwSymbolNotFound(context, symbolName, this->getPath(), "coalesced namespace");
@@ -1142,8 +1147,11 @@ uintptr_t ImageLoaderMachOClassic::resolveUndefined(const LinkContext& context,
 		}
 
 		uintptr_t address;
-		if ( target->findExportedSymbolAddress(context, symbolName, this, ord, runResolver, foundIn, &address) )
+		if ( target->findExportedSymbolAddress(context, symbolName, this, ord, runResolver, foundIn, &address) ) {
+			if ( lookupStart != 0 )
+				traceSymbolLookup(kSymbolLookupTwoLevel, this, symbolName, *foundIn, lookupStart);
 			return address;
+		}
 
 		if ( (undefinedSymbol->n_type & N_PEXT) != 0 ) {
 			// don't know why the static linker did not eliminate the internal reference to a private extern definition
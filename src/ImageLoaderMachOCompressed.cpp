@@ -63,6 +63,7 @@
 	struct macho_routines_command	: public routines_command  {};	
 #endif
 
+uint32_t ImageLoaderMachOCompressed::fgExportSearches = 0;
 #if __arm__ || __arm64__
 bool ImageLoaderMachOCompressed::sVmAccountingDisabled  = false;
 bool ImageLoaderMachOCompressed::sVmAccountingSuspended = false;
@@ -394,6 +395,69 @@ void ImageLoaderMachOCompressed::rebaseAt(const LinkContext& context, uintptr_t
 	}
 }
 
+// Applies "count" rebases of "type" starting at "addr" and advancing by "stride" bytes.
+// The whole run is range checked and type checked once up front, then slid with a
+// tight loop.  Contiguous runs (stride == pointer size) are slid a vector at a time.
+void ImageLoaderMachOCompressed::rebaseRun(const LinkContext& context, uintptr_t addr, uintptr_t count, uintptr_t stride, uintptr_t slide, uint8_t type,
+											uintptr_t segmentStartAddress, uintptr_t segmentEndAddress, int segmentIndex,
+											const uint8_t* startOpcodes, const uint8_t* endOpcodes, const uint8_t* pos)
+{
+	if ( count == 0 )
+		return;
+	if ( (addr < segmentStartAddress) || (addr >= segmentEndAddress) )
+		throwBadRebaseAddress(addr, segmentEndAddress, segmentIndex, startOpcodes, endOpcodes, pos);
+	// a skip of minus the pointer size wraps the stride to zero, which would rebase one location over and over
+	if ( stride == 0 )
+		throwBadRebaseAddress(addr, segmentEndAddress, segmentIndex, startOpcodes, endOpcodes, pos);
+	// last location is addr+(count-1)*stride, check it without overflowing
+	const uintptr_t maxIndexInSegment = (segmentEndAddress - 1 - addr) / stride;
+	if ( (count - 1) > maxIndexInSegment )
+		throwBadRebaseAddress(addr + (maxIndexInSegment+1)*stride, segmentEndAddress, segmentIndex, startOpcodes, endOpcodes, pos);
+
+	// verbose logging wants one line per location, so use the slow path
+	if ( context.verboseRebase ) {
+		for (uintptr_t i=0; i < count; ++i)
+			rebaseAt(context, addr + i*stride, slide, type);
+		return;
+	}
+
+	switch (type) {
+		case REBASE_TYPE_POINTER:
+		case REBASE_TYPE_TEXT_ABSOLUTE32:
+			break;
+		default:
+			dyld::throwf("bad rebase type %d", type);
+	}
+
+	uint8_t* loc = (uint8_t*)addr;
+	uintptr_t i = 0;
+	if ( stride == sizeof(uintptr_t) ) {
+		// 16-byte vectors: two pointers per vector on 64-bit, four on 32-bit
+		typedef uintptr_t RebaseVector __attribute__((vector_size(16)));
+		const uintptr_t perVector = 16/sizeof(uintptr_t);
+		for ( ; (i + 2*perVector) <= count; i += 2*perVector, loc += 32) {
+			RebaseVector v0;
+			RebaseVector v1;
+			memcpy(&v0, loc,    16);
+			memcpy(&v1, loc+16, 16);
+			v0 += slide;
+			v1 += slide;
+			memcpy(loc,    &v0, 16);
+			memcpy(loc+16, &v1, 16);
+		}
+	}
+	else {
+		for ( ; (i + 4) <= count; i += 4, loc += 4*stride) {
+			*(uintptr_t*)(loc)          += slide;
+			*(uintptr_t*)(loc+stride)   += slide;
+			*(uintptr_t*)(loc+2*stride) += slide;
+			*(uintptr_t*)(loc+3*stride) += slide;
+		}
+	}
+	for ( ; i < count; ++i, loc += stride)
+		*(uintptr_t*)loc += slide;
+}
+
 void ImageLoaderMachOCompressed::throwBadRebaseAddress(uintptr_t address, uintptr_t segmentEndAddress, int segmentIndex, 
 										const uint8_t* startOpcodes, const uint8_t* endOpcodes, const uint8_t* pos)
 {
@@ -452,22 +516,14 @@ void ImageLoaderMachOCompressed::rebase(const LinkContext& context, uintptr_t sl
 					address += immediate*sizeof(uintptr_t);
 					break;
 				case REBASE_OPCODE_DO_REBASE_IMM_TIMES:
-					for (int i=0; i < immediate; ++i) {
-						if ( (address < segmentStartAddress) || (address >= segmentEndAddress) )
-							throwBadRebaseAddress(address, segmentEndAddress, segmentIndex, start, end, p);
-						rebaseAt(context, address, slide, type);
-						address += sizeof(uintptr_t);
-					}
+					rebaseRun(context, address, immediate, sizeof(uintptr_t), slide, type, segmentStartAddress, segmentEndAddress, segmentIndex, start, end, p);
+					address += immediate*sizeof(uintptr_t);
 					fgTotalRebaseFixups += immediate;
 					break;
 				case REBASE_OPCODE_DO_REBASE_ULEB_TIMES:
 					count = read_uleb128(p, end);
-					for (uint32_t i=0; i < count; ++i) {
-						if ( (address < segmentStartAddress) || (address >= segmentEndAddress) )
-							throwBadRebaseAddress(address, segmentEndAddress, segmentIndex, start, end, p);
-						rebaseAt(context, address, slide, type);
-						address += sizeof(uintptr_t);
-					}
+					rebaseRun(context, address, count, sizeof(uintptr_t), slide, type, segmentStartAddress, segmentEndAddress, segmentIndex, start, end, p);
+					address += count*sizeof(uintptr_t);
 					fgTotalRebaseFixups += count;
 					break;
 				case REBASE_OPCODE_DO_REBASE_ADD_ADDR_ULEB:
@@ -480,12 +536,8 @@ void ImageLoaderMachOCompressed::rebase(const LinkContext& context, uintptr_t sl
 				case REBASE_OPCODE_DO_REBASE_ULEB_TIMES_SKIPPING_ULEB:
 					count = read_uleb128(p, end);
 					skip = read_uleb128(p, end);
-					for (uint32_t i=0; i < count; ++i) {
-						if ( (address < segmentStartAddress) || (address >= segmentEndAddress) )
-							throwBadRebaseAddress(address, segmentEndAddress, segmentIndex, start, end, p);
-						rebaseAt(context, address, slide, type);
-						address += skip + sizeof(uintptr_t);
-					}
+					rebaseRun(context, address, count, skip + sizeof(uintptr_t), slide, type, segmentStartAddress, segmentEndAddress, segmentIndex, start, end, p);
+					address += count*(skip + sizeof(uintptr_t));
 					fgTotalRebaseFixups += count;
 					break;
 				default:
@@ -510,6 +562,7 @@ const ImageLoader::Symbol* ImageLoaderMachOCompressed::findShallowExportedSymbol
 	dyld::logBindings("%s: %s\n", this->getShortName(), symbol);
 #endif
 	++ImageLoaderMachO::fgSymbolTrieSearchs;
+	++fgExportSearches;
 	const uint8_t* start = &fLinkEditBase[fDyldInfo->export_off];
 	const uint8_t* end = &start[fDyldInfo->export_size];
 	const uint8_t* foundNodeStart = this->trieWalk(start, end, symbol); 
@@ -697,26 +750,69 @@ uintptr_t ImageLoaderMachOCompressed::resolveTwolevel(const LinkContext& context
 }
 
 
+unsigned ImageLoaderMachOCompressed::BindCache::hash(long ordinal, uint8_t flags, const char* name)
+{
+	uintptr_t h = ((uintptr_t)name >> 1) ^ ((uintptr_t)ordinal << 24) ^ flags;
+	h *= 2654435761U;
+	return (unsigned)(h >> 8);
+}
+
+const ImageLoaderMachOCompressed::LastLookup* ImageLoaderMachOCompressed::BindCache::find(long ordinal, uint8_t flags, const char* name) const
+{
+	unsigned index = hash(ordinal, flags, name);
+	for (unsigned i=0; i < kMaxProbes; ++i, ++index) {
+		const LastLookup& entry = fEntries[index & (kCapacity-1)];
+		if ( entry.name == NULL )
+			return NULL;
+		if ( (entry.name == name) && (entry.ordinal == ordinal) && (entry.flags == flags) )
+			return &entry;
+	}
+	return NULL;
+}
+
+void ImageLoaderMachOCompressed::BindCache::add(long ordinal, uint8_t flags, const char* name, uintptr_t result, const ImageLoader* foundIn)
+{
+	const unsigned home = hash(ordinal, flags, name);
+	LastLookup* slot = &fEntries[home & (kCapacity-1)];
+	for (unsigned i=0; i < kMaxProbes; ++i) {
+		LastLookup* entry = &fEntries[(home+i) & (kCapacity-1)];
+		if ( entry->name == NULL ) {
+			slot = entry;
+			break;
+		}
+	}
+	slot->ordinal	= ordinal;
+	slot->flags		= flags;
+	slot->name		= name;
+	slot->result	= result;
+	slot->foundIn	= foundIn;
+}
+
+
 uintptr_t ImageLoaderMachOCompressed::resolve(const LinkContext& context, const char* symbolName, 
 													uint8_t symboFlags, long libraryOrdinal, const ImageLoader** targetImage,
-													LastLookup* last, bool runResolver)
+													BindCache* cache, bool runResolver)
 {
 	*targetImage = NULL;
 	
-	// only clients that benefit from caching last lookup pass in a LastLookup struct
-	if ( last != NULL ) {
-		if ( (last->ordinal == libraryOrdinal)
-			&& (last->flags == symboFlags)
-			&& (last->name == symbolName) ) {
-				*targetImage = last->foundIn;
-				return last->result;
-			}
+	// only clients that benefit from caching lookups pass in a BindCache
+	if ( cache != NULL ) {
+		if ( const LastLookup* entry = cache->find(libraryOrdinal, symboFlags, symbolName) ) {
+			*targetImage = entry->foundIn;
+			return entry->result;
+		}
 	}
+	++fgTotalBindSymbolsResolved;
+	// only image searches made to resolve a bind count toward DYLD_PRINT_STATISTICS, not dlsym() or weak binding
+	const uint32_t exportSearchesBefore = fgExportSearches;
+	uint64_t lookupStart = symbolLookupTracingEnabled() ? mach_absolute_time() : 0;
 	
 	bool weak_import = (symboFlags & BIND_SYMBOL_FLAGS_WEAK_IMPORT);
 	uintptr_t symbolAddress;
 	if ( context.bindFlat || (libraryOrdinal == BIND_SPECIAL_DYLIB_FLAT_LOOKUP) ) {
 		symbolAddress = this->resolveFlat(context, symbolName, weak_import, runResolver, targetImage);
+		if ( lookupStart != 0 )
+			traceSymbolLookup(kSymbolLookupFlat, this, symbolName, *targetImage, lookupStart);
 	}
 	else {
 		if ( libraryOrdinal == BIND_SPECIAL_DYLIB_MAIN_EXECUTABLE ) {
@@ -748,35 +844,43 @@ uintptr_t ImageLoaderMachOCompressed::resolve(const LinkContext& context, const
 		}
 		else {
 			symbolAddress = resolveTwolevel(context, symbolName, *targetImage, this, (unsigned)libraryOrdinal, weak_import, runResolver, targetImage);
+			if ( lookupStart != 0 )
+				traceSymbolLookup(kSymbolLookupTwoLevel, this, symbolName, *targetImage, lookupStart);
 		}
 	}
 
+	fgTotalBindImageSearches += (fgExportSearches - exportSearchesBefore);
+
 	// save off lookup results if client wants 
-	if ( last != NULL ) {
-		last->ordinal	= libraryOrdinal;
-		last->flags		= symboFlags;
-		last->name		= symbolName;
-		last->foundIn	= *targetImage;
-		last->result	= symbolAddress;
-	}
+	if ( cache != NULL )
+		cache->add(libraryOrdinal, symboFlags, symbolName, symbolAddress, *targetImage);
 	
 	return symbolAddress;
 }
 
 uintptr_t ImageLoaderMachOCompressed::bindAt(const LinkContext& context, uintptr_t addr, uint8_t type, const char* symbolName, 
 								uint8_t symbolFlags, intptr_t addend, long libraryOrdinal, const char* msg,
-								LastLookup* last, bool runResolver)
+								BindCache* cache, bool runResolver)
 {
 	const ImageLoader*	targetImage;
 	uintptr_t			symbolAddress;
 	
 	// resolve symbol
-	symbolAddress = this->resolve(context, symbolName, symbolFlags, libraryOrdinal, &targetImage, last, runResolver);
+	symbolAddress = this->resolve(context, symbolName, symbolFlags, libraryOrdinal, &targetImage, cache, runResolver);
 
 	// do actual update
 	return this->bindLocation(context, addr, symbolAddress, type, symbolName, addend, this->getPath(), targetImage ? targetImage->getPath() : NULL, msg);
 }
 
+// used with DYLD_PRERESOLVE_BINDS to resolve every unique import into the cache before any location is bound
+uintptr_t ImageLoaderMachOCompressed::preResolveAt(const LinkContext& context, uintptr_t addr, uint8_t type, const char* symbolName,
+								uint8_t symbolFlags, intptr_t addend, long libraryOrdinal, const char* msg,
+								BindCache* cache, bool runResolver)
+{
+	const ImageLoader*	targetImage;
+	return this->resolve(context, symbolName, symbolFlags, libraryOrdinal, &targetImage, cache, runResolver);
+}
+
 
 void ImageLoaderMachOCompressed::throwBadBindingAddress(uintptr_t address, uintptr_t segmentEndAddress, int segmentIndex, 
 										const uint8_t* startOpcodes, const uint8_t* endOpcodes, const uint8_t* pos)
@@ -806,7 +910,10 @@ void ImageLoaderMachOCompressed::doBind(const LinkContext& context, bool forceLa
 	#endif
 	
 		// run through all binding opcodes
-		eachBind(context, &ImageLoaderMachOCompressed::bindAt);
+		BindCache cache;
+		if ( context.preResolveBinds )
+			eachBind(context, &ImageLoaderMachOCompressed::preResolveAt, &cache);
+		eachBind(context, &ImageLoaderMachOCompressed::bindAt, &cache);
 			
 	#if TEXT_RELOC_SUPPORT
 		// if there were __TEXT fixups, restore write protection
@@ -858,7 +965,7 @@ int ImageLoaderMachOCompressed::vmAccountingSetSuspended(bool suspend, const Lin
 }
 #endif
 
-void ImageLoaderMachOCompressed::eachBind(const LinkContext& context, bind_handler handler)
+void ImageLoaderMachOCompressed::eachBind(const LinkContext& context, bind_handler handler, BindCache* cache)
 {
 #if __arm__ || __arm64__
     // <rdar://problem/29099600> dyld should tell the kernel when it is doing root fix-ups
@@ -898,7 +1005,6 @@ void ImageLoaderMachOCompressed::eachBind(const LinkContext& context, bind_handl
 		uintptr_t count;
 		uintptr_t skip;
 		uintptr_t segOffset;
-		LastLookup last = { 0, 0, NULL, 0, NULL };
 		const uint8_t* const start = fLinkEditBase + fDyldInfo->bind_off;
 		const uint8_t* const end = &start[fDyldInfo->bind_size];
 		const uint8_t* p = start;
@@ -972,7 +1078,7 @@ void ImageLoaderMachOCompressed::eachBind(const LinkContext& context, bind_handl
 						dyld::throwf("BIND_OPCODE_DO_BIND missing preceding BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB");
 					if ( !libraryOrdinalSet )
 						dyld::throwf("BIND_OPCODE_DO_BIND missing preceding BIND_OPCODE_SET_DYLIB_ORDINAL*");
-					(this->*handler)(context, address, type, symbolName, symboFlags, addend, libraryOrdinal, "", &last, false);
+					(this->*handler)(context, address, type, symbolName, symboFlags, addend, libraryOrdinal, "", cache, false);
 					address += sizeof(intptr_t);
 					break;
 				case BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB:
@@ -984,7 +1090,7 @@ void ImageLoaderMachOCompressed::eachBind(const LinkContext& context, bind_handl
 						dyld::throwf("BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB missing preceding BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB");
 					if ( !libraryOrdinalSet )
 						dyld::throwf("BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB missing preceding BIND_OPCODE_SET_DYLIB_ORDINAL*");
-					(this->*handler)(context, address, type, symbolName, symboFlags, addend, libraryOrdinal, "", &last, false);
+					(this->*handler)(context, address, type, symbolName, symboFlags, addend, libraryOrdinal, "", cache, false);
 					address += read_uleb128(p, end) + sizeof(intptr_t);
 					break;
 				case BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED:
@@ -996,7 +1102,7 @@ void ImageLoaderMachOCompressed::eachBind(const LinkContext& context, bind_handl
 						dyld::throwf("BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED missing preceding BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB");
 					if ( !libraryOrdinalSet )
 						dyld::throwf("BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED missing preceding BIND_OPCODE_SET_DYLIB_ORDINAL*");
-					(this->*handler)(context, address, type, symbolName, symboFlags, addend, libraryOrdinal, "", &last, false);
+					(this->*handler)(context, address, type, symbolName, symboFlags, addend, libraryOrdinal, "", cache, false);
 					address += immediate*sizeof(intptr_t) + sizeof(intptr_t);
 					break;
 				case BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB:
@@ -1011,7 +1117,7 @@ void ImageLoaderMachOCompressed::eachBind(const LinkContext& context, bind_handl
 					for (uint32_t i=0; i < count; ++i) {
 						if ( (address < segmentStartAddress) || (address >= segmentEndAddress) )
 							throwBadBindingAddress(address, segmentEndAddress, segmentIndex, start, end, p);
-						(this->*handler)(context, address, type, symbolName, symboFlags, addend, libraryOrdinal, "", &last, false);
+						(this->*handler)(context, address, type, symbolName, symboFlags, addend, libraryOrdinal, "", cache, false);
 						address += skip + sizeof(intptr_t);
 					}
 					break;
@@ -1455,7 +1561,7 @@ void ImageLoaderMachOCompressed::updateUsesCoalIterator(CoalIterator& it, uintpt
 }
 
 uintptr_t ImageLoaderMachOCompressed::interposeAt(const LinkContext& context, uintptr_t addr, uint8_t type, const char*, 
-												uint8_t, intptr_t, long, const char*, LastLookup*, bool runResolver)
+												uint8_t, intptr_t, long, const char*, BindCache*, bool runResolver)
 {
 	if ( type == BIND_TYPE_POINTER ) {
 		uintptr_t* fixupLocation = (uintptr_t*)addr;
@@ -1474,13 +1580,13 @@ void ImageLoaderMachOCompressed::doInterpose(const LinkContext& context)
 		dyld::log("dyld: interposing %lu tuples onto image: %s\n", fgInterposingTuples.size(), this->getPath());
 
 	// update prebound symbols
-	eachBind(context, &ImageLoaderMachOCompressed::interposeAt);
+	eachBind(context, &ImageLoaderMachOCompressed::interposeAt, NULL);
 	eachLazyBind(context, &ImageLoaderMachOCompressed::interposeAt);
 }
 
 
 uintptr_t ImageLoaderMachOCompressed::dynamicInterposeAt(const LinkContext& context, uintptr_t addr, uint8_t type, const char* symbolName, 
-												uint8_t, intptr_t, long, const char*, LastLookup*, bool runResolver)
+												uint8_t, intptr_t, long, const char*, BindCache*, bool runResolver)
 {
 	if ( type == BIND_TYPE_POINTER ) {
 		uintptr_t* fixupLocation = (uintptr_t*)addr;
@@ -1507,7 +1613,7 @@ void ImageLoaderMachOCompressed::dynamicInterpose(const LinkContext& context)
 		dyld::log("dyld: dynamic interposing %lu tuples onto image: %s\n", context.dynamicInterposeCount, this->getPath());
 
 	// update already bound references to symbols
-	eachBind(context, &ImageLoaderMachOCompressed::dynamicInterposeAt);
+	eachBind(context, &ImageLoaderMachOCompressed::dynamicInterposeAt, NULL);
 	eachLazyBind(context, &ImageLoaderMachOCompressed::dynamicInterposeAt);
 }
 
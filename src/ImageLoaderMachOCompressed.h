@@ -94,13 +94,28 @@ protected:
 private:
 	struct LastLookup { long ordinal; uint8_t flags; const char* name; uintptr_t result; const ImageLoader* foundIn; };
 
+	// Small open addressing table of symbols already resolved during one pass over an image's
+	// bind opcodes, keyed by (ordinal, symbol name pointer, flags).  If every slot in a probe
+	// sequence is taken, the home slot is overwritten, so adding never fails.
+	struct BindCache {
+		enum { kCapacity = 256, kMaxProbes = 8 };
+
+										BindCache() { bzero(fEntries, sizeof(fEntries)); }
+		const LastLookup*				find(long ordinal, uint8_t flags, const char* name) const;
+		void							add(long ordinal, uint8_t flags, const char* name, uintptr_t result, const ImageLoader* foundIn);
+	private:
+		static unsigned					hash(long ordinal, uint8_t flags, const char* name);
+
+		LastLookup						fEntries[kCapacity];
+	};
+
 
 	typedef uintptr_t (ImageLoaderMachOCompressed::*bind_handler)(const LinkContext& context, uintptr_t addr, uint8_t type, 
 											const char* symbolName, uint8_t symboFlags, intptr_t addend, long libraryOrdinal, 
-											const char* msg, LastLookup* last, bool runResolver);
+											const char* msg, BindCache* cache, bool runResolver);
 
 	void								eachLazyBind(const LinkContext& context, bind_handler);
-	void								eachBind(const LinkContext& context, bind_handler);
+	void								eachBind(const LinkContext& context, bind_handler, BindCache* cache);
 
 
 										ImageLoaderMachOCompressed(const macho_header* mh, const char* path, unsigned int segCount,
@@ -112,17 +127,23 @@ private:
 	void								markLINKEDIT(const LinkContext& context, int advise);
 
 	void								rebaseAt(const LinkContext& context, uintptr_t addr, uintptr_t slide, uint8_t type);
+	void								rebaseRun(const LinkContext& context, uintptr_t addr, uintptr_t count, uintptr_t stride, uintptr_t slide, uint8_t type,
+												uintptr_t segmentStartAddress, uintptr_t segmentEndAddress, int segmentIndex,
+												const uint8_t* startOpcodes, const uint8_t* endOpcodes, const uint8_t* pos);
 	void								throwBadRebaseAddress(uintptr_t address, uintptr_t segmentEndAddress, int segmentIndex, 
 												const uint8_t* startOpcodes, const uint8_t* endOpcodes, const uint8_t* pos);
 	uintptr_t							bindAt(const LinkContext& context, uintptr_t addr, uint8_t type, const char* symbolName, 
 												uint8_t symboFlags, intptr_t addend, long libraryOrdinal, const char* msg,
-												LastLookup* last, bool runResolver=false);
+												BindCache* cache, bool runResolver=false);
+	uintptr_t							preResolveAt(const LinkContext& context, uintptr_t addr, uint8_t type, const char* symbolName,
+												uint8_t symboFlags, intptr_t addend, long libraryOrdinal, const char* msg,
+												BindCache* cache, bool runResolver);
 	void								bindCompressed(const LinkContext& context);
 	void								throwBadBindingAddress(uintptr_t address, uintptr_t segmentEndAddress, int segmentIndex, 
 												const uint8_t* startOpcodes, const uint8_t* endOpcodes, const uint8_t* pos);
 	uintptr_t							resolve(const LinkContext& context, const char* symbolName, 
 												uint8_t symboFlags, long libraryOrdinal, const ImageLoader** targetImage, 
-												LastLookup* last = NULL, bool runResolver=false);
+												BindCache* cache = NULL, bool runResolver=false);
 	uintptr_t							resolveFlat(const LinkContext& context, const char* symbolName, bool weak_import, bool runResolver,
 													const ImageLoader** foundIn);
 	uintptr_t							resolveCoalesced(const LinkContext& context, const char* symbolName, const ImageLoader** foundIn);
@@ -130,15 +151,16 @@ private:
 													  const ImageLoader* requestorImage, unsigned requestorOrdinalOfDef, bool weak_import, bool runResolver,
 													  const ImageLoader** foundInn);
 	uintptr_t							interposeAt(const LinkContext& context, uintptr_t addr, uint8_t type, const char*, 
-												uint8_t, intptr_t, long, const char*, LastLookup*, bool runResolver);
+												uint8_t, intptr_t, long, const char*, BindCache*, bool runResolver);
 	uintptr_t							dynamicInterposeAt(const LinkContext& context, uintptr_t addr, uint8_t type, const char*, 
-												uint8_t, intptr_t, long, const char*, LastLookup*, bool runResolver);
+												uint8_t, intptr_t, long, const char*, BindCache*, bool runResolver);
     void                                updateOptimizedLazyPointers(const LinkContext& context);
     void                                updateAlternateLazyPointer(uint8_t* stub, void** originalLazyPointerAddr, const LinkContext& context);
 	void								registerEncryption(const struct encryption_info_command* encryptCmd, const LinkContext& context);
 
 	const struct dyld_info_command*			fDyldInfo;
 
+    static uint32_t                     fgExportSearches;       // findShallowExportedSymbol() calls, for bind statistics
 #if __arm__ || __arm64__
     static int                          vmAccountingSetSuspended(bool suspend, const LinkContext& context);
     static bool                         sVmAccountingDisabled;  // sysctl not availble
@@ -122,6 +122,29 @@ ImageLoaderMegaDylib::ImageLoaderMegaDylib(const dyld_cache_header* header, long
 	_initializerCount = accHeader->initializersCount;
 	_dylibsTrieStart = (uint8_t*)accHeader + accHeader->dylibTrieOffset;
 	_dylibsTrieEnd = _dylibsTrieStart + accHeader->dylibTrieSize;
+	_dylibHashBase = (uint8_t*)accHeader;
+	if ( accHeader->version >= 2 ) {
+		_dylibHashDisplacements = (uint32_t*)((uint8_t*)accHeader + accHeader->dylibHashDisplacementsOffset);
+		_dylibHashSlots = (dyld_cache_accelerator_dylib_slot*)((uint8_t*)accHeader + accHeader->dylibHashSlotsOffset);
+		_dylibHashSeed = accHeader->dylibHashSeed;
+		_dylibHashBucketCount = accHeader->dylibHashBucketCount;
+		_dylibHashSlotCount = accHeader->dylibHashSlotCount;
+	}
+	else {
+		_dylibHashDisplacements = NULL;
+		_dylibHashSlots = NULL;
+		_dylibHashSeed = 0;
+		_dylibHashBucketCount = 0;
+		_dylibHashSlotCount = 0;
+	}
+	if ( (accHeader->version >= 3) && (accHeader->exportEntriesCount != 0) ) {
+		_exportIndexes = (dyld_cache_accelerator_export_index*)((uint8_t*)accHeader + accHeader->exportIndexesOffset);
+		_exportEntries = (dyld_cache_accelerator_export_entry*)((uint8_t*)accHeader + accHeader->exportEntriesOffset);
+	}
+	else {
+		_exportIndexes = NULL;
+		_exportEntries = NULL;
+	}
 	_imageTextInfo = (dyld_cache_image_text_info*)((uint8_t*)_header + _header->imagesTextOffset);
 	DATAdyld* dyldSection = (DATAdyld*)(accHeader->dyldSectionAddr + slide);
 	dyldSection->dyldLazyBinder = NULL; // not used by libdyld.dylib
@@ -194,6 +217,18 @@ void ImageLoaderMegaDylib::printSegments(const macho_header* mh) const
 
 bool ImageLoaderMegaDylib::hasDylib(const char* path, unsigned* index) const
 {
+	// newer caches have a perfect hash of all install names and symlink aliases found when the cache was built,
+	// it is authoritative, so a lookup is one hash and one strcmp() with no trie walk or realpath()
+	if ( _dylibHashSlotCount != 0 ) {
+		uint64_t hash = dyld_cache_dylib_path_hash(path, _dylibHashSeed);
+		uint32_t displacement = _dylibHashDisplacements[dyld_cache_dylib_hash_bucket(hash, _dylibHashBucketCount)];
+		const dyld_cache_accelerator_dylib_slot& slot = _dylibHashSlots[dyld_cache_dylib_hash_slot(hash, displacement, _dylibHashSlotCount)];
+		if ( strcmp((char*)_dylibHashBase + slot.pathOffset, path) != 0 )
+			return false;
+		*index = slot.imageIndex;
+		return true;
+	}
+
 	const uint8_t* imageNode = ImageLoader::trieWalk(_dylibsTrieStart, _dylibsTrieEnd, path);
 	if ( imageNode == NULL ) {
   #if __MAC_OS_X_VERSION_MIN_REQUIRED
@@ -287,8 +322,8 @@ unsigned ImageLoaderMegaDylib::findImageIndex(const LinkContext& context, const
 			}
 		}
 	}
-    else {
-        // handle symlinks embedded in load commands
+    else if ( _dylibHashSlotCount == 0 ) {
+        // handle symlinks embedded in load commands (newer caches record these as aliases)
         char resolvedPath[PATH_MAX];
         realpath(path, resolvedPath);
         int realpathErrno = errno;
@@ -609,10 +644,37 @@ bool ImageLoaderMegaDylib::exportTrieHasNode(const char* symbolName, unsigned in
 	return true;
 }
 
+bool ImageLoaderMegaDylib::exportIndexHasNode(const char* symbolName, unsigned index,
+												const uint8_t** exportNode, const uint8_t** exportTrieEnd,
+												unsigned* foundinIndex) const
+{
+	const dyld_cache_accelerator_export_index& exportIndex = _exportIndexes[index];
+	const dyld_cache_accelerator_export_entry* buckets = &_exportEntries[exportIndex.entriesStartIndex];
+	const uint32_t mask = exportIndex.bucketCount - 1;
+	const uint32_t hash = dyld_cache_export_name_hash(symbolName);
+	for (uint32_t b = (hash & mask); buckets[b].nameHash != 0; b = ((b + 1) & mask)) {
+		if ( buckets[b].nameHash != hash )
+			continue;
+		// hashes can collide, so confirm by walking the one trie the index says has this symbol
+		const unsigned imageIndex = buckets[b].imageIndex;
+		const uint8_t* trieStart = (uint8_t*)(_imageExtras[imageIndex].exportsTrieAddr + _slide);
+		if ( exportTrieHasNode(symbolName, imageIndex, exportNode, exportTrieEnd) && (*exportNode == trieStart + buckets[b].nodeOffset) ) {
+			*foundinIndex = imageIndex;
+			return true;
+		}
+	}
+	// index covers whole re-export tree, so a miss here is definitive
+	return false;
+}
+
 bool ImageLoaderMegaDylib::exportTrieHasNodeRecursive(const char* symbolName, unsigned index,
 														const uint8_t** exportNode, const uint8_t** exportTrieEnd,
 														unsigned* foundinIndex) const
 {
+	// umbrellas may have a flattened index of their re-export tree, which avoids walking every re-exported trie
+	if ( (_exportIndexes != NULL) && (_exportIndexes[index].bucketCount != 0) )
+		return exportIndexHasNode(symbolName, index, exportNode, exportTrieEnd, foundinIndex);
+
 	// look in trie for image index
 	if ( exportTrieHasNode(symbolName, index, exportNode, exportTrieEnd) ) {
 		*foundinIndex = index;
@@ -209,6 +209,9 @@ private:
 																	unsigned* foundinIndex) const;
 	bool								exportTrieHasNode(const char* symbolName, unsigned index,
 														  const uint8_t** exportNode, const uint8_t** exportTrieEnd) const;
+	bool								exportIndexHasNode(const char* symbolName, unsigned index,
+														   const uint8_t** exportNode, const uint8_t** exportTrieEnd,
+														   unsigned* foundinIndex) const;
 
 	void								initAllLoaded(const LinkContext& context, InitializerTimingList& timingInfo);
 	void								printSegments(const macho_header* mh) const;
@@ -242,6 +245,14 @@ private:
 	const uint16_t*								_bottomUpArray;
 	const uint8_t*								_dylibsTrieStart;
 	const uint8_t*								_dylibsTrieEnd;
+	const uint8_t*								_dylibHashBase;
+	const uint32_t*								_dylibHashDisplacements;
+	const dyld_cache_accelerator_dylib_slot*	_dylibHashSlots;
+	uint32_t									_dylibHashSeed;
+	uint32_t									_dylibHashBucketCount;
+	uint32_t									_dylibHashSlotCount;
+	const dyld_cache_accelerator_export_index*	_exportIndexes;
+	const dyld_cache_accelerator_export_entry*	_exportEntries;
 	const dyld_cache_image_text_info*			_imageTextInfo;
 	uint8_t*									_stateFlags;
 	uint32_t									_imageCount;
@@ -174,6 +174,7 @@ extern "C" ssize_t __sendto(int, const void *, size_t, int, const struct sockadd
 extern void resetAllImages();
 extern void addImagesToAllImages(uint32_t infoCount, const dyld_image_info info[]);
 extern void removeImageFromAllImages(const mach_header* mh);
+extern void removeImagesFromAllImages(uint32_t count, const mach_header* const loadAddresses[]);
 extern void addNonSharedCacheImageUUID(const dyld_uuid_info& info);
 extern const char* notifyGDB(enum dyld_image_states state, uint32_t infoCount, const dyld_image_info info[]);
 extern size_t allImagesCount();
@@ -233,11 +234,13 @@ struct EnvironmentVariables {
 	bool						DYLD_DISABLE_DOFS;
 	bool						DYLD_PRINT_CS_NOTIFICATIONS;
                             //  DYLD_SHARED_CACHE_DIR           ==> sSharedCacheOverrideDir
+                            //  DYLD_SHARED_CACHE_SERIAL_SLIDE  ==> sSharedCacheSerialSlide
 							//	DYLD_ROOT_PATH					==> gLinkContext.rootPaths
 							//	DYLD_IMAGE_SUFFIX				==> gLinkContext.imageSuffix
 							//	DYLD_PRINT_OPTS					==> gLinkContext.verboseOpts
 							//	DYLD_PRINT_ENV					==> gLinkContext.verboseEnv
 							//	DYLD_FORCE_FLAT_NAMESPACE		==> gLinkContext.bindFlat
+							//	DYLD_PRERESOLVE_BINDS			==> gLinkContext.preResolveBinds
 							//	DYLD_PRINT_INITIALIZERS			==> gLinkContext.verboseInit
 							//	DYLD_PRINT_SEGMENTS				==> gLinkContext.verboseMapping
 							//	DYLD_PRINT_BINDINGS				==> gLinkContext.verboseBind
@@ -298,6 +301,7 @@ static UndefinedHandler				sUndefinedHandler = NULL;
 static ImageLoader*					sBundleBeingLoaded = NULL;	// hack until OFI is reworked
 static dyld3::SharedCacheLoadInfo	sSharedCacheLoadInfo;
 static const char*					sSharedCacheOverrideDir;
+static bool							sSharedCacheSerialSlide = false;
        bool							gSharedCacheOverridden = false;
 ImageLoader::LinkContext			gLinkContext;
 bool								gLogAPIs = false;
@@ -406,11 +410,12 @@ void addMappedRange(ImageLoader* image, uintptr_t start, uintptr_t end)
 	}
 }
 
-void removedMappedRanges(ImageLoader* image)
+// sortedImages must be sorted by address
+void removedMappedRanges(ImageLoader* const sortedImages[], unsigned count)
 {
 	for (MappedRanges* p = sMappedRangesStart; p != NULL; p = p->next) {
 		for (unsigned long i=0; i < p->count; ++i) {
-			if ( p->array[i].image == image ) {
+			if ( (p->array[i].image != NULL) && std::binary_search(&sortedImages[0], &sortedImages[count], p->array[i].image) ) {
 				// clear with a barrier so that any reader will see consistent records
 				OSMemoryBarrier();
 				p->array[i].image = NULL;
@@ -906,9 +911,39 @@ void notifyKernel(const ImageLoader& image, bool loading) {
 	}
 }
 
+//
+// Per-state worklists of images that reached a batch notified state since the last batch
+// notification for that state, so notifyBatch() does not scan and sort all images on every dlopen.
+// New images are candidates for dependents_mapped (there is no single notification for that state),
+// the other states are recorded as images are notified one by one.  Guarded by allImagesLock().
+//
+enum { kBatchDependentsMapped, kBatchRebased, kBatchBound, kBatchInitialized, kBatchStateCount };
+static std::vector<ImageLoader*>	sImagesEnteringState[kBatchStateCount];
+
+static std::vector<ImageLoader*>* batchWorklist(dyld_image_states state)
+{
+	switch ( state ) {
+		case dyld_image_state_dependents_mapped:
+			return &sImagesEnteringState[kBatchDependentsMapped];
+		case dyld_image_state_rebased:
+			return &sImagesEnteringState[kBatchRebased];
+		case dyld_image_state_bound:
+			return &sImagesEnteringState[kBatchBound];
+		case dyld_image_state_initialized:
+			return &sImagesEnteringState[kBatchInitialized];
+		default:
+			return NULL;
+	}
+}
+
 static void notifySingle(dyld_image_states state, const ImageLoader* image, ImageLoader::InitializerTimingList* timingInfo)
 {
 	//dyld::log("notifySingle(state=%d, image=%s)\n", state, image->getPath());
+	if ( std::vector<ImageLoader*>* worklist = batchWorklist(state) ) {
+		allImagesLock();
+			worklist->push_back((ImageLoader*)image);
+		allImagesUnlock();
+	}
 	std::vector<dyld_image_state_change_handler>* handlers = stateToHandlers(state, sSingleHandlers);
 	if ( handlers != NULL ) {
 		dyld_image_info info;
@@ -1024,21 +1059,52 @@ static int imageSorter(const void* l, const void* r)
 	return left->compare(right);
 }
 
+//
+// Moves images now in 'state' out of the worklist into 'images' (no duplicates), and returns the new end.
+// Images that have not reached 'state' yet stay in the worklist, images already past it are dropped.
+//
+static ImageLoader** takeImagesEnteringState(dyld_image_states state, std::vector<ImageLoader*>& worklist, ImageLoader** images)
+{
+	std::sort(worklist.begin(), worklist.end());
+	worklist.erase(std::unique(worklist.begin(), worklist.end()), worklist.end());
+	ImageLoader** end = images;
+	worklist.erase(std::remove_if(worklist.begin(), worklist.end(), [&](ImageLoader* image) {
+		dyld_image_states imageState = image->getState();
+		if ( imageState == state )
+			*end++ = image;
+		return (imageState >= state);
+	}), worklist.end());
+	return end;
+}
+
 static void notifyBatchPartial(dyld_image_states state, bool orLater, dyld_image_state_change_handler onlyHandler, bool preflightOnly, bool onlyObjCMappedNotification)
 {
 	std::vector<dyld_image_state_change_handler>* handlers = stateToHandlers(state, sBatchHandlers);
 	if ( (handlers != NULL) || ((state == dyld_image_state_bound) && (sNotifyObjCMapped != NULL)) ) {
 		// don't use a vector because it will use malloc/free and we want notifcation to be low cost
         allImagesLock();
-		dyld_image_info	infos[allImagesCount()+1];
-        ImageLoader* images[allImagesCount()+1];
+		std::vector<ImageLoader*>* worklist = orLater ? NULL : batchWorklist(state);
+		size_t maxImageCount = (worklist != NULL) ? worklist->size()+1 : sAllImages.size()+1;
+		size_t maxInfoCount = maxImageCount;
+#if SUPPORT_ACCELERATE_TABLES
+		if ( sAllCacheImagesProxy != NULL )
+			maxInfoCount += allImagesCount();
+#endif
+		dyld_image_info	infos[maxInfoCount];
+        ImageLoader* images[maxImageCount];
         ImageLoader** end = images;
-        for (std::vector<ImageLoader*>::iterator it=sAllImages.begin(); it != sAllImages.end(); it++) {
-            dyld_image_states imageState = (*it)->getState();
-            if ( (imageState == state) || (orLater && (imageState > state)) )
-                *end++ = *it;
-        }
-		if ( sBundleBeingLoaded != NULL ) {
+		if ( worklist != NULL ) {
+			// only images that changed state since the last notification for this state
+			end = takeImagesEnteringState(state, *worklist, images);
+		}
+		else {
+			for (std::vector<ImageLoader*>::iterator it=sAllImages.begin(); it != sAllImages.end(); it++) {
+				dyld_image_states imageState = (*it)->getState();
+				if ( (imageState == state) || (orLater && (imageState > state)) )
+					*end++ = *it;
+			}
+		}
+		if ( (sBundleBeingLoaded != NULL) && (std::find(images, end, sBundleBeingLoaded) == end) ) {
 			dyld_image_states imageState = sBundleBeingLoaded->getState();
 			if ( (imageState == state) || (orLater && (imageState > state)) )
 				*end++ = sBundleBeingLoaded;
@@ -1276,11 +1342,200 @@ static void addDynamicReference(ImageLoader* from, ImageLoader* to) {
 	OSSpinLockUnlock(&sDynamicReferencesLock);
 }
 
+//
+// LoadedImageIndex is a hash index over sAllImages, so finding an already loaded image by
+// (device, inode), install name or load path does not scan every image.  Each entry records
+// when its image was added, so a lookup returns the same image a front-to-back scan of
+// sAllImages would.  The indexes are updated by addImage() and removeImage() under
+// allImagesLock(), and read under the global dyld lock like sAllImages.
+//
+class LoadedImageIndex
+{
+public:
+	typedef bool		(*KeyHash)(const ImageLoader* image, uint32_t& hash);
+
+						LoadedImageIndex(KeyHash keyHash) : fKeyHash(keyHash) { }
+	void				add(ImageLoader* image, uint64_t sequence);
+	void				remove(ImageLoader* image);
+	void				rekey(ImageLoader* image, uint32_t oldHash);
+	void				clear();
+
+	// returns earliest added image with hash for which match(image) is true, or NULL
+	template <typename Match>
+	ImageLoader*		find(uint32_t hash, uint64_t& sequence, Match match) const
+	{
+		ImageLoader* result = NULL;
+		sequence = UINT64_MAX;
+		if ( fCount == 0 )
+			return NULL;
+		for (const Entry* e = fBuckets[hash & (fBucketCount-1)]; e != NULL; e = e->next) {
+			if ( (e->hash == hash) && (e->sequence < sequence) && match(e->image) ) {
+				result   = e->image;
+				sequence = e->sequence;
+			}
+		}
+		return result;
+	}
+
+private:
+	enum { kInitialBucketCount = 256 };
+	struct Entry { ImageLoader* image; uint64_t sequence; uint32_t hash; Entry* next; };
+
+	void				grow();
+	bool				removeFromBucket(ImageLoader* image, uint32_t bucket);
+
+	KeyHash				fKeyHash;
+	Entry**				fBuckets = NULL;
+	uint32_t			fBucketCount = 0;
+	uint32_t			fCount = 0;
+};
+
+void LoadedImageIndex::grow()
+{
+	Entry** oldBuckets = fBuckets;
+	uint32_t oldBucketCount = fBucketCount;
+	fBucketCount = (oldBucketCount == 0) ? kInitialBucketCount : oldBucketCount*2;
+	fBuckets = (Entry**)calloc(fBucketCount, sizeof(Entry*));
+	for (uint32_t i=0; i < oldBucketCount; ++i) {
+		for (Entry* e = oldBuckets[i]; e != NULL; ) {
+			Entry* next = e->next;
+			uint32_t bucket = e->hash & (fBucketCount-1);
+			e->next = fBuckets[bucket];
+			fBuckets[bucket] = e;
+			e = next;
+		}
+	}
+	free(oldBuckets);
+}
+
+void LoadedImageIndex::add(ImageLoader* image, uint64_t sequence)
+{
+	uint32_t hash;
+	if ( !fKeyHash(image, hash) )
+		return;
+	if ( fCount >= fBucketCount )
+		grow();
+	Entry* e = (Entry*)malloc(sizeof(Entry));
+	uint32_t bucket = hash & (fBucketCount-1);
+	e->image		= image;
+	e->sequence		= sequence;
+	e->hash			= hash;
+	e->next			= fBuckets[bucket];
+	fBuckets[bucket] = e;
+	++fCount;
+}
+
+bool LoadedImageIndex::removeFromBucket(ImageLoader* image, uint32_t bucket)
+{
+	for (Entry** link = &fBuckets[bucket]; *link != NULL; link = &(*link)->next) {
+		Entry* e = *link;
+		if ( e->image == image ) {
+			*link = e->next;
+			free(e);
+			--fCount;
+			return true;
+		}
+	}
+	return false;
+}
+
+void LoadedImageIndex::remove(ImageLoader* image)
+{
+	if ( fCount == 0 )
+		return;
+	uint32_t hash;
+	if ( fKeyHash(image, hash) && removeFromBucket(image, hash & (fBucketCount-1)) )
+		return;
+	// key changed since image was added (e.g. path set later), so look everywhere
+	for (uint32_t i=0; i < fBucketCount; ++i) {
+		if ( removeFromBucket(image, i) )
+			return;
+	}
+}
+
+// moves an image whose key changed to its new bucket, keeping when it was added
+void LoadedImageIndex::rekey(ImageLoader* image, uint32_t oldHash)
+{
+	if ( fCount == 0 )
+		return;
+	for (Entry** link = &fBuckets[oldHash & (fBucketCount-1)]; *link != NULL; link = &(*link)->next) {
+		Entry* e = *link;
+		if ( e->image == image ) {
+			*link = e->next;
+			if ( !fKeyHash(image, e->hash) ) {
+				free(e);
+				--fCount;
+				return;
+			}
+			uint32_t bucket = e->hash & (fBucketCount-1);
+			e->next = fBuckets[bucket];
+			fBuckets[bucket] = e;
+			return;
+		}
+	}
+}
+
+void LoadedImageIndex::clear()
+{
+	for (uint32_t i=0; i < fBucketCount; ++i) {
+		for (Entry* e = fBuckets[i]; e != NULL; ) {
+			Entry* next = e->next;
+			free(e);
+			e = next;
+		}
+	}
+	free(fBuckets);
+	fBuckets = NULL;
+	fBucketCount = 0;
+	fCount = 0;
+}
+
+static uint32_t fileIDHash(dev_t device, ino_t inode)
+{
+	return (uint32_t)(inode ^ (inode >> 32)) ^ ((uint32_t)device * 0x9E3779B1);
+}
+
+static bool imageFileIDKey(const ImageLoader* image, uint32_t& hash)
+{
+	hash = fileIDHash(image->getDevice(), image->getInode());
+	return true;
+}
+
+static bool imageInstallNameKey(const ImageLoader* image, uint32_t& hash)
+{
+	// the dyld3 cache proxy stands for many dylibs and has no install name of its own
+	if ( image == (ImageLoader*)sAllCacheImagesProxy )
+		return false;
+	const char* installPath = image->getInstallPath();
+	if ( installPath == NULL )
+		return false;
+	hash = ImageLoader::hash(installPath);
+	return true;
+}
+
+static bool imagePathKey(const ImageLoader* image, uint32_t& hash)
+{
+	if ( image->getPath() == NULL )
+		return false;
+	hash = image->getPathHash();
+	return true;
+}
+
+static LoadedImageIndex		sImagesByFileID(&imageFileIDKey);
+static LoadedImageIndex		sImagesByInstallName(&imageInstallNameKey);
+static LoadedImageIndex		sImagesByPath(&imagePathKey);
+static uint64_t				sImageAddSequence = 0;
+
 static void addImage(ImageLoader* image)
 {
 	// add to master list
     allImagesLock();
         sAllImages.push_back(image);
+        sImagesEnteringState[kBatchDependentsMapped].push_back(image);
+        ++sImageAddSequence;
+        sImagesByFileID.add(image, sImageAddSequence);
+        sImagesByInstallName.add(image, sImageAddSequence);
+        sImagesByPath.add(image, sImageAddSequence);
     allImagesUnlock();
 	
 	// update mapped ranges
@@ -1313,88 +1568,104 @@ static void addImage(ImageLoader* image)
 	
 }
 
+// called when the path of an image changes after it was added (e.g. NSLinkModule() naming a bundle)
+void imagePathChanged(ImageLoader* image, uint32_t oldPathHash)
+{
+    allImagesLock();
+        sImagesByPath.rekey(image, oldPathHash);
+    allImagesUnlock();
+}
+
 //
-// Helper for std::remove_if
+// Removes images from all of dyld's lists.  Each list is compacted in one pass for the
+// whole batch, so unloading many images at once is not O(images * loaded images).
 //
-class RefUsesImage {
-public:
-	RefUsesImage(ImageLoader* image) : _image(image) {}
-	bool operator()(const ImageLoader::DynamicReference& ref) const {
-		return ( (ref.from == _image) || (ref.to == _image) );
-	}
-private:
-	ImageLoader* _image;
-};
-
+static void removeImages(ImageLoader* const images[], unsigned count)
+{
+	// sorted copies for membership tests while compacting lists
+	ImageLoader* sortedImages[count];
+	const mach_header* machHeaders[count];
+	const mach_header* sortedMachHeaders[count];
+	for (unsigned i=0; i < count; ++i) {
+		sortedImages[i] = images[i];
+		machHeaders[i] = sortedMachHeaders[i] = images[i]->machHeader();
+	}
+	std::sort(&sortedImages[0], &sortedImages[count]);
+	std::sort(&sortedMachHeaders[0], &sortedMachHeaders[count]);
+	auto isRemoved = [&](const ImageLoader* image) {
+		return std::binary_search(&sortedImages[0], &sortedImages[count], image);
+	};
 
-
-void removeImage(ImageLoader* image)
-{
 	// if has dtrace DOF section, tell dtrace it is going away, then remove from sImageFilesNeedingDOFUnregistration
-	for (std::vector<RegisteredDOF>::iterator it=sImageFilesNeedingDOFUnregistration.begin(); it != sImageFilesNeedingDOFUnregistration.end(); ) {
-		if ( it->mh == image->machHeader() ) {
-			unregisterDOF(it->registrationID);
-			sImageFilesNeedingDOFUnregistration.erase(it);
-			// don't increment iterator, the erase caused next element to be copied to where this iterator points
-		}
-		else {
-			++it;
-		}
-	}
+	sImageFilesNeedingDOFUnregistration.erase(std::remove_if(sImageFilesNeedingDOFUnregistration.begin(), sImageFilesNeedingDOFUnregistration.end(), [&](const RegisteredDOF& dof) {
+		if ( !std::binary_search(&sortedMachHeaders[0], &sortedMachHeaders[count], dof.mh) )
+			return false;
+		unregisterDOF(dof.registrationID);
+		return true;
+	}), sImageFilesNeedingDOFUnregistration.end());
 	
-	// tell all registered remove image handlers about this
-	// do this before removing image from internal data structures so that the callback can query dyld about the image
-	if ( image->getState() >= dyld_image_state_bound ) {
-		sRemoveImageCallbacksInUse = true; // This only runs inside dyld's global lock, so ok to use a global for the in-use flag.
-		for (std::vector<ImageCallback>::iterator it=sRemoveImageCallbacks.begin(); it != sRemoveImageCallbacks.end(); it++) {
-			(*it)(image->machHeader(), image->getSlide());
-		}
-		sRemoveImageCallbacksInUse = false;
+	// tell all registered remove image handlers about these
+	// do this before removing images from internal data structures so that the callback can query dyld about them
+	for (unsigned i=0; i < count; ++i) {
+		ImageLoader* image = images[i];
+		if ( image->getState() >= dyld_image_state_bound ) {
+			sRemoveImageCallbacksInUse = true; // This only runs inside dyld's global lock, so ok to use a global for the in-use flag.
+			for (std::vector<ImageCallback>::iterator it=sRemoveImageCallbacks.begin(); it != sRemoveImageCallbacks.end(); it++) {
+				(*it)(image->machHeader(), image->getSlide());
+			}
+			sRemoveImageCallbacksInUse = false;
 
-		if ( sNotifyObjCUnmapped !=  NULL && image->notifyObjC() )
-			(*sNotifyObjCUnmapped)(image->getRealPath(), image->machHeader());
+			if ( sNotifyObjCUnmapped !=  NULL && image->notifyObjC() )
+				(*sNotifyObjCUnmapped)(image->getRealPath(), image->machHeader());
+		}
 	}
 	
 	// notify 
-	notifySingle(dyld_image_state_terminated, image, NULL);
+	for (unsigned i=0; i < count; ++i)
+		notifySingle(dyld_image_state_terminated, images[i], NULL);
 	
 	// remove from mapped images table
-	removedMappedRanges(image);
+	removedMappedRanges(sortedImages, count);
 
 	// remove from master list
     allImagesLock();
-        for (std::vector<ImageLoader*>::iterator it=sAllImages.begin(); it != sAllImages.end(); it++) {
-            if ( *it == image ) {
-                sAllImages.erase(it);
-                break;
-            }
+        sAllImages.erase(std::remove_if(sAllImages.begin(), sAllImages.end(), isRemoved), sAllImages.end());
+        for (std::vector<ImageLoader*>& worklist : sImagesEnteringState)
+            worklist.erase(std::remove_if(worklist.begin(), worklist.end(), isRemoved), worklist.end());
+        for (unsigned i=0; i < count; ++i) {
+            sImagesByFileID.remove(images[i]);
+            sImagesByInstallName.remove(images[i]);
+            sImagesByPath.remove(images[i]);
         }
     allImagesUnlock();
 	
 	// remove from sDynamicReferences
 	OSSpinLockLock(&sDynamicReferencesLock);
-		sDynamicReferences.erase(std::remove_if(sDynamicReferences.begin(), sDynamicReferences.end(), RefUsesImage(image)), sDynamicReferences.end());
+		sDynamicReferences.erase(std::remove_if(sDynamicReferences.begin(), sDynamicReferences.end(), [&](const ImageLoader::DynamicReference& ref) {
+			return ( isRemoved(ref.from) || isRemoved(ref.to) );
+		}), sDynamicReferences.end());
 	OSSpinLockUnlock(&sDynamicReferencesLock);
 
 	// flush find-by-address cache (do this after removed from master list, so there is no chance it can come back)
-	if ( sLastImageByAddressCache == image )
+	if ( (sLastImageByAddressCache != NULL) && isRemoved(sLastImageByAddressCache) )
 		sLastImageByAddressCache = NULL;
 
-	// if in root list, pull it out 
-	for (std::vector<ImageLoader*>::iterator it=sImageRoots.begin(); it != sImageRoots.end(); it++) {
-		if ( *it == image ) {
-			sImageRoots.erase(it);
-			break;
-		}
-	}
+	// if in root list, pull them out 
+	sImageRoots.erase(std::remove_if(sImageRoots.begin(), sImageRoots.end(), isRemoved), sImageRoots.end());
 
 	// log if requested
 	if ( gLinkContext.verboseLoading || (sEnv.DYLD_PRINT_LIBRARIES_POST_LAUNCH && (sMainExecutable!=NULL) && sMainExecutable->isLinked()) ) {
-		dyld::log("dyld: unloaded: %s\n", image->getPath());
+		for (unsigned i=0; i < count; ++i)
+			dyld::log("dyld: unloaded: %s\n", images[i]->getPath());
 	}
 
 	// tell gdb, new way
-	removeImageFromAllImages(image->machHeader());
+	removeImagesFromAllImages(count, machHeaders);
+}
+
+void removeImage(ImageLoader* image)
+{
+	removeImages(&image, 1);
 }
 
 
@@ -1428,6 +1699,8 @@ const char* getExecutablePath()
 
 static void runAllStaticTerminators(void* extra)
 {
+	// lookups done by terminators are not included
+	ImageLoader::printSymbolLookupTrace();
 	try {
 		const size_t imageCount = sImageFilesNeedingTermination.size();
 		for(size_t i=imageCount; i > 0; --i){
@@ -1442,11 +1715,48 @@ static void runAllStaticTerminators(void* extra)
 	}
 }
 
+//
+// While launching, the DYLD_*_PATH and fallback directories are probed once per
+// dependent, and a directory that does not exist is probed for every leaf name.
+// SearchPathMissCache interns the search directories once and records, per leaf
+// name, which of them are known not to contain it, so repeated probes become a
+// hash lookup instead of a stat().  Only misses are recorded: a hit is loaded and
+// then found by loadPhase5check() on later lookups.  The cache is only consulted
+// until initializers start, so files created by initializers are always seen.
+//
+class SearchPathMissCache
+{
+public:
+	int					stat(const char* path, struct stat* statBuf);
+	void				clear();
+
+private:
+	enum { kMaxDirs = 64, kInitialLeafCapacity = 64 };
+	struct Dir  { const char* path; size_t len; bool checked; bool exists; };
+	struct Leaf { const char* name; uint32_t hash; uint64_t missingInDirs; };
+
+	void				addDirs(const char* const* list);
+	int					dirIndexFor(const char* path);
+	Leaf*				findOrAddLeaf(const char* name);
+	void				growLeaves();
+
+	std::vector<Dir>	fDirs;
+	Leaf*				fLeaves = NULL;
+	uint32_t			fLeafCapacity = 0;
+	uint32_t			fLeafCount = 0;
+	bool				fDirsBuilt = false;
+};
+
+static SearchPathMissCache	sSearchPathMissCache;
+
 void initializeMainExecutable()
 {
 	// record that we've reached this step
 	gLinkContext.startedInitializingMainExecutable = true;
 
+	// search path misses recorded during launch may not hold once initializers run
+	sSearchPathMissCache.clear();
+
 	// run initialzers for any inserted dylibs
 	ImageLoader::InitializerTimingList initializerTimes[allImagesCount()];
 	initializerTimes[0].count = 0;
@@ -1469,6 +1779,18 @@ void initializeMainExecutable()
 		ImageLoader::printStatistics((unsigned int)allImagesCount(), initializerTimes[0]);
 	if ( sEnv.DYLD_PRINT_STATISTICS_DETAILS )
 		ImageLoaderMachO::printStatisticsDetails((unsigned int)allImagesCount(), initializerTimes[0]);
+	if ( dyld3::launch_profile_enabled() ) {
+		ImageLoader::addLaunchProfileCounters((unsigned int)allImagesCount());
+		if ( (gLibSystemHelpers != NULL) && (gLibSystemHelpers->version >= 14) ) {
+			struct dyld_global_lock_statistics lockStats;
+			(*gLibSystemHelpers->getGlobalDyldLockStatistics)(&lockStats);
+			dyld3::launch_profile_add_counter("lockAcquisitions", lockStats.acquisitions);
+			dyld3::launch_profile_add_counter("lockContendedAcquisitions", lockStats.contendedAcquisitions);
+			dyld3::launch_profile_add_counter("lockWaitTime", lockStats.totalWaitTime);
+			dyld3::launch_profile_add_counter("lockHoldTime", lockStats.totalHoldTime);
+		}
+		dyld3::launch_profile_write();
+	}
 }
 
 bool mainExecutablePrebound()
@@ -1873,6 +2195,9 @@ void processDyldEnvironmentVariable(const char* key, const char* value, const ch
 	else if ( strcmp(key, "DYLD_FORCE_FLAT_NAMESPACE") == 0 ) {
 		gLinkContext.bindFlat = true;
 	}
+	else if ( strcmp(key, "DYLD_PRERESOLVE_BINDS") == 0 ) {
+		gLinkContext.preResolveBinds = true;
+	}
 	else if ( strcmp(key, "DYLD_NEW_LOCAL_SHARED_REGIONS") == 0 ) {
 		// ignore, no longer relevant but some scripts still set it
 	}
@@ -1903,6 +2228,17 @@ void processDyldEnvironmentVariable(const char* key, const char* value, const ch
 	else if ( strcmp(key, "DYLD_PRINT_STATISTICS_DETAILS") == 0 ) {
 		sEnv.DYLD_PRINT_STATISTICS_DETAILS = true;
 	}
+	else if ( strcmp(key, "DYLD_PRINT_SYMBOL_LOOKUPS") == 0 ) {
+		// value is how many of the most expensive lookups to print at exit
+		unsigned topCount = 0;
+		for (const char* s = value; (*s >= '0') && (*s <= '9'); ++s)
+			topCount = topCount*10 + (*s - '0');
+		ImageLoader::enableSymbolLookupTracing((topCount != 0) ? topCount : 25);
+	}
+	else if ( strcmp(key, "DYLD_LAUNCH_PROFILE") == 0 ) {
+		// also read by libdyld, which writes the profile when launching with a closure
+		dyld3::launch_profile_enable(value);
+	}
 	else if ( strcmp(key, "DYLD_PRINT_SEGMENTS") == 0 ) {
 		gLinkContext.verboseMapping = true;
 	}
@@ -1958,6 +2294,12 @@ void processDyldEnvironmentVariable(const char* key, const char* value, const ch
 	else if ( (strcmp(key, "DYLD_SHARED_CACHE_DIR") == 0) && !sSafeMode  ) {
 		sSharedCacheOverrideDir = value;
 	}
+	else if ( strcmp(key, "DYLD_SHARED_CACHE_SERIAL_SLIDE") == 0 ) {
+		sSharedCacheSerialSlide = true;
+	}
+	else if ( strcmp(key, "DYLD_TLV_ARENA") == 0 ) {
+		// handled by libdyld when it sets up thread local variables
+	}
 	else if ( strcmp(key, "DYLD_USE_CLOSURES") == 0 ) {
 		if ( dyld3::loader::internalInstall() )
 			sEnableClosures = true;
@@ -2406,13 +2748,10 @@ void forEachImageDo( void (*callback)(ImageLoader*, void* userData), void* userD
 
 ImageLoader* findLoadedImage(const struct stat& stat_buf)
 {
-	const size_t imageCount = sAllImages.size();
-	for(size_t i=0; i < imageCount; ++i){
-		ImageLoader* anImage = sAllImages[i];
-		if ( anImage->statMatch(stat_buf) )
-			return anImage;
-	}
-	return NULL;
+	uint64_t sequence;
+	return sImagesByFileID.find(fileIDHash(stat_buf.st_dev, stat_buf.st_ino), sequence, [&](const ImageLoader* anImage) {
+		return anImage->statMatch(stat_buf);
+	});
 }
 
 // based on ANSI-C strstr()
@@ -2899,17 +3238,15 @@ static ImageLoader* checkandAddImage(ImageLoader* image, const LoadContext& cont
 	// now sanity check that this loaded image does not have the same install path as any existing image
 	const char* loadedImageInstallPath = image->getInstallPath();
 	if ( image->isDylib() && (loadedImageInstallPath != NULL) && (loadedImageInstallPath[0] == '/') ) {
-		for (std::vector<ImageLoader*>::iterator it=sAllImages.begin(); it != sAllImages.end(); it++) {
-			ImageLoader* anImage = *it;
-			const char* installPath = anImage->getInstallPath();
-			if ( installPath != NULL) {
-				if ( strcmp(loadedImageInstallPath, installPath) == 0 ) {
-					//dyld::log("duplicate(%s) => %p\n", installPath, anImage);
-					removeImage(image);
-					ImageLoader::deleteImage(image);
-					return anImage;
-				}
-			}
+		uint64_t sequence;
+		ImageLoader* anImage = sImagesByInstallName.find(ImageLoader::hash(loadedImageInstallPath), sequence, [&](const ImageLoader* candidate) {
+			return ( strcmp(loadedImageInstallPath, candidate->getInstallPath()) == 0 );
+		});
+		if ( anImage != NULL ) {
+			//dyld::log("duplicate(%s) => %p\n", loadedImageInstallPath, anImage);
+			removeImage(image);
+			ImageLoader::deleteImage(image);
+			return anImage;
 		}
 	}
 
@@ -3054,10 +3391,14 @@ static ImageLoader* loadPhase6(int fd, const struct stat& stat_buf, const char*
 #endif
 
 		// instantiate an image
+		uint64_t t1 = mach_absolute_time();
 		ImageLoader* image = ImageLoaderMachO::instantiateFromFile(path, fd, firstPages, headerAndLoadCommandsSize, fileOffset, fileLength, stat_buf, gLinkContext);
+		uint64_t t2 = mach_absolute_time();
 		
 		// validate
-		return checkandAddImage(image, context);
+		ImageLoader* result = checkandAddImage(image, context);
+		dyld3::launch_profile_add_duration("map", result->getPath(), t1, t2);
+		return result;
 	}
 	
 	// try other file formats here...
@@ -3111,6 +3452,138 @@ static ImageLoader* loadPhase5open(const char* path, const LoadContext& context,
 
 
 
+void SearchPathMissCache::addDirs(const char* const* list)
+{
+	if ( list == NULL )
+		return;
+	for (const char* const* dp = list; *dp != NULL; ++dp) {
+		size_t len = strlen(*dp);
+		// "dir/" and "dir" are the same directory
+		while ( (len > 1) && ((*dp)[len-1] == '/') )
+			--len;
+		bool found = false;
+		for (const Dir& dir : fDirs) {
+			if ( (dir.len == len) && (strncmp(dir.path, *dp, len) == 0) ) {
+				found = true;
+				break;
+			}
+		}
+		if ( !found && (fDirs.size() < kMaxDirs) )
+			fDirs.push_back({ *dp, len, false, false });
+	}
+}
+
+int SearchPathMissCache::dirIndexFor(const char* path)
+{
+	if ( !fDirsBuilt ) {
+		fDirsBuilt = true;
+		addDirs(sEnv.DYLD_FRAMEWORK_PATH);
+		addDirs(sEnv.DYLD_LIBRARY_PATH);
+		addDirs(sEnv.DYLD_FALLBACK_FRAMEWORK_PATH);
+		addDirs(sEnv.DYLD_FALLBACK_LIBRARY_PATH);
+		addDirs(sEnv.LD_LIBRARY_PATH);
+	}
+	// pick longest matching directory, so nested search dirs get their own entries
+	int result = -1;
+	size_t resultLen = 0;
+	for (size_t i=0; i < fDirs.size(); ++i) {
+		const Dir& dir = fDirs[i];
+		if ( (dir.len > resultLen) && (strncmp(path, dir.path, dir.len) == 0) && (path[dir.len] == '/') ) {
+			result = (int)i;
+			resultLen = dir.len;
+		}
+	}
+	return result;
+}
+
+void SearchPathMissCache::growLeaves()
+{
+	Leaf* oldLeaves = fLeaves;
+	uint32_t oldCapacity = fLeafCapacity;
+	fLeafCapacity = (oldCapacity == 0) ? kInitialLeafCapacity : oldCapacity*2;
+	fLeaves = (Leaf*)calloc(fLeafCapacity, sizeof(Leaf));
+	for (uint32_t i=0; i < oldCapacity; ++i) {
+		if ( oldLeaves[i].name == NULL )
+			continue;
+		uint32_t slot = oldLeaves[i].hash & (fLeafCapacity-1);
+		while ( fLeaves[slot].name != NULL )
+			slot = (slot+1) & (fLeafCapacity-1);
+		fLeaves[slot] = oldLeaves[i];
+	}
+	free(oldLeaves);
+}
+
+SearchPathMissCache::Leaf* SearchPathMissCache::findOrAddLeaf(const char* name)
+{
+	// keep load factor under 3/4
+	if ( (fLeafCount+1)*4 > fLeafCapacity*3 )
+		growLeaves();
+	uint32_t hash = ImageLoader::hash(name);
+	uint32_t slot = hash & (fLeafCapacity-1);
+	while ( fLeaves[slot].name != NULL ) {
+		if ( (fLeaves[slot].hash == hash) && (strcmp(fLeaves[slot].name, name) == 0) )
+			return &fLeaves[slot];
+		slot = (slot+1) & (fLeafCapacity-1);
+	}
+	fLeaves[slot].name			= strdup(name);
+	fLeaves[slot].hash			= hash;
+	fLeaves[slot].missingInDirs	= 0;
+	++fLeafCount;
+	return &fLeaves[slot];
+}
+
+int SearchPathMissCache::stat(const char* path, struct stat* statBuf)
+{
+	if ( gLinkContext.startedInitializingMainExecutable )
+		return my_stat(path, statBuf);
+
+	int index = dirIndexFor(path);
+	if ( index == -1 )
+		return my_stat(path, statBuf);
+
+	// a missing search directory answers every probe under it
+	Dir& dir = fDirs[index];
+	if ( !dir.checked ) {
+		char dirPath[dir.len+1];
+		strlcpy(dirPath, dir.path, dir.len+1);
+		struct stat dirStatBuf;
+		dir.exists  = ( (my_stat(dirPath, &dirStatBuf) == 0) || (errno != ENOENT) );
+		dir.checked = true;
+	}
+	if ( !dir.exists ) {
+		++ImageLoader::fgTotalSearchPathStatsAvoided;
+		errno = ENOENT;
+		return -1;
+	}
+
+	Leaf* leaf = findOrAddLeaf(&path[dir.len+1]);
+	const uint64_t dirBit = 1ULL << index;
+	if ( leaf->missingInDirs & dirBit ) {
+		++ImageLoader::fgTotalSearchPathStatsAvoided;
+		errno = ENOENT;
+		return -1;
+	}
+	int result = my_stat(path, statBuf);
+	if ( (result != 0) && (errno == ENOENT) )
+		leaf->missingInDirs |= dirBit;
+	return result;
+}
+
+void SearchPathMissCache::clear()
+{
+	for (uint32_t i=0; i < fLeafCapacity; ++i) {
+		if ( fLeaves[i].name != NULL )
+			free((void*)fLeaves[i].name);
+	}
+	free(fLeaves);
+	fLeaves = NULL;
+	fLeafCapacity = 0;
+	fLeafCount = 0;
+	fDirs.clear();
+	fDirsBuilt = false;
+}
+
+
 // try to open file
 static ImageLoader* loadPhase5load(const char* path, const char* orgPath, const LoadContext& context, unsigned& cacheIndex, std::vector<const char*>* exceptions)
 {
@@ -3152,7 +3625,7 @@ static ImageLoader* loadPhase5load(const char* path, const char* orgPath, const
 		bool useCache = false;
 		if ( shareCacheResults.imageData == nullptr ) {
 			// HACK to support old caches
-			existsOnDisk = ( my_stat(path, &statBuf) == 0 );
+			existsOnDisk = ( sSearchPathMissCache.stat(path, &statBuf) == 0 );
 			didStat = true;
 			statErrNo = errno;
 			useCache = !existsOnDisk;
@@ -3162,7 +3635,7 @@ static ImageLoader* loadPhase5load(const char* path, const char* orgPath, const
 			bzero(&statBuf, sizeof(statBuf));
 			dyld3::launch_cache::Image image(shareCacheResults.imageData);
 			if ( image.overridableDylib() ) {
-				existsOnDisk = ( my_stat(path, &statBuf) == 0 );
+				existsOnDisk = ( sSearchPathMissCache.stat(path, &statBuf) == 0 );
 				didStat = true;
 				statErrNo = errno;
 				if ( sSharedCacheLoadInfo.loadAddress->header.dylibsExpectedOnDisk ) {
@@ -3186,7 +3659,7 @@ static ImageLoader* loadPhase5load(const char* path, const char* orgPath, const
 
 	// not in cache or cache not usable
 	if ( !didStat ) {
-		existsOnDisk = ( my_stat(path, &statBuf) == 0 );
+		existsOnDisk = ( sSearchPathMissCache.stat(path, &statBuf) == 0 );
 		statErrNo = errno;
 	}
 	if ( existsOnDisk ) {
@@ -3218,43 +3691,41 @@ static ImageLoader* loadPhase5check(const char* path, const char* orgPath, const
 {
 	//dyld::log("%s(%s, %s)\n", __func__ , path, orgPath);
 	// search path against load-path and install-path of all already loaded images
+	// the earliest loaded match wins, as if sAllImages was scanned in order
 	uint32_t hash = ImageLoader::hash(path);
 	//dyld::log("check() hash=%d, path=%s\n", hash, path);
-	for (std::vector<ImageLoader*>::iterator it=sAllImages.begin(); it != sAllImages.end(); it++) {
-		ImageLoader* anImage = *it;
-		// check hash first to cut down on strcmp calls
-		//dyld::log("    check() hash=%d, path=%s\n", anImage->getPathHash(), anImage->getPath());
-		if ( anImage->getPathHash() == hash ) {
-			if ( strcmp(path, anImage->getPath()) == 0 ) {
-				// if we are looking for a dylib don't return something else
-				if ( !context.mustBeDylib || anImage->isDylib() )
-					return anImage;
-			}
-		}
-		if ( context.matchByInstallName || anImage->matchInstallPath() ) {
-			const char* installPath = anImage->getInstallPath();
-			if ( installPath != NULL) {
-				if ( strcmp(path, installPath) == 0 ) {
-					// if we are looking for a dylib don't return something else
-					if ( !context.mustBeDylib || anImage->isDylib() )
-						return anImage;
-				}
-			}
-		}
-		// an install name starting with @rpath should match by install name, not just real path
-		if ( (orgPath[0] == '@') && (strncmp(orgPath, "@rpath/", 7) == 0) ) {
-			const char* installPath = anImage->getInstallPath();
-			if ( installPath != NULL) {
-				if ( !context.mustBeDylib || anImage->isDylib() ) {
-					if ( strcmp(orgPath, installPath) == 0 )
-						return anImage;
-				}
-			}
+	ImageLoader* result = NULL;
+	uint64_t resultSequence = UINT64_MAX;
+	uint64_t sequence;
+	// if we are looking for a dylib don't return something else
+	ImageLoader* anImage = sImagesByPath.find(hash, sequence, [&](const ImageLoader* candidate) {
+		return ( (strcmp(path, candidate->getPath()) == 0) && (!context.mustBeDylib || candidate->isDylib()) );
+	});
+	if ( (anImage != NULL) && (sequence < resultSequence) ) {
+		result = anImage;
+		resultSequence = sequence;
+	}
+	anImage = sImagesByInstallName.find(hash, sequence, [&](const ImageLoader* candidate) {
+		return ( (context.matchByInstallName || candidate->matchInstallPath()) && (strcmp(path, candidate->getInstallPath()) == 0)
+				&& (!context.mustBeDylib || candidate->isDylib()) );
+	});
+	if ( (anImage != NULL) && (sequence < resultSequence) ) {
+		result = anImage;
+		resultSequence = sequence;
+	}
+	// an install name starting with @rpath should match by install name, not just real path
+	if ( (orgPath[0] == '@') && (strncmp(orgPath, "@rpath/", 7) == 0) ) {
+		anImage = sImagesByInstallName.find(ImageLoader::hash(orgPath), sequence, [&](const ImageLoader* candidate) {
+			return ( (strcmp(orgPath, candidate->getInstallPath()) == 0) && (!context.mustBeDylib || candidate->isDylib()) );
+		});
+		if ( (anImage != NULL) && (sequence < resultSequence) ) {
+			result = anImage;
+			resultSequence = sequence;
 		}
 	}
-	
-	//dyld::log("%s(%s) => NULL\n", __func__,   path);
-	return NULL;
+
+	//dyld::log("%s(%s) => %p\n", __func__, path, result);
+	return result;
 }
 
 
@@ -3645,6 +4116,7 @@ static void mapSharedCache()
 	opts.useHaswell			= false;
 #endif
 	opts.verbose			= gLinkContext.verboseMapping;
+	opts.serialSlide		= sSharedCacheSerialSlide;
 	loadDyldCache(opts, &sSharedCacheLoadInfo);
 
 	// update global state
@@ -4559,26 +5031,36 @@ void garbageCollectImages()
 		if ( (rangeCount > 0) && (gLibSystemHelpers != NULL) && (gLibSystemHelpers->version >= 13) )
 			(*gLibSystemHelpers->cxa_finalize_ranges)(ranges, rangeCount);
 
-		// collect phase: delete all images which are not marked in-use
-		bool mightBeMore;
-		do {
-			mightBeMore = false;
-			for (std::vector<ImageLoader*>::iterator it=sAllImages.begin(); it != sAllImages.end(); it++) {
-				ImageLoader* image = *it;
-				if ( ! image->isMarkedInUse() ) {
-					try {
-						if (gLogAPIs) dyld::log("dlclose(), deleting %p %s\n", image, image->getShortName());
-						removeImage(image);
-						ImageLoader::deleteImage(image);
-						mightBeMore = true;
-						break;  // interator in invalidated by this removal
-					}
-					catch (const char* msg) {
-						dyld::warn("problem deleting image: %s\n", msg);
-					}
+		// collect phase: remove all images which are not marked in-use from dyld's lists in one batch, then delete them
+		// (terminators may have changed what is loaded, so build the list again)
+		ImageLoader* unusedImages[sAllImages.size()];
+		unsigned unusedCount = 0;
+		for (std::vector<ImageLoader*>::iterator it=sAllImages.begin(); it != sAllImages.end(); it++) {
+			ImageLoader* image = *it;
+			if ( ! image->isMarkedInUse() ) {
+				if (gLogAPIs) dyld::log("dlclose(), deleting %p %s\n", image, image->getShortName());
+				unusedImages[unusedCount++] = image;
+			}
+		}
+		if ( unusedCount != 0 ) {
+			bool removed = false;
+			try {
+				removeImages(unusedImages, unusedCount);
+				removed = true;
+			}
+			catch (const char* msg) {
+				dyld::warn("problem removing images: %s\n", msg);
+			}
+			// one image failing to delete must not leak the rest
+			for (unsigned i=0; removed && (i < unusedCount); ++i) {
+				try {
+					ImageLoader::deleteImage(unusedImages[i]);
+				}
+				catch (const char* msg) {
+					dyld::warn("problem deleting image: %s\n", msg);
 				}
 			}
-		} while ( mightBeMore );
+		}
 	} while (sRedo);
 	sDoingGC = false;
 
@@ -5989,6 +6471,11 @@ reloadAllImages:
 			}
 			// note: we don't need to worry about inserted images because if DYLD_INSERT_LIBRARIES was set we would not be using the accelerator table
 			sAllImages.clear();
+			for (std::vector<ImageLoader*>& worklist : sImagesEnteringState)
+				worklist.clear();
+			sImagesByFileID.clear();
+			sImagesByInstallName.clear();
+			sImagesByPath.clear();
 			sImageRoots.clear();
 			sImageFilesNeedingTermination.clear();
 			sImageFilesNeedingDOFUnregistration.clear();
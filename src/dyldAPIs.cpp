@@ -41,6 +41,7 @@
 #include <algorithm>
 
 #include <mach/mach.h>
+#include <mach/mach_time.h>
 #include <sys/time.h>
 #include <sys/sysctl.h>
 #include <mach/mach_traps.h> // for task_self_trap()
@@ -1709,6 +1710,18 @@ char* dlerror()
 	return NULL;
 }
 
+// called when dlsym() finds its symbol while DYLD_PRINT_SYMBOL_LOOKUPS is on
+static void traceDlsym(void* callerAddress, const char* underscoredName, const ImageLoader* foundIn, uint64_t lookupStart)
+{
+	if ( lookupStart == 0 )
+		return;
+	// don't count the time to find the caller as part of the lookup
+	uint64_t lookupEnd = mach_absolute_time();
+	const ImageLoader* callerImage = dyld::findImageContainingAddress(callerAddress);
+	lookupStart += mach_absolute_time() - lookupEnd;
+	ImageLoader::traceSymbolLookup(ImageLoader::kSymbolLookupDlsym, callerImage, underscoredName, foundIn, lookupStart);
+}
+
 void* dlsym(void* handle, const char* symbolName)
 {
 	if ( dyld::gLogAPIs )
@@ -1727,6 +1740,10 @@ void* dlsym(void* handle, const char* symbolName)
 	CRSetCrashLogMessage("dyld: in dlsym()");
 	dlerrorClear();
 
+	// DYLD_PRINT_SYMBOL_LOOKUPS records each dlsym() that finds its symbol once, not each image searched
+	uint64_t lookupStart = ImageLoader::symbolLookupTracingEnabled() ? mach_absolute_time() : 0;
+	void* lookupCaller = (lookupStart != 0) ? __builtin_return_address(1) : NULL; // note layers: 1: real client, 0: libSystem glue
+
 	const ImageLoader* image;
 	const ImageLoader::Symbol* sym;
 	void* result;
@@ -1742,6 +1759,7 @@ void* dlsym(void* handle, const char* symbolName)
 		if ( dyld::flatFindExportedSymbol(underscoredName, &sym, &image) ) {
 			CRSetCrashLogMessage(NULL);
 			result = (void*)image->getExportedSymbolAddress(sym, dyld::gLinkContext, NULL, false, underscoredName);
+			traceDlsym(lookupCaller, underscoredName, image, lookupStart);
 			if ( dyld::gLogAPIs )
 				dyld::log("  %s(RTLD_DEFAULT, %s) ==> %p\n", __func__, symbolName, result);
 			return result;
@@ -1762,6 +1780,7 @@ void* dlsym(void* handle, const char* symbolName)
 		if ( sym != NULL ) {
 			CRSetCrashLogMessage(NULL);
 			result = (void*)image->getExportedSymbolAddress(sym, dyld::gLinkContext, NULL, false, underscoredName);
+			traceDlsym(lookupCaller, underscoredName, image, lookupStart);
 			if ( dyld::gLogAPIs )
 				dyld::log("  %s(RTLD_MAIN_ONLY, %s) ==> %p\n", __func__, symbolName, result);
 			return result;
@@ -1795,6 +1814,7 @@ void* dlsym(void* handle, const char* symbolName)
 		if ( sym != NULL ) {
 			CRSetCrashLogMessage(NULL);
 			result = (void*)image->getExportedSymbolAddress(sym, dyld::gLinkContext , callerImage, false, underscoredName);
+			traceDlsym(lookupCaller, underscoredName, image, lookupStart);
 			if ( dyld::gLogAPIs )
 				dyld::log("  %s(RTLD_NEXT, %s) ==> %p\n", __func__, symbolName, result);
 			return result;
@@ -1827,6 +1847,7 @@ void* dlsym(void* handle, const char* symbolName)
 		if ( sym != NULL ) {
 			CRSetCrashLogMessage(NULL);
 			result = (void*)image->getExportedSymbolAddress(sym, dyld::gLinkContext, callerImage, false, underscoredName);
+			traceDlsym(lookupCaller, underscoredName, image, lookupStart);
 			if ( dyld::gLogAPIs )
 				dyld::log("  %s(RTLD_SELF, %s) ==> %p\n", __func__, symbolName, result);
 			return result;
@@ -1865,6 +1886,7 @@ void* dlsym(void* handle, const char* symbolName)
 				callerImage = dyld::findImageContainingAddress(callerAddress);
 			}
 			result = (void*)image->getExportedSymbolAddress(sym, dyld::gLinkContext, callerImage, false, underscoredName);
+			traceDlsym(lookupCaller, underscoredName, image, lookupStart);
 			if ( dyld::gLogAPIs )
 				dyld::log("  %s(%p, %s) ==> %p\n", __func__, handle, symbolName, result);
 			return result;
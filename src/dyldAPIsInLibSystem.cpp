@@ -1671,7 +1671,7 @@ static void shared_cache_out_of_date()
 
 
 // the table passed to dyld containing thread helpers
-static dyld::LibSystemHelpers sHelpers = { 13, &dyldGlobalLockAcquire, &dyldGlobalLockRelease,
+static dyld::LibSystemHelpers sHelpers = { 14, &dyldGlobalLockAcquire, &dyldGlobalLockRelease,
 									&getPerThreadBufferFor_dlerror, &malloc, &free, &__cxa_atexit,
 									&shared_cache_missing, &shared_cache_out_of_date,
 									NULL, NULL,
@@ -1684,7 +1684,8 @@ static dyld::LibSystemHelpers sHelpers = { 13, &dyldGlobalLockAcquire, &dyldGlob
 									&isLaunchdOwned,
 									&vm_allocate,
 									&mmap,
-									&__cxa_finalize_ranges
+									&__cxa_finalize_ranges,
+									&_dyld_get_global_lock_statistics
 									};
 
 
@@ -29,6 +29,7 @@
 #include <stdint.h>
 
 struct __cxa_range_t { const void* addr; size_t length; };
+struct dyld_global_lock_statistics;
 
 #if __cplusplus
 namespace dyld {
@@ -74,6 +75,8 @@ namespace dyld {
 		void*		(*mmap)(void* addr, size_t len, int prot, int flags, int fd, off_t offset);
 		// added in version 13
 		void		(*cxa_finalize_ranges)(const struct __cxa_range_t ranges[], int count);
+		// added in version 14
+		void		(*getGlobalDyldLockStatistics)(struct dyld_global_lock_statistics* stats);
 	};
 #if __cplusplus
 }
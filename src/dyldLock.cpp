@@ -23,8 +23,10 @@
  */
 
 #include <pthread.h>
+#include <mach/mach_time.h>
 
 #include "dyldLock.h"
+#include "mach-o/dyld_priv.h"
 
 
 
@@ -44,15 +46,45 @@ LockHelper::~LockHelper()
 	dyldGlobalLockRelease();
 }
 
+// only changed while sGlobalMutex is held
+static struct dyld_global_lock_statistics	sLockStats;
+static uint64_t								sLockHoldStart;
+
+
 void dyldGlobalLockAcquire() 
 {
-	pthread_mutex_lock(&sGlobalMutex);
-	++_dyld_global_lock_held;
+	if ( pthread_mutex_trylock(&sGlobalMutex) != 0 ) {
+		// another thread is in dyld, record how long this one waited
+		uint64_t waitStart = mach_absolute_time();
+		pthread_mutex_lock(&sGlobalMutex);
+		uint64_t waitTime = mach_absolute_time() - waitStart;
+		++sLockStats.contendedAcquisitions;
+		sLockStats.totalWaitTime += waitTime;
+		if ( waitTime > sLockStats.maxWaitTime )
+			sLockStats.maxWaitTime = waitTime;
+	}
+	if ( ++_dyld_global_lock_held == 1 ) {
+		++sLockStats.acquisitions;
+		sLockHoldStart = mach_absolute_time();
+	}
 }
 
 void dyldGlobalLockRelease() 
 {
-	--_dyld_global_lock_held;
+	if ( --_dyld_global_lock_held == 0 ) {
+		uint64_t holdTime = mach_absolute_time() - sLockHoldStart;
+		sLockStats.totalHoldTime += holdTime;
+		if ( holdTime > sLockStats.maxHoldTime )
+			sLockStats.maxHoldTime = holdTime;
+	}
+	pthread_mutex_unlock(&sGlobalMutex);
+}
+
+void _dyld_get_global_lock_statistics(struct dyld_global_lock_statistics* stats)
+{
+	// not dyldGlobalLockAcquire(), so asking does not change the statistics
+	pthread_mutex_lock(&sGlobalMutex);
+	*stats = sLockStats;
 	pthread_mutex_unlock(&sGlobalMutex);
 }
 
@@ -29,6 +29,7 @@
 #include <mach-o/loader.h>
 
 #include <vector>
+#include <algorithm>
 
 #include "mach-o/dyld_gdb.h"
 #include "mach-o/dyld_images.h"
@@ -141,21 +142,28 @@ void addNonSharedCacheImageUUID(const dyld_uuid_info& info)
 	dyld::gProcessInfo->uuidArray = &sImageUUIDs[0];
 }
 
-void removeImageFromAllImages(const struct mach_header* loadAddress)
+void removeImagesFromAllImages(uint32_t count, const struct mach_header* const loadAddresses[])
 {
-	dyld_image_info goingAway;
-	
+	// sorted copy of load addresses, so each list is compacted in one pass
+	const struct mach_header* sortedAddresses[count];
+	memcpy(sortedAddresses, loadAddresses, count*sizeof(loadAddresses[0]));
+	std::sort(&sortedAddresses[0], &sortedAddresses[count]);
+	auto goingAway = [&](const struct mach_header* mh) {
+		return std::binary_search(&sortedAddresses[0], &sortedAddresses[count], mh);
+	};
+	dyld_image_info goingAwayInfos[count];
+	uint32_t goingAwayCount = 0;
+
 	// set infoArray to NULL to denote it is in-use
 	dyld::gProcessInfo->infoArray = NULL;
 	
-	// remove image from infoArray
-	for (std::vector<dyld_image_info>::iterator it=sImageInfos.begin(); it != sImageInfos.end(); it++) {
-		if ( it->imageLoadAddress == loadAddress ) {
-			goingAway = *it;
-			sImageInfos.erase(it);
-			break;
-		}
-	}
+	// remove images from infoArray
+	sImageInfos.erase(std::remove_if(sImageInfos.begin(), sImageInfos.end(), [&](const dyld_image_info& info) {
+		if ( !goingAway(info.imageLoadAddress) || (goingAwayCount == count) )
+			return false;
+		goingAwayInfos[goingAwayCount++] = info;
+		return true;
+	}), sImageInfos.end());
 	dyld::gProcessInfo->infoArrayCount = (uint32_t)sImageInfos.size();
 	
 	// set infoArray back to base address of vector
@@ -165,21 +173,24 @@ void removeImageFromAllImages(const struct mach_header* loadAddress)
 	// set uuidArrayCount to NULL to denote it is in-use
 	dyld::gProcessInfo->uuidArray = NULL;
 	
-	// remove image from infoArray
-	for (std::vector<dyld_uuid_info>::iterator it=sImageUUIDs.begin(); it != sImageUUIDs.end(); it++) {
-		if ( it->imageLoadAddress == loadAddress ) {
-			sImageUUIDs.erase(it);
-			break;
-		}
-	}
+	// remove images from uuidArray
+	sImageUUIDs.erase(std::remove_if(sImageUUIDs.begin(), sImageUUIDs.end(), [&](const dyld_uuid_info& info) {
+		return goingAway(info.imageLoadAddress);
+	}), sImageUUIDs.end());
 	dyld::gProcessInfo->uuidArrayCount = sImageUUIDs.size();
 	dyld::gProcessInfo->infoArrayChangeTimestamp = mach_absolute_time();
 
 	// set infoArray back to base address of vector
 	dyld::gProcessInfo->uuidArray = &sImageUUIDs[0];
 
-	// tell gdb that about the new images
-	dyld::gProcessInfo->notification(dyld_image_removing, 1, &goingAway);
+	// tell gdb that about the removed images, all at once
+	if ( goingAwayCount != 0 )
+		dyld::gProcessInfo->notification(dyld_image_removing, goingAwayCount, goingAwayInfos);
+}
+
+void removeImageFromAllImages(const struct mach_header* loadAddress)
+{
+	removeImagesFromAllImages(1, &loadAddress);
 }
 
 
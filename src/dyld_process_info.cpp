@@ -33,6 +33,8 @@
 #include <mach/vm_region.h>
 #include <libkern/OSAtomic.h>
 
+#include <algorithm>
+
 #include "dyld_process_info.h"
 #include "dyld_process_info_internal.h"
 #include "dyld_images.h"
@@ -45,7 +47,7 @@ extern "C" {
 
 namespace {
 
-void withRemoteBuffer(task_t task, vm_address_t remote_address, size_t remote_size, bool allow_truncation, kern_return_t *kr, void (^block)(void *buffer, size_t size)) {
+kern_return_t mapRemoteBuffer(task_t task, vm_address_t remote_address, size_t remote_size, bool allow_truncation, mach_vm_address_t* local_address_out, mach_vm_size_t* local_size_out) {
     kern_return_t r = KERN_SUCCESS;
     mach_vm_address_t local_address = 0;
     mach_vm_address_t local_size = remote_size;
@@ -62,14 +64,10 @@ void withRemoteBuffer(task_t task, vm_address_t remote_address, size_t remote_si
                             &cur_protection,
                             &max_protection,
                             VM_INHERIT_DEFAULT);
-        //Do this here to allow chaining of multiple embedded blocks with a single error out;
-        if (kr != NULL) {
-            *kr = r;
-        }
         if (r == KERN_SUCCESS) {
-            // We got someting, call the block and then exit
-            block(reinterpret_cast<void *>(local_address), local_size);
-            vm_deallocate(mach_task_self(), local_address, local_size);
+            // We got someting, hand it back to the caller
+            *local_address_out = local_address;
+            *local_size_out = local_size;
             break;
         }
         if (!allow_truncation) {
@@ -84,6 +82,22 @@ void withRemoteBuffer(task_t task, vm_address_t remote_address, size_t remote_si
             local_size -= trunc_size;
         }
     }
+    return r;
+}
+
+void withRemoteBuffer(task_t task, vm_address_t remote_address, size_t remote_size, bool allow_truncation, kern_return_t *kr, void (^block)(void *buffer, size_t size)) {
+    mach_vm_address_t local_address = 0;
+    mach_vm_size_t local_size = 0;
+    kern_return_t r = mapRemoteBuffer(task, remote_address, remote_size, allow_truncation, &local_address, &local_size);
+    //Do this here to allow chaining of multiple embedded blocks with a single error out;
+    if (kr != NULL) {
+        *kr = r;
+    }
+    if (r == KERN_SUCCESS) {
+        // We got someting, call the block and then exit
+        block(reinterpret_cast<void *>(local_address), (size_t)local_size);
+        vm_deallocate(mach_task_self(), local_address, local_size);
+    }
 }
 
 template<typename T>
@@ -95,12 +109,131 @@ void withRemoteObject(task_t task, vm_address_t remote_address, kern_return_t *k
 }
 };
 
+
+kern_return_t TaskRemoteMemory::dyldInfo(task_dyld_info_data_t& info)
+{
+    mach_msg_type_number_t count = TASK_DYLD_INFO_COUNT;
+    return task_info(_task, TASK_DYLD_INFO, (task_info_t)&info, &count);
+}
+
+kern_return_t TaskRemoteMemory::copy(uint64_t remoteAddress, size_t size, void* localBuffer)
+{
+    mach_vm_size_t readSize = size;
+    return mach_vm_read_overwrite(_task, remoteAddress, size, (vm_address_t)localBuffer, &readSize);
+}
+
+kern_return_t TaskRemoteMemory::map(uint64_t remoteAddress, size_t size, bool allowTruncation, const void*& localAddress, size_t& localSize)
+{
+    mach_vm_address_t local_address = 0;
+    mach_vm_size_t local_size = 0;
+    kern_return_t r = mapRemoteBuffer(_task, (vm_address_t)remoteAddress, size, allowTruncation, &local_address, &local_size);
+    if ( r == KERN_SUCCESS ) {
+        localAddress = (const void*)local_address;
+        localSize    = (size_t)local_size;
+    }
+    return r;
+}
+
+void TaskRemoteMemory::unmap(const void* localAddress, size_t localSize)
+{
+    vm_deallocate(mach_task_self(), (vm_address_t)localAddress, localSize);
+}
+
+
+RemoteReadPlan::RemoteReadPlan(RemoteMemory& memory, unsigned maxRequests)
+ :  _memory(memory), _requests((Request*)malloc(sizeof(Request)*maxRequests)), _requestCount(0), _maxRequests(maxRequests),
+    _mappings((Mapping*)malloc(sizeof(Mapping)*maxRequests)), _mappingCount(0)
+{
+}
+
+RemoteReadPlan::~RemoteReadPlan()
+{
+    for (unsigned i=0; i < _mappingCount; ++i)
+        _memory.unmap(_mappings[i].buffer, _mappings[i].size);
+    free(_mappings);
+    free(_requests);
+}
+
+unsigned RemoteReadPlan::add(uint64_t remoteAddress, size_t size, bool allowTruncation)
+{
+    if ( _requestCount == _maxRequests )
+        return kNoRead;
+    Request& req        = _requests[_requestCount];
+    req.remoteAddress   = remoteAddress;
+    req.size            = size;
+    req.buffer          = NULL;
+    req.bufferSize      = 0;
+    req.kr              = KERN_INVALID_ADDRESS;
+    req.allowTruncation = allowTruncation;
+    return _requestCount++;
+}
+
+void RemoteReadPlan::read()
+{
+    // visit requests in address order, so neighboring ranges can be read as one
+    unsigned order[_requestCount];
+    for (unsigned i=0; i < _requestCount; ++i)
+        order[i] = i;
+    std::sort(&order[0], &order[_requestCount], [&](unsigned a, unsigned b) {
+        return _requests[a].remoteAddress < _requests[b].remoteAddress;
+    });
+
+    for (unsigned i=0; i < _requestCount; ) {
+        uint64_t groupStart = _requests[order[i]].remoteAddress;
+        uint64_t groupEnd   = groupStart + _requests[order[i]].size;
+        unsigned groupLimit = i+1;
+        while ( groupLimit < _requestCount ) {
+            const Request& next = _requests[order[groupLimit]];
+            if ( next.remoteAddress > groupEnd + kMaxGap )
+                break;
+            uint64_t newEnd = std::max(groupEnd, next.remoteAddress + next.size);
+            if ( newEnd - groupStart > kMaxReadSize )
+                break;
+            groupEnd = newEnd;
+            ++groupLimit;
+        }
+        if ( groupLimit - i > 1 ) {
+            const void* buffer;
+            size_t      bufferSize;
+            if ( _memory.map(groupStart, (size_t)(groupEnd - groupStart), false, buffer, bufferSize) == KERN_SUCCESS ) {
+                _mappings[_mappingCount++] = { buffer, bufferSize };
+                for (unsigned j=i; j < groupLimit; ++j) {
+                    Request& req  = _requests[order[j]];
+                    req.buffer     = (uint8_t*)buffer + (req.remoteAddress - groupStart);
+                    req.bufferSize = req.size;
+                    req.kr         = KERN_SUCCESS;
+                }
+                i = groupLimit;
+                continue;
+            }
+        }
+        // lone range, or group spans unreadable memory (e.g. path near the end of a region), read each on its own
+        for (unsigned j=i; j < groupLimit; ++j) {
+            Request& req = _requests[order[j]];
+            req.kr = _memory.map(req.remoteAddress, req.size, req.allowTruncation, req.buffer, req.bufferSize);
+            if ( req.kr == KERN_SUCCESS )
+                _mappings[_mappingCount++] = { req.buffer, req.bufferSize };
+        }
+        i = groupLimit;
+    }
+}
+
+kern_return_t RemoteReadPlan::contents(unsigned index, const void*& buffer, size_t& size) const
+{
+    if ( index >= _requestCount )
+        return KERN_RESOURCE_SHORTAGE;
+    const Request& req = _requests[index];
+    buffer = req.buffer;
+    size   = req.bufferSize;
+    return req.kr;
+}
+
 //
 // Opaque object returned by _dyld_process_info_create()
 //
 
 struct __attribute__((visibility("hidden"))) dyld_process_info_base {
-    static dyld_process_info_base* make(task_t task, const dyld_all_image_infos_64& allImageInfo, const dyld_image_info_64 imageArray[], kern_return_t* kr);
+    static dyld_process_info_base* make(RemoteMemory& memory, const dyld_all_image_infos_64& allImageInfo, const dyld_image_info_64 imageArray[], kern_return_t* kr);
     static dyld_process_info_base* makeSuspended(task_t task, kern_return_t* kr);
 
     uint32_t&                   retainCount() const { return _retainCount; }
@@ -124,15 +257,20 @@ private:
         uint64_t                size;
     };
 
+    struct RemoteImage {
+        uint64_t                loadAddress;
+        uint64_t                pathAddress;
+        const char*             localPath;
+        bool                    sameCacheAsThisProcess;    // in-cache paths and mach_headers can be read in this process
+    };
+
                                 dyld_process_info_base(unsigned imageCount, size_t totalSize);
     void*                       operator new (size_t, void* buf) { return buf; }
 
     static bool                 inCache(uint64_t addr) { return (addr > SHARED_REGION_BASE) && (addr < SHARED_REGION_BASE+SHARED_REGION_SIZE); }
-    kern_return_t               addImage(task_t task, bool sameCacheAsThisProcess, uint64_t imageAddress, uint64_t imagePath, const char* imagePathLocal);
-    kern_return_t               addDyldImage(task_t task, uint64_t dyldAddress, uint64_t dyldPathAddress, const char* localPath);
+    kern_return_t               addImages(RemoteMemory& memory, const RemoteImage images[], unsigned count);
 
     bool                        invalid() { return ((char*)_stringRevBumpPtr < (char*)_curSegment); }
-    const char*                 copyPath(task_t task, uint64_t pathAddr, kern_return_t* kr);
     const char*                 addString(const char*, size_t);
     const char*                 copySegmentName(const char*);
 
@@ -175,7 +313,7 @@ dyld_process_info_base::dyld_process_info_base(unsigned imageCount, size_t total
 }
 
 
-dyld_process_info_base* dyld_process_info_base::make(task_t task, const dyld_all_image_infos_64& allImageInfo, const dyld_image_info_64 imageArray[], kern_return_t* kr)
+dyld_process_info_base* dyld_process_info_base::make(RemoteMemory& memory, const dyld_all_image_infos_64& allImageInfo, const dyld_image_info_64 imageArray[], kern_return_t* kr)
 {
     // figure out how many path strings will need to be copied and their size
     const dyld_all_image_infos* myInfo = _dyld_get_all_image_infos();
@@ -232,33 +370,29 @@ dyld_process_info_base* dyld_process_info_base::make(task_t task, const dyld_all
     if ( allImageInfo.errorMessage != 0 )
         stateInfo->dyldState = allImageInfo.terminationFlags ? dyld_process_state_terminated_before_inits : dyld_process_state_dyld_terminated;
 
-    // fill in info for dyld
-    if ( allImageInfo.dyldPath != 0 ) {
-        if ( kern_return_t r = obj->addDyldImage(task, allImageInfo.dyldImageLoadAddress, allImageInfo.dyldPath, NULL) ) {
+    // fill in info for dyld and each image
+    {
+        RemoteImage images[imageCountWithDyld];
+        unsigned    count = 0;
+        if ( allImageInfo.dyldPath != 0 )
+            images[count++] = { allImageInfo.dyldImageLoadAddress, allImageInfo.dyldPath, NULL, false };
+        for (uint32_t i=0; i < allImageInfo.infoArrayCount; ++i)
+            images[count++] = { imageArray[i].imageLoadAddress, imageArray[i].imageFilePath, NULL, sameCacheAsThisProcess };
+        if ( kern_return_t r = obj->addImages(memory, images, count) ) {
             if ( kr != NULL )
                 *kr = r;
-            goto fail;
-        }
-    }
-
-    // fill in info for each image
-    for (uint32_t i=0; i < allImageInfo.infoArrayCount; ++i) {
-        if ( kern_return_t r = obj->addImage(task, sameCacheAsThisProcess, imageArray[i].imageLoadAddress, imageArray[i].imageFilePath, NULL) ) {
-           if ( kr != NULL )
-                *kr = r;
-            goto fail;
+            free(obj);
+            return NULL;
         }
     }
 
     // sanity check internal data did not overflow
-    if ( obj->invalid() )
-        goto fail;
+    if ( obj->invalid() ) {
+        free(obj);
+        return NULL;
+    }
 
     return obj;
-
-fail:
-    free(obj);
-    return NULL;
 }
 
 dyld_process_info_base* dyld_process_info_base::makeSuspended(task_t task, kern_return_t* kr)
@@ -339,24 +473,19 @@ dyld_process_info_base* dyld_process_info_base::makeSuspended(task_t task, kern_
     stateInfo->initialImageCount   = imageCount;
     stateInfo->dyldState           = dyld_process_state_not_started;
 
-    // fill in info for dyld
-    if ( dyldAddress != 0 ) {
-        if ( kern_return_t r = obj->addDyldImage(task, dyldAddress, 0, dyldPath) ) {
-            if ( kr != NULL )
-                *kr = r;
-            free(obj);
-            return NULL;
-        }
-    }
-
-    // fill in info for each image
-    if ( mainExecutableAddress != 0 ) {
-        if ( kern_return_t r = obj->addImage(task, false, mainExecutableAddress, 0, mainExecutablePath) ) {
-            if ( kr != NULL )
-                *kr = r;
-            free(obj);
-            return NULL;
-        }
+    // fill in info for dyld and main executable
+    RemoteImage images[2];
+    unsigned    count = 0;
+    if ( dyldAddress != 0 )
+        images[count++] = { dyldAddress, 0, dyldPath, false };
+    if ( mainExecutableAddress != 0 )
+        images[count++] = { mainExecutableAddress, 0, mainExecutablePath, false };
+    TaskRemoteMemory memory(task);
+    if ( kern_return_t r = obj->addImages(memory, images, count) ) {
+        if ( kr != NULL )
+            *kr = r;
+        free(obj);
+        return NULL;
     }
 
     return obj;
@@ -372,79 +501,70 @@ const char* dyld_process_info_base::addString(const char* str, size_t maxlen)
     return _stringRevBumpPtr;
 }
 
-const char* dyld_process_info_base::copyPath(task_t task, uint64_t stringAddressInTask, kern_return_t* kr)
+kern_return_t dyld_process_info_base::addImages(RemoteMemory& memory, const RemoteImage images[], unsigned count)
 {
-    __block const char* retval = NULL;
-    withRemoteBuffer(task, stringAddressInTask, PATH_MAX, true, kr, ^(void *buffer, size_t size) {
-        retval = addString(static_cast<const char *>(buffer), size);
-    });
-
-    return retval;
-}
-
-kern_return_t dyld_process_info_base::addImage(task_t task, bool sameCacheAsThisProcess, uint64_t imageAddress, uint64_t imagePath, const char* imagePathLocal)
-{
-    _curImage->loadAddress = imageAddress;
-    _curImage->segmentStartIndex = _curSegmentIndex;
-    if ( imagePathLocal != NULL ) {
-        _curImage->path = addString(imagePathLocal, PATH_MAX);
-    }
-    else if ( sameCacheAsThisProcess && inCache(imagePath) ) {
-        _curImage->path = (const char*)imagePath;
-    }
-    else {
-        kern_return_t kr;
-        _curImage->path = copyPath(task, imagePath, &kr);
-        if ( kr )
-            return kr;
-    }
-    if ( sameCacheAsThisProcess && inCache(imageAddress) ) {
-        addInfoFromLoadCommands((mach_header*)imageAddress, imageAddress, 32*1024);
-    }
-    else {
-        __block kern_return_t kr = KERN_SUCCESS;
-        withRemoteObject(task, imageAddress, &kr, ^(mach_header_64 mhBuffer) {
-            size_t          headerPagesSize = sizeof(mach_header_64) + mhBuffer.sizeofcmds;
-            withRemoteBuffer(task, imageAddress, headerPagesSize, false, &kr, ^(void * buffer, size_t size) {
-                addInfoFromLoadCommands((mach_header*)buffer, imageAddress, size);
-            });
-        });
-        if (kr != KERN_SUCCESS) {
-            return kr;
-        }
-    }
-    _curImage->segmentsCount = _curSegmentIndex - _curImage->segmentStartIndex;
-    _curImage++;
-    return KERN_SUCCESS;
-}
-
-
-kern_return_t dyld_process_info_base::addDyldImage(task_t task, uint64_t dyldAddress, uint64_t dyldPathAddress, const char* localPath)
-{
-    __block kern_return_t kr = KERN_SUCCESS;
-    _curImage->loadAddress = dyldAddress;
-    _curImage->segmentStartIndex = _curSegmentIndex;
-    if ( localPath != NULL ) {
-        _curImage->path = addString(localPath, PATH_MAX);
-    }
-    else {
-        _curImage->path = copyPath(task, dyldPathAddress, &kr);
-        if ( kr )
+    // first round of reads: path strings and mach_headers
+    RemoteReadPlan headerPlan(memory, 2*count);
+    unsigned       pathReads[count];
+    unsigned       headerReads[count];
+    for (unsigned i=0; i < count; ++i) {
+        const RemoteImage& image = images[i];
+        pathReads[i] = RemoteReadPlan::kNoRead;
+        if ( (image.localPath == NULL) && !(image.sameCacheAsThisProcess && inCache(image.pathAddress)) )
+            pathReads[i] = headerPlan.add(image.pathAddress, PATH_MAX, true);
+        headerReads[i] = RemoteReadPlan::kNoRead;
+        if ( !(image.sameCacheAsThisProcess && inCache(image.loadAddress)) )
+            headerReads[i] = headerPlan.add(image.loadAddress, sizeof(mach_header_64), false);
+    }
+    headerPlan.read();
+
+    // second round: load commands, now that their sizes are known
+    RemoteReadPlan loadCommandsPlan(memory, count);
+    unsigned       loadCommandsReads[count];
+    for (unsigned i=0; i < count; ++i) {
+        loadCommandsReads[i] = RemoteReadPlan::kNoRead;
+        if ( headerReads[i] == RemoteReadPlan::kNoRead )
+            continue;
+        const void* buffer;
+        size_t      size;
+        if ( kern_return_t kr = headerPlan.contents(headerReads[i], buffer, size) )
             return kr;
+        const mach_header_64* mh = (mach_header_64*)buffer;
+        loadCommandsReads[i] = loadCommandsPlan.add(images[i].loadAddress, sizeof(mach_header_64) + mh->sizeofcmds, false);
     }
+    loadCommandsPlan.read();
 
-    withRemoteObject(task, dyldAddress, &kr, ^(mach_header_64 mhBuffer) {
-        size_t          headerPagesSize = sizeof(mach_header_64) + mhBuffer.sizeofcmds;
-        withRemoteBuffer(task, dyldAddress, headerPagesSize, false, &kr, ^(void * buffer, size_t size) {
-            addInfoFromLoadCommands((mach_header*)buffer, dyldAddress, size);
-        });
-    });
-    if (kr != KERN_SUCCESS) {
-        return kr;
+    // fill in info for each image
+    for (unsigned i=0; i < count; ++i) {
+        const RemoteImage& image = images[i];
+        _curImage->loadAddress = image.loadAddress;
+        _curImage->segmentStartIndex = _curSegmentIndex;
+        if ( image.localPath != NULL ) {
+            _curImage->path = addString(image.localPath, PATH_MAX);
+        }
+        else if ( pathReads[i] == RemoteReadPlan::kNoRead ) {
+            _curImage->path = (const char*)image.pathAddress;
+        }
+        else {
+            const void* buffer;
+            size_t      size;
+            if ( kern_return_t kr = headerPlan.contents(pathReads[i], buffer, size) )
+                return kr;
+            _curImage->path = addString(static_cast<const char*>(buffer), size);
+        }
+        if ( loadCommandsReads[i] == RemoteReadPlan::kNoRead ) {
+            addInfoFromLoadCommands((mach_header*)image.loadAddress, image.loadAddress, 32*1024);
+        }
+        else {
+            const void* buffer;
+            size_t      size;
+            if ( kern_return_t kr = loadCommandsPlan.contents(loadCommandsReads[i], buffer, size) )
+                return kr;
+            addInfoFromLoadCommands((mach_header*)buffer, image.loadAddress, size);
+        }
+        _curImage->segmentsCount = _curSegmentIndex - _curImage->segmentStartIndex;
+        _curImage++;
     }
-
-    _curImage->segmentsCount = _curSegmentIndex - _curImage->segmentStartIndex;
-    _curImage++;
     return KERN_SUCCESS;
 }
 
@@ -535,14 +655,13 @@ void dyld_process_info_base::forEachSegment(uint64_t machHeaderAddress, void (^c
 
 
 // Implementation that works with existing dyld data structures
-static dyld_process_info _dyld_process_info_create_inner(task_t task, uint64_t timestamp, kern_return_t* kr)
+static dyld_process_info _dyld_process_info_create_inner(RemoteMemory& memory, uint64_t timestamp, kern_return_t* kr)
 {
     if ( kr != NULL )
         *kr = KERN_SUCCESS;
 
     task_dyld_info_data_t task_dyld_info;
-    mach_msg_type_number_t count = TASK_DYLD_INFO_COUNT;
-    if ( kern_return_t r = task_info(task, TASK_DYLD_INFO, (task_info_t)&task_dyld_info, &count) ) {
+    if ( kern_return_t r = memory.dyldInfo(task_dyld_info) ) {
         if ( kr != NULL )
             *kr = r;
         return  NULL;
@@ -557,8 +676,7 @@ static dyld_process_info _dyld_process_info_create_inner(task_t task, uint64_t t
 
     // read all_image_infos struct
     dyld_all_image_infos_64 allImageInfo64;
-    mach_vm_size_t readSize = task_dyld_info.all_image_info_size;
-    if ( kern_return_t r = mach_vm_read_overwrite(task, task_dyld_info.all_image_info_addr, task_dyld_info.all_image_info_size, (vm_address_t)&allImageInfo64, &readSize) ) {
+    if ( kern_return_t r = memory.copy(task_dyld_info.all_image_info_addr, task_dyld_info.all_image_info_size, &allImageInfo64) ) {
         if ( kr != NULL )
             *kr = r;
         return  NULL;
@@ -566,14 +684,14 @@ static dyld_process_info _dyld_process_info_create_inner(task_t task, uint64_t t
     if ( allImageInfo64.infoArrayCount == 0 ) {
         // could be task was launch suspended or still launching, wait a moment to see
         usleep(1000 * 50); // 50ms
-        if ( kern_return_t r = mach_vm_read_overwrite(task, task_dyld_info.all_image_info_addr, task_dyld_info.all_image_info_size, (vm_address_t)&allImageInfo64, &readSize) ) {
+        if ( kern_return_t r = memory.copy(task_dyld_info.all_image_info_addr, task_dyld_info.all_image_info_size, &allImageInfo64) ) {
             if ( kr != NULL )
                 *kr = r;
             return  NULL;
         }
         // if infoArrayCount is still zero, then target was most likely launched suspended
         if ( allImageInfo64.infoArrayCount == 0 )
-            return dyld_process_info_base::makeSuspended(task, kr);
+            return dyld_process_info_base::makeSuspended(memory.task(), kr);
     }
 
     // bail out of dyld is too old
@@ -628,7 +746,7 @@ static dyld_process_info _dyld_process_info_create_inner(task_t task, uint64_t t
         return NULL;
     }
     dyld_image_info_64 imageArray64[imageCount];
-    if ( kern_return_t r = mach_vm_read_overwrite(task, allImageInfo64.infoArray, imageArraySize, (vm_address_t)&imageArray64, &readSize) ) {
+    if ( kern_return_t r = memory.copy(allImageInfo64.infoArray, imageArraySize, &imageArray64) ) {
         // if image array moved, try whole thing again
         if ( kr != NULL ) {
             *kr = r;
@@ -648,13 +766,12 @@ static dyld_process_info _dyld_process_info_create_inner(task_t task, uint64_t t
     }
 
     // create object based on local copy of all image infos and image array
-    dyld_process_info result = dyld_process_info_base::make(task, allImageInfo64, imageArray64, kr);
+    dyld_process_info result = dyld_process_info_base::make(memory, allImageInfo64, imageArray64, kr);
 
     // verify nothing has changed by re-reading all_image_infos struct and checking timestamp
     if ( result != NULL ) {
         dyld_all_image_infos_64 allImageInfo64again;
-        readSize = task_dyld_info.all_image_info_size;
-        if ( kern_return_t r = mach_vm_read_overwrite(task, task_dyld_info.all_image_info_addr, task_dyld_info.all_image_info_size, (vm_address_t)&allImageInfo64again, &readSize) ) {
+        if ( kern_return_t r = memory.copy(task_dyld_info.all_image_info_addr, task_dyld_info.all_image_info_size, &allImageInfo64again) ) {
             if ( kr != NULL )
                 *kr = r;
             free((void*)result);
@@ -677,18 +794,24 @@ static dyld_process_info _dyld_process_info_create_inner(task_t task, uint64_t t
 }
 
 
-dyld_process_info _dyld_process_info_create(task_t task, uint64_t timestamp, kern_return_t* kr)
+dyld_process_info _dyld_process_info_create_with_memory(RemoteMemory& memory, uint64_t timestamp, kern_return_t* kr)
 {
     // Other process may be loading and unloading as we read its memory, which can cause a read failure
     // <rdar://problem30067343&29567679> Retry if something fails
     for (int i=0; i < 100; ++i) {
-        if ( dyld_process_info result = _dyld_process_info_create_inner( task,  timestamp, kr) )
+        if ( dyld_process_info result = _dyld_process_info_create_inner(memory, timestamp, kr) )
             return result;
 
     }
     return NULL;
 }
 
+dyld_process_info _dyld_process_info_create(task_t task, uint64_t timestamp, kern_return_t* kr)
+{
+    TaskRemoteMemory memory(task);
+    return _dyld_process_info_create_with_memory(memory, timestamp, kr);
+}
+
 void _dyld_process_info_get_state(dyld_process_info info, dyld_process_state_info* stateInfo)
 {
     *stateInfo = *info->stateInfo();
@@ -133,6 +133,78 @@ struct dyld_process_info_notify_header {
 };
 
 
+//
+// Access to the memory of the task being inspected.  Everything _dyld_process_info_create()
+// reads from the target goes through this, so the whole pipeline can be run against an
+// in-process fake of a task.
+//
+class RemoteMemory {
+public:
+    virtual                 ~RemoteMemory() {}
+    virtual task_t          task() const = 0;
+    virtual kern_return_t   dyldInfo(task_dyld_info_data_t& info) = 0;
+    virtual kern_return_t   copy(uint64_t remoteAddress, size_t size, void* localBuffer) = 0;
+    // maps remote range read-only into this process; if allowTruncation the range may be cut
+    // short at the first unreadable page, and localSize is set to how much was mapped
+    virtual kern_return_t   map(uint64_t remoteAddress, size_t size, bool allowTruncation, const void*& localAddress, size_t& localSize) = 0;
+    virtual void            unmap(const void* localAddress, size_t localSize) = 0;
+};
+
+class __attribute__((visibility("hidden"))) TaskRemoteMemory : public RemoteMemory {
+public:
+                            TaskRemoteMemory(task_t task) : _task(task) { }
+    task_t                  task() const override { return _task; }
+    kern_return_t           dyldInfo(task_dyld_info_data_t& info) override;
+    kern_return_t           copy(uint64_t remoteAddress, size_t size, void* localBuffer) override;
+    kern_return_t           map(uint64_t remoteAddress, size_t size, bool allowTruncation, const void*& localAddress, size_t& localSize) override;
+    void                    unmap(const void* localAddress, size_t localSize) override;
+private:
+    task_t                  _task;
+};
+
+//
+// Collects the remote ranges needed for one step of building a dyld_process_info (path
+// strings, mach_headers, load commands), then maps them with as few remote reads as possible
+// by coalescing ranges that are near each other.  Mapped memory lives as long as the plan.
+//
+class __attribute__((visibility("hidden"))) RemoteReadPlan {
+public:
+    static const unsigned   kNoRead      = ~0U;
+    static const uint64_t   kMaxGap      = 0x10000;    // ranges closer than this are read together
+    static const uint64_t   kMaxReadSize = 0x400000;
+
+                            RemoteReadPlan(RemoteMemory& memory, unsigned maxRequests);
+                            ~RemoteReadPlan();
+    unsigned                add(uint64_t remoteAddress, size_t size, bool allowTruncation);
+    void                    read();
+    kern_return_t           contents(unsigned index, const void*& buffer, size_t& size) const;
+    unsigned                readCount() const { return _mappingCount; }
+
+private:
+    struct Request {
+        uint64_t            remoteAddress;
+        size_t              size;
+        const void*         buffer;
+        size_t              bufferSize;
+        kern_return_t       kr;
+        bool                allowTruncation;
+    };
+    struct Mapping {
+        const void*         buffer;
+        size_t              size;
+    };
+
+    RemoteMemory&           _memory;
+    Request*                _requests;
+    unsigned                _requestCount;
+    const unsigned          _maxRequests;
+    Mapping*                _mappings;
+    unsigned                _mappingCount;
+};
+
+// same as _dyld_process_info_create() but reads target through memory
+__attribute__((visibility("hidden")))
+const struct dyld_process_info_base* _dyld_process_info_create_with_memory(RemoteMemory& memory, uint64_t timestamp, kern_return_t* kr);
 
 
 #endif // _DYLD_PROCESS_INFO_INTERNAL_H_
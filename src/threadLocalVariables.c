@@ -28,6 +28,7 @@
 #include <string.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <limits.h>
 #include <pthread.h>
 #include <Block.h>
 #include <malloc/malloc.h>
@@ -102,10 +103,26 @@ typedef struct TLVDescriptor  TLVDescriptor;
 // implemented in assembly
 extern void* tlv_get_addr(TLVDescriptor*);
 
+typedef void (*TLVInitFunc)(void);
+
+// Everything needed to set up a thread's TLV block for one image.
+// Computed once when the image is loaded, so first access on a new thread does not parse load commands.
+struct TLVTemplate
+{
+	const uint8_t*		initialContent;		// start of the TLV template sections
+	unsigned long		initialContentSize;	// bytes copied from the template (through the last S_THREAD_LOCAL_REGULAR)
+	unsigned long		zeroFillSize;		// bytes after that which are all zero (S_THREAD_LOCAL_ZEROFILL tail)
+	unsigned long		arenaOffset;		// where this image's TLVs go in a thread's arena (arena mode only)
+	unsigned long		initializerCount;
+	TLVInitFunc			initializers[];		// S_THREAD_LOCAL_INIT_FUNCTION_POINTERS, in the order they are run
+};
+typedef struct TLVTemplate		TLVTemplate;
+
 struct TLVImageInfo
 {
 	pthread_key_t				key;
 	const struct mach_header*	mh;
+	const TLVTemplate*			tmpl;
 };
 typedef struct TLVImageInfo		TLVImageInfo;
 
@@ -114,7 +131,32 @@ static unsigned int		tlv_live_image_alloc_count = 0;
 static unsigned int		tlv_live_image_used_count = 0;
 static pthread_mutex_t	tlv_live_image_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static void tlv_set_key_for_image(const struct mach_header* mh, pthread_key_t key)
+// Side table from key to template, read without taking tlv_live_image_lock.
+// Entries are written once, before any descriptor using the key is set up, and never change.
+// Keys that do not fit fall back to searching tlv_live_images.
+#define TLV_TEMPLATE_TABLE_SIZE	PTHREAD_KEYS_MAX
+static const TLVTemplate* volatile tlv_templates_by_key[TLV_TEMPLATE_TABLE_SIZE];
+
+// Optional arena mode (DYLD_TLV_ARENA).  Instead of a malloc()ed block per image per thread, each thread
+// gets one block holding the TLVs of all images, at the offsets assigned as images are loaded.  Images
+// loaded after a thread's arena was allocated go in an overflow arena chained to it.  Each image keeps
+// its own pthread key (so tlv_get_addr is unchanged), whose value points into the arena.  Those keys have
+// no destructor; the whole chain is freed by the tlv_arena_key destructor.  TLV state handlers still see
+// one allocation per image: each image's slice of the arena is reported as it is initialized and freed.
+struct TLVArena
+{
+	struct TLVArena*	next;			// arena for images loaded before this one was allocated
+	unsigned long		startOffset;	// arena offset of content[0]
+	unsigned long		endOffset;
+	uint8_t				content[] __attribute__((aligned(16)));
+};
+typedef struct TLVArena		TLVArena;
+
+static bool					tlv_arena_enabled = false;
+static pthread_key_t		tlv_arena_key = 0;
+static volatile unsigned long tlv_arena_size = 0;	// offset assigned to next image loaded
+
+static void tlv_set_key_for_image(const struct mach_header* mh, pthread_key_t key, TLVTemplate* tmpl)
 {
 	pthread_mutex_lock(&tlv_live_image_lock);
 		if ( tlv_live_image_used_count == tlv_live_image_alloc_count ) {
@@ -129,17 +171,32 @@ static void tlv_set_key_for_image(const struct mach_header* mh, pthread_key_t ke
 		}
 		tlv_live_images[tlv_live_image_used_count].key = key;
 		tlv_live_images[tlv_live_image_used_count].mh = mh;
+		tlv_live_images[tlv_live_image_used_count].tmpl = tmpl;
 		++tlv_live_image_used_count;
+		if ( tlv_arena_enabled ) {
+			// keep each image's TLVs 16-byte aligned, like malloc() does
+			tmpl->arenaOffset = tlv_arena_size;
+			OSMemoryBarrier();
+			tlv_arena_size += (tmpl->initialContentSize + tmpl->zeroFillSize + 15) & (-16);
+		}
+		if ( key < TLV_TEMPLATE_TABLE_SIZE ) {
+			// make sure template contents and arena size are visible before the table entry
+			OSMemoryBarrier();
+			tlv_templates_by_key[key] = tmpl;
+		}
 	pthread_mutex_unlock(&tlv_live_image_lock);
 }
 
-static const struct mach_header* tlv_get_image_for_key(pthread_key_t key)
+static const TLVTemplate* tlv_get_template_for_key(pthread_key_t key)
 {
-	const struct mach_header* result = NULL;
+	if ( key < TLV_TEMPLATE_TABLE_SIZE )
+		return tlv_templates_by_key[key];
+
+	const TLVTemplate* result = NULL;
 	pthread_mutex_lock(&tlv_live_image_lock);
 		for(unsigned int i=0; i < tlv_live_image_used_count; ++i) {
 			if ( tlv_live_images[i].key == key ) {
-				result = tlv_live_images[i].mh;
+				result = tlv_live_images[i].tmpl;
 				break;
 			}
 		}
@@ -149,13 +206,11 @@ static const struct mach_header* tlv_get_image_for_key(pthread_key_t key)
 
 
 static void
-tlv_notify(enum dyld_tlv_states state, void *buffer)
+tlv_notify_size(enum dyld_tlv_states state, void *buffer, size_t size)
 {
 	if (!tlv_handlers) return;
 
-	// Always use malloc_size() to ensure allocated and deallocated states 
-	// send the same size. tlv_free() doesn't have anything else recorded.
-	dyld_tlv_info info = { sizeof(info), buffer, malloc_size(buffer) };
+	dyld_tlv_info info = { sizeof(info), buffer, size };
 	
 	for (TLVHandler *h = tlv_handlers; h != NULL; h = h->next) {
 		if (h->state == state  &&  h->handler) {
@@ -164,93 +219,81 @@ tlv_notify(enum dyld_tlv_states state, void *buffer)
 	}
 }
 
+static void
+tlv_notify(enum dyld_tlv_states state, void *buffer)
+{
+	if (!tlv_handlers) return;
+
+	// Always use malloc_size() to ensure allocated and deallocated states 
+	// send the same size. tlv_free() doesn't have anything else recorded.
+	tlv_notify_size(state, buffer, malloc_size(buffer));
+}
+
+// size reported for an image's slice of an arena, the same when allocated and deallocated
+static size_t tlv_arena_slice_size(const TLVTemplate* tmpl)
+{
+	return tmpl->initialContentSize + tmpl->zeroFillSize;
+}
+
+
+static void* tlv_arena_buffer_for_template(const TLVTemplate* tmpl)
+{
+	const unsigned long start = tmpl->arenaOffset;
+	const unsigned long end   = start + tmpl->initialContentSize + tmpl->zeroFillSize;
+	TLVArena* arenas = (TLVArena*)pthread_getspecific(tlv_arena_key);
+	for (TLVArena* a = arenas; a != NULL; a = a->next) {
+		if ( (a->startOffset <= start) && (end <= a->endOffset) )
+			return &a->content[start - a->startOffset];
+	}
+
+	// image was loaded after this thread's arenas were allocated, so add one for all images not yet covered
+	// (this image's template was published after its arena offset was assigned, so the arena covers it)
+	const unsigned long arenaStart = (arenas != NULL) ? arenas->endOffset : 0;
+	const unsigned long arenaEnd   = tlv_arena_size;
+	TLVArena* arena = malloc(offsetof(TLVArena, content) + (arenaEnd - arenaStart));
+	arena->next        = arenas;
+	arena->startOffset = arenaStart;
+	arena->endOffset   = arenaEnd;
+	pthread_setspecific(tlv_arena_key, arena);
+	return &arena->content[start - arena->startOffset];
+}
+
 
 // called lazily when TLV is first accessed
 __attribute__((visibility("hidden")))
 void* tlv_allocate_and_initialize_for_key(pthread_key_t key)
 {
-	const struct mach_header* mh = tlv_get_image_for_key(key);
-	if ( mh == NULL )
+	const TLVTemplate* tmpl = tlv_get_template_for_key(key);
+	if ( tmpl == NULL )
 		return NULL;	// if data structures are screwed up, don't crash
-	
-	// first pass, find size and template
-	uint8_t*		start = NULL;
-	unsigned long	size = 0;
-	intptr_t		slide = 0;
-	bool			slideComputed = false;
-	bool			hasInitializers = false;
-	const uint32_t	cmd_count = mh->ncmds;
-	const struct load_command* const cmds = (struct load_command*)(((uint8_t*)mh) + sizeof(macho_header));
-	const struct load_command* cmd = cmds;
-	for (uint32_t i = 0; i < cmd_count; ++i) {
-		if ( cmd->cmd == LC_SEGMENT_COMMAND) {
-			const macho_segment_command* seg = (macho_segment_command*)cmd;
-			if ( !slideComputed && (seg->filesize != 0) ) {
-				slide = (uintptr_t)mh - seg->vmaddr;
-				slideComputed = true;
-			}
-			const macho_section* const sectionsStart = (macho_section*)((char*)seg + sizeof(macho_segment_command));
-			const macho_section* const sectionsEnd = &sectionsStart[seg->nsects];
-			for (const macho_section* sect=sectionsStart; sect < sectionsEnd; ++sect) {
-				switch ( sect->flags & SECTION_TYPE ) {
-					case S_THREAD_LOCAL_INIT_FUNCTION_POINTERS:
-						hasInitializers = true;
-						break;
-					case S_THREAD_LOCAL_ZEROFILL:
-					case S_THREAD_LOCAL_REGULAR:
-						if ( start == NULL ) {
-							// first of N contiguous TLV template sections, record as if this was only section
-							start = (uint8_t*)(sect->addr + slide);
-							size = sect->size;
-						}
-						else {
-							// non-first of N contiguous TLV template sections, accumlate values
-							const uint8_t* newEnd = (uint8_t*)(sect->addr + slide + sect->size);
-							size = newEnd - start;
-						}
-						break;
-				}
-			}
-		}
-		cmd = (const struct load_command*)(((char*)cmd)+cmd->cmdsize);
+
+	void* buffer;
+	if ( tlv_arena_enabled ) {
+		// find the space for this image in the thread's arena
+		buffer = tlv_arena_buffer_for_template(tmpl);
 	}
-    // no thread local storage in image: should never happen
-    if ( size == 0 )
-        return NULL;
-	
-	// allocate buffer and fill with template
-	void* buffer = malloc(size);
-	memcpy(buffer, start, size);
-	
+	else {
+		// allocate buffer
+		buffer = malloc(tmpl->initialContentSize + tmpl->zeroFillSize);
+	}
+
+	// fill with template
+	memcpy(buffer, tmpl->initialContent, tmpl->initialContentSize);
+	memset((uint8_t*)buffer + tmpl->initialContentSize, 0, tmpl->zeroFillSize);
+
 	// set this thread's value for key to be the new buffer.
 	pthread_setspecific(key, buffer);
 
 	// send tlv state notifications
-	tlv_notify(dyld_tlv_state_allocated, buffer);
-	
-	// second pass, run initializers
-	if ( hasInitializers ) {
-		cmd = cmds;
-		for (uint32_t i = 0; i < cmd_count; ++i) {
-			if ( cmd->cmd == LC_SEGMENT_COMMAND) {
-				const macho_segment_command* seg = (macho_segment_command*)cmd;
-				const macho_section* const sectionsStart = (macho_section*)((char*)seg + sizeof(macho_segment_command));
-				const macho_section* const sectionsEnd = &sectionsStart[seg->nsects];
-				for (const macho_section* sect=sectionsStart; sect < sectionsEnd; ++sect) {
-					if ( (sect->flags & SECTION_TYPE) == S_THREAD_LOCAL_INIT_FUNCTION_POINTERS ) {
-						typedef void (*InitFunc)(void);
-						InitFunc* funcs = (InitFunc*)(sect->addr + slide);
-						const size_t count = sect->size / sizeof(uintptr_t);
-						for (size_t j=count; j > 0; --j) {
-							InitFunc func = funcs[j-1];
-							func();
-						}
-					}
-				}
-			}
-			cmd = (const struct load_command*)(((char*)cmd)+cmd->cmdsize);
-		}
-	}
+	if ( tlv_arena_enabled )
+		tlv_notify_size(dyld_tlv_state_allocated, buffer, tlv_arena_slice_size(tmpl));
+	else
+		tlv_notify(dyld_tlv_state_allocated, buffer);
+
+	// run initializers
+	for (unsigned long i=0; i < tmpl->initializerCount; ++i)
+		tmpl->initializers[i]();
+
 	return buffer;
 }
 
@@ -263,11 +306,38 @@ tlv_free(void *storage)
 	free(storage);
 }
 
+// pthread destructor for all of a thread's TLV storage in arena mode
+static void
+tlv_arena_free(void *storage)
+{
+	// image keys point into the arenas, clear them so later destructors that use a TLV get new storage
+	pthread_mutex_lock(&tlv_live_image_lock);
+		unsigned int count = tlv_live_image_used_count;
+		void*  list[count];
+		size_t sizes[count];
+		for (unsigned int i=0; i < count; ++i) {
+			list[i]  = pthread_getspecific(tlv_live_images[i].key);
+			sizes[i] = tlv_arena_slice_size(tlv_live_images[i].tmpl);
+			pthread_setspecific(tlv_live_images[i].key, NULL);
+		}
+	pthread_mutex_unlock(&tlv_live_image_lock);
+
+	// report each image's slice, as they were reported when allocated
+	for (unsigned int i=0; i < count; ++i) {
+		if ( list[i] != NULL )
+			tlv_notify_size(dyld_tlv_state_deallocated, list[i], sizes[i]);
+	}
 
-// called when image is loaded
-static void tlv_initialize_descriptors(const struct mach_header* mh)
+	TLVArena* next;
+	for (TLVArena* a = (TLVArena*)storage; a != NULL; a = next) {
+		next = a->next;
+		free(a);
+	}
+}
+
+
+static void tlv_for_each_section(const struct mach_header* mh, void (^callback)(const macho_section* sect, intptr_t slide))
 {
-	pthread_key_t	key = 0;
 	intptr_t		slide = 0;
 	bool			slideComputed = false;
 	const uint32_t cmd_count = mh->ncmds;
@@ -282,33 +352,87 @@ static void tlv_initialize_descriptors(const struct mach_header* mh)
 			}
 			const macho_section* const sectionsStart = (macho_section*)((char*)seg + sizeof(macho_segment_command));
 			const macho_section* const sectionsEnd = &sectionsStart[seg->nsects];
-			for (const macho_section* sect=sectionsStart; sect < sectionsEnd; ++sect) {
-				if ( (sect->flags & SECTION_TYPE) == S_THREAD_LOCAL_VARIABLES ) {
-					if ( sect->size != 0 ) {
-						// allocate pthread key when we first discover this image has TLVs
-						if ( key == 0 ) {
-							int result = pthread_key_create(&key, &tlv_free);
-							if ( result != 0 )
-								abort();
-							tlv_set_key_for_image(mh, key);
-						}
-						// initialize each descriptor
-						TLVDescriptor* start = (TLVDescriptor*)(sect->addr + slide);
-						TLVDescriptor* end = (TLVDescriptor*)(sect->addr + sect->size + slide);
-						for (TLVDescriptor* d=start; d < end; ++d) {
-							d->thunk = tlv_get_addr;
-							d->key = key;
-							//d->offset = d->offset;  // offset unchanged
-						}
-					}
-				}
-			}
+			for (const macho_section* sect=sectionsStart; sect < sectionsEnd; ++sect)
+				callback(sect, slide);
 		}
 		cmd = (const struct load_command*)(((char*)cmd)+cmd->cmdsize);
 	}
 }
 
 
+// called when image is loaded
+static void tlv_initialize_descriptors(const struct mach_header* mh)
+{
+	// first pass, find template and count initializers
+	__block bool			hasDescriptors = false;
+	__block const uint8_t*	start = NULL;
+	__block const uint8_t*	end = NULL;
+	__block const uint8_t*	initialContentEnd = NULL;
+	__block unsigned long	initializerCount = 0;
+	tlv_for_each_section(mh, ^(const macho_section* sect, intptr_t slide) {
+		switch ( sect->flags & SECTION_TYPE ) {
+			case S_THREAD_LOCAL_VARIABLES:
+				if ( sect->size != 0 )
+					hasDescriptors = true;
+				break;
+			case S_THREAD_LOCAL_ZEROFILL:
+			case S_THREAD_LOCAL_REGULAR:
+				// N contiguous TLV template sections, the first one starts the template
+				if ( start == NULL )
+					start = (uint8_t*)(sect->addr + slide);
+				end = (uint8_t*)(sect->addr + slide + sect->size);
+				// zerofill sections have no content, so only the template up to the last regular section needs copying
+				if ( (sect->flags & SECTION_TYPE) == S_THREAD_LOCAL_REGULAR )
+					initialContentEnd = end;
+				break;
+			case S_THREAD_LOCAL_INIT_FUNCTION_POINTERS:
+				initializerCount += sect->size / sizeof(uintptr_t);
+				break;
+		}
+	});
+	if ( !hasDescriptors )
+		return;
+
+	// build template, recording initializers in the order they are run (each section's last to first)
+	TLVTemplate* tmpl = malloc(offsetof(TLVTemplate, initializers[initializerCount]));
+	tmpl->initialContent     = start;
+	tmpl->initialContentSize = (initialContentEnd != NULL) ? (initialContentEnd - start) : 0;
+	tmpl->zeroFillSize       = end - start - tmpl->initialContentSize;
+	tmpl->initializerCount   = initializerCount;
+	if ( initializerCount != 0 ) {
+		__block unsigned long index = 0;
+		tlv_for_each_section(mh, ^(const macho_section* sect, intptr_t slide) {
+			if ( (sect->flags & SECTION_TYPE) == S_THREAD_LOCAL_INIT_FUNCTION_POINTERS ) {
+				const TLVInitFunc* funcs = (TLVInitFunc*)(sect->addr + slide);
+				const size_t count = sect->size / sizeof(uintptr_t);
+				for (size_t j=count; j > 0; --j)
+					tmpl->initializers[index++] = funcs[j-1];
+			}
+		});
+	}
+
+	// allocate pthread key and publish template before any descriptor can use it
+	pthread_key_t key;
+	int result = pthread_key_create(&key, tlv_arena_enabled ? NULL : &tlv_free);
+	if ( result != 0 )
+		abort();
+	tlv_set_key_for_image(mh, key, tmpl);
+
+	// initialize each descriptor
+	tlv_for_each_section(mh, ^(const macho_section* sect, intptr_t slide) {
+		if ( ((sect->flags & SECTION_TYPE) == S_THREAD_LOCAL_VARIABLES) && (sect->size != 0) ) {
+			TLVDescriptor* dStart = (TLVDescriptor*)(sect->addr + slide);
+			TLVDescriptor* dEnd = (TLVDescriptor*)(sect->addr + sect->size + slide);
+			for (TLVDescriptor* d=dStart; d < dEnd; ++d) {
+				d->thunk = tlv_get_addr;
+				d->key = key;
+				//d->offset = d->offset;  // offset unchanged
+			}
+		}
+	});
+}
+
+
 static void tlv_load_notification(const struct mach_header* mh, intptr_t slide)
 {
 	// This is called on all images, even those without TLVs. So we want this to be fast.
@@ -337,14 +461,17 @@ void dyld_enumerate_tlv_storage(dyld_tlv_state_change_handler handler)
 	pthread_mutex_lock(&tlv_live_image_lock);
 		unsigned int count = tlv_live_image_used_count;
 		void *list[count];
+		size_t sizes[count];
 		for (unsigned int i = 0; i < count; ++i) {
 			list[i] = pthread_getspecific(tlv_live_images[i].key);
+			// in arena mode image keys point into the arenas, so report just each image's slice
+			sizes[i] = tlv_arena_enabled ? tlv_arena_slice_size(tlv_live_images[i].tmpl) : 0;
 		}
 	pthread_mutex_unlock(&tlv_live_image_lock);
 
 	for (unsigned int i = 0; i < count; ++i) {
 		if (list[i]) {
-			dyld_tlv_info info = { sizeof(info), list[i], malloc_size(list[i]) };
+			dyld_tlv_info info = { sizeof(info), list[i], tlv_arena_enabled ? sizes[i] : malloc_size(list[i]) };
 			handler(dyld_tlv_state_allocated, &info);
 		}
 	}
@@ -450,7 +577,14 @@ void tlv_initializer()
     // NOTE: this key must be allocated before any keys for TLV
     // so that _pthread_tsd_cleanup will run destructors before deallocation
     (void)pthread_key_create(&tlv_terminators_key, &tlv_finalize);
-       
+
+	// arena mode key must also come before TLV keys, and after the terminators key
+	// so that thread_local objects are destroyed before their storage is freed
+	if ( getenv("DYLD_TLV_ARENA") != NULL ) {
+		if ( pthread_key_create(&tlv_arena_key, &tlv_arena_free) == 0 )
+			tlv_arena_enabled = true;
+	}
+
     // register with dyld for notification when images are loaded
 	_dyld_register_func_for_add_image(tlv_load_notification);
 
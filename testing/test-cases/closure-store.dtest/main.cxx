@@ -0,0 +1,83 @@
+
+// BUILD:  $CXX main.cxx ../../../dyld3/shared-cache/ClosureStore.cpp -I../../../dyld3/shared-cache -std=c++11 -o $BUILD_DIR/closure-store.exe
+
+// RUN:  ./closure-store.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ClosureStore.h"
+
+#define FAIL(msg) do { printf("[FAIL] closure-store: %s\n", msg); return 0; } while (0)
+
+int main()
+{
+    printf("[BEGIN] closure-store\n");
+
+    char storeDir[] = "/tmp/closure-store-XXXXXX";
+    if ( mkdtemp(storeDir) == nullptr )
+        FAIL("could not create temp dir");
+
+    const uint8_t cdHash[20]    = { 0x01, 0x02, 0x03 };
+    const uint8_t cacheUUID[16] = { 0xAA, 0xBB, 0xCC };
+    dyld3::ClosureStore::Key key1 = dyld3::ClosureStore::makeKey(cdHash, cacheUUID, "/usr/bin/foo", { "DYLD_LIBRARY_PATH=/tmp" });
+    dyld3::ClosureStore::Key key2 = dyld3::ClosureStore::makeKey(cdHash, cacheUUID, "/usr/bin/foo", { "DYLD_LIBRARY_PATH=/usr" });
+    dyld3::ClosureStore::Key key3 = dyld3::ClosureStore::makeKey(cdHash, cacheUUID, "/usr/bin/foo", {});
+    if ( key1 == key2 )
+        FAIL("env vars not part of key");
+    // a copy of the same binary elsewhere resolves @executable_path differently
+    dyld3::ClosureStore::Key copyKey = dyld3::ClosureStore::makeKey(cdHash, cacheUUID, "/tmp/foo", { "DYLD_LIBRARY_PATH=/tmp" });
+    if ( (key1 == copyKey) || (key1.fileName() == copyKey.fileName()) )
+        FAIL("main executable path not part of key");
+
+    {
+        dyld3::ClosureStore store(storeDir, 2);
+        size_t size;
+        if ( store.find(key1, size, nullptr) != nullptr )
+            FAIL("found closure in empty store");
+        if ( !store.save(key1, "closure1", 9) || !store.save(key2, "closure2", 9) || !store.save(key3, "closure3", 9) )
+            FAIL("could not save closures");
+
+        // first lookup maps from disk, second is served from memory
+        const char* content = (const char*)store.find(key1, size, nullptr);
+        if ( (content == nullptr) || (size != 9) || (strcmp(content, "closure1") != 0) )
+            FAIL("wrong content for key1");
+        if ( store.find(key1, size, nullptr) != content )
+            FAIL("second lookup not served from memory");
+        if ( (store.stats().diskHits != 1) || (store.stats().memoryHits != 1) )
+            FAIL("wrong hit counts");
+
+        // LRU holds two mappings, so key1 gets evicted and is reloaded from disk
+        store.find(key2, size, nullptr);
+        store.find(key3, size, nullptr);
+        if ( store.find(key1, size, nullptr) == nullptr )
+            FAIL("evicted closure not reloaded");
+        if ( store.stats().diskHits != 4 )
+            FAIL("evicted closure not reloaded from disk");
+
+        // closures rejected by validator are removed from disk
+        if ( store.find(key1, size, [](const void*, size_t) { return false; }) != nullptr )
+            FAIL("invalid closure returned");
+        if ( store.find(key1, size, nullptr) != nullptr )
+            FAIL("invalid closure not removed");
+        if ( store.stats().invalidated != 1 )
+            FAIL("wrong invalidated count");
+    }
+
+    // closures persist across store instances
+    {
+        dyld3::ClosureStore store(storeDir);
+        size_t size;
+        const char* content = (const char*)store.find(key2, size, nullptr);
+        if ( (content == nullptr) || (strcmp(content, "closure2") != 0) )
+            FAIL("closure not persisted");
+        store.remove(key2);
+        store.remove(key3);
+    }
+    rmdir(storeDir);
+
+    printf("[PASS] closure-store\n");
+    return 0;
+}
@@ -0,0 +1,5 @@
+
+int dep()
+{
+    return 1;
+}
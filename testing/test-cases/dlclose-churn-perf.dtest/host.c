@@ -0,0 +1,5 @@
+
+int host()
+{
+    return 1;
+}
@@ -0,0 +1,58 @@
+
+// BUILD:  $CC dep.c -c -o $TEMP_DIR/dep.o && mkdir -p $BUILD_DIR/deps && for i in $(seq 1 200); do $CC $TEMP_DIR/dep.o -dynamiclib -o $BUILD_DIR/deps/libdep$i.dylib -install_name $RUN_DIR/deps/libdep$i.dylib || exit 1; DEPS="$DEPS $BUILD_DIR/deps/libdep$i.dylib"; done && $CC host.c -dynamiclib $DEPS -o $BUILD_DIR/libhost.dylib -install_name $RUN_DIR/libhost.dylib
+// BUILD:  $CC main.c -DRUN_DIR="$RUN_DIR" -o $BUILD_DIR/dlclose-churn-perf.exe
+
+// RUN:  ./dlclose-churn-perf.exe
+
+// libhost.dylib links with 200 dylibs, so each dlclose() of it unloads 201 images at once
+
+#include <stdio.h>
+#include <dlfcn.h>
+#include <mach/mach_time.h>
+#include <mach-o/dyld.h>
+
+#define CYCLES  50
+
+
+int main()
+{
+    printf("[BEGIN] dlclose-churn-perf\n");
+
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+
+    uint32_t initialCount = _dyld_image_count();
+    uint64_t openNanos    = 0;
+    uint64_t closeNanos   = 0;
+    uint32_t unloadCount  = 0;
+    for (int i=0; i < CYCLES; ++i) {
+        uint64_t t0 = mach_absolute_time();
+        void* handle = dlopen(RUN_DIR "/libhost.dylib", RTLD_LAZY);
+        uint64_t t1 = mach_absolute_time();
+        if ( handle == NULL ) {
+            printf("[FAIL] dlclose-churn-perf: %s\n", dlerror());
+            return 0;
+        }
+        uint32_t loadedCount = _dyld_image_count();
+        if ( dlclose(handle) != 0 ) {
+            printf("[FAIL] dlclose-churn-perf: %s\n", dlerror());
+            return 0;
+        }
+        uint64_t t2 = mach_absolute_time();
+        if ( _dyld_image_count() != initialCount ) {
+            printf("[FAIL] dlclose-churn-perf: %u images still loaded after dlclose(), expected %u\n", _dyld_image_count(), initialCount);
+            return 0;
+        }
+        unloadCount += loadedCount - initialCount;
+        openNanos   += (t1 - t0) * timebase.numer / timebase.denom;
+        closeNanos  += (t2 - t1) * timebase.numer / timebase.denom;
+    }
+    if ( closeNanos == 0 )
+        closeNanos = 1;
+
+    printf("dlclose-churn-perf: %d cycles: %llu us per dlopen(), %llu us per dlclose(), %llu images unloaded/sec\n",
+           CYCLES, openNanos/CYCLES/1000, closeNanos/CYCLES/1000, (unloadCount * 1000000000ULL) / closeNanos);
+
+    printf("[PASS] dlclose-churn-perf\n");
+    return 0;
+}
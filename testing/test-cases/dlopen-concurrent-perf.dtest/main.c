@@ -0,0 +1,84 @@
+
+// BUILD:  mkdir -p $BUILD_DIR/libs && for i in $(seq 1 400); do $CC foo.c -DVALUE=$i -dynamiclib -o $BUILD_DIR/libs/libfoo$i.dylib -install_name $RUN_DIR/libs/libfoo$i.dylib || exit 1; done
+// BUILD:  $CC main.c -DRUN_DIR="$RUN_DIR" -o $BUILD_DIR/dlopen-concurrent-perf.exe
+
+// RUN:  ./dlopen-concurrent-perf.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <dlfcn.h>
+#include <dispatch/dispatch.h>
+#include <mach/mach_time.h>
+#include <mach-o/dyld_priv.h>
+
+#define LIB_COUNT       400
+#define THREAD_COUNT    8
+
+typedef int (*FooProc)(void);
+
+static uint64_t toMicros(uint64_t absTime)
+{
+    static mach_timebase_info_data_t timebase;
+    if ( timebase.denom == 0 )
+        mach_timebase_info(&timebase);
+    return absTime * timebase.numer / timebase.denom / 1000;
+}
+
+int main()
+{
+    printf("[BEGIN] dlopen-concurrent-perf\n");
+
+    struct dyld_global_lock_statistics before;
+    _dyld_get_global_lock_statistics(&before);
+
+    // each thread opens its own share of the libraries, then every library is opened once more by another thread
+    __block bool allGood = true;
+    uint64_t start = mach_absolute_time();
+    dispatch_apply(THREAD_COUNT, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+        for (unsigned pass=0; pass < 2; ++pass) {
+            for (unsigned i=1; i <= LIB_COUNT; ++i) {
+                if ( (i % THREAD_COUNT) != ((thread + pass) % THREAD_COUNT) )
+                    continue;
+                char path[PATH_MAX];
+                snprintf(path, sizeof(path), "%s/libs/libfoo%u.dylib", RUN_DIR, i);
+                void* handle = dlopen(path, RTLD_LAZY);
+                if ( handle == NULL ) {
+                    printf("[FAIL] dlopen-concurrent-perf: %s\n", dlerror());
+                    allGood = false;
+                    return;
+                }
+                FooProc foo = (FooProc)dlsym(handle, "foo");
+                if ( (foo == NULL) || (foo() != (int)i) ) {
+                    printf("[FAIL] dlopen-concurrent-perf: wrong foo() in %s\n", path);
+                    allGood = false;
+                    return;
+                }
+            }
+        }
+    });
+    uint64_t elapsed = mach_absolute_time() - start;
+    if ( !allGood )
+        return 0;
+
+    struct dyld_global_lock_statistics after;
+    _dyld_get_global_lock_statistics(&after);
+    if ( after.acquisitions < before.acquisitions + 2*LIB_COUNT ) {
+        printf("[FAIL] dlopen-concurrent-perf: expected at least %u lock acquisitions, got %llu\n", 2*LIB_COUNT, after.acquisitions - before.acquisitions);
+        return 0;
+    }
+    if ( (after.totalHoldTime <= before.totalHoldTime) || ((after.contendedAcquisitions == before.contendedAcquisitions) && (after.totalWaitTime != before.totalWaitTime)) ) {
+        printf("[FAIL] dlopen-concurrent-perf: inconsistent lock statistics\n");
+        return 0;
+    }
+
+    printf("dlopen-concurrent-perf: %u dylibs on %u threads in %llu us\n", LIB_COUNT, THREAD_COUNT, toMicros(elapsed));
+    printf("dlopen-concurrent-perf: %llu lock acquisitions, %llu contended, wait %llu us (max %llu us), hold %llu us (max %llu us)\n",
+           after.acquisitions - before.acquisitions, after.contendedAcquisitions - before.contendedAcquisitions,
+           toMicros(after.totalWaitTime - before.totalWaitTime), toMicros(after.maxWaitTime),
+           toMicros(after.totalHoldTime - before.totalHoldTime), toMicros(after.maxHoldTime));
+
+    printf("[PASS] dlopen-concurrent-perf\n");
+    return 0;
+}
@@ -0,0 +1,6 @@
+
+int foo()
+{
+    return 1;
+}
+
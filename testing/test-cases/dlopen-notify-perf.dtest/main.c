@@ -0,0 +1,89 @@
+
+// BUILD:  $CC foo.c -c -o $TEMP_DIR/foo.o && mkdir -p $BUILD_DIR/libs && for i in $(seq 1 1100); do $CC $TEMP_DIR/foo.o -dynamiclib -o $BUILD_DIR/libs/libfoo$i.dylib -install_name $RUN_DIR/libs/libfoo$i.dylib || exit 1; done
+// BUILD:  $CC main.c -DRUN_DIR="$RUN_DIR" -o $BUILD_DIR/dlopen-notify-perf.exe
+
+// RUN:  ./dlopen-notify-perf.exe
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <dlfcn.h>
+#include <mach/mach_time.h>
+#include <mach-o/dyld.h>
+
+#define PRELOAD_COUNT   1000
+#define MEASURE_COUNT   100
+
+static unsigned sAddImageCount = 0;
+
+static void addImageCallback(const struct mach_header* mh, intptr_t slide)
+{
+    ++sAddImageCount;
+}
+
+static uint64_t nanosSince(uint64_t start)
+{
+    static mach_timebase_info_data_t timebase;
+    if ( timebase.denom == 0 )
+        mach_timebase_info(&timebase);
+    return (mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+static bool openLib(unsigned index)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/libs/libfoo%u.dylib", RUN_DIR, index);
+    if ( dlopen(path, RTLD_LAZY) == NULL ) {
+        printf("[FAIL] dlopen-notify-perf: %s\n", dlerror());
+        return false;
+    }
+    return true;
+}
+
+// average cost of dlopen() of new images, and check that each one was announced exactly once
+static bool measure(unsigned firstLib, unsigned count, uint64_t* nanosPerOpen)
+{
+    unsigned addImagesBefore = sAddImageCount;
+    uint64_t start = mach_absolute_time();
+    for (unsigned i=firstLib; i < firstLib+count; ++i) {
+        if ( !openLib(i) )
+            return false;
+    }
+    *nanosPerOpen = nanosSince(start) / count;
+    if ( sAddImageCount - addImagesBefore != count ) {
+        printf("[FAIL] dlopen-notify-perf: %u add image notifications for %u new images\n", sAddImageCount - addImagesBefore, count);
+        return false;
+    }
+    return true;
+}
+
+
+int main()
+{
+    printf("[BEGIN] dlopen-notify-perf\n");
+
+    // batch notifications also feed the add image callbacks
+    _dyld_register_func_for_add_image(&addImageCallback);
+
+    uint64_t fewLoadedNanos;
+    if ( !measure(1, MEASURE_COUNT, &fewLoadedNanos) )
+        return 0;
+    uint32_t fewLoadedCount = _dyld_image_count();
+
+    for (unsigned i=MEASURE_COUNT+1; i <= PRELOAD_COUNT; ++i) {
+        if ( !openLib(i) )
+            return 0;
+    }
+
+    uint64_t manyLoadedNanos;
+    uint32_t manyLoadedCount = _dyld_image_count();
+    if ( !measure(PRELOAD_COUNT+1, MEASURE_COUNT, &manyLoadedNanos) )
+        return 0;
+
+    printf("dlopen-notify-perf: %4u images loaded: %6llu ns per new dlopen()\n", fewLoadedCount, fewLoadedNanos);
+    printf("dlopen-notify-perf: %4u images loaded: %6llu ns per new dlopen()\n", manyLoadedCount, manyLoadedNanos);
+
+    printf("[PASS] dlopen-notify-perf\n");
+    return 0;
+}
+
@@ -0,0 +1,126 @@
+
+// BUILD:  $CXX main.cpp ../../../launch-cache/dsc_extractor.cpp ../../../launch-cache/dsc_iterator.cpp -I../../../launch-cache -std=c++11 -O2 -o $BUILD_DIR/dsc-extract-perf.exe
+
+// RUN:  ./dsc-extract-perf.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <removefile.h>
+#include <fts.h>
+#include <sys/stat.h>
+#include <mach/mach_time.h>
+#include <mach-o/dyld_priv.h>
+
+#include "dsc_extractor.h"
+
+
+// the whole cache is too slow to extract on every test run, so the timed runs use a bounded subset
+// set DSC_EXTRACT_PERF_FULL in the environment to also time extracting every dylib in the cache
+static const char* const kTimedGlob = "/usr/lib/system/*";
+
+static uint64_t bytesWritten(const char* outDir)
+{
+    uint64_t total = 0;
+    char* const paths[] = { (char*)outDir, NULL };
+    FTS* fts = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+    if ( fts == NULL )
+        return 0;
+    while ( FTSENT* entry = fts_read(fts) ) {
+        if ( entry->fts_info == FTS_F )
+            total += entry->fts_statp->st_size;
+    }
+    fts_close(fts);
+    return total;
+}
+
+static bool timeExtract(const char* cachePath, unsigned workerCount, const char* glob, char outDir[PATH_MAX])
+{
+    strlcpy(outDir, "/tmp/dsc-extract-perf-XXXXXX", PATH_MAX);
+    if ( mkdtemp(outDir) == NULL ) {
+        printf("[FAIL] dsc-extract-perf: could not create temp dir\n");
+        return false;
+    }
+
+    dyld_shared_cache_extract_options options;
+    options.version         = 0;
+    options.workerCount     = workerCount;
+    options.installNameGlob = glob;
+
+    __block unsigned dylibCount = 0;
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    uint64_t start = mach_absolute_time();
+    int result = dyld_shared_cache_extract_dylibs_with_options(cachePath, outDir, &options, ^(unsigned current, unsigned total) {
+        dylibCount = total;
+    });
+    uint64_t end = mach_absolute_time();
+    if ( result != 0 ) {
+        printf("[FAIL] dsc-extract-perf: extraction with %u workers failed\n", workerCount);
+        return false;
+    }
+
+    double   seconds = (double)((end - start) * timebase.numer / timebase.denom) / 1000000000.0;
+    uint64_t bytes   = bytesWritten(outDir);
+    double   mbPerSec = (seconds > 0.0) ? ((double)bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+    printf("dsc-extract-perf: %u dylibs matching %s with %u workers (0=all cpus): %.3fs, %.1fMB written, %.1fMB/s\n",
+           dylibCount, (glob != NULL) ? glob : "*", workerCount, seconds, (double)bytes / (1024.0 * 1024.0), mbPerSec);
+    return true;
+}
+
+
+int main()
+{
+    printf("[BEGIN] dsc-extract-perf\n");
+
+    const char* cachePath = dyld_shared_cache_file_path();
+    struct stat statBuf;
+    if ( (cachePath == NULL) || (stat(cachePath, &statBuf) != 0) ) {
+        printf("[PASS] dsc-extract-perf: no dyld shared cache file to extract\n");
+        return 0;
+    }
+
+    // serial vs one worker per cpu
+    char serialOutDir[PATH_MAX];
+    bool ok = timeExtract(cachePath, 1, kTimedGlob, serialOutDir);
+    removefile(serialOutDir, NULL, REMOVEFILE_RECURSIVE);
+    if ( !ok )
+        return 0;
+    char outDir[PATH_MAX];
+    if ( !timeExtract(cachePath, 0, kTimedGlob, outDir) )
+        return 0;
+
+    // optionally time the whole cache too
+    if ( getenv("DSC_EXTRACT_PERF_FULL") != NULL ) {
+        char fullOutDir[PATH_MAX];
+        ok = timeExtract(cachePath, 1, NULL, fullOutDir);
+        removefile(fullOutDir, NULL, REMOVEFILE_RECURSIVE);
+        if ( ok ) {
+            ok = timeExtract(cachePath, 0, NULL, fullOutDir);
+            removefile(fullOutDir, NULL, REMOVEFILE_RECURSIVE);
+        }
+        if ( !ok ) {
+            removefile(outDir, NULL, REMOVEFILE_RECURSIVE);
+            return 0;
+        }
+    }
+
+    // subset extraction only writes matching dylibs
+    char systemKernel[PATH_MAX];
+    char libSystem[PATH_MAX];
+    strlcpy(systemKernel, outDir, PATH_MAX);
+    strlcat(systemKernel, "/usr/lib/system/libsystem_kernel.dylib", PATH_MAX);
+    strlcpy(libSystem, outDir, PATH_MAX);
+    strlcat(libSystem, "/usr/lib/libSystem.B.dylib", PATH_MAX);
+    bool foundMatch   = (stat(systemKernel, &statBuf) == 0);
+    bool foundNoMatch = (stat(libSystem, &statBuf) == 0);
+    removefile(outDir, NULL, REMOVEFILE_RECURSIVE);
+    if ( !foundMatch || foundNoMatch ) {
+        printf("[FAIL] dsc-extract-perf: install name glob selected wrong dylibs\n");
+        return 0;
+    }
+
+    printf("[PASS] dsc-extract-perf\n");
+    return 0;
+}
@@ -0,0 +1,257 @@
+
+// BUILD:  $CXX main.cpp ../../../src/dyld_process_info.cpp -I../../../src -I../../../include -I../../../include/mach-o -std=c++11 -O2 -o $BUILD_DIR/dyld_process_info-perf.exe
+
+// RUN:  ./dyld_process_info-perf.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach-o/loader.h>
+#include <mach-o/dyld_images.h>
+#include <mach-o/dyld_process_info.h>
+
+#include "dyld_process_info_internal.h"
+
+#define FAIL(...) do { printf("[FAIL] dyld_process_info-perf: " __VA_ARGS__); printf("\n"); return 0; } while (0)
+
+// libdyld's version is not exported, so the copy of dyld_process_info.cpp built into this test uses this one
+extern "C" const struct dyld_all_image_infos* _dyld_get_all_image_infos()
+{
+    task_dyld_info_data_t info;
+    mach_msg_type_number_t count = TASK_DYLD_INFO_COUNT;
+    if ( task_info(mach_task_self(), TASK_DYLD_INFO, (task_info_t)&info, &count) != KERN_SUCCESS )
+        return NULL;
+    return (const struct dyld_all_image_infos*)info.all_image_info_addr;
+}
+
+
+//
+// A fake task whose address space is one local buffer.  It has an all_image_infos, an image list,
+// a packed pool of path strings (like dyld's malloc()ed paths), and a mach_header every 16KB.
+//
+class FakeTaskMemory : public RemoteMemory {
+public:
+    static const uint64_t   kBaseAddress  = 0x300000000ULL;
+    static const uint64_t   kPathsOffset  = 0x10000;
+    static const uint64_t   kImagesOffset = 0x100000;
+    static const uint64_t   kImageSpacing = 0x4000;
+
+                            FakeTaskMemory(unsigned imageCount);
+                            ~FakeTaskMemory() { free(_buffer); }
+    task_t                  task() const override { return MACH_PORT_NULL; }
+    kern_return_t           dyldInfo(task_dyld_info_data_t& info) override;
+    kern_return_t           copy(uint64_t remoteAddress, size_t size, void* localBuffer) override;
+    kern_return_t           map(uint64_t remoteAddress, size_t size, bool allowTruncation, const void*& localAddress, size_t& localSize) override;
+    void                    unmap(const void* localAddress, size_t localSize) override { }
+
+    unsigned                mapCount() const { return _mapCount; }
+    void                    expectedPath(unsigned index, char path[PATH_MAX]) const;
+    uint64_t                imageAddress(unsigned index) const { return kBaseAddress + kImagesOffset + index*kImageSpacing; }
+
+private:
+    uint8_t*                local(uint64_t remoteAddress) { return _buffer + (remoteAddress - kBaseAddress); }
+
+    uint8_t*                _buffer;
+    uint64_t                _size;
+    unsigned                _imageCount;
+    unsigned                _mapCount;
+};
+
+FakeTaskMemory::FakeTaskMemory(unsigned imageCount)
+    : _imageCount(imageCount), _mapCount(0)
+{
+    // dyld's own path is put alone at the very end, so reading it needs truncation
+    uint64_t dyldAddress     = imageAddress(imageCount);
+    uint64_t dyldPathAddress = dyldAddress + 0x100000;
+    const char* dyldPath     = "/usr/lib/dyld";
+    _size   = (dyldPathAddress - kBaseAddress) + strlen(dyldPath) + 1;
+    _buffer = (uint8_t*)calloc(1, _size);
+    strcpy((char*)local(dyldPathAddress), dyldPath);
+
+    dyld_all_image_infos_64* allInfo = (dyld_all_image_infos_64*)local(kBaseAddress);
+    allInfo->version                  = 15;
+    allInfo->infoArrayCount           = imageCount;
+    allInfo->infoArray                = kBaseAddress + 0x1000;
+    allInfo->libSystemInitialized     = true;
+    allInfo->initialImageCount        = imageCount;
+    allInfo->infoArrayChangeTimestamp = 1;
+    allInfo->dyldImageLoadAddress     = dyldAddress;
+    allInfo->dyldPath                 = dyldPathAddress;
+
+    dyld_image_info_64* imageArray = (dyld_image_info_64*)local(allInfo->infoArray);
+    uint64_t pathAddress = kBaseAddress + kPathsOffset;
+    for (unsigned i=0; i <= imageCount; ++i) {
+        if ( i < imageCount ) {
+            char path[PATH_MAX];
+            expectedPath(i, path);
+            strcpy((char*)local(pathAddress), path);
+            imageArray[i].imageLoadAddress = imageAddress(i);
+            imageArray[i].imageFilePath    = pathAddress;
+            pathAddress += strlen(path) + 1;
+        }
+
+        mach_header_64* mh = (mach_header_64*)local(imageAddress(i));
+        mh->magic      = MH_MAGIC_64;
+        mh->filetype   = (i < imageCount) ? MH_DYLIB : MH_DYLINKER;
+        mh->ncmds      = 2;
+        mh->sizeofcmds = sizeof(segment_command_64) + sizeof(uuid_command);
+        segment_command_64* seg = (segment_command_64*)(mh + 1);
+        seg->cmd     = LC_SEGMENT_64;
+        seg->cmdsize = sizeof(segment_command_64);
+        strcpy(seg->segname, "__TEXT");
+        seg->vmaddr  = 0;
+        seg->vmsize  = kImageSpacing;
+        uuid_command* uuidCmd = (uuid_command*)(seg + 1);
+        uuidCmd->cmd     = LC_UUID;
+        uuidCmd->cmdsize = sizeof(uuid_command);
+        memcpy(uuidCmd->uuid, &i, sizeof(i));
+    }
+}
+
+void FakeTaskMemory::expectedPath(unsigned index, char path[PATH_MAX]) const
+{
+    snprintf(path, PATH_MAX, "/System/Library/Frameworks/Fake%u.framework/Versions/A/Fake%u", index, index);
+}
+
+kern_return_t FakeTaskMemory::dyldInfo(task_dyld_info_data_t& info)
+{
+    info.all_image_info_addr   = kBaseAddress;
+    info.all_image_info_size   = sizeof(dyld_all_image_infos_64);
+    info.all_image_info_format = TASK_DYLD_ALL_IMAGE_INFO_64;
+    return KERN_SUCCESS;
+}
+
+kern_return_t FakeTaskMemory::copy(uint64_t remoteAddress, size_t size, void* localBuffer)
+{
+    if ( (remoteAddress < kBaseAddress) || (remoteAddress + size > kBaseAddress + _size) )
+        return KERN_INVALID_ADDRESS;
+    memcpy(localBuffer, local(remoteAddress), size);
+    return KERN_SUCCESS;
+}
+
+kern_return_t FakeTaskMemory::map(uint64_t remoteAddress, size_t size, bool allowTruncation, const void*& localAddress, size_t& localSize)
+{
+    ++_mapCount;
+    if ( (remoteAddress < kBaseAddress) || (remoteAddress >= kBaseAddress + _size) )
+        return KERN_INVALID_ADDRESS;
+    if ( remoteAddress + size > kBaseAddress + _size ) {
+        if ( !allowTruncation )
+            return KERN_INVALID_ADDRESS;
+        size = (size_t)(kBaseAddress + _size - remoteAddress);
+    }
+    localAddress = local(remoteAddress);
+    localSize    = size;
+    return KERN_SUCCESS;
+}
+
+
+static bool checkFakeTask(FakeTaskMemory& memory, unsigned imageCount)
+{
+    kern_return_t kr;
+    dyld_process_info info = _dyld_process_info_create_with_memory(memory, 0, &kr);
+    if ( info == NULL ) {
+        printf("[FAIL] dyld_process_info-perf: _dyld_process_info_create_with_memory() failed, kr=%d\n", kr);
+        return false;
+    }
+
+    __block unsigned index = 0;
+    __block bool     ok    = true;
+    _dyld_process_info_for_each_image(info, ^(uint64_t machHeaderAddress, const uuid_t uuid, const char* path) {
+        // dyld is always first
+        if ( index == 0 ) {
+            if ( (machHeaderAddress != memory.imageAddress(imageCount)) || (strcmp(path, "/usr/lib/dyld") != 0) ) {
+                printf("[FAIL] dyld_process_info-perf: wrong dyld info %s\n", path);
+                ok = false;
+            }
+        }
+        else {
+            unsigned imageIndex = index-1;
+            char expected[PATH_MAX];
+            memory.expectedPath(imageIndex, expected);
+            if ( (machHeaderAddress != memory.imageAddress(imageIndex)) || (strcmp(path, expected) != 0) || (memcmp(uuid, &imageIndex, sizeof(imageIndex)) != 0) ) {
+                printf("[FAIL] dyld_process_info-perf: wrong info for image %u: %s\n", imageIndex, path);
+                ok = false;
+            }
+        }
+        ++index;
+    });
+    if ( ok && (index != imageCount+1) ) {
+        printf("[FAIL] dyld_process_info-perf: found %u images, expected %u\n", index, imageCount+1);
+        ok = false;
+    }
+
+    __block bool foundText = false;
+    _dyld_process_info_for_each_segment(info, memory.imageAddress(7), ^(uint64_t segmentAddress, uint64_t segmentSize, const char* segmentName) {
+        if ( (strcmp(segmentName, "__TEXT") == 0) && (segmentAddress == memory.imageAddress(7)) && (segmentSize == FakeTaskMemory::kImageSpacing) )
+            foundText = true;
+    });
+    if ( ok && !foundText ) {
+        printf("[FAIL] dyld_process_info-perf: __TEXT of image 7 not found\n");
+        ok = false;
+    }
+
+    _dyld_process_info_release(info);
+    return ok;
+}
+
+static void reportRate(const char* kind, unsigned imagesPerCreate, unsigned iterations, uint64_t start, uint64_t end)
+{
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    uint64_t nanos = (end - start) * timebase.numer / timebase.denom;
+    if ( nanos == 0 )
+        nanos = 1;
+    printf("dyld_process_info-perf: %s: %u images x %u iterations in %llu us, %llu images/sec\n", kind, imagesPerCreate, iterations,
+           nanos/1000, ((uint64_t)imagesPerCreate * iterations * 1000000000ULL) / nanos);
+}
+
+
+int main()
+{
+    printf("[BEGIN] dyld_process_info-perf\n");
+
+    // in-process fake task: check contents, and that reads were coalesced
+    const unsigned imageCount = 1000;
+    FakeTaskMemory fake(imageCount);
+    if ( !checkFakeTask(fake, imageCount) )
+        return 0;
+    unsigned mapsPerCreate = fake.mapCount();
+    printf("dyld_process_info-perf: fake task: %u remote reads for %u images\n", mapsPerCreate, imageCount+1);
+    if ( mapsPerCreate > imageCount/10 )
+        FAIL("remote reads were not coalesced (%u reads)", mapsPerCreate);
+
+    const unsigned iterations = 100;
+    uint64_t start = mach_absolute_time();
+    for (unsigned i=0; i < iterations; ++i) {
+        kern_return_t kr;
+        dyld_process_info info = _dyld_process_info_create_with_memory(fake, 0, &kr);
+        if ( info == NULL )
+            FAIL("_dyld_process_info_create_with_memory() failed, kr=%d", kr);
+        _dyld_process_info_release(info);
+    }
+    reportRate("fake task", imageCount+1, iterations, start, mach_absolute_time());
+
+    // this process, through mach_vm_remap()
+    __block unsigned selfImageCount = 0;
+    kern_return_t kr;
+    dyld_process_info info = _dyld_process_info_create(mach_task_self(), 0, &kr);
+    if ( info == NULL )
+        FAIL("_dyld_process_info_create(mach_task_self()) failed, kr=%d", kr);
+    _dyld_process_info_for_each_image(info, ^(uint64_t machHeaderAddress, const uuid_t uuid, const char* path) {
+        ++selfImageCount;
+    });
+    _dyld_process_info_release(info);
+    start = mach_absolute_time();
+    for (unsigned i=0; i < iterations; ++i) {
+        info = _dyld_process_info_create(mach_task_self(), 0, &kr);
+        if ( info == NULL )
+            FAIL("_dyld_process_info_create(mach_task_self()) failed, kr=%d", kr);
+        _dyld_process_info_release(info);
+    }
+    reportRate("self", selfImageCount, iterations, start, mach_absolute_time());
+
+    printf("[PASS] dyld_process_info-perf\n");
+    return 0;
+}
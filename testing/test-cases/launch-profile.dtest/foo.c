@@ -0,0 +1,14 @@
+
+static int sValue = 0;
+static int* sValuePtr = &sValue;    // a rebase, so the profile has a non-empty rebase event for this image
+
+__attribute__((constructor))
+static void myinit()
+{
+    sValue = VALUE;
+}
+
+int foo()
+{
+    return *sValuePtr;
+}
@@ -0,0 +1,82 @@
+
+// BUILD:  $CC foo.c -DVALUE=1 -dynamiclib -install_name $RUN_DIR/libfoo1.dylib -o $BUILD_DIR/libfoo1.dylib
+// BUILD:  $CC foo.c -DVALUE=2 -dynamiclib -install_name $RUN_DIR/libfoo2.dylib -o $BUILD_DIR/libfoo2.dylib -Dfoo=foo2
+// BUILD:  $CC main.c $BUILD_DIR/libfoo1.dylib $BUILD_DIR/libfoo2.dylib -o $BUILD_DIR/launch-profile.exe
+
+// RUN:  DYLD_LAUNCH_PROFILE=/tmp/dyld-launch-profile.json ./launch-profile.exe
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern int foo();
+extern int foo2();
+
+#define FAIL(...) do { printf("[FAIL] launch-profile: " __VA_ARGS__); printf("\n"); return 0; } while (0)
+
+// the profile is not parsed, just checked for the events and totals every launch should have
+static const char* const sExpected[] = {
+    "{\"traceEvents\":[",
+    "\"name\":\"initializer\"",
+    "\"ph\":\"X\"",
+    "libfoo1.dylib\"",
+    "libfoo2.dylib\"",
+    "\"otherData\":{",
+    "\"images\":",
+    "\"lockWaitTime\":",
+};
+
+//
+// Each image gets a "rebase" event that times just doRebase(), e.g.
+//   {"name":"rebase",...,"dur":12.345,"args":{"image":"/path/libfoo1.dylib","fixups":1}}
+//
+static bool hasRebaseEvent(const char* profile, const char* leafName)
+{
+    for (const char* event = strstr(profile, "{\"name\":\"rebase\""); event != NULL; event = strstr(event+1, "{\"name\":\"rebase\"")) {
+        const char* eventEnd = strstr(event, "}}");
+        const char* image    = strstr(event, leafName);
+        if ( (eventEnd == NULL) || (image == NULL) || (image > eventEnd) )
+            continue;
+        const char* dur    = strstr(event, "\"dur\":");
+        const char* fixups = strstr(event, "\"fixups\":");
+        return (dur != NULL) && (dur < eventEnd) && (fixups != NULL) && (fixups < eventEnd) && (strtoul(fixups + 9, NULL, 10) != 0);
+    }
+    return false;
+}
+
+int main()
+{
+    printf("[BEGIN] launch-profile\n");
+
+    if ( (foo() != 1) || (foo2() != 2) )
+        FAIL("initializers not run");
+
+    const char* path = getenv("DYLD_LAUNCH_PROFILE");
+    if ( path == NULL )
+        FAIL("DYLD_LAUNCH_PROFILE not set");
+    FILE* file = fopen(path, "r");
+    if ( file == NULL )
+        FAIL("no profile written to %s", path);
+    struct stat statBuf;
+    fstat(fileno(file), &statBuf);
+    char* contents = (char*)calloc(1, statBuf.st_size+1);
+    fread(contents, 1, statBuf.st_size, file);
+    fclose(file);
+    unlink(path);
+
+    for (size_t i=0; i < sizeof(sExpected)/sizeof(sExpected[0]); ++i) {
+        if ( strstr(contents, sExpected[i]) == NULL )
+            FAIL("profile is missing %s", sExpected[i]);
+    }
+    if ( !hasRebaseEvent(contents, "/libfoo1.dylib\"") )
+        FAIL("profile has no rebase event with fixups for libfoo1.dylib");
+    size_t length = strlen(contents);
+    if ( (length < 3) || (strcmp(&contents[length-3], "}}\n") != 0) )
+        FAIL("profile is truncated");
+
+    printf("[PASS] launch-profile\n");
+    return 0;
+}
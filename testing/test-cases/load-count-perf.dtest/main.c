@@ -0,0 +1,66 @@
+
+// BUILD:  $CC foo.c -c -o $TEMP_DIR/foo.o && mkdir -p $BUILD_DIR/libs && for i in $(seq 1 800); do $CC $TEMP_DIR/foo.o -dynamiclib -o $BUILD_DIR/libs/libfoo$i.dylib -install_name $RUN_DIR/libs/libfoo$i.dylib || exit 1; done
+// BUILD:  $CC main.c -DRUN_DIR="$RUN_DIR" -o $BUILD_DIR/load-count-perf.exe
+
+// RUN:  ./load-count-perf.exe
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <dlfcn.h>
+#include <mach/mach_time.h>
+#include <mach-o/dyld.h>
+
+#define LIB_COUNT   800
+#define BATCH_SIZE  100
+
+
+static uint64_t nanosSince(uint64_t start)
+{
+    static mach_timebase_info_data_t timebase;
+    if ( timebase.denom == 0 )
+        mach_timebase_info(&timebase);
+    return (mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+static bool openLib(unsigned index)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/libs/libfoo%u.dylib", RUN_DIR, index);
+    if ( dlopen(path, RTLD_LAZY) == NULL ) {
+        printf("[FAIL] load-count-perf: %s\n", dlerror());
+        return false;
+    }
+    return true;
+}
+
+
+int main()
+{
+    printf("[BEGIN] load-count-perf\n");
+
+    // load dylibs in batches, so per-dlopen cost can be compared as the number of loaded images grows
+    for (unsigned batchStart=1; batchStart <= LIB_COUNT; batchStart += BATCH_SIZE) {
+        uint32_t loadedBefore = _dyld_image_count();
+        uint64_t start = mach_absolute_time();
+        for (unsigned i=batchStart; i < batchStart+BATCH_SIZE; ++i) {
+            if ( !openLib(i) )
+                return 0;
+        }
+        uint64_t loadNanos = nanosSince(start);
+
+        // dlopen() of an already loaded image is just the "already loaded" lookup
+        start = mach_absolute_time();
+        for (unsigned i=batchStart; i < batchStart+BATCH_SIZE; ++i) {
+            if ( !openLib(i) )
+                return 0;
+        }
+        uint64_t reopenNanos = nanosSince(start);
+
+        printf("load-count-perf: %4u images loaded: %6llu ns per new dlopen(), %6llu ns per repeat dlopen()\n",
+               loadedBefore, loadNanos/BATCH_SIZE, reopenNanos/BATCH_SIZE);
+    }
+
+    printf("[PASS] load-count-perf\n");
+    return 0;
+}
@@ -0,0 +1,152 @@
+
+// BUILD:  $CXX main.cpp ../../../dyld3/shared-cache/MachOValidator.cpp ../../../dyld3/MachOParser.cpp ../../../dyld3/Diagnostics.cpp -I../../../dyld3 -I../../../dyld3/shared-cache -I../../../include -std=c++11 -O2 -o $BUILD_DIR/macho-validate-perf.exe
+
+// RUN:  ./macho-validate-perf.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <mach/mach_time.h>
+#include <mach-o/dyld.h>
+
+#include <string>
+#include <vector>
+
+#include "MachOParser.h"
+#include "MachOValidator.h"
+
+#define FAIL(...) do { printf("[FAIL] macho-validate-perf: " __VA_ARGS__); printf("\n"); return 0; } while (0)
+
+
+// maps the slice for archName of every regular file in dir
+static void mapFiles(const char* dir, const std::string& archName, std::vector<dyld3::MachOValidator::File>& files)
+{
+    DIR* dirp = opendir(dir);
+    if ( dirp == NULL )
+        return;
+    while ( dirent* entry = readdir(dirp) ) {
+        std::string path = std::string(dir) + "/" + entry->d_name;
+        struct stat statBuf;
+        if ( (lstat(path.c_str(), &statBuf) != 0) || !S_ISREG(statBuf.st_mode) || (statBuf.st_size < 4096) )
+            continue;
+        int fd = open(path.c_str(), O_RDONLY);
+        if ( fd == -1 )
+            continue;
+        const void* content = mmap(NULL, statBuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if ( content == MAP_FAILED )
+            continue;
+        Diagnostics diag;
+        size_t sliceOffset = 0;
+        size_t sliceLength = statBuf.st_size;
+        bool   missingSlice;
+        if ( !dyld3::FatUtil::isFatFileWithSlice(diag, content, statBuf.st_size, archName, sliceOffset, sliceLength, missingSlice) && missingSlice )
+            continue;
+        files.push_back({ (uint8_t*)content + sliceOffset, sliceLength, path, archName, (uint64_t)statBuf.st_dev, (uint64_t)statBuf.st_ino,
+                          dyld3::MachOValidator::changeTime(statBuf), (uint64_t)statBuf.st_size, sliceOffset });
+    }
+    closedir(dirp);
+}
+
+static uint64_t elapsedMicroseconds(uint64_t start)
+{
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (mach_absolute_time() - start) * timebase.numer / timebase.denom / 1000;
+}
+
+
+int main()
+{
+    printf("[BEGIN] macho-validate-perf\n");
+
+    const mach_header* mh = _dyld_get_image_header(0);
+    std::string archName = dyld3::MachOParser::archName(mh->cputype, mh->cpusubtype);
+    dyld3::Platform platform = dyld3::MachOParser::currentPlatform();
+
+    std::vector<dyld3::MachOValidator::File> files;
+    mapFiles("/usr/lib", archName, files);
+    mapFiles("/usr/bin", archName, files);
+    mapFiles("/usr/sbin", archName, files);
+    if ( files.empty() )
+        FAIL("no files found to validate");
+
+    // one at a time, the way the scan used to do it
+    uint64_t start = mach_absolute_time();
+    std::vector<bool> serialValid;
+    for (const dyld3::MachOValidator::File& file : files) {
+        Diagnostics diag;
+        serialValid.push_back(dyld3::MachOParser::isValidMachO(diag, file.archName, platform, file.content, file.length, file.path, false));
+    }
+    uint64_t serialTime = elapsedMicroseconds(start);
+
+    // as one batch, results must match
+    dyld3::MachOValidator validator(platform, false);
+    std::vector<dyld3::MachOValidator::Result> results;
+    start = mach_absolute_time();
+    validator.validate(files, results);
+    uint64_t batchTime = elapsedMicroseconds(start);
+    unsigned validCount = 0;
+    for (size_t i=0; i < files.size(); ++i) {
+        if ( results[i].valid != serialValid[i] )
+            FAIL("batch and serial validation differ for %s", files[i].path.c_str());
+        if ( results[i].fromCache )
+            FAIL("%s found in empty cache", files[i].path.c_str());
+        if ( results[i].valid )
+            ++validCount;
+    }
+    if ( validCount == 0 )
+        FAIL("no valid mach-o files in %lu files", files.size());
+
+    // saved results are used by the next run, for every file that had nothing to report
+    char cachePath[] = "/tmp/macho-validate-perf-XXXXXX";
+    int fd = mkstemp(cachePath);
+    if ( fd == -1 )
+        FAIL("could not create temp file");
+    close(fd);
+    if ( !validator.save(cachePath) )
+        FAIL("could not save validation cache");
+    dyld3::MachOValidator nextRun(platform, false);
+    if ( !nextRun.load(cachePath) )
+        FAIL("could not load validation cache");
+    std::vector<dyld3::MachOValidator::Result> cachedResults;
+    start = mach_absolute_time();
+    nextRun.validate(files, cachedResults);
+    uint64_t cachedTime = elapsedMicroseconds(start);
+    for (size_t i=0; i < files.size(); ++i) {
+        bool clean = results[i].valid && results[i].diag.warnings().empty();
+        if ( cachedResults[i].fromCache != clean )
+            FAIL("wrong cache use for %s", files[i].path.c_str());
+        if ( cachedResults[i].valid != results[i].valid )
+            FAIL("cached result differs for %s", files[i].path.c_str());
+    }
+
+    // a file changed within the same second, or the same inode on another device, is validated again
+    std::vector<dyld3::MachOValidator::File> changed(1, files[0]);
+    changed[0].changeTime += 1;
+    nextRun.validate(changed, cachedResults);
+    if ( cachedResults[0].fromCache )
+        FAIL("changed file found in cache");
+    std::vector<dyld3::MachOValidator::File> otherDevice(1, files[0]);
+    otherDevice[0].device += 1;
+    nextRun.validate(otherDevice, cachedResults);
+    if ( cachedResults[0].fromCache )
+        FAIL("file on another device found in cache");
+
+    // results for another platform are not used
+    dyld3::MachOValidator otherPlatform((platform == dyld3::Platform::macOS) ? dyld3::Platform::iOS : dyld3::Platform::macOS, false);
+    if ( otherPlatform.load(cachePath) )
+        FAIL("loaded validation cache for another platform");
+    unlink(cachePath);
+
+    printf("macho-validate-perf: %lu slices (%u valid): serial %lluus, batch %lluus, cached %lluus (%llu hits)\n", files.size(), validCount,
+           serialTime, batchTime, cachedTime, nextRun.stats().cacheHits);
+
+    printf("[PASS] macho-validate-perf\n");
+    return 0;
+}
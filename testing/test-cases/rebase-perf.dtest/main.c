@@ -0,0 +1,100 @@
+
+// BUILD:  $CC pointers.c -dynamiclib -o $BUILD_DIR/libcontiguous.dylib -install_name $RUN_DIR/libcontiguous.dylib
+// BUILD:  $CC pointers.c -dynamiclib -DSTRIDED=1 -o $BUILD_DIR/libstrided.dylib -install_name $RUN_DIR/libstrided.dylib
+// BUILD:  $CC main.c -DRUN_DIR="$RUN_DIR" -o $BUILD_DIR/rebase-perf.exe
+
+// RUN:  ./rebase-perf.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <mach/mach_time.h>
+#include <mach-o/dyld_priv.h>
+
+#define FAIL(...) do { printf("[FAIL] rebase-perf: " __VA_ARGS__); printf("\n"); return 0; } while (0)
+
+static const char*  sTimedLeafName = NULL;
+static uint64_t     sRebaseStart = 0;
+static uint64_t     sRebaseEnd = 0;
+
+
+//
+// dlopen() of a leaf dylib whose dependents are already loaded rebases only that dylib,
+// right after the dependents-mapped batch notification and just before its rebased notification.
+//
+static const char* dependentsMapped(enum dyld_image_states state, uint32_t infoCount, const struct dyld_image_info info[])
+{
+    sRebaseStart = mach_absolute_time();
+    return NULL;
+}
+
+static const char* rebased(enum dyld_image_states state, uint32_t infoCount, const struct dyld_image_info info[])
+{
+    uint64_t now = mach_absolute_time();
+    for (uint32_t i=0; i < infoCount; ++i) {
+        if ( (sTimedLeafName != NULL) && (strstr(info[i].imageFilePath, sTimedLeafName) != NULL) )
+            sRebaseEnd = now;
+    }
+    return NULL;
+}
+
+
+static int timeRebase(const char* leafName, const char* kind, unsigned long stride)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), RUN_DIR "/%s", leafName);
+    sTimedLeafName = leafName;
+    sRebaseStart   = 0;
+    sRebaseEnd     = 0;
+    void* handle = dlopen(path, RTLD_LAZY);
+    sTimedLeafName = NULL;
+    if ( handle == NULL ) {
+        printf("[FAIL] rebase-perf: dlopen(%s): %s\n", path, dlerror());
+        return 0;
+    }
+    if ( (sRebaseStart == 0) || (sRebaseEnd < sRebaseStart) ) {
+        printf("[FAIL] rebase-perf: no rebase notifications for %s\n", leafName);
+        return 0;
+    }
+
+    // every pointer must have been rebased to the dylib's own target
+    int*                 target   = (int*)dlsym(handle, "target");
+    int**                pointers = (int**)dlsym(handle, "pointers");
+    const unsigned long* count    = (unsigned long*)dlsym(handle, "pointerCount");
+    if ( (target == NULL) || (pointers == NULL) || (count == NULL) ) {
+        printf("[FAIL] rebase-perf: symbols missing from %s\n", leafName);
+        return 0;
+    }
+    for (unsigned long i=0; i < *count; ++i) {
+        if ( pointers[i*stride] != target ) {
+            printf("[FAIL] rebase-perf: %s pointer %lu not rebased\n", leafName, i);
+            return 0;
+        }
+    }
+
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    double micros = (double)((sRebaseEnd - sRebaseStart) * timebase.numer / timebase.denom) / 1000.0;
+    if ( micros < 0.001 )
+        micros = 0.001;
+    printf("rebase-perf: %s: %lu pointers rebased in %.3f us, %.0f pointers/sec\n", kind, *count, micros, *count * 1000000.0 / micros);
+    return 1;
+}
+
+
+int main()
+{
+    printf("[BEGIN] rebase-perf\n");
+
+    dyld_register_image_state_change_handler(dyld_image_state_dependents_mapped, true, &dependentsMapped);
+    dyld_register_image_state_change_handler(dyld_image_state_rebased, false, &rebased);
+
+    if ( !timeRebase("libcontiguous.dylib", "contiguous", 1) )
+        return 0;
+    if ( !timeRebase("libstrided.dylib", "strided", 2) )
+        return 0;
+
+    printf("[PASS] rebase-perf\n");
+    return 0;
+}
@@ -0,0 +1,23 @@
+
+// Synthetic rebase streams.  Built with -DSTRIDED the pointers are interleaved with
+// padding so the linker emits REBASE_OPCODE_DO_REBASE_ULEB_TIMES_SKIPPING_ULEB runs,
+// otherwise they are contiguous and use REBASE_OPCODE_DO_REBASE_ULEB_TIMES.
+
+int target = 0;
+
+#define P1      &target
+#define P16     P1,P1,P1,P1,P1,P1,P1,P1,P1,P1,P1,P1,P1,P1,P1,P1
+#define P256    P16,P16,P16,P16,P16,P16,P16,P16,P16,P16,P16,P16,P16,P16,P16,P16
+#define P4K     P256,P256,P256,P256,P256,P256,P256,P256,P256,P256,P256,P256,P256,P256,P256,P256
+#define P64K    P4K,P4K,P4K,P4K,P4K,P4K,P4K,P4K,P4K,P4K,P4K,P4K,P4K,P4K,P4K,P4K
+
+#if STRIDED
+struct Entry { int* ptr; long pad; };
+#undef  P1
+#define P1      { &target, 0 }
+struct Entry pointers[] = { P64K };
+#else
+int* pointers[] = { P64K };
+#endif
+
+unsigned long pointerCount = sizeof(pointers)/sizeof(pointers[0]);
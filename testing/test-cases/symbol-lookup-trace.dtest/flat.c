@@ -0,0 +1,7 @@
+
+extern int bar();
+
+int flat()
+{
+    return bar();
+}
@@ -0,0 +1,63 @@
+
+// BUILD:  $CC bar.c -dynamiclib -install_name $RUN_DIR/libbar.dylib -o $BUILD_DIR/libbar.dylib
+// BUILD:  $CC flat.c -dynamiclib -install_name $RUN_DIR/libflat.dylib -o $BUILD_DIR/libflat.dylib -flat_namespace -undefined dynamic_lookup
+// BUILD:  $CC target.c $BUILD_DIR/libbar.dylib $BUILD_DIR/libflat.dylib -o $BUILD_DIR/symbol-lookup-trace-target.exe
+// BUILD:  $CC main.c -o $BUILD_DIR/symbol-lookup-trace.exe
+
+// RUN:  ./symbol-lookup-trace.exe $RUN_DIR/symbol-lookup-trace-target.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define FAIL(...) do { printf("[FAIL] symbol-lookup-trace: " __VA_ARGS__); printf("\n"); return 0; } while (0)
+
+int main(int argc, const char* argv[])
+{
+    printf("[BEGIN] symbol-lookup-trace\n");
+
+    // run the target with the tracer on, its dyld output goes to a file
+    char logPath[] = "/tmp/symbol-lookup-trace-XXXXXX";
+    int fd = mkstemp(logPath);
+    if ( fd == -1 )
+        FAIL("mkstemp() failed");
+    close(fd);
+    char printToFile[PATH_MAX+32];
+    snprintf(printToFile, sizeof(printToFile), "DYLD_PRINT_TO_FILE=%s", logPath);
+    const char* env[] = { "DYLD_PRINT_SYMBOL_LOOKUPS=10", printToFile, NULL };
+    const char* targetArgv[] = { argv[1], NULL };
+    pid_t pid;
+    if ( posix_spawn(&pid, argv[1], NULL, NULL, (char**)targetArgv, (char**)env) != 0 )
+        FAIL("posix_spawn(%s) failed", argv[1]);
+    int status;
+    if ( (waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0) )
+        FAIL("target did not run correctly");
+
+    FILE* file = fopen(logPath, "r");
+    if ( file == NULL )
+        FAIL("no dyld output in %s", logPath);
+    struct stat statBuf;
+    fstat(fileno(file), &statBuf);
+    char* contents = (char*)calloc(1, statBuf.st_size+1);
+    fread(contents, 1, statBuf.st_size, file);
+    fclose(file);
+    unlink(logPath);
+
+    if ( strstr(contents, "symbol lookups by time") == NULL )
+        FAIL("no symbol lookup report");
+    if ( strstr(contents, "flat       libflat.dylib -> _bar -> libbar.dylib") == NULL )
+        FAIL("flat lookup of _bar not reported:\n%s", contents);
+    if ( strstr(contents, "two-level  symbol-lookup-trace-target.exe -> _flat -> libflat.dylib") == NULL )
+        FAIL("two-level lookup of _flat not reported:\n%s", contents);
+    if ( strstr(contents, "dlsym      symbol-lookup-trace-target.exe -> _bar -> libbar.dylib") == NULL )
+        FAIL("dlsym of _bar not reported:\n%s", contents);
+    if ( strstr(contents, " - -> _bar -> ") != NULL )
+        FAIL("images searched by dlsym reported as lookups:\n%s", contents);
+
+    printf("[PASS] symbol-lookup-trace\n");
+    return 0;
+}
@@ -0,0 +1,13 @@
+#include <dlfcn.h>
+
+extern int bar();
+extern int flat();
+
+int main()
+{
+    // one dlsym() that searches every image, recorded once with this program as requester
+    int (*barPtr)() = (int (*)())dlsym(RTLD_DEFAULT, "bar");
+    if ( (barPtr == NULL) || (barPtr() != bar()) )
+        return 1;
+    return (flat() == bar()) ? 0 : 1;
+}
@@ -0,0 +1,10 @@
+
+__thread int  value = VALUE;
+__thread char buffer[256];
+
+int* valueAddress()
+{
+    buffer[0] = 1;
+    return &value;
+}
+
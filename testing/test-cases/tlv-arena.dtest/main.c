@@ -0,0 +1,163 @@
+
+// BUILD:  mkdir -p $BUILD_DIR/libs && for i in $(seq 1 30); do $CC foo.c -DVALUE=$i -dynamiclib -o $BUILD_DIR/libs/libtlv$i.dylib -install_name $RUN_DIR/libs/libtlv$i.dylib || exit 1; done
+// BUILD:  $CC main.c -DRUN_DIR="$RUN_DIR" -o $BUILD_DIR/tlv-arena.exe
+
+// RUN:  ./tlv-arena.exe
+// RUN:  DYLD_TLV_ARENA=1 ./tlv-arena.exe
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <libkern/OSAtomic.h>
+#include <mach/mach_time.h>
+#include <mach-o/dyld_priv.h>
+
+#define LIB_COUNT           30
+#define LAUNCH_LIB_COUNT    20
+#define THREAD_COUNT        500
+
+typedef int* (*ValueAddressFunc)(void);
+
+static ValueAddressFunc sValueAddress[LIB_COUNT];
+static unsigned         sLoadedCount = 0;
+static volatile int32_t sAllocated = 0;
+static volatile int32_t sDeallocated = 0;
+static volatile int32_t sFailures = 0;
+
+
+static void loadLibs(unsigned count)
+{
+    for (unsigned i=sLoadedCount; i < count; ++i) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), RUN_DIR "/libs/libtlv%u.dylib", i+1);
+        void* handle = dlopen(path, RTLD_LAZY);
+        if ( handle == NULL ) {
+            printf("[FAIL] tlv-arena, dlopen(%s): %s\n", path, dlerror());
+            exit(0);
+        }
+        sValueAddress[i] = (ValueAddressFunc)dlsym(handle, "valueAddress");
+        if ( sValueAddress[i] == NULL ) {
+            printf("[FAIL] tlv-arena, valueAddress not found in %s\n", path);
+            exit(0);
+        }
+    }
+    sLoadedCount = count;
+}
+
+
+// first use of TLVs in libs [firstLib, sLoadedCount) on this thread
+static void useLibs(unsigned firstLib)
+{
+    int* addresses[LIB_COUNT];
+    for (unsigned i=0; i < sLoadedCount; ++i) {
+        addresses[i] = sValueAddress[i]();
+        if ( (i >= firstLib) && (*addresses[i] != (int)(i+1)) )
+            OSAtomicIncrement32(&sFailures);
+        *addresses[i] = -1;
+    }
+
+    // every TLV of this thread must be inside storage reported by dyld_enumerate_tlv_storage(),
+    // which reports each image's storage separately, even in arena mode
+    __block unsigned found = 0;
+    __block bool     shared = false;
+    dyld_enumerate_tlv_storage(^(enum dyld_tlv_states state, const dyld_tlv_info *info) {
+        unsigned inThis = 0;
+        for (unsigned i=0; i < sLoadedCount; ++i) {
+            if ( ((uint8_t*)addresses[i] >= (uint8_t*)info->tlv_addr) && ((uint8_t*)addresses[i] < (uint8_t*)info->tlv_addr + info->tlv_size) )
+                ++inThis;
+        }
+        found += inThis;
+        if ( inThis > 1 )
+            shared = true;
+    });
+    if ( (found != sLoadedCount) || shared )
+        OSAtomicIncrement32(&sFailures);
+}
+
+static void* work(void* arg)
+{
+    useLibs(0);
+    return NULL;
+}
+
+// uses TLVs of the launch images, then of images loaded while this thread is running
+static void* workAcrossDlopen(void* arg)
+{
+    useLibs(0);
+    loadLibs(LIB_COUNT);
+    useLibs(LAUNCH_LIB_COUNT);
+    return NULL;
+}
+
+
+static uint64_t runThreads()
+{
+    uint64_t start = mach_absolute_time();
+    const unsigned batchSize = 50;
+    for (unsigned batch=0; batch < THREAD_COUNT; batch += batchSize) {
+        pthread_t workers[batchSize];
+        for (unsigned i=0; i < batchSize; ++i) {
+            if ( pthread_create(&workers[i], NULL, work, NULL) != 0 ) {
+                printf("[FAIL] tlv-arena, pthread_create\n");
+                exit(0);
+            }
+        }
+        for (unsigned i=0; i < batchSize; ++i)
+            pthread_join(workers[i], NULL);
+    }
+    return mach_absolute_time() - start;
+}
+
+
+int main()
+{
+    const bool arenaMode = (getenv("DYLD_TLV_ARENA") != NULL);
+    printf("[BEGIN] tlv-arena%s\n", arenaMode ? " DYLD_TLV_ARENA" : "");
+
+    dyld_register_tlv_state_change_handler(dyld_tlv_state_allocated, ^(enum dyld_tlv_states state, const dyld_tlv_info *info) {
+        OSAtomicIncrement32(&sAllocated);
+    });
+    dyld_register_tlv_state_change_handler(dyld_tlv_state_deallocated, ^(enum dyld_tlv_states state, const dyld_tlv_info *info) {
+        OSAtomicIncrement32(&sDeallocated);
+    });
+
+    loadLibs(LAUNCH_LIB_COUNT);
+    uint64_t launchTime = runThreads();
+
+    // a thread whose TLV storage has to grow when more images are loaded
+    pthread_t worker;
+    if ( pthread_create(&worker, NULL, workAcrossDlopen, NULL) != 0 ) {
+        printf("[FAIL] tlv-arena, pthread_create\n");
+        return 0;
+    }
+    pthread_join(worker, NULL);
+    uint64_t dlopenTime = runThreads();
+
+    if ( sFailures != 0 ) {
+        printf("[FAIL] tlv-arena, %d threads saw wrong TLV values or storage\n", sFailures);
+        return 0;
+    }
+    if ( sAllocated != sDeallocated ) {
+        printf("[FAIL] tlv-arena, %d TLV allocations but %d deallocations\n", sAllocated, sDeallocated);
+        return 0;
+    }
+    // handlers see one allocation per image per thread in both modes, even though arena mode mallocs far less
+    const int expectedAllocations = THREAD_COUNT*LAUNCH_LIB_COUNT + LIB_COUNT + THREAD_COUNT*LIB_COUNT;
+    if ( sAllocated != expectedAllocations ) {
+        printf("[FAIL] tlv-arena, %d TLV allocations, expected %d\n", sAllocated, expectedAllocations);
+        return 0;
+    }
+
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    printf("tlv-arena: %u threads x %u images in %llu us, %u threads x %u images in %llu us, %d TLV allocations\n",
+           THREAD_COUNT, LAUNCH_LIB_COUNT, (launchTime * timebase.numer / timebase.denom) / 1000,
+           THREAD_COUNT, LIB_COUNT, (dlopenTime * timebase.numer / timebase.denom) / 1000, sAllocated);
+
+    printf("[PASS] tlv-arena%s\n", arenaMode ? " DYLD_TLV_ARENA" : "");
+    return 0;
+}
+
@@ -0,0 +1,18 @@
+
+extern "C" int barValue();
+
+static int sNext = 100;
+
+struct Counter
+{
+    Counter() : value(__sync_add_and_fetch(&sNext, 1)) { }
+    int value;
+};
+
+static thread_local Counter sCounter;
+
+int barValue()
+{
+    return sCounter.value;
+}
+
@@ -0,0 +1,5 @@
+
+
+__thread int  fooInitialized[64] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+__thread char fooZeroFill[16384];
+
@@ -0,0 +1,97 @@
+
+// BUILD:  $CC foo.c -dynamiclib -o $BUILD_DIR/libfoo.dylib -install_name $RUN_DIR/libfoo.dylib
+// BUILD:  $CXX bar.cpp -std=c++11 -dynamiclib -o $BUILD_DIR/libbar.dylib -install_name $RUN_DIR/libbar.dylib
+// BUILD:  $CC main.c $BUILD_DIR/libfoo.dylib $BUILD_DIR/libbar.dylib -o $BUILD_DIR/tlv-first-access-perf.exe
+
+// RUN:  ./tlv-first-access-perf.exe
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <mach/mach_time.h>
+
+extern __thread int  fooInitialized[64];
+extern __thread char fooZeroFill[16384];
+extern int barValue();
+
+#define THREAD_COUNT 2000
+
+static uint64_t sFirstAccessTime[THREAD_COUNT];
+static int      sBarValue[THREAD_COUNT];
+static bool     sBadContent[THREAD_COUNT];
+
+
+static void* work(void* arg)
+{
+    unsigned index = (unsigned)(uintptr_t)arg;
+
+    // first access on this thread allocates and fills the TLV block of both dylibs
+    uint64_t start = mach_absolute_time();
+    int* initialized = fooInitialized;
+    int  barv = barValue();
+    sFirstAccessTime[index] = mach_absolute_time() - start;
+
+    sBarValue[index] = barv;
+    for (int i=0; i < 64; ++i) {
+        if ( initialized[i] != ((i < 8) ? i+1 : 0) )
+            sBadContent[index] = true;
+    }
+    for (unsigned i=0; i < sizeof(fooZeroFill); ++i) {
+        if ( fooZeroFill[i] != 0 )
+            sBadContent[index] = true;
+    }
+    // dirty this thread's copy, which must not leak into the template
+    fooInitialized[0] = -1;
+    fooZeroFill[100]  = 1;
+    return NULL;
+}
+
+
+int main()
+{
+    printf("[BEGIN] tlv-first-access-perf\n");
+
+    // run threads in batches so that thread creation is not limited by process resources
+    const unsigned batchSize = 50;
+    for (unsigned batch=0; batch < THREAD_COUNT; batch += batchSize) {
+        pthread_t workers[batchSize];
+        for (unsigned i=0; i < batchSize; ++i) {
+            if ( pthread_create(&workers[i], NULL, work, (void*)(uintptr_t)(batch+i)) != 0 ) {
+                printf("[FAIL] tlv-first-access-perf, pthread_create\n");
+                return 0;
+            }
+        }
+        for (unsigned i=0; i < batchSize; ++i)
+            pthread_join(workers[i], NULL);
+    }
+
+    uint64_t total = 0;
+    uint64_t worst = 0;
+    bool     seen[THREAD_COUNT] = { false };
+    for (unsigned i=0; i < THREAD_COUNT; ++i) {
+        if ( sBadContent[i] ) {
+            printf("[FAIL] tlv-first-access-perf, thread %u did not get a clean copy of the TLV template\n", i);
+            return 0;
+        }
+        // the thread_local initializer must run exactly once per thread
+        int slot = sBarValue[i] - 101;
+        if ( (slot < 0) || (slot >= THREAD_COUNT) || seen[slot] ) {
+            printf("[FAIL] tlv-first-access-perf, thread %u got thread_local value %d\n", i, sBarValue[i]);
+            return 0;
+        }
+        seen[slot] = true;
+        total += sFirstAccessTime[i];
+        if ( sFirstAccessTime[i] > worst )
+            worst = sFirstAccessTime[i];
+    }
+
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    printf("tlv-first-access-perf: %u threads, first access average %llu ns, worst %llu ns\n", THREAD_COUNT,
+           (total * timebase.numer / timebase.denom) / THREAD_COUNT, worst * timebase.numer / timebase.denom);
+
+    printf("[PASS] tlv-first-access-perf\n");
+    return 0;
+}
+